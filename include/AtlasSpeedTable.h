@@ -0,0 +1,96 @@
+/***************************************************************************
+ *   Copyright (C) 2015 by OpenCPN development team                        *
+ *                                                                         *
+ *   This program is free software; you can redistribute it and/or modify  *
+ *   it under the terms of the GNU General Public License as published by  *
+ *   the Free Software Foundation; either version 3 of the License, or     *
+ *   (at your option) any later version.                                   *
+ *                                                                         *
+ *   This program is distributed in the hope that it will be useful,       *
+ *   but WITHOUT ANY WARRANTY; without even the implied warranty of        *
+ *   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the         *
+ *   GNU General Public License for more details.                          *
+ *                                                                         *
+ *   You should have received a copy of the GNU General Public License     *
+ *   along with this program; if not, write to the                         *
+ *   Free Software Foundation, Inc.,                                       *
+ *   51 Franklin Street, Fifth Floor, Boston, MA 02110-1301,  USA.         *
+ **************************************************************************/
+
+#ifndef _WEATHER_ROUTING_ATLAS_SPEED_TABLE_H_
+#define _WEATHER_ROUTING_ATLAS_SPEED_TABLE_H_
+
+#include <memory>
+#include <vector>
+
+#include "Polar.h"
+
+struct RouteMapConfiguration;
+struct climatology_wind_atlas;
+class WeatherData;
+
+/**
+ * Precomputed boat speed tables for the cumulative climatology wind atlas.
+ *
+ * With the CUMULATIVE_MAP and CUMULATIVE_MINUS_CALMS climatology types the
+ * boat speed for a heading is the probability weighted sum of the polar speed
+ * for each of the 8 wind atlas directions, which costs 8 Polar::Speed() calls
+ * per heading instead of one.  A position is propagated for every configured
+ * degree step, and with the climatology cache neighbouring positions share the
+ * same atlas, so the weighted speeds are computed once for all degree steps of
+ * an atlas and polar, and then read back from a table.
+ *
+ * Tables are keyed by the atlas (directions and speeds over water and their
+ * probabilities), the wind direction over water, the polar, the bound and
+ * tacking options and an order independent hash of the degree steps.  The
+ * table last used at a position is kept in its WeatherData, so the shared
+ * tables are only searched once per position and polar.  Headings that are not one of the configured degree steps, such as
+ * optimal VMG angles or Runge-Kutta substeps, are computed directly.
+ *
+ * All functions are thread safe.
+ */
+class AtlasSpeedTable {
+public:
+  /** Weighted speeds of one atlas and polar for each degree step. */
+  struct Table {
+    int polar_index;
+    bool bound;
+    std::vector<double> twa;  //!< Sorted degree steps
+    std::vector<double> speed;
+    std::vector<PolarSpeedStatus> status;
+  };
+  typedef std::shared_ptr<const Table> TablePtr;
+
+  /**
+   * Returns the probability weighted boat speed through water for a heading,
+   * before the calm probability is applied.
+   *
+   * @param configuration Configuration providing the polars, the degree steps
+   * and the tacking option.
+   * @param polar_index Index of the polar in configuration.boat.Polars.
+   * @param weather_data Wind atlas and wind direction over water. Its
+   * atlas_speeds member caches the table for the next call.
+   * @param twa True wind angle of the heading.
+   * @param bound Passed to Polar::Speed().
+   * @param status [out] Status of the last Polar::Speed() call.
+   * @return The speed in knots, NAN if any of the polar lookups failed.
+   */
+  static double Speed(RouteMapConfiguration& configuration, int polar_index,
+                      const WeatherData& weather_data, double twa, bool bound,
+                      PolarSpeedStatus* status);
+
+  /** Computes the same weighted speed without using the tables. */
+  static double CumulativeSpeed(Polar& polar,
+                                const climatology_wind_atlas& atlas,
+                                double twdOverWater, double twa, bool bound,
+                                bool optimize_tacking,
+                                PolarSpeedStatus* status);
+
+  /** Drops every table, must be called when a polar is edited. */
+  static void Clear();
+
+  /** Number of tables currently held. */
+  static size_t Size();
+};
+
+#endif
@@ -34,6 +34,26 @@ public:
   wxString OpenXML(wxString filename, bool shortcut = true);
   wxString SaveXML(wxString filename);
 
+  /**
+   * Reads a boat file like OpenXML, but without generating missing cross
+   * over contours, saving the file or resolving the plugin data directory,
+   * so it may be called from a worker thread on a boat no other thread uses.
+   *
+   * @param polars Directory of the polar files named without a path
+   * @param generateContours Set if a polar has no saved contours, call
+   * GenerateContours from the main thread then
+   * @return An error message, empty on success
+   */
+  wxString ParseXML(wxString filename, const wxString& polars,
+                    bool& generateContours);
+
+  /**
+   * Generates the cross over contours of every polar and saves them with the
+   * boat file.  Must be called from the main thread.
+   * @return An error message if the boat file could not be saved
+   */
+  wxString GenerateContours(wxString filename);
+
   std::vector<Polar> Polars;
 
   /**
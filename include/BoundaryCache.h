@@ -0,0 +1,75 @@
+/***************************************************************************
+ *   Copyright (C) 2015 by OpenCPN development team                        *
+ *                                                                         *
+ *   This program is free software; you can redistribute it and/or modify  *
+ *   it under the terms of the GNU General Public License as published by  *
+ *   the Free Software Foundation; either version 3 of the License, or     *
+ *   (at your option) any later version.                                   *
+ *                                                                         *
+ *   This program is distributed in the hope that it will be useful,       *
+ *   but WITHOUT ANY WARRANTY; without even the implied warranty of        *
+ *   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the         *
+ *   GNU General Public License for more details.                          *
+ *                                                                         *
+ *   You should have received a copy of the GNU General Public License     *
+ *   along with this program; if not, write to the                         *
+ *   Free Software Foundation, Inc.,                                       *
+ *   51 Franklin Street, Fifth Floor, Boston, MA 02110-1301,  USA.         *
+ **************************************************************************/
+
+#ifndef _WEATHER_ROUTING_BOUNDARY_CACHE_H_
+#define _WEATHER_ROUTING_BOUNDARY_CACHE_H_
+
+#include <stddef.h>
+
+#include "ODAPI.h"
+
+/**
+ * Thread-safe memo layer in front of the ocpn_draw boundary crossing test.
+ *
+ * With boundary detection enabled every candidate segment of every isochrone
+ * calls RouteMap::ODFindClosestBoundaryLineCrossing, a function of another
+ * plugin which is not documented as thread safe, while the propagation
+ * workers call it concurrently.
+ *
+ * ocpn_draw does not expose the boundary polygons themselves, so they cannot
+ * be prefetched and indexed locally.  The workers call into ocpn_draw
+ * concurrently, as they always did; a readers/writer lock only makes
+ * replacing or dropping the ocpn_draw function wait for the calls in
+ * progress.
+ *
+ * The answer for every segment is memoized, snapped to about a meter, in a
+ * sharded table the workers query without waiting on each other.  This pays
+ * off for the route simplifier and the routes following a plan, which test
+ * the same legs repeatedly, but the isochrone propagation hardly ever tests a
+ * segment twice: the memo is bypassed for the rest of a computation once its
+ * first queries show a hit rate below 1%.  The memo must be cleared whenever
+ * the boundaries may have changed: when a route starts computing, and when
+ * ocpn_draw announces itself again.
+ */
+class BoundaryCache {
+public:
+  /**
+   * Returns true if the segment crosses an active boundary of any type,
+   * false if it does not or if ocpn_draw is not available.
+   */
+  static bool EntersBoundary(double lat1, double lon1, double lat2,
+                             double lon2);
+
+  /**
+   * Sets the ocpn_draw boundary crossing function, nullptr when ocpn_draw is
+   * gone, once the calls in progress returned.  Drops every memoized result.
+   */
+  static void SetCrossingFunction(OD_FindClosestBoundaryLineCrossing function);
+
+  /** Drops every memoized result and enables the memo again. */
+  static void Clear();
+
+  /** Memo queries and hits since the last Clear(). */
+  static void GetStats(size_t& queries, size_t& hits);
+
+  /** Number of memoized results. */
+  static size_t Size();
+};
+
+#endif
@@ -0,0 +1,88 @@
+/***************************************************************************
+ *   Copyright (C) 2015 by OpenCPN development team                        *
+ *                                                                         *
+ *   This program is free software; you can redistribute it and/or modify  *
+ *   it under the terms of the GNU General Public License as published by  *
+ *   the Free Software Foundation; either version 3 of the License, or     *
+ *   (at your option) any later version.                                   *
+ *                                                                         *
+ *   This program is distributed in the hope that it will be useful,       *
+ *   but WITHOUT ANY WARRANTY; without even the implied warranty of        *
+ *   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the         *
+ *   GNU General Public License for more details.                          *
+ *                                                                         *
+ *   You should have received a copy of the GNU General Public License     *
+ *   along with this program; if not, write to the                         *
+ *   Free Software Foundation, Inc.,                                       *
+ *   51 Franklin Street, Fifth Floor, Boston, MA 02110-1301,  USA.         *
+ **************************************************************************/
+
+#ifndef _WEATHER_ROUTING_CLIMATOLOGY_CACHE_H_
+#define _WEATHER_ROUTING_CLIMATOLOGY_CACHE_H_
+
+#include <wx/datetime.h>
+
+/**
+ * Thread-safe memo layer in front of the climatology plugin.
+ *
+ * RouteMap::ClimatologyData, ClimatologyWindAtlasData and
+ * ClimatologyCycloneTrackCrossings call into the climatology plugin, which is
+ * slow compared to reading a GRIB record.  With climatology enabled they are
+ * called for every position and every candidate segment of every isochrone.
+ *
+ * Climatology is a monthly product on a coarse grid, so the results are
+ * memoized per grid cell: positions are snapped to the center of a cell of
+ * the configured resolution and the plugin is queried once per cell, month
+ * and setting.  Cyclone track crossings are memoized per snapped segment, day
+ * of year and day range, since the plugin counts tracks in a window of days.
+ *
+ * Segments away from every cyclone track are answered from a mask of the
+ * 1 degree cells no track of the window of days goes through.  The plugin
+ * only counts crossings, so each cell is probed with lines 1/8 degree apart:
+ * a track entering the cell crosses one of its edges, which neighboring cells
+ * share, and a track lying within the cell crosses one of the lines in
+ * between unless it is shorter than about 20 km.
+ *
+ * Each function has the same signature and return values as the function
+ * pointer it wraps, and returns false (or -1 for cyclone crossings) if that
+ * pointer is not set.
+ */
+class ClimatologyCache {
+public:
+  /** Cached RouteMap::ClimatologyData. */
+  static bool Data(int setting, const wxDateTime& date, double lat, double lon,
+                   double& dir, double& speed);
+
+  /**
+   * Cached RouteMap::ClimatologyWindAtlasData.
+   *
+   * @param count [in,out] Number of atlas directions requested and returned,
+   * at most 8.
+   */
+  static bool WindAtlasData(const wxDateTime& date, double lat, double lon,
+                            int& count, double* directions, double* speeds,
+                            double& storm, double& calm);
+
+  /** Cached RouteMap::ClimatologyCycloneTrackCrossings. */
+  static int CycloneTrackCrossings(double lat1, double lon1, double lat2,
+                                   double lon2, const wxDateTime& date,
+                                   int dayrange);
+
+  /**
+   * Sets the size in degrees of the grid cells results are memoized for.
+   * Changing the resolution drops every cached result.
+   */
+  static void SetResolution(double degrees);
+  static double GetResolution();
+
+  /**
+   * Drops every cached result, must be called whenever the climatology
+   * function pointers change.
+   */
+  static void Clear();
+
+  /** Default cell size, a quarter of the 1 degree climatology grid. */
+  static const double DEFAULT_RESOLUTION;
+};
+
+#endif
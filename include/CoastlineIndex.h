@@ -0,0 +1,98 @@
+/***************************************************************************
+ *   Copyright (C) 2015 by OpenCPN development team                        *
+ *                                                                         *
+ *   This program is free software; you can redistribute it and/or modify  *
+ *   it under the terms of the GNU General Public License as published by  *
+ *   the Free Software Foundation; either version 3 of the License, or     *
+ *   (at your option) any later version.                                   *
+ *                                                                         *
+ *   This program is distributed in the hope that it will be useful,       *
+ *   but WITHOUT ANY WARRANTY; without even the implied warranty of        *
+ *   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the         *
+ *   GNU General Public License for more details.                          *
+ *                                                                         *
+ *   You should have received a copy of the GNU General Public License     *
+ *   along with this program; if not, write to the                         *
+ *   Free Software Foundation, Inc.,                                       *
+ *   51 Franklin Street, Fifth Floor, Boston, MA 02110-1301,  USA.         *
+ **************************************************************************/
+
+#ifndef _WEATHER_ROUTING_COASTLINE_INDEX_H_
+#define _WEATHER_ROUTING_COASTLINE_INDEX_H_
+
+#include <wx/arrstr.h>
+
+/**
+ * Native, re-entrant replacement for PlugIn_GSHHS_CrossesLand.
+ *
+ * PlugIn_GSHHS_CrossesLand loads coastline cells on demand into tables shared
+ * by every caller without any locking, so it has to be initialized from the
+ * main thread and the propagation workers can only hope they never load the
+ * same cell at once.  It is also opaque: nothing tells whether a cell holds
+ * any coastline at all.
+ *
+ * This index reads the same GSHHS polygon files OpenCPN uses (poly-?-1.dat,
+ * pre-clipped to 1 degree cells) directly.  Cells are loaded at most once, on
+ * first use, and are read-only afterwards, so any number of threads can query
+ * them concurrently.  Each cell is flagged as open water when it holds no
+ * coastline, and otherwise buckets its coastline edges in a grid of sub-cells
+ * so a segment is only tested against the edges near it.
+ *
+ * A segment crosses land when it intersects an edge of a land polygon, which
+ * gives the same results as PlugIn_GSHHS_CrossesLand for the same polygon
+ * file.
+ */
+class CoastlineIndex {
+public:
+  /**
+   * Opens the best quality polygon file found in the given directories, full
+   * resolution first.  Does nothing if an index is already open.
+   *
+   * @return true if an index is open.
+   */
+  static bool Open(const wxArrayString& directories);
+
+  /**
+   * Returns true if an index is open on the polygon file Open() would pick
+   * now, unchanged since it was opened.  False once new coastline data was
+   * installed, in which case the index should be closed and opened again.
+   */
+  static bool IsCurrent(const wxArrayString& directories);
+
+  /**
+   * Identifies the polygon file Open() would pick now by its path and
+   * modification time, empty if there is none and OpenCPN's own coastline
+   * test is used instead.
+   */
+  static wxString Source(const wxArrayString& directories);
+
+  /**
+   * Drops every loaded cell and closes the polygon file.  Must not be called
+   * while another thread may query the index.
+   */
+  static void Close();
+
+  static bool IsOpen();
+
+  /**
+   * Returns true if the segment crosses a coastline.  Must only be called
+   * while the index is open.
+   */
+  static bool CrossesLand(double lat1, double lon1, double lat2, double lon2);
+
+  /**
+   * Returns true if coastline may lie in the box from lat1, lon1 to lat2,
+   * lon2 (lat1 <= lat2, lon1 <= lon2), its sides included: edges on the
+   * sides, such as the cell boundaries the polygons are clipped to, count for
+   * the boxes on both sides.  Returns false only if the box holds no
+   * coastline, which does not tell whether it is land or water.  Must only be
+   * called while the index is open.
+   */
+  static bool HasCoastline(double lat1, double lon1, double lat2,
+                           double lon2);
+
+  /** Number of cells with a coastline loaded so far. */
+  static size_t LoadedCells();
+};
+
+#endif
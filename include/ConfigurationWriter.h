@@ -0,0 +1,93 @@
+/***************************************************************************
+ *   Copyright (C) 2015 by OpenCPN development team                        *
+ *                                                                         *
+ *   This program is free software; you can redistribute it and/or modify  *
+ *   it under the terms of the GNU General Public License as published by  *
+ *   the Free Software Foundation; either version 3 of the License, or     *
+ *   (at your option) any later version.                                   *
+ *                                                                         *
+ *   This program is distributed in the hope that it will be useful,       *
+ *   but WITHOUT ANY WARRANTY; without even the implied warranty of        *
+ *   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the         *
+ *   GNU General Public License for more details.                          *
+ *                                                                         *
+ *   You should have received a copy of the GNU General Public License     *
+ *   along with this program; if not, write to the                         *
+ *   Free Software Foundation, Inc.,                                       *
+ *   51 Franklin Street, Fifth Floor, Boston, MA 02110-1301,  USA.         *
+ **************************************************************************/
+
+#ifndef _WEATHER_ROUTING_CONFIGURATION_WRITER_H_
+#define _WEATHER_ROUTING_CONFIGURATION_WRITER_H_
+
+#include <wx/string.h>
+#include <wx/thread.h>
+
+#include <memory>
+#include <string>
+#include <vector>
+
+class TiXmlElement;
+class ConfigurationWriterThread;
+
+/**
+ * Writes the weather routing configuration file from a background thread.
+ *
+ * The main thread formats each element of the file once, when it changes,
+ * and hands an immutable document of shared elements to the writer, so
+ * saving a file of thousands of configurations neither formats them again
+ * nor blocks the user interface on file output.  The file is replaced
+ * atomically: it is written to a temporary file which is then renamed.
+ *
+ * Save() may be called again while a write is in progress, only the last
+ * document is written once the current write completes.  Save() and Flush()
+ * must be called from the main thread.
+ */
+class ConfigurationWriter {
+public:
+  /** A formatted element of the root element, shared between documents. */
+  typedef std::shared_ptr<const std::string> Element;
+
+  struct Document {
+    wxString filename;
+    /** Plugin version written as an attribute of the root element. */
+    std::string version;
+    /** Positions, then configurations, in file order. */
+    std::vector<Element> elements;
+  };
+
+  ConfigurationWriter();
+  /** Waits for pending writes. */
+  ~ConfigurationWriter();
+
+  /** Queues a document to be written in the background. */
+  void Save(const Document& document);
+
+  /**
+   * Waits until every queued document is written.
+   * @return false if the last write failed.
+   */
+  bool Flush();
+
+  /** Formats an element for a document, as TinyXML would save it. */
+  static Element Format(const TiXmlElement& element);
+
+  /**
+   * Writes a document, replacing its file atomically.
+   * @return false if the file could not be written.
+   */
+  static bool Write(const Document& document);
+
+private:
+  friend class ConfigurationWriterThread;
+
+  /** Reclaims the thread after its last write. */
+  void Join();
+
+  wxMutex m_Mutex;
+  Document m_Pending;
+  bool m_bPending, m_bWriting, m_bFailed;
+  ConfigurationWriterThread* m_Thread;
+};
+
+#endif
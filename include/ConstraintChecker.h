@@ -20,6 +20,8 @@
 #ifndef _WEATHER_ROUTING_CONSTRAINT_CHECKER_H_
 #define _WEATHER_ROUTING_CONSTRAINT_CHECKER_H_
 
+#include <stddef.h>
+
 struct RouteMapConfiguration;
 
 enum PropagationError {
@@ -184,6 +186,92 @@ public:
                                            PropagationError& error_code);
 };
 
+/**
+ * A candidate position and the propagation step leading to it, as checked by
+ * ConstraintPipeline.
+ */
+struct PropagationCandidate {
+  /** Position propagated from. */
+  double lat, lon;
+  /** Candidate position. */
+  double dlat, dlon;
+  /** Course over ground and distance in nm of the step. */
+  double cog, dist;
+  /** Speed through water, true wind angle and true wind speed over water. */
+  double stw, twa, twsOverWater;
+};
+
+/**
+ * Constraints checked on every candidate position of Position::Propagate,
+ * ordered by their measured cost and rejection rate.
+ *
+ * How much each check costs and how often it rejects a candidate differs by
+ * orders of magnitude between routes: land rarely rejects anything in the
+ * open ocean but is the main filter along a coast.  The pipeline counts calls
+ * and rejections of each check, and times a sample of the calls.  Every
+ * REORDER_INTERVAL candidates the checks are sorted by cost per rejection, so
+ * cheap checks that reject most run first.
+ *
+ * The land and boundary check also sets the land_crossing and
+ * boundary_crossing flags of the configuration for the candidates reaching
+ * it, so it and the checks after it keep their place, and only the checks
+ * before it are reordered.  Whether a candidate passes, the flags and the
+ * error code are then the same as in the default order; only the counters
+ * and how fast a candidate is rejected change.
+ *
+ * A pipeline is not thread safe, each RouteMap owns one for its run.
+ */
+class ConstraintPipeline {
+public:
+  enum CheckType {
+    COURSE_ANGLE,
+    DIVERTED_COURSE,
+    APPARENT_WIND,
+    LAND_AND_BOUNDARY,
+    CYCLONE_TRACK,
+    CHECK_COUNT
+  };
+
+  ConstraintPipeline();
+
+  /**
+   * Runs the checks in the current order, stopping at the first that rejects
+   * the candidate.
+   *
+   * @param error_code [out] Set by the checks reporting a propagation error.
+   * @return true if the candidate meets every constraint.
+   */
+  bool Check(RouteMapConfiguration& configuration,
+             const PropagationCandidate& candidate,
+             PropagationError& error_code);
+
+  /** Clears the counters and restores the default order. */
+  void Reset();
+
+  /** Logs the counters of each check, in the current order. */
+  void LogProfile() const;
+
+  static const char* GetCheckName(CheckType type);
+
+  /** Candidates between two reorderings. */
+  static const size_t REORDER_INTERVAL = 1024;
+  /** One candidate out of this many is timed. */
+  static const size_t TIMING_INTERVAL = 16;
+
+private:
+  struct CheckStats {
+    CheckType type;
+    size_t calls, rejections;
+    size_t timed_calls;
+    double timed_seconds;
+  };
+
+  void Reorder();
+
+  CheckStats m_checks[CHECK_COUNT];
+  size_t m_candidates;
+};
+
 // Land cache management functions
 void log_cache_stats();
 void maintain_land_cache();
@@ -0,0 +1,129 @@
+/***************************************************************************
+ *   Copyright (C) 2015 by OpenCPN development team                        *
+ *                                                                         *
+ *   This program is free software; you can redistribute it and/or modify  *
+ *   it under the terms of the GNU General Public License as published by  *
+ *   the Free Software Foundation; either version 3 of the License, or     *
+ *   (at your option) any later version.                                   *
+ *                                                                         *
+ *   This program is distributed in the hope that it will be useful,       *
+ *   but WITHOUT ANY WARRANTY; without even the implied warranty of        *
+ *   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the         *
+ *   GNU General Public License for more details.                          *
+ *                                                                         *
+ *   You should have received a copy of the GNU General Public License     *
+ *   along with this program; if not, write to the                         *
+ *   Free Software Foundation, Inc.,                                       *
+ *   51 Franklin Street, Fifth Floor, Boston, MA 02110-1301,  USA.         *
+ **************************************************************************/
+
+#ifndef _WEATHER_ROUTING_FREE_LIST_POOL_H_
+#define _WEATHER_ROUTING_FREE_LIST_POOL_H_
+
+#include <cstddef>
+#include <new>
+
+/**
+ * Thread local free list of blocks of a fixed size.
+ *
+ * Released blocks are kept for the next allocation of the releasing thread
+ * instead of going back to the general purpose allocator.  A route map is
+ * computed by a single thread, so the objects of one run are recycled
+ * within that run without any locking.  Blocks may be released by another
+ * thread than the one which allocated them; each thread keeps at most
+ * MAX_FREE blocks, so a thread that only deletes, like the main thread
+ * clearing a route map, hands the rest back.
+ */
+template <size_t Size>
+class FreeListPool {
+public:
+  static void* Allocate() {
+    FreeList& list = s_FreeList;
+    if (Block* block = list.head) {
+      list.head = block->next;
+      list.count--;
+      return block;
+    }
+    return ::operator new(BLOCK_SIZE);
+  }
+
+  static void Release(void* p) {
+    FreeList& list = s_FreeList;
+    if (list.count >= MAX_FREE) {
+      ::operator delete(p);
+      return;
+    }
+    Block* block = static_cast<Block*>(p);
+    block->next = list.head;
+    list.head = block;
+    list.count++;
+  }
+
+  static const size_t MAX_FREE = 16384;
+
+private:
+  struct Block {
+    Block* next;
+  };
+
+  static const size_t BLOCK_SIZE = Size < sizeof(Block) ? sizeof(Block) : Size;
+
+  struct FreeList {
+    FreeList() : head(nullptr), count(0) {}
+    ~FreeList() {
+      while (head) {
+        Block* block = head;
+        head = block->next;
+        ::operator delete(block);
+      }
+    }
+
+    Block* head;
+    size_t count;
+  };
+
+  static thread_local FreeList s_FreeList;
+};
+
+template <size_t Size>
+thread_local typename FreeListPool<Size>::FreeList
+    FreeListPool<Size>::s_FreeList;
+
+/**
+ * Standard allocator taking single objects from a FreeListPool, so the
+ * nodes of node based containers such as std::list are recycled.  Arrays
+ * come from the general purpose allocator.
+ */
+template <class T>
+class PoolAllocator {
+public:
+  typedef T value_type;
+
+  PoolAllocator() {}
+  template <class U>
+  PoolAllocator(const PoolAllocator<U>&) {}
+
+  T* allocate(size_t n) {
+    if (n == 1) return static_cast<T*>(FreeListPool<sizeof(T)>::Allocate());
+    return static_cast<T*>(::operator new(n * sizeof(T)));
+  }
+
+  void deallocate(T* p, size_t n) {
+    if (n == 1)
+      FreeListPool<sizeof(T)>::Release(p);
+    else
+      ::operator delete(p);
+  }
+};
+
+template <class T, class U>
+bool operator==(const PoolAllocator<T>&, const PoolAllocator<U>&) {
+  return true;
+}
+
+template <class T, class U>
+bool operator!=(const PoolAllocator<T>&, const PoolAllocator<U>&) {
+  return false;
+}
+
+#endif
@@ -515,6 +515,42 @@ public:
                               bool numericalInterpolation = true,
                               bool dir = false) const;
 
+  /**
+   * Grid cell containing a point and its interpolation weights.
+   *
+   * Locating the cell is the costly part of getInterpolatedValue(), so callers
+   * reading several fields at the same point locate it once with
+   * getInterpolationCell() and reuse it for every record with the same grid.
+   */
+  struct InterpolationCell {
+    int i0, j0;     //!< Corner 00 of the cell
+    int i1, j1;     //!< Corner 11 of the cell, clamped to the grid
+    double fx, fy;  //!< Position of the point inside the cell, 0 to 1
+    double dx, dy;  //!< Pseudo hermite weights of fx and fy
+  };
+
+  /**
+   * Locates the grid cell containing a point.
+   *
+   * @param px Longitude in degrees.
+   * @param py Latitude in degrees.
+   * @param cell [out] Cell and weights of the point.
+   * @return false if the point is outside of the grid.
+   */
+  bool getInterpolationCell(double px, double py,
+                            InterpolationCell& cell) const;
+
+  /**
+   * Same as getInterpolatedValue() with numerical interpolation, for a cell
+   * located by getInterpolationCell() on this record or on a record with the
+   * same grid.
+   */
+  double getInterpolatedValue(const InterpolationCell& cell,
+                              bool dir = false) const;
+
+  /** Returns true if both records have the same grid geometry. */
+  bool hasSameGrid(const GribRecord& other) const;
+
   /**
    * Gets spatially interpolated wind or current vector values at a specific
    * latitude/longitude point.
@@ -0,0 +1,112 @@
+/***************************************************************************
+ *   Copyright (C) 2015 by OpenCPN development team                        *
+ *                                                                         *
+ *   This program is free software; you can redistribute it and/or modify  *
+ *   it under the terms of the GNU General Public License as published by  *
+ *   the Free Software Foundation; either version 3 of the License, or     *
+ *   (at your option) any later version.                                   *
+ *                                                                         *
+ *   This program is distributed in the hope that it will be useful,       *
+ *   but WITHOUT ANY WARRANTY; without even the implied warranty of        *
+ *   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the         *
+ *   GNU General Public License for more details.                          *
+ *                                                                         *
+ *   You should have received a copy of the GNU General Public License     *
+ *   along with this program; if not, write to the                         *
+ *   Free Software Foundation, Inc.,                                       *
+ *   51 Franklin Street, Fifth Floor, Boston, MA 02110-1301,  USA.         *
+ **************************************************************************/
+
+#ifndef _WEATHER_ROUTING_GRIB_TILE_STORE_H_
+#define _WEATHER_ROUTING_GRIB_TILE_STORE_H_
+
+#include <wx/string.h>
+
+#include <cstddef>
+
+class GribRecord;
+class WR_GribRecordSet;
+
+/**
+ * On-disk tiled cache for decoded GRIB fields.
+ *
+ * Every isochrone keeps a WR_GribRecordSet for its time step, so a long
+ * forecast on a large grid quickly adds up.  Many of the copied fields (cloud,
+ * rain, temperatures, CAPE, humidity, pressure, reflectivity) are never read
+ * while propagating and are only shown in the plot and route position dialogs.
+ * Large grids of those fields are written once to a tile file in the plugin
+ * data directory instead of being kept on the heap.  The file is written by a
+ * background thread, lookups read a copy of the record until it is done.
+ * Afterwards they page in the tiles they touch and keep a bounded number of
+ * them in memory.
+ *
+ * File names are derived from the record set id, its reference time, the
+ * field index and a checksum of the values.  Every tile file starts with a
+ * header identifying the record it was written from (grid, dates, origin,
+ * parameter and checksum), which is verified before an existing file is
+ * reused.  Routes computed together, and later OpenCPN sessions using the same
+ * GRIB file, find an existing tile file and reuse it without writing it
+ * again.  Files unused for a week are pruned.
+ *
+ * Store(), Flush() and SetDirectory() must be called from the main thread, the
+ * other functions are thread safe.  Files are written and read without
+ * holding the lock guarding lookups, and a few tile files are kept open
+ * between tile misses.
+ */
+class GribTileStore {
+public:
+  /**
+   * Returns true if the record is large enough that keeping it on disk is
+   * worthwhile.  Small regional grids stay on the heap.
+   */
+  static bool IsWorthStoring(const GribRecord& rec);
+
+  /**
+   * Copies a field of a record set to the tile store and registers it for
+   * lookups.  The tile file is written in the background, unless a matching
+   * one is already there.  If it cannot be written the copy is kept.
+   *
+   * @param set Record set the field belongs to. Its m_ID and m_Reference_Time
+   * must be final.  Sets interpolated in time are never stored.
+   * @param idx Field index (Idx_*) in the record set.
+   * @param rec Decoded field.
+   * @return true if the field can now be read from the store, false if the
+   * caller should keep the record in memory.
+   */
+  static bool Store(const WR_GribRecordSet& set, int idx,
+                    const GribRecord& rec);
+
+  /**
+   * Waits until the stored fields are written to their tile files.  Must be
+   * called at the latest before the plugin is unloaded.
+   */
+  static void Flush();
+
+  /** Returns true if a field of the record set is held by the store. */
+  static bool Contains(const WR_GribRecordSet& set, int idx);
+
+  /**
+   * Returns the spatially interpolated value of a stored field, using the
+   * same interpolation as GribRecord::getInterpolatedValue() for scalar data.
+   *
+   * @return The value, or GRIB_NOTDEF if the field is not stored, the position
+   * is outside of the grid or the tile file can no longer be read.
+   */
+  static double GetInterpolatedValue(const WR_GribRecordSet& set, int idx,
+                                     double lon, double lat);
+
+  /** Returns the number of tiles currently held in memory. */
+  static size_t CachedTiles();
+
+  /** Directory holding the tile files. */
+  static wxString Directory();
+
+  /**
+   * Waits for the queued fields, then uses another directory for the tile
+   * files and forgets every field stored so far.  Tile files already on disk
+   * are kept and reused when the same field is stored again.
+   */
+  static void SetDirectory(const wxString& dir);
+};
+
+#endif
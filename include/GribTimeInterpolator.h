@@ -0,0 +1,84 @@
+/***************************************************************************
+ *   Copyright (C) 2015 by OpenCPN development team                        *
+ *                                                                         *
+ *   This program is free software; you can redistribute it and/or modify  *
+ *   it under the terms of the GNU General Public License as published by  *
+ *   the Free Software Foundation; either version 3 of the License, or     *
+ *   (at your option) any later version.                                   *
+ *                                                                         *
+ *   This program is distributed in the hope that it will be useful,       *
+ *   but WITHOUT ANY WARRANTY; without even the implied warranty of        *
+ *   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the         *
+ *   GNU General Public License for more details.                          *
+ *                                                                         *
+ *   You should have received a copy of the GNU General Public License     *
+ *   along with this program; if not, write to the                         *
+ *   Free Software Foundation, Inc.,                                       *
+ *   51 Franklin Street, Fifth Floor, Boston, MA 02110-1301,  USA.         *
+ **************************************************************************/
+
+#ifndef _WEATHER_ROUTING_GRIB_TIME_INTERPOLATOR_H_
+#define _WEATHER_ROUTING_GRIB_TIME_INTERPOLATOR_H_
+
+#include <ctime>
+#include <memory>
+
+class WR_GribRecordSet;
+
+/**
+ * Shared cache of GRIB record sets interpolated in time.
+ *
+ * An isochrone is propagated with the GRIB record set valid at its start time,
+ * while the record set valid at the end of the step is already known because
+ * the RouteMap requested it before propagating.  The Runge-Kutta integrator
+ * samples the weather in between, at t+dt/2 and t+dt.  This class blends the
+ * two bracketing record sets at an arbitrary time and memoizes the resulting
+ * "slab" so that every route sharing the same GRIB timestamps, and every
+ * substep of every position, reuses a single blend.
+ *
+ * Slabs are held through std::shared_ptr so a slab evicted from the cache stays
+ * valid for as long as a propagation step still references it.
+ */
+class GribTimeInterpolator {
+public:
+  typedef std::shared_ptr<WR_GribRecordSet> Slab;
+
+  /**
+   * Returns the weather valid at the requested time.
+   *
+   * @param before Record set valid at the start of the interval.
+   * @param after Record set valid at the end of the interval, may be null.
+   * @param time Requested time, normally between the two reference times.
+   * @param holder [out] Keeps an interpolated slab alive while the returned
+   * pointer is in use.  Untouched when no interpolation is needed.
+   * @return before if there is nothing to interpolate with or the time is not
+   * past it, after if the time reaches it, otherwise the memoized blend.  Falls
+   * back to before when the records cannot be interpolated.  Blends are marked
+   * m_Interpolated so id keyed caches do not mistake them for before.
+   */
+  static WR_GribRecordSet* GribAt(WR_GribRecordSet* before,
+                                  WR_GribRecordSet* after, time_t time,
+                                  Slab& holder);
+
+  /** Drops every cached slab. Slabs still referenced by callers survive. */
+  static void Clear();
+
+  /** Returns the number of slabs currently held by the cache. */
+  static size_t CachedSlabs();
+
+private:
+  /**
+   * Builds a new record set blended between two record sets.
+   *
+   * Wind and current components are interpolated together in polar form, wave
+   * direction angularly and every other field linearly.  A field present in
+   * only one of the record sets is copied from it unchanged.
+   *
+   * @param d Interpolation factor, 0 for before and 1 for after.
+   */
+  static WR_GribRecordSet* Blend(const WR_GribRecordSet& before,
+                                 const WR_GribRecordSet& after, double d,
+                                 time_t time);
+};
+
+#endif
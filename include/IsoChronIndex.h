@@ -0,0 +1,98 @@
+/***************************************************************************
+ *   Copyright (C) 2015 by OpenCPN development team                        *
+ *                                                                         *
+ *   This program is free software; you can redistribute it and/or modify  *
+ *   it under the terms of the GNU General Public License as published by  *
+ *   the Free Software Foundation; either version 3 of the License, or     *
+ *   (at your option) any later version.                                   *
+ *                                                                         *
+ *   This program is distributed in the hope that it will be useful,       *
+ *   but WITHOUT ANY WARRANTY; without even the implied warranty of        *
+ *   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the         *
+ *   GNU General Public License for more details.                          *
+ *                                                                         *
+ *   You should have received a copy of the GNU General Public License     *
+ *   along with this program; if not, write to the                         *
+ *   Free Software Foundation, Inc.,                                       *
+ *   51 Franklin Street, Fifth Floor, Boston, MA 02110-1301,  USA.         *
+ **************************************************************************/
+
+#ifndef _WEATHER_ROUTING_ISO_CHRON_INDEX_H_
+#define _WEATHER_ROUTING_ISO_CHRON_INDEX_H_
+
+#include <vector>
+
+#include "IsoRoute.h"
+
+class Position;
+
+/**
+ * Spatial index of the routes of a finished IsoChron.
+ *
+ * IsoChron::Contains and IsoChron::ClosestPosition otherwise walk the skip
+ * lists of every route for each query, and they are called for every cursor
+ * move, every wind barb drawn and every position RouteSimplifier looks up.
+ *
+ * Point in isochrone queries cast the same ray towards the north as
+ * IsoRoute::IntersectionCount.  The edges of all routes, children included,
+ * are hashed into uniform columns of longitude, each sorted by decreasing
+ * maximum latitude, so a query only tests the edges of one column which lie
+ * at least partly north of the point.  Nearest position queries search a
+ * kd-tree of all positions.
+ *
+ * The index holds pointers into the routes, which must not change after it
+ * is built.
+ */
+class IsoChronIndex {
+public:
+  IsoChronIndex(const IsoRouteList& routes);
+
+  /** Same result as IsoChron::Contains without an index. */
+  bool Contains(double lat, double lon) const;
+
+  /**
+   * Same result as IsoChron::ClosestPosition without an index.
+   *
+   * @param dist [out] Squared distance in degrees to the closest position,
+   * infinite if there are no positions.
+   * @return The closest position, or nullptr if there are no positions.
+   */
+  Position* ClosestPosition(double lat, double lon, double* dist) const;
+
+  /** Heap memory held by the index, in bytes. */
+  size_t MemoryUsage() const;
+
+  /**
+   * Number of queries an IsoChron answers by walking its routes before
+   * building an index.  Most isochrones are only queried once, to detect
+   * the destination while they are computed.
+   */
+  static const int MIN_QUERIES = 4;
+
+private:
+  struct Edge {
+    double lat1, lon1, lat2, lon2;
+    double maxlat;
+    int route;  // index of the top level route the edge belongs to
+  };
+
+  struct Point {
+    double lat, lon;
+    Position* position;
+  };
+
+  void AddRoute(IsoRoute* route, int index, std::vector<Edge>& edges);
+  void BuildTree(int begin, int end, int depth);
+  void Nearest(int begin, int end, int depth, double lat, double lon,
+               int& best, double& bestdist) const;
+  int Column(double lon) const;
+
+  int m_RouteCount;
+  double m_MinLon, m_MaxLon, m_ColumnScale;
+  int m_Columns;
+  std::vector<int> m_ColumnStart;  // compressed rows of m_ColumnEdges
+  std::vector<Edge> m_ColumnEdges;
+  std::vector<Point> m_Points;  // implicit kd-tree, split at the middle
+};
+
+#endif
@@ -22,16 +22,24 @@
 
 #include <wx/wx.h>
 
+#include <atomic>
 #include <list>
+#include <mutex>
+#include <unordered_set>
 
+#include "FreeListPool.h"
 #include "WeatherDataProvider.h"
 
 class SkipPosition;
 class Position;
 struct RouteMapConfiguration;
+struct RouteMapMemory;
 class IsoRoute;
+class IsoChronIndex;
 
-typedef std::list<IsoRoute*> IsoRouteList;
+/* the nodes are recycled, routes are constantly moved between lists while
+   merging */
+typedef std::list<IsoRoute*, PoolAllocator<IsoRoute*> > IsoRouteList;
 
 /**
  * Represents a closed loop of positions forming an isochrone boundary.
@@ -76,6 +84,10 @@ public:
   IsoRoute(IsoRoute* r, IsoRoute* p = nullptr);
   ~IsoRoute();
 
+  /** IsoRoutes are recycled through a FreeListPool. */
+  static void* operator new(size_t size);
+  static void operator delete(void* p, size_t size);
+
   /**
    * Outputs route information for debugging.
    *
@@ -147,9 +159,18 @@ public:
    *
    * Removes positions that are within a small epsilon distance of each other
    * to improve computational efficiency without significantly changing the
-   * route.
-   */
-  void ReduceClosePoints();
+   * route.  The skip list is updated as positions are removed rather than
+   * rebuilt.
+   *
+   * @param resolution Positions closer than this many degrees to the previous
+   * one are removed, and positions nearly in line with their neighbors are
+   * decimated (Visvalingam) until none is further than about this from the
+   * simplified route.  0 only removes positions within 2 meters.
+   * @param max_positions If positive, the least significant positions are
+   * decimated until at most this many remain, or only the first positions of
+   * skip list runs are left.  Children are reduced with the same parameters.
+   */
+  void ReduceClosePoints(double resolution = 0, int max_positions = 0);
   //    bool ApplyCurrents(GribRecordSet *grib, wxDateTime time,
   //    RouteMapConfiguration &configuration);
   /**
@@ -363,6 +384,48 @@ public:
                             double* dist = 0);
   void ResetDrawnFlag();
 
+  /**
+   * Marks an isochrone which has been propagated: its routes are no longer
+   * changed, only rendered and looked up.  Nothing is released, later
+   * positions refer to these ones as parents, and the rendering and cursor
+   * code hold pointers to them.
+   */
+  void Freeze();
+  bool IsFrozen() const { return m_Frozen; }
+
+  /**
+   * Drops the reference to the GRIB records of this isochrone, they are
+   * deleted once no other isochrone or route map shares them.  The isochrone
+   * is no longer offered to other route maps as a copy of these records.
+   */
+  void ReleaseGrib();
+
+  /**
+   * Deletes every position of this isochrone not found in keep.  The
+   * positions kept, in their original order, form a single route.  The
+   * isochrone is frozen.
+   *
+   * @param keep Positions to keep, typically the parent chain of the
+   * destination.
+   */
+  void KeepPositions(const std::unordered_set<Position*>& keep);
+
+  /**
+   * Adds the memory held by the positions, skip lists and routes of this
+   * isochrone to memory.  The GRIB records are not counted, they are
+   * usually shared with the neighboring isochrones, nor is the index, see
+   * SetIndexMemory().
+   */
+  void GetMemoryUsage(RouteMapMemory& memory);
+
+  /**
+   * Sets the counter the memory of the index is added to when it is built,
+   * and taken from when it is deleted.  The index is built by whichever
+   * thread queries the isochrone, the cursor and the wind barbs included,
+   * so the owner reads the counter rather than the isochrone.
+   */
+  void SetIndexMemory(std::atomic<size_t>* counter);
+
   /**
    * List of IsoRoute objects that together form this isochrone.
    *
@@ -403,6 +466,21 @@ public:
    * When true, weather data may be incomplete or extrapolated.
    */
   bool m_Grib_is_data_deficient;
+
+private:
+  /**
+   * Returns the spatial index of the routes, building it once the isochrone
+   * has been queried IsoChronIndex::MIN_QUERIES times, or
+   * nullptr before.
+   */
+  IsoChronIndex* GetIndex();
+  void DeleteIndex();
+
+  std::atomic<IsoChronIndex*> m_Index;
+  std::atomic<size_t>* m_IndexMemory;
+  std::atomic<int> m_Queries;
+  std::atomic<bool> m_Frozen;
+  std::mutex m_IndexMutex;
 };
 
 typedef std::list<IsoChron*> IsoChronList;
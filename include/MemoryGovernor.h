@@ -0,0 +1,78 @@
+/***************************************************************************
+ *   Copyright (C) 2015 by OpenCPN development team                        *
+ *                                                                         *
+ *   This program is free software; you can redistribute it and/or modify  *
+ *   it under the terms of the GNU General Public License as published by  *
+ *   the Free Software Foundation; either version 3 of the License, or     *
+ *   (at your option) any later version.                                   *
+ *                                                                         *
+ *   This program is distributed in the hope that it will be useful,       *
+ *   but WITHOUT ANY WARRANTY; without even the implied warranty of        *
+ *   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the         *
+ *   GNU General Public License for more details.                          *
+ *                                                                         *
+ *   You should have received a copy of the GNU General Public License     *
+ *   along with this program; if not, write to the                         *
+ *   Free Software Foundation, Inc.,                                       *
+ *   51 Franklin Street, Fifth Floor, Boston, MA 02110-1301,  USA.         *
+ **************************************************************************/
+
+#ifndef _WEATHER_ROUTING_MEMORY_GOVERNOR_H_
+#define _WEATHER_ROUTING_MEMORY_GOVERNOR_H_
+
+#include <cstddef>
+
+/**
+ * Decides how route computations proceed under memory pressure.
+ *
+ * The load is the fraction of the memory budget in use, 1 meaning the
+ * budget is exhausted.  WeatherRouting computes it from the memory held by
+ * the route maps and, on Windows, from the address space usage relative to
+ * the AddressSpaceMonitor threshold.
+ *
+ * - NORMAL: waiting routes are started as threads become available.
+ * - THROTTLED: from THROTTLE_LOAD, waiting routes are computed one at a
+ *   time, a route is only started when no other one is running.
+ * - SHEDDING: from a load of 1, routes are marked to keep only their
+ *   isochrone outlines.  Finished routes release their GRIB copies at once,
+ *   running routes only once they finish.
+ *
+ * Shedding goes on until the load is back under THROTTLE_LOAD, and starts
+ * only resume under RESUME_LOAD, so the state does not oscillate around a
+ * single threshold.
+ */
+class MemoryGovernor {
+public:
+  enum State { NORMAL, THROTTLED, SHEDDING };
+
+  MemoryGovernor() : m_State(NORMAL) {}
+
+  /** Updates the state from the current load and returns it. */
+  State Update(double load);
+
+  State GetState() const { return m_State; }
+  /**
+   * Whether a route may start next to the running ones.  When throttled
+   * the caller may still start one if nothing is running.
+   */
+  bool CanStart() const { return m_State == NORMAL; }
+
+  /**
+   * Sets the memory the route maps may hold, in megabytes.  0 disables
+   * the budget, only the address space usage is then considered.
+   */
+  static void SetBudget(int megabytes);
+  static int GetBudget();
+  /** The budget in bytes, 0 if disabled. */
+  static size_t GetBudgetBytes();
+
+  /** Default budget, smaller for 32 bit processes. */
+  static const int DEFAULT_BUDGET;
+  static const double THROTTLE_LOAD;
+  static const double RESUME_LOAD;
+
+private:
+  State m_State;
+};
+
+#endif
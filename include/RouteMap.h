@@ -24,7 +24,9 @@
 #include <wx/object.h>
 #include <wx/weakref.h>
 
+#include <atomic>
 #include <list>
+#include <map>
 
 #include "ODAPI.h"
 #include "GribRecordSet.h"
@@ -563,6 +565,37 @@ struct RouteMapConfiguration {
    */
   double MotorSpeed;
 
+  /**
+   * Decimation resolution of each new isochrone, as a fraction of the mean
+   * distance sailed in one step (DeltaTime times the boat speed).  Positions
+   * closer together, or nearly in line with their neighbors, are removed.
+   * 0 only removes positions within about 2 meters of each other.
+   */
+  double DecimationFactor;
+
+  /**
+   * If positive, the maximum number of positions kept in each route of an
+   * isochrone, so isochrones stay bounded on long runs.
+   */
+  int MaxRoutePositions;
+
+  /**
+   * What is kept of a route map once its computation has finished.
+   *
+   * - RETAIN_FULL: every isochrone with its GRIB records, for display.
+   * - RETAIN_OUTLINES: the isochrone outlines, without the GRIB records.
+   * - RETAIN_BEST_ROUTE: only the positions of the route to the destination.
+   *
+   * The statistics of the route to the destination are computed before
+   * anything is released, the other modes are meant for batch runs where
+   * only the best route and its summary are needed.
+   */
+  enum RetentionType {
+    RETAIN_FULL,
+    RETAIN_OUTLINES,
+    RETAIN_BEST_ROUTE
+  } Retention;
+
   /* computed values */
   /**
    * Collection of angular steps used for vessel propagation calculations.
@@ -610,6 +643,19 @@ struct RouteMapConfiguration {
 
   // parameters
   WR_GribRecordSet* grib;
+  /**
+   * GRIB record sets valid half way through and at the end of the current
+   * propagation step, used by the Runge-Kutta integrator substeps.
+   * These are interpolated in time between grib and the record set requested
+   * for the next isochrone, and fall back to grib when it is unavailable.
+   */
+  WR_GribRecordSet* rk_grib_2;
+  WR_GribRecordSet* rk_grib;
+  /**
+   * Constraint checks of the route map being propagated, reordered as it
+   * measures them.  nullptr outside of RouteMap::Propagate.
+   */
+  ConstraintPipeline* constraints;
 
   /** Returns the current latitude of the boat, in degrees. */
   static double GetBoatLat();
@@ -664,6 +710,44 @@ struct RouteMapConfiguration {
 bool operator!=(const RouteMapConfiguration& c1,
                 const RouteMapConfiguration& c2);
 
+/**
+ * Approximate heap memory held by a route map, in bytes, by kind of object.
+ *
+ * GRIB records shared by several route maps are counted in each of them.
+ */
+struct RouteMapMemory {
+  RouteMapMemory()
+      : positions(0),
+        skippositions(0),
+        routes(0),
+        grib(0),
+        plotdata(0),
+        render(0) {}
+
+  size_t Total() const {
+    return positions + skippositions + routes + grib + plotdata + render;
+  }
+
+  RouteMapMemory& operator+=(const RouteMapMemory& m);
+  RouteMapMemory& operator-=(const RouteMapMemory& m);
+
+  /** Machine readable form, one member per kind of object and the total. */
+  Json::Value ToJSON() const;
+
+  /** Positions of the isochrones. */
+  size_t positions;
+  /** Skip lists of the isochrone routes. */
+  size_t skippositions;
+  /** IsoChron and IsoRoute objects, with the isochrone indexes. */
+  size_t routes;
+  /** GRIB records copied for the isochrones. */
+  size_t grib;
+  /** Cached plot data of the destination and cursor routes. */
+  size_t plotdata;
+  /** Cached wind barbs and current arrows. */
+  size_t render;
+};
+
 /**
  * Manages the complete weather routing calculation process from start to
  * destination.
@@ -817,6 +901,11 @@ public:
   }
   void SetNewGrib(GribRecordSet* grib);
   void SetNewGrib(WR_GribRecordSet* grib);
+  /**
+   * Identifies the GRIB file a record set of the GRIB plugin comes from,
+   * which does not give record sets an id.  The set must have wind records.
+   */
+  static unsigned int GribRecordSetID(GribRecordSet* grib);
   /**
    * Thread-safe accessor to get the time when new weather data is needed.
    *
@@ -845,8 +934,19 @@ public:
     m_Configuration = o;
     m_bValid = m_Configuration.Update();
     m_bFinished = false;
+    m_ConfigurationVersion++;
     Unlock();
   }
+  /**
+   * Thread-safe accessor to a counter incremented each time the configuration
+   * is set, so callers can tell whether it changed without copying it.
+   */
+  unsigned int GetConfigurationVersion() {
+    Lock();
+    unsigned int version = m_ConfigurationVersion;
+    Unlock();
+    return version;
+  }
   RouteMapConfiguration GetConfiguration() {
     Lock();
     RouteMapConfiguration o = m_Configuration;
@@ -856,6 +956,22 @@ public:
 
   void GetStatistics(int& isochrones, int& routes, int& invroutes,
                      int& skippositions, int& positions);
+
+  /**
+   * Gets the memory held by this route map.  The isochrones are accounted
+   * as they are added, changed and cleared, and their indexes as they are
+   * built, so this is cheap to call while the route map is computed.
+   */
+  virtual RouteMapMemory GetMemoryUsage();
+
+  /**
+   * Adds the GRIB record sets held by the isochrones to gribs, with the
+   * bytes accounted for them in GetMemoryUsage().  Route maps computed at the
+   * same time share record sets, the memory of several route maps counts
+   * each of them once.
+   */
+  void GetGribMemory(std::map<WR_GribRecordSet*, size_t>& gribs);
+
   /**
    * Performs one step of the routing propagation algorithm.
    *
@@ -907,7 +1023,7 @@ public:
    *
    * Marks the calculation as finished to terminate any ongoing processing.
    */
-  void Stop() {
+  virtual void Stop() {
     Lock();
     m_bFinished = true;
     Unlock();
@@ -981,6 +1097,13 @@ protected:
   }
 
   virtual void Clear();
+
+  /**
+   * Accounts an isochrone of origin again after it changed, the caller must
+   * hold Lock().  The index of the isochrone is counted from then on.
+   */
+  void UpdateMemoryUsage(IsoChron* isochron);
+
   /**
    * Reduces a list of routes by merging overlapping ones.
    *
@@ -1011,6 +1134,11 @@ protected:
   virtual void Lock() = 0;
   virtual void Unlock() = 0;
   virtual bool TestAbort() = 0;
+  /**
+   * Called from Propagate() once the GRIB data of the next isochrone is
+   * needed, so it can be requested while the current one is computed.
+   */
+  virtual void GribNeeded() {}
 
   /**
    * Determines the time step for the next isochrone generation based on current
@@ -1045,6 +1173,19 @@ private:
                              std::vector<Position*>& failed_positions);
 
   RouteMapConfiguration m_Configuration;
+  /** @see GetConfigurationVersion() */
+  unsigned int m_ConfigurationVersion;
+  /** Memory held by the isochrones of origin. */
+  RouteMapMemory m_Memory;
+  /** What each isochrone of origin was last accounted for in m_Memory. */
+  std::map<IsoChron*, RouteMapMemory> m_IsoChronMemory;
+  /**
+   * Memory of the indexes of the isochrones of origin, kept by the
+   * isochrones themselves as they build their indexes on any thread.
+   */
+  std::atomic<size_t> m_IndexMemory;
+  /** Constraint checks of the current run, with their counters. */
+  ConstraintPipeline m_Constraints;
   bool m_bFinished, m_bValid;
   bool m_bReachedDestination;
   /**
@@ -20,7 +20,12 @@
 #ifndef _WEATHER_ROUTING_ROUTE_MAP_OVERLAY_H_
 #define _WEATHER_ROUTING_ROUTE_MAP_OVERLAY_H_
 
+#include <wx/event.h>
+
+#include <atomic>
+
 #include "RouteMap.h"
+#include "RouteMapSnapshot.h"
 #include "LineBufferOverlay.h"
 
 class PlugIn_ViewPort;
@@ -30,9 +35,19 @@ class piDC;
 class RouteMapOverlay;
 class SettingsDialog;
 
+/**
+ * Posted by the calculation threads to the event handler given to
+ * RouteMapOverlay::Start(), with a RouteMapOverlay::ComputationEvent as its
+ * integer.
+ */
+wxDECLARE_EVENT(wxEVT_ROUTEMAP_COMPUTATION, wxThreadEvent);
+
 /**
  * Thread class for route map overlay calculations.
  * Handles the background processing for weather route generation.
+ *
+ * The thread does not poll: while the route map waits for GRIB data it
+ * blocks until woken by the main thread.
  */
 class RouteMapOverlayThread : public wxThread {
 public:
@@ -48,9 +63,29 @@ public:
    */
   void* Entry();
 
+  /** Wakes the thread if it waits for GRIB data or was stopped. */
+  void Wake();
+
+  /** Makes the thread exit as soon as possible, before it is deleted. */
+  void Abort();
+
+  /** True once the calculation is over and the thread is exiting. */
+  bool Done() const { return m_bDone; }
+
 private:
+  /**
+   * Blocks until Wake() or Abort() is called.
+   * @return false if the thread must exit.
+   */
+  bool WaitForWake();
+
   /** Reference to the parent RouteMapOverlay object. */
   RouteMapOverlay& m_RouteMapOverlay;
+
+  wxMutex m_WakeMutex;
+  wxCondition m_WakeCondition;
+  bool m_bWake, m_bAbort;
+  std::atomic<bool> m_bDone;
 };
 
 /**
@@ -131,6 +166,13 @@ public:
     COMFORT             //!< Sailing comfort level
   };
 
+  /** Events posted by the calculation thread. */
+  enum ComputationEvent {
+    COMPUTATION_FINISHED,    //!< The thread is exiting
+    COMPUTATION_NEEDS_GRIB,  //!< GRIB data must be requested for NewTime()
+    COMPUTATION_PROGRESS     //!< An isochrone was computed
+  };
+
   /**
    * Default constructor.
    * Initializes a new RouteMapOverlay with default values.
@@ -208,6 +250,12 @@ public:
    */
   void RequestGrib(wxDateTime time);
 
+  /**
+   * Asks the GRIB plugin for the record set at a specific time, which it
+   * answers with a GRIB_TIMELINE_RECORD message before this returns.
+   */
+  static void RequestGribRecord(wxDateTime time);
+
   /**
    * Gets plot data for either the cursor route or destination route.
    * @param cursor_route If true, gets data for cursor route, otherwise for
@@ -267,6 +315,57 @@ public:
    */
   void UpdateDestination();
 
+  /**
+   * Releases what the configured retention policy does not keep of a
+   * finished route map.
+   *
+   * The plot data of the route to the destination is computed first, so the
+   * route statistics stay available.  Must be called from the main thread
+   * once the computation thread has been deleted.
+   *
+   * @see RouteMapConfiguration::Retention
+   * @see SetMinimumRetention
+   */
+  void ApplyRetention();
+
+  /**
+   * Sets a retention policy applied instead of the configured one when it
+   * keeps less, without changing the configuration.  Used to shed memory,
+   * reset when the route map is cleared.
+   */
+  void SetMinimumRetention(RouteMapConfiguration::RetentionType retention) {
+    m_MinimumRetention = retention;
+  }
+  RouteMapConfiguration::RetentionType GetMinimumRetention() const {
+    return m_MinimumRetention;
+  }
+
+  /**
+   * Sets the result key the route map is computed for, 0 if it is unknown.
+   * @see RouteMapSnapshot::ResultKey
+   */
+  void SetResultKey(wxUint64 key) { m_ResultKey = key; }
+  /** The result key, 0 if unknown or once the route map is reset. */
+  wxUint64 GetResultKey() const { return m_ResultKey; }
+
+  /**
+   * Writes a snapshot of the finished route map under its result key, so it
+   * can be reloaded without being computed again.  The isochrones are
+   * serialized under the lock and the file is written in the background.
+   * Must be called from the main thread once the computation thread has
+   * been deleted, before ApplyRetention().
+   *
+   * @return false if the result key is unknown.
+   * @see RouteMapSnapshot
+   */
+  bool SaveSnapshot();
+
+  /**
+   * Replaces the route map with a snapshot read for a result key and marks
+   * it finished.  Takes the isochrones and the destination of contents.
+   */
+  void RestoreSnapshot(wxUint64 key, RouteMapSnapshot::Contents& contents);
+
   /**
    * Gets the end time of the route.
    * @return The calculated end time.
@@ -279,6 +378,12 @@ public:
    */
   virtual void Clear();
 
+  /**
+   * Gets the memory held by this route map, including the plot data and
+   * render caches, which must only be read from the main thread.
+   */
+  virtual RouteMapMemory GetMemoryUsage();
+
   /**
    * Locks the route map for thread-safe access.
    */
@@ -293,14 +398,21 @@ public:
    * Checks if the calculation thread is still running.
    * @return True if the thread is running.
    */
-  bool Running() { return m_Thread && m_Thread->IsAlive(); }
+  bool Running() {
+    return m_Thread && m_Thread->IsAlive() && !m_Thread->Done();
+  }
 
   /**
    * Starts the route calculation thread.
    * @param error Output parameter for error messages.
+   * @param handler Receives the wxEVT_ROUTEMAP_COMPUTATION events of the
+   * thread, if not null.
    * @return True if the thread started successfully.
    */
-  bool Start(wxString& error);
+  bool Start(wxString& error, wxEvtHandler* handler = nullptr);
+
+  /** Stops the calculation, waking the thread if it waits for GRIB data. */
+  void Stop();
 
   /**
    * Deletes the calculation thread.
@@ -368,15 +480,15 @@ private:
                             PlugIn_ViewPort& vp);
 
   /**
-   * Renders a single isochrone route.
-   * @param r Pointer to the route to render.
+   * Renders a single contour of an isochrone route, without its children.
+   * @param start First position of the contour.
    * @param time The currently selected time in the GRIB timeline.
    * @param grib_color Color for grib-based segments.
    * @param climatology_color Color for climatology-based segments.
    * @param dc Device context for drawing.
    * @param vp ViewPort for coordinate transformations.
    */
-  void RenderIsoRoute(IsoRoute* r, wxDateTime time, wxColour& grib_color,
+  void RenderIsoRoute(Position* start, wxDateTime time, wxColour& grib_color,
                       wxColour& climatology_color, piDC& dc,
                       PlugIn_ViewPort& vp);
 
@@ -427,9 +539,18 @@ private:
    */
   virtual bool TestAbort() { return Finished(); }
 
+  /** Asks the event handler for GRIB data from the calculation thread. */
+  virtual void GribNeeded();
+
+  /** Posts a ComputationEvent to the event handler, if any. */
+  void PostComputationEvent(ComputationEvent event);
+
   /** Pointer to the calculation thread. */
   RouteMapOverlayThread* m_Thread;
 
+  /** Receives the events of the calculation thread, may be null. */
+  wxEvtHandler* m_EventHandler;
+
   /** Mutex for thread-safe access to route data. */
   wxMutex routemutex;
 
@@ -582,6 +703,15 @@ private:
 
   /** Projection type for the current cache. */
   int current_cache_projection;
+
+  /** Retention forced by SetMinimumRetention. */
+  RouteMapConfiguration::RetentionType m_MinimumRetention;
+
+  /** Retention ApplyRetention last released the route map to. */
+  RouteMapConfiguration::RetentionType m_AppliedRetention;
+
+  /** Result key of the computation, 0 if unknown. */
+  wxUint64 m_ResultKey;
 };
 
 #endif
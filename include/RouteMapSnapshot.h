@@ -0,0 +1,217 @@
+/***************************************************************************
+ *   Copyright (C) 2015 by OpenCPN development team                        *
+ *                                                                         *
+ *   This program is free software; you can redistribute it and/or modify  *
+ *   it under the terms of the GNU General Public License as published by  *
+ *   the Free Software Foundation; either version 3 of the License, or     *
+ *   (at your option) any later version.                                   *
+ *                                                                         *
+ *   This program is distributed in the hope that it will be useful,       *
+ *   but WITHOUT ANY WARRANTY; without even the implied warranty of        *
+ *   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the         *
+ *   GNU General Public License for more details.                          *
+ *                                                                         *
+ *   You should have received a copy of the GNU General Public License     *
+ *   along with this program; if not, write to the                         *
+ *   Free Software Foundation, Inc.,                                       *
+ *   51 Franklin Street, Fifth Floor, Boston, MA 02110-1301,  USA.         *
+ **************************************************************************/
+
+#ifndef _WEATHER_ROUTING_ROUTE_MAP_SNAPSHOT_H_
+#define _WEATHER_ROUTING_ROUTE_MAP_SNAPSHOT_H_
+
+#include <wx/datetime.h>
+#include <wx/string.h>
+
+#include <ctime>
+#include <list>
+#include <vector>
+
+#include "IsoRoute.h"
+
+struct RouteMapConfiguration;
+class GribRecord;
+class PlotData;
+class Position;
+
+/**
+ * Compact binary snapshot of a computed route map.
+ *
+ * Isochrones are lost when OpenCPN restarts or when a configuration is edited
+ * and reverted, and large route sets take long to compute again.  When a
+ * route map finishes, its isochrones are written to a snapshot file in the
+ * plugin data directory, named after the result key of the route map.  A
+ * route map whose configuration, boat, polars, environment and GRIB data give
+ * the same key reads the file back instead of computing.
+ *
+ * The file holds a header with the result key, then for each isochrone its
+ * time, time step and the fingerprint of the GRIB record set it was
+ * propagated with, followed by its routes and their positions.  Positions
+ * are stored as fixed size records; the parent of a position is stored as its
+ * index in the file, and the destination position, if the destination was
+ * reached, is the last position record.  The plot data of the route to the
+ * destination comes last.
+ *
+ * Snapshots do not hold GRIB data: reloaded isochrones are frozen and have no
+ * GRIB record set, as after RouteMapConfiguration::RETAIN_OUTLINES.  Files
+ * unused for a month are pruned.
+ *
+ * A finished route map is serialized under its lock and written by a
+ * background thread, so the main thread does no file output.  All functions
+ * are thread safe, the caller must hold the route map lock while the
+ * isochrones are serialized.
+ */
+class RouteMapSnapshot {
+public:
+  /** Identity of the GRIB record set an isochrone was propagated with. */
+  struct GribProvenance {
+    time_t reference_time;  //!< -1 if propagated without GRIB
+    wxUint64 fingerprint;   //!< GribFingerprint() of the set
+  };
+
+  /**
+   * Data a configuration is computed with besides its own fields, its boat
+   * and its GRIB data.
+   */
+  struct Environment {
+    /** CoastlineIndex::Source(), or empty, when detecting land. */
+    wxString coastline;
+    /**
+     * Climatology cache resolution and answers near the start and the end,
+     * empty without climatology.  The climatology plugin does not tell which
+     * data it loaded.
+     */
+    std::vector<double> climatology;
+  };
+
+  /** Everything stored in a snapshot. */
+  struct Contents {
+    IsoChronList origin;
+    /** Position at the destination, null if it was not reached. */
+    Position* destination;
+    /**
+     * The destination was reached, possibly between two isochrones without
+     * a position at the destination.
+     */
+    bool reached_destination;
+    wxDateTime end_time;
+    /** GRIB provenance of each isochrone of origin. */
+    std::vector<GribProvenance> gribs;
+    /** Plot data of the route to the destination. */
+    std::list<PlotData> plotdata;
+  };
+
+  /**
+   * Hash of the configuration fields which affect the computed isochrones.
+   *
+   * The start and end are hashed by position rather than by name, and the
+   * retention policy is not hashed since snapshots are written before it is
+   * applied.
+   */
+  static wxUint64 ConfigurationHash(const RouteMapConfiguration& c);
+
+  /**
+   * Hash of the contents of a file, memoized while its size and modification
+   * time do not change.
+   *
+   * @return 0 if the file cannot be read.
+   */
+  static wxUint64 FileHash(const wxString& path);
+
+  /**
+   * Fingerprint of a GRIB record set: the reference time and, for every
+   * record, its grid, center, model, level, reference and forecast dates and
+   * a sample of its values.  The GRIB plugin does not tell which file the
+   * records come from.
+   *
+   * @param records The Idx_COUNT records of the set, null where missing.
+   */
+  static wxUint64 GribFingerprint(time_t reference_time,
+                                  GribRecord* const* records);
+
+  /**
+   * Key of the result of computing a configuration.  It combines the
+   * configuration hash, the contents of the boat and polar files, the
+   * environment and, if the configuration uses GRIB data, the fingerprint of
+   * the GRIB record set at the start time.  The boat of the configuration
+   * must be loaded.
+   *
+   * Later record sets are not known before computing: the fingerprint of
+   * the set of every isochrone is stored in the snapshot and should be
+   * checked against the GRIB data before a snapshot is reused.
+   *
+   * @param forecast GRIB record set at the start time, ignored if the
+   * configuration does not use GRIB data.
+   */
+  static wxUint64 ResultKey(const RouteMapConfiguration& c,
+                            const GribProvenance& forecast,
+                            const Environment& environment);
+
+  /** Path of the snapshot file for a result key. */
+  static wxString Path(wxUint64 key);
+
+  /**
+   * Removes the snapshot of a result key, waiting for queued writes first.
+   * Must be called from the main thread.
+   */
+  static void Remove(wxUint64 key);
+
+  /**
+   * Serializes the isochrones of a route map into the contents of a
+   * snapshot file.
+   *
+   * @param destination Position at the destination, or null.
+   * @param plotdata Plot data of the route to the destination, computed
+   * while the GRIB record sets are available.
+   */
+  static void Serialize(wxUint64 key, const IsoChronList& origin,
+                        Position* destination, bool reached_destination,
+                        const wxDateTime& end_time,
+                        const std::list<PlotData>& plotdata,
+                        std::vector<char>& data);
+
+  /**
+   * Writes the contents of a snapshot file, replacing the file atomically.
+   * @return false if the file could not be written.
+   */
+  static bool WriteData(const wxString& path, const std::vector<char>& data);
+
+  /**
+   * Serializes and writes the isochrones of a route map.
+   * @see Serialize
+   */
+  static bool Write(const wxString& path, wxUint64 key,
+                    const IsoChronList& origin, Position* destination,
+                    bool reached_destination, const wxDateTime& end_time,
+                    const std::list<PlotData>& plotdata);
+
+  /**
+   * Queues the contents of a snapshot file to be written by a background
+   * thread, taking them from data.  Read() sees queued snapshots before they
+   * are written.  Must be called from the main thread.
+   */
+  static void WriteInBackground(const wxString& path, std::vector<char>& data);
+
+  /**
+   * Waits until the queued snapshots are written.  Must be called from the
+   * main thread, at the latest before the plugin is unloaded.
+   */
+  static void Flush();
+
+  /**
+   * Reads a snapshot written for the result key.  On success the
+   * caller owns the isochrones and the destination of contents.
+   *
+   * @return false if there is no snapshot, it was written for another key or
+   * another version of the plugin, or it is corrupt.
+   */
+  static bool Read(const wxString& path, wxUint64 key, Contents& contents);
+
+  /** Deletes the isochrones and the destination of contents read. */
+  static void Discard(Contents& contents);
+
+  /** Directory holding the snapshot files. */
+  static wxString Directory();
+};
+
+#endif
@@ -24,6 +24,7 @@
 #include <vector>
 #include <json/json.h>
 
+#include "AtlasSpeedTable.h"
 #include "ConstraintChecker.h"
 
 struct RouteMapConfiguration;
@@ -150,6 +151,8 @@ public:
   double currentSpeed;
   double swell;
   climatology_wind_atlas atlas;
+  /** Cumulative atlas speed table last used at this position. */
+  mutable AtlasSpeedTable::TablePtr atlas_speeds;
 
   WeatherData(RoutePoint* position);
 
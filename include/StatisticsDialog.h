@@ -22,6 +22,8 @@
 
 #include <list>
 
+#include <json/json.h>
+
 #include "WeatherRoutingUI.h"
 
 class RouteMapOverlay;
@@ -31,6 +33,22 @@ public:
   StatisticsDialog(wxWindow* parent);
   void SetRouteMapOverlays(std::list<RouteMapOverlay*> routemapoverlays);
   void SetRunTime(wxTimeSpan RunTime);
+
+private:
+  wxStaticText* AddMemoryLabel(wxWindow* parent, wxSizer* sizer,
+                               const wxString& label);
+  void OnCopyMemory(wxCommandEvent& event);
+
+  wxStaticText* m_stMemoryPositions;
+  wxStaticText* m_stMemorySkipPositions;
+  wxStaticText* m_stMemoryRoutes;
+  wxStaticText* m_stMemoryGrib;
+  wxStaticText* m_stMemoryPlotData;
+  wxStaticText* m_stMemoryRender;
+  wxStaticText* m_stMemoryTotal;
+
+  /** Memory held by each route map shown, as copied to the clipboard. */
+  Json::Value m_MemoryReport;
 };
 
 #endif
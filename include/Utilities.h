@@ -124,4 +124,14 @@ bool AttributeBool(TiXmlElement* e, const char* name, bool def);
 // CUSTOMIZATION
 wxString calculateTimeDelta(wxDateTime startTime, wxDateTime endTime);
 
+/**
+ * Replace a file with a temporary file written next to it, atomically so
+ * that a reader sees either the old or the new contents.  wxRenameFile
+ * removes the target first on Windows.
+ * @param temp Temporary file, removed on success
+ * @param path File to replace
+ * @return false if the file could not be replaced
+ */
+bool replace_file(const wxString& temp, const wxString& path);
+
 #endif
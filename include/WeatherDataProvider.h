@@ -32,11 +32,55 @@
 struct RouteMapConfiguration;
 class RoutePoint;
 struct climatology_wind_atlas;
+class PlotData;
+
+/** Time and position to request GRIB values for, see RequestGribValues(). */
+struct GribValuePoint {
+  wxDateTime time;
+  double lat;
+  double lon;
+};
 
 class WeatherDataProvider {
 public:
   virtual ~WeatherDataProvider() = default;
 
+  /** Fields that can be requested from the GRIB plugin. */
+  enum GribValueField {
+    GRIB_VALUE_WIND = 1 << 0,     //!< Wind speed and direction
+    GRIB_VALUE_CURRENT = 1 << 1,  //!< Current speed and direction
+    GRIB_VALUE_SWELL = 1 << 2,
+    GRIB_VALUE_WAVE_DIR = 1 << 3,
+    GRIB_VALUE_WAVE_PERIOD = 1 << 4,
+    GRIB_VALUE_GUST = 1 << 5,
+    GRIB_VALUE_CLOUD = 1 << 6,
+    GRIB_VALUE_RAIN = 1 << 7,
+    GRIB_VALUE_AIR_TEMP = 1 << 8,
+    GRIB_VALUE_SEA_TEMP = 1 << 9,
+    GRIB_VALUE_CAPE = 1 << 10,
+    GRIB_VALUE_REL_HUM = 1 << 11,
+    GRIB_VALUE_PRESSURE = 1 << 12,
+    GRIB_VALUE_REFLECTIVITY = 1 << 13,
+    GRIB_VALUE_ALL = (1 << 14) - 1
+  };
+
+  /**
+   * Requests every GRIB value of a point from the GRIB plugin in a single
+   * GRIB_VALUES_REQUEST message, for configurations following a route without
+   * a local GRIB copy.
+   *
+   * The reply is kept until ClearGribValues() is called, and requests for a
+   * single field of a fetched point (GetGribWind(), GetCurrent(),
+   * GetWeatherParameter()) are answered from it without a message.
+   *
+   * @param point Time and position to request.
+   * @param fields Bitwise or of GribValueField.
+   * @return true if a reply was received.
+   */
+  static bool RequestGribValues(const GribValuePoint& point, int fields);
+  /** Drops the values fetched by RequestGribValues(). */
+  static void ClearGribValues();
+
   static double GetWeatherParameter(
       RouteMapConfiguration& configuration, double lat, double lon,
       const wxString& requestKey, int gribIndex, double returnOnEmpty = NAN,
@@ -75,6 +119,19 @@ public:
   static double GetReflectivity(RouteMapConfiguration& configuration,
                                 double lat, double lon);
 
+  /**
+   * Reads every weather field shown in plots and tables (swell, waves, gust,
+   * cloud, rain, temperatures, CAPE, humidity, reflectivity and pressure) at a
+   * point into PlotData.
+   *
+   * The values are the same as those of GetSwell(), GetWaveDirection() and the
+   * other getters, but with a local GRIB copy the grid cell and interpolation
+   * weights of the point are computed once for all records sharing a grid,
+   * instead of once per field.
+   */
+  static void GetPlotWeather(RouteMapConfiguration& configuration, double lat,
+                             double lon, PlotData& data);
+
   static void GroundToWaterFrame(double groundDir, double groundMag,
                                  double currentDir, double currentMag,
                                  double& waterDir, double& waterMag);
@@ -103,7 +160,11 @@ public:
 
 class WR_GribRecordSet {
 public:
-  WR_GribRecordSet(unsigned int id) : m_Reference_Time(-1), m_ID(id) {
+  WR_GribRecordSet(unsigned int id)
+      : m_Reference_Time(-1),
+        m_ID(id),
+        m_Fingerprint(0),
+        m_Interpolated(false) {
     for (int i = 0; i < Idx_COUNT; i++) {
       m_GribRecordPtrArray[i] = 0;
       m_GribRecordUnref[i] = false;
@@ -132,6 +193,12 @@ public:
 
   time_t m_Reference_Time;
   unsigned int m_ID;
+  // RouteMapSnapshot::GribFingerprint() of the set copied from the GRIB
+  // plugin, 0 if unknown
+  wxUint64 m_Fingerprint;
+  // blended in time between two record sets, m_ID is the one of the earlier
+  // set and does not identify this data: never cache it by id
+  bool m_Interpolated;
 
   GribRecord* m_GribRecordPtrArray[Idx_COUNT];
 
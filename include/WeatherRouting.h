@@ -24,6 +24,8 @@
 #include <wx/fileconf.h>
 #include <wx/collpane.h>
 
+#include <map>
+
 #ifdef __OCPN__ANDROID__
 #include <wx/qt/private/wxQtGesture.h>
 #endif
@@ -39,6 +41,9 @@
 #include "PlotDialog.h"
 #include "FilterRoutesDialog.h"
 #include "RoutingTablePanel.h"
+#include "ConfigurationWriter.h"
+#include "MemoryGovernor.h"
+#include "RouteMapSnapshot.h"
 
 class weather_routing_pi;
 class WeatherRouting;
@@ -165,6 +170,13 @@ public:
 
   /** Pointer to the actual route calculation and display overlay. */
   RouteMapOverlay* routemapoverlay;
+
+  /**
+   * Configuration element as last saved, formatted again only when the
+   * configuration version of routemapoverlay changes.
+   */
+  ConfigurationWriter::Element SavedConfiguration;
+  unsigned int SavedConfigurationVersion;
 };
 
 /**
@@ -203,6 +215,8 @@ private:
   WeatherRoutingPanel* m_panel;
   /** Timer for auto-saving positions and routes. */
   wxTimer m_tAutoSaveXML;
+  /** Writes the configuration file in the background. */
+  ConfigurationWriter m_ConfigurationWriter;
 
 public:
   /**
@@ -291,6 +305,16 @@ public:
   std::list<RouteMapOverlay*> CurrentRouteMaps(bool messagedialog = false);
   RouteMapOverlay* FirstCurrentRouteMap();
   RouteMapOverlay* m_RouteMapOverlayNeedingGrib;
+  /**
+   * Filled with the identity of the GRIB record set answered to a request
+   * made while no route map needs GRIB data, null when not requesting.
+   */
+  RouteMapSnapshot::GribProvenance* m_GribIdentityRequest;
+  /**
+   * GRIB record set identities by time, reused while every route is started
+   * so the GRIB plugin is asked once per time.  Null otherwise.
+   */
+  std::map<time_t, RouteMapSnapshot::GribProvenance>* m_GribIdentityCache;
 
   void RebuildList();
   /**
@@ -529,14 +553,29 @@ private:
   void OnAbout(wxCommandEvent& event);
 
   void OnComputationTimer(wxTimerEvent&);
+  /** Governs memory while no route is computing. */
+  void OnMemoryTimer(wxTimerEvent&);
+  /** Reacts to the wxEVT_ROUTEMAP_COMPUTATION events of the threads. */
+  void OnComputationEvent(wxThreadEvent& event);
   void OnHideConfigurationTimer(wxTimerEvent&);
   void OnAutoSaveXMLTimer(wxTimerEvent&);
   void OnRenderedTimer(wxTimerEvent&);
 
   bool OpenXML(wxString filename, bool reportfailure = true);
-  void SaveXML(wxString filename);
+  /**
+   * Saves positions and configurations to a file, waiting for the write.
+   *
+   * @param background If true, return once the file is queued to be written
+   * by m_ConfigurationWriter, errors are then only logged.
+   */
+  void SaveXML(wxString filename, bool background = false);
   /** Auto save on positions/routes changes. */
   void AutoSaveXML();
+  /**
+   * Builds the document to save, formatting only the configurations which
+   * changed since they were last saved.
+   */
+  ConfigurationWriter::Document XMLDocument(const wxString& filename);
 
   void SetEnableConfigurationMenu();
 
@@ -557,6 +596,33 @@ private:
    * @see RouteMapOverlay For the route calculation and display engine
    */
   bool AddConfiguration(RouteMapConfiguration& configuration);
+  /**
+   * Computes the result key of the current configuration of a route map,
+   * loading its boat, asking the GRIB plugin for the record set at the
+   * start time and sampling the coastline and climatology sources.
+   *
+   * @return false if the result cannot be cached: the route map follows an
+   * OpenCPN route or avoids ocpn_draw boundaries, whose geometry is not
+   * available to fingerprint, its boat cannot be loaded or there is no GRIB
+   * data at the start time.
+   * @see RouteMapSnapshot::ResultKey
+   */
+  bool ResultKey(RouteMapOverlay* routemapoverlay, wxUint64& key);
+  /**
+   * Reloads the snapshot of a result key into a route map, if the GRIB
+   * record set of each of its isochrones is still the one loaded now.
+   *
+   * @return false if there is no usable snapshot, the route map is unchanged.
+   */
+  bool LoadResult(RouteMapOverlay* routemapoverlay, wxUint64 key);
+  /**
+   * Asks the GRIB plugin for the identity of the record set at a time,
+   * memoized in m_GribIdentityCache if set.
+   *
+   * @return false if there is no GRIB data at that time.
+   */
+  bool GribIdentity(const wxDateTime& time,
+                    RouteMapSnapshot::GribProvenance& forecast);
   /**
    * Updates a route map overlay in the UI.
    *
@@ -621,14 +687,31 @@ private:
    * - It adds successful starts to the running routes list
    *
    * @param routemapoverlay Pointer to the route map overlay to compute
+   * @param reuse Whether a snapshot of the same result may be reloaded
+   * instead.  Otherwise the snapshot is removed and the route computed again.
    */
-  void Start(RouteMapOverlay* routemapoverlay);
+  void Start(RouteMapOverlay* routemapoverlay, bool reuse = true);
   void StartAll();
   /* Stop the computation of the specified route. */
   void Stop(RouteMapOverlay* routemapoverlay);
   /* Stop the computation of all routes. */
   void StopAll();
 
+  /**
+   * Updates the memory governor from the memory held by the route maps,
+   * shedding memory while over the budget.  Called by the computation
+   * timer while routes compute and by the memory timer otherwise.
+   */
+  void GovernMemory();
+  /**
+   * Reclaims the threads of finished route maps, requests the GRIB data
+   * the running ones wait for and starts waiting route maps on the free
+   * threads.  Stops once every route map is computed.
+   */
+  void ScheduleComputations();
+  /** Refreshes the display and dialogs if a current route map changed. */
+  void RefreshComputations();
+
   void DeleteRouteMaps(std::list<RouteMapOverlay*> routemapoverlays);
   RouteMapConfiguration DefaultConfiguration();
 
@@ -642,7 +725,7 @@ private:
   PlotDialog m_PlotDialog;
   FilterRoutesDialog m_FilterRoutesDialog;
 
-  wxTimer m_tCompute, m_tHideConfiguration;
+  wxTimer m_tCompute, m_tHideConfiguration, m_tMemory;
 
   bool m_bRunning;
   wxTimeSpan m_RunTime;
@@ -651,6 +734,8 @@ private:
   wxString m_default_configuration_path;
 
   int m_RoutesToRun;
+  /** Pauses route starts and sheds memory near the memory budget. */
+  MemoryGovernor m_MemoryGovernor;
   bool m_bSkipUpdateCurrentItems;
 
   bool m_bShowConfiguration;
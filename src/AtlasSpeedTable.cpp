@@ -0,0 +1,226 @@
+/***************************************************************************
+ *   Copyright (C) 2015 by OpenCPN development team                        *
+ *                                                                         *
+ *   This program is free software; you can redistribute it and/or modify  *
+ *   it under the terms of the GNU General Public License as published by  *
+ *   the Free Software Foundation; either version 3 of the License, or     *
+ *   (at your option) any later version.                                   *
+ *                                                                         *
+ *   This program is distributed in the hope that it will be useful,       *
+ *   but WITHOUT ANY WARRANTY; without even the implied warranty of        *
+ *   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the         *
+ *   GNU General Public License for more details.                          *
+ *                                                                         *
+ *   You should have received a copy of the GNU General Public License     *
+ *   along with this program; if not, write to the                         *
+ *   Free Software Foundation, Inc.,                                       *
+ *   51 Franklin Street, Fifth Floor, Boston, MA 02110-1301,  USA.         *
+ **************************************************************************/
+
+#include <wx/wx.h>
+
+#include <algorithm>
+#include <cmath>
+#include <mutex>
+#include <unordered_map>
+
+#include "AtlasSpeedTable.h"
+#include "RouteMap.h"
+#include "RoutePoint.h"
+#include "Utilities.h"
+
+namespace {
+
+/* the tables are simply emptied when there are this many of them */
+const size_t MAX_TABLES = 4096;
+const int ATLAS_DIRECTIONS = 8;
+
+struct TableKey {
+  double W[ATLAS_DIRECTIONS], VW[ATLAS_DIRECTIONS];
+  double directions[ATLAS_DIRECTIONS];
+  double twdOverWater;
+  wxString polar;
+  int polar_index;
+  bool bound, optimize_tacking;
+  size_t steps;
+  size_t steps_hash;  //!< Independent of the order of the degree steps
+
+  bool operator==(const TableKey& other) const {
+    for (int i = 0; i < ATLAS_DIRECTIONS; i++)
+      if (W[i] != other.W[i] || VW[i] != other.VW[i] ||
+          directions[i] != other.directions[i])
+        return false;
+    return twdOverWater == other.twdOverWater &&
+           polar_index == other.polar_index && bound == other.bound &&
+           optimize_tacking == other.optimize_tacking &&
+           steps == other.steps && steps_hash == other.steps_hash &&
+           polar == other.polar;
+  }
+};
+
+struct TableKeyHash {
+  size_t operator()(const TableKey& k) const {
+    std::hash<double> hd;
+    size_t h = hd(k.twdOverWater);
+    for (int i = 0; i < ATLAS_DIRECTIONS; i++) {
+      h = h * 31 + hd(k.W[i]);
+      h = h * 31 + hd(k.VW[i]);
+      h = h * 31 + hd(k.directions[i]);
+    }
+    h = h * 31 + std::hash<int>()(k.polar_index);
+    h = h * 31 + std::hash<size_t>()(k.steps);
+    h = h * 31 + k.steps_hash;
+    return h * 4 + k.bound * 2 + k.optimize_tacking;
+  }
+};
+
+/* sum of mixed hashes, so a permutation of the steps gives the same value */
+size_t StepsHash(const std::vector<double>& steps) {
+  std::hash<double> hd;
+  unsigned long long sum = 0;
+  for (double step : steps) {
+    unsigned long long x = hd(step) + 0x9e3779b97f4a7c15ULL;
+    x = (x ^ (x >> 30)) * 0xbf58476d1ce4e5b9ULL;
+    x = (x ^ (x >> 27)) * 0x94d049bb133111ebULL;
+    sum += x ^ (x >> 31);
+  }
+  return (size_t)sum;
+}
+
+/* twa is sorted, steps normally are too */
+bool SameSteps(const std::vector<double>& twa,
+               const std::vector<double>& steps) {
+  if (twa.size() != steps.size()) return false;
+  if (std::is_sorted(steps.begin(), steps.end()))
+    return std::equal(twa.begin(), twa.end(), steps.begin());
+  for (double step : steps)
+    if (!std::binary_search(twa.begin(), twa.end(), step)) return false;
+  return true;
+}
+
+std::unordered_map<TableKey, AtlasSpeedTable::TablePtr, TableKeyHash> tables;
+std::mutex atlas_speed_table_mutex;
+
+/* speed for a single atlas direction, dir is the wind angle off the bow */
+double DirectionSpeed(Polar& polar, double dir, double VW, bool bound,
+                      bool optimize_tacking, PolarSpeedStatus* status) {
+  if (dir > 180) dir = 360 - dir;
+  double mind = polar.MinDegreeStep();
+  // if tacking
+  if (fabs(dir) < mind)
+    return polar.Speed(mind, VW, status, bound, optimize_tacking) *
+           cos(deg2rad(mind)) / cos(deg2rad(dir));
+  return polar.Speed(dir, VW, status, bound, optimize_tacking);
+}
+
+AtlasSpeedTable::TablePtr GetTable(RouteMapConfiguration& configuration,
+                                   int polar_index,
+                                   const WeatherData& weather_data,
+                                   bool bound) {
+  Polar& polar = configuration.boat.Polars[polar_index];
+  const climatology_wind_atlas& atlas = weather_data.atlas;
+
+  TableKey key;
+  for (int i = 0; i < ATLAS_DIRECTIONS; i++) {
+    key.W[i] = atlas.W[i];
+    key.VW[i] = atlas.VW[i];
+    key.directions[i] = atlas.directions[i];
+  }
+  key.twdOverWater = weather_data.twdOverWater;
+  key.polar = polar.FileName;
+  key.polar_index = polar_index;
+  key.bound = bound;
+  key.optimize_tacking = configuration.OptimizeTacking;
+  key.steps = configuration.DegreeSteps.size();
+  key.steps_hash = StepsHash(configuration.DegreeSteps);
+
+  {
+    std::lock_guard<std::mutex> lock(atlas_speed_table_mutex);
+    auto it = tables.find(key);
+    // the hash already matched, only a collision can make this fail
+    if (it != tables.end() &&
+        SameSteps(it->second->twa, configuration.DegreeSteps))
+      return it->second;
+  }
+
+  // compute outside of the lock, other threads keep reading tables
+  std::shared_ptr<AtlasSpeedTable::Table> table =
+      std::make_shared<AtlasSpeedTable::Table>();
+  table->polar_index = polar_index;
+  table->bound = bound;
+  table->twa = configuration.DegreeSteps;
+  std::sort(table->twa.begin(), table->twa.end());
+  size_t count = table->twa.size();
+  table->speed.assign(count, 0);
+  table->status.assign(count, POLAR_SPEED_SUCCESS);
+
+  /* one atlas direction at a time so each pass reads the same polar wind
+     speed columns, the weighted sum is accumulated in the same order as
+     AtlasSpeedTable::CumulativeSpeed() */
+  for (int i = 0; i < ATLAS_DIRECTIONS; i++)
+    for (size_t j = 0; j < count; j++) {
+      double dir = table->twa[j] - weather_data.twdOverWater + atlas.W[i];
+      table->speed[j] +=
+          atlas.directions[i] * DirectionSpeed(polar, dir, atlas.VW[i], bound,
+                                               configuration.OptimizeTacking,
+                                               &table->status[j]);
+    }
+
+  std::lock_guard<std::mutex> lock(atlas_speed_table_mutex);
+  if (tables.size() >= MAX_TABLES) tables.clear();
+  tables[key] = table;
+  return table;
+}
+
+}  // namespace
+
+double AtlasSpeedTable::Speed(RouteMapConfiguration& configuration,
+                              int polar_index, const WeatherData& weather_data,
+                              double twa, bool bound,
+                              PolarSpeedStatus* status) {
+  TablePtr table = weather_data.atlas_speeds;
+  if (!table || table->polar_index != polar_index || table->bound != bound) {
+    table = GetTable(configuration, polar_index, weather_data, bound);
+    weather_data.atlas_speeds = table;
+  }
+
+  auto it = std::lower_bound(table->twa.begin(), table->twa.end(), twa);
+  if (it != table->twa.end() && *it == twa) {
+    size_t j = it - table->twa.begin();
+    if (status) *status = table->status[j];
+    return table->speed[j];
+  }
+
+  return CumulativeSpeed(configuration.boat.Polars[polar_index],
+                         weather_data.atlas, weather_data.twdOverWater, twa,
+                         bound, configuration.OptimizeTacking, status);
+}
+
+double AtlasSpeedTable::CumulativeSpeed(Polar& polar,
+                                        const climatology_wind_atlas& atlas,
+                                        double twdOverWater, double twa,
+                                        bool bound, bool optimize_tacking,
+                                        PolarSpeedStatus* status) {
+  double stw = 0;
+  for (int i = 0; i < ATLAS_DIRECTIONS; i++) {
+    // Calculate relative wind angle (difference between heading and wind
+    // direction).
+    double dir = twa - twdOverWater + atlas.W[i];
+    // Accumulate weighted boat speed based on probability of each wind
+    // direction
+    stw += atlas.directions[i] *
+           DirectionSpeed(polar, dir, atlas.VW[i], bound, optimize_tacking,
+                          status);
+  }
+  return stw;
+}
+
+void AtlasSpeedTable::Clear() {
+  std::lock_guard<std::mutex> lock(atlas_speed_table_mutex);
+  tables.clear();
+}
+
+size_t AtlasSpeedTable::Size() {
+  std::lock_guard<std::mutex> lock(atlas_speed_table_mutex);
+  return tables.size();
+}
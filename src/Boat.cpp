@@ -38,13 +38,26 @@ Boat::Boat() {}
 Boat::~Boat() {}
 
 wxString Boat::OpenXML(wxString filename, bool shortcut) {
-  wxDateTime last_filetime = wxFileName(filename).GetModificationTime();
   /* shortcut if already loaded, and boat wasn't modified */
   if (shortcut && m_last_filename == filename && m_last_filetime.IsValid() &&
-      m_last_filetime == last_filetime)
+      m_last_filetime == wxFileName(filename).GetModificationTime())
     return _T("");
 
+  bool generateContours;
+  wxString error =
+      ParseXML(filename,
+               weather_routing_pi::StandardPath() + _T("polars") +
+                   wxFileName::GetPathSeparator(),
+               generateContours);
+  if (error.IsEmpty() && generateContours) GenerateContours(filename);
+  return error;
+}
+
+wxString Boat::ParseXML(wxString filename, const wxString& polars,
+                        bool& generateContours) {
+  wxDateTime last_filetime = wxFileName(filename).GetModificationTime();
   bool cleared = false;
+  generateContours = false;
   Polars.clear();
 
   if (!wxFileName::FileExists(filename)) return _("Boat file does not exist.");
@@ -59,8 +72,6 @@ wxString Boat::OpenXML(wxString filename, bool shortcut) {
   if (strcmp(doc.RootElement()->Value(), "OpenCPNWeatherRoutingBoat"))
     return _("Invalid xml file (no OCPWeatherRoutingBoat node): " + filename);
 
-  bool generateContours = false;
-
   for (TiXmlElement* e = root.FirstChild().Element(); e;
        e = e->NextSiblingElement()) {
     if (!strcmp(e->Value(), "Polar")) {
@@ -74,8 +85,7 @@ wxString Boat::OpenXML(wxString filename, bool shortcut) {
       polar.FileName = wxString::FromUTF8(e->Attribute("FileName"));
       polar.FileName.Replace(_T("/"), wxFileName::GetPathSeparator());
       if (!wxFileName::FileExists(polar.FileName))
-        polar.FileName = weather_routing_pi::StandardPath() + _T("polars") +
-                         wxFileName::GetPathSeparator() + polar.FileName;
+        polar.FileName = polars + polar.FileName;
 
       const char* str = e->Attribute("CrossOverContours");
       if (str) {
@@ -118,16 +128,20 @@ wxString Boat::OpenXML(wxString filename, bool shortcut) {
     }
   }
 
-  if (generateContours) {
-    GenerateCrossOverChart();
-    SaveXML(filename);
-  }
-
   m_last_filename = filename;
   m_last_filetime = last_filetime;
   return _T("");
 }
 
+wxString Boat::GenerateContours(wxString filename) {
+  GenerateCrossOverChart();
+  wxString error = SaveXML(filename);
+  /* saving changed the file, don't parse it again for that */
+  if (error.IsEmpty() && m_last_filename == filename)
+    m_last_filetime = wxFileName(filename).GetModificationTime();
+  return error;
+}
+
 wxString Boat::SaveXML(wxString filename) {
   TiXmlDocument doc;
   TiXmlDeclaration* decl = new TiXmlDeclaration("1.0", "utf-8", "");
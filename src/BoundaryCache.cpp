@@ -0,0 +1,199 @@
+/***************************************************************************
+ *   Copyright (C) 2015 by OpenCPN development team                        *
+ *                                                                         *
+ *   This program is free software; you can redistribute it and/or modify  *
+ *   it under the terms of the GNU General Public License as published by  *
+ *   the Free Software Foundation; either version 3 of the License, or     *
+ *   (at your option) any later version.                                   *
+ *                                                                         *
+ *   This program is distributed in the hope that it will be useful,       *
+ *   but WITHOUT ANY WARRANTY; without even the implied warranty of        *
+ *   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the         *
+ *   GNU General Public License for more details.                          *
+ *                                                                         *
+ *   You should have received a copy of the GNU General Public License     *
+ *   along with this program; if not, write to the                         *
+ *   Free Software Foundation, Inc.,                                       *
+ *   51 Franklin Street, Fifth Floor, Boston, MA 02110-1301,  USA.         *
+ **************************************************************************/
+
+#include <wx/wx.h>
+
+#include <atomic>
+#include <cmath>
+#include <condition_variable>
+#include <cstdint>
+#include <mutex>
+#include <unordered_map>
+
+#include "BoundaryCache.h"
+#include "RouteMap.h"
+#include "Utilities.h"
+
+namespace {
+
+/* each shard is simply emptied when it grows past this many entries */
+const size_t MAX_CACHED_RESULTS = 50000;
+const size_t SHARDS = 16;
+/* endpoints are snapped to 1e-5 degrees, about a meter */
+const double QUANT = 1e5;
+/* the memo is bypassed once, after this many queries, less than 1% hit */
+const size_t MEMO_PROBE_QUERIES = 10000;
+
+struct SegmentKey {
+  int32_t lat1, lon1, lat2, lon2;
+
+  bool operator==(const SegmentKey& other) const {
+    return lat1 == other.lat1 && lon1 == other.lon1 && lat2 == other.lat2 &&
+           lon2 == other.lon2;
+  }
+};
+
+struct SegmentKeyHash {
+  size_t operator()(const SegmentKey& k) const {
+    size_t h = std::hash<int32_t>()(k.lat1);
+    h = h * 31 + std::hash<int32_t>()(k.lon1);
+    h = h * 31 + std::hash<int32_t>()(k.lat2);
+    return h * 31 + std::hash<int32_t>()(k.lon2);
+  }
+};
+
+struct Shard {
+  std::mutex mutex;
+  std::unordered_map<SegmentKey, bool, SegmentKeyHash> results;
+};
+
+/* readers/writer lock, std::shared_mutex needing C++17 */
+class SharedMutex {
+public:
+  void lock_shared() {
+    std::unique_lock<std::mutex> lock(m_mutex);
+    m_cond.wait(lock, [this] { return !m_writer; });
+    m_readers++;
+  }
+
+  void unlock_shared() {
+    std::lock_guard<std::mutex> lock(m_mutex);
+    if (--m_readers == 0) m_cond.notify_all();
+  }
+
+  void lock() {
+    std::unique_lock<std::mutex> lock(m_mutex);
+    m_cond.wait(lock, [this] { return !m_writer; });
+    m_writer = true;
+    m_cond.wait(lock, [this] { return m_readers == 0; });
+  }
+
+  void unlock() {
+    std::lock_guard<std::mutex> lock(m_mutex);
+    m_writer = false;
+    m_cond.notify_all();
+  }
+
+private:
+  std::mutex m_mutex;
+  std::condition_variable m_cond;
+  int m_readers = 0;
+  bool m_writer = false;
+};
+
+class SharedLock {
+public:
+  explicit SharedLock(SharedMutex& mutex) : m_mutex(mutex) {
+    m_mutex.lock_shared();
+  }
+  ~SharedLock() { m_mutex.unlock_shared(); }
+
+private:
+  SharedMutex& m_mutex;
+};
+
+Shard shards[SHARDS];
+/* the workers call into ocpn_draw concurrently, only replacing or dropping
+   its function waits for the calls in progress */
+SharedMutex od_mutex;
+
+std::atomic<size_t> memo_queries{0}, memo_hits{0};
+std::atomic<bool> memo_enabled{true};
+
+int32_t Quantize(double v) { return (int32_t)std::lround(v * QUANT); }
+
+}  // namespace
+
+bool BoundaryCache::EntersBoundary(double lat1, double lon1, double lat2,
+                                   double lon2) {
+  SharedLock od_lock(od_mutex);
+  if (!RouteMap::ODFindClosestBoundaryLineCrossing) return false;
+
+  lon1 = heading_resolve(lon1), lon2 = heading_resolve(lon2);
+  SegmentKey key = {Quantize(lat1), Quantize(lon1), Quantize(lat2),
+                    Quantize(lon2)};
+  Shard& shard = shards[SegmentKeyHash()(key) % SHARDS];
+  bool memo = memo_enabled.load(std::memory_order_relaxed);
+  if (memo) {
+    size_t queries = memo_queries.fetch_add(1) + 1;
+    std::lock_guard<std::mutex> lock(shard.mutex);
+    auto it = shard.results.find(key);
+    if (it != shard.results.end()) {
+      memo_hits.fetch_add(1);
+      return it->second;
+    }
+
+    // the propagation rarely tests a segment twice, skip the memo then
+    bool enabled = true;
+    if (queries >= MEMO_PROBE_QUERIES && memo_hits.load() < queries / 100 &&
+        memo_enabled.compare_exchange_strong(enabled, false))
+      wxLogMessage(
+          "WeatherRouting: boundary memo hit %zu of %zu queries, bypassed",
+          memo_hits.load(), queries);
+  }
+
+  struct FindClosestBoundaryLineCrossing_t t;
+  t.dStartLat = lat1, t.dStartLon = lon1;
+  t.dEndLat = lat2, t.dEndLon = lon2;
+  t.sBoundaryState = wxT("Active");
+
+  // we request any type
+  bool crosses = RouteMap::ODFindClosestBoundaryLineCrossing(&t);
+  if (!memo) return crosses;
+
+  std::lock_guard<std::mutex> lock(shard.mutex);
+  if (shard.results.size() >= MAX_CACHED_RESULTS) shard.results.clear();
+  shard.results[key] = crosses;
+  return crosses;
+}
+
+void BoundaryCache::SetCrossingFunction(
+    OD_FindClosestBoundaryLineCrossing function) {
+  std::lock_guard<SharedMutex> lock(od_mutex);
+  RouteMap::ODFindClosestBoundaryLineCrossing = function;
+  // results memoized from a previous ocpn_draw instance are stale
+  for (Shard& shard : shards) {
+    std::lock_guard<std::mutex> lock(shard.mutex);
+    shard.results.clear();
+  }
+}
+
+void BoundaryCache::Clear() {
+  for (Shard& shard : shards) {
+    std::lock_guard<std::mutex> lock(shard.mutex);
+    shard.results.clear();
+  }
+  memo_queries.store(0);
+  memo_hits.store(0);
+  memo_enabled.store(true);
+}
+
+void BoundaryCache::GetStats(size_t& queries, size_t& hits) {
+  queries = memo_queries.load();
+  hits = memo_hits.load();
+}
+
+size_t BoundaryCache::Size() {
+  size_t size = 0;
+  for (Shard& shard : shards) {
+    std::lock_guard<std::mutex> lock(shard.mutex);
+    size += shard.results.size();
+  }
+  return size;
+}
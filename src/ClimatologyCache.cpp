@@ -0,0 +1,392 @@
+/***************************************************************************
+ *   Copyright (C) 2015 by OpenCPN development team                        *
+ *                                                                         *
+ *   This program is free software; you can redistribute it and/or modify  *
+ *   it under the terms of the GNU General Public License as published by  *
+ *   the Free Software Foundation; either version 3 of the License, or     *
+ *   (at your option) any later version.                                   *
+ *                                                                         *
+ *   This program is distributed in the hope that it will be useful,       *
+ *   but WITHOUT ANY WARRANTY; without even the implied warranty of        *
+ *   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the         *
+ *   GNU General Public License for more details.                          *
+ *                                                                         *
+ *   You should have received a copy of the GNU General Public License     *
+ *   along with this program; if not, write to the                         *
+ *   Free Software Foundation, Inc.,                                       *
+ *   51 Franklin Street, Fifth Floor, Boston, MA 02110-1301,  USA.         *
+ **************************************************************************/
+
+#include <wx/wx.h>
+
+#include <cmath>
+#include <mutex>
+#include <unordered_map>
+
+#include "ClimatologyCache.h"
+#include "RouteMap.h"
+
+const double ClimatologyCache::DEFAULT_RESOLUTION = 0.25;
+
+namespace {
+
+/* each table is simply emptied when it grows past this many entries */
+const size_t MAX_CACHED_RESULTS = 200000;
+const int MAX_ATLAS_DIRECTIONS = 8;
+
+struct CellKey {
+  int setting;
+  int period;
+  int lat, lon;
+
+  bool operator==(const CellKey& other) const {
+    return setting == other.setting && period == other.period &&
+           lat == other.lat && lon == other.lon;
+  }
+};
+
+struct CellKeyHash {
+  size_t operator()(const CellKey& k) const {
+    size_t h = std::hash<int>()(k.lat);
+    h = h * 31 + std::hash<int>()(k.lon);
+    h = h * 31 + std::hash<int>()(k.period);
+    return h * 31 + std::hash<int>()(k.setting);
+  }
+};
+
+struct TrackKey {
+  int lat1, lon1, lat2, lon2;
+  int day, dayrange;
+
+  bool operator==(const TrackKey& other) const {
+    return lat1 == other.lat1 && lon1 == other.lon1 && lat2 == other.lat2 &&
+           lon2 == other.lon2 && day == other.day &&
+           dayrange == other.dayrange;
+  }
+};
+
+struct TrackKeyHash {
+  size_t operator()(const TrackKey& k) const {
+    size_t h = std::hash<int>()(k.lat1);
+    h = h * 31 + std::hash<int>()(k.lon1);
+    h = h * 31 + std::hash<int>()(k.lat2);
+    h = h * 31 + std::hash<int>()(k.lon2);
+    h = h * 31 + std::hash<int>()(k.day);
+    return h * 31 + std::hash<int>()(k.dayrange);
+  }
+};
+
+/* probe line of the cyclone mask, one cell long: horizontal lines at lat in
+   units of a probe spacing running east from lon in cells, vertical lines at
+   lon in units of a probe spacing running north from lat in cells */
+struct EdgeKey {
+  int lat, lon;
+  bool vertical;
+  int day, dayrange;
+
+  bool operator==(const EdgeKey& other) const {
+    return lat == other.lat && lon == other.lon &&
+           vertical == other.vertical && day == other.day &&
+           dayrange == other.dayrange;
+  }
+};
+
+struct EdgeKeyHash {
+  size_t operator()(const EdgeKey& k) const {
+    size_t h = std::hash<int>()(k.lat);
+    h = h * 31 + std::hash<int>()(k.lon);
+    h = h * 31 + std::hash<int>()(k.day);
+    h = h * 31 + std::hash<int>()(k.dayrange);
+    return h * 2 + k.vertical;
+  }
+};
+
+struct DataResult {
+  bool ok;
+  double dir, speed;
+};
+
+struct AtlasResult {
+  bool ok;
+  int count;
+  double directions[MAX_ATLAS_DIRECTIONS], speeds[MAX_ATLAS_DIRECTIONS];
+  double storm, calm;
+};
+
+std::unordered_map<CellKey, DataResult, CellKeyHash> data_cache;
+std::unordered_map<CellKey, AtlasResult, CellKeyHash> atlas_cache;
+std::unordered_map<TrackKey, int, TrackKeyHash> track_cache;
+/* cyclone mask, whether any track crosses each probe line of the 1 degree
+   cells */
+std::unordered_map<EdgeKey, bool, EdgeKeyHash> edge_cache;
+/* cyclone mask, whether each cell is free of tracks, keyed by day range as
+   the setting and day of year as the period */
+std::unordered_map<CellKey, bool, CellKeyHash> mask_cache;
+double cache_resolution = ClimatologyCache::DEFAULT_RESOLUTION;
+std::mutex climatology_cache_mutex;
+
+int Quantize(double v, double resolution) {
+  return (int)floor(v / resolution);
+}
+
+double CellCenter(int q, double resolution) { return (q + 0.5) * resolution; }
+
+/* cells of the cyclone mask, the resolution of the climatology data */
+const double MASK_RESOLUTION = 1.0;
+/* larger segments are always checked exactly */
+const int MAX_MASK_CELLS = 16;
+/* probe lines per cell and direction, edges included: a track segment lying
+   within a cell still crosses one unless it is shorter than the diagonal of
+   the probe spacing, about 20 km, less than 6 hours of the slowest cyclone */
+const int MASK_PROBES = 8;
+
+/* the climatology is queried at a fixed date within the memoized period so the
+   cached result does not depend on which query came first */
+wxDateTime MidMonth(const wxDateTime& date) {
+  return wxDateTime(15, date.GetMonth(wxDateTime::UTC),
+                    date.GetYear(wxDateTime::UTC), 12)
+      .FromTimezone(wxDateTime::UTC);
+}
+
+wxDateTime MidDay(const wxDateTime& date) {
+  wxDateTime::Tm tm = date.GetTm(wxDateTime::UTC);
+  return wxDateTime(tm.mday, tm.mon, tm.year, 12)
+      .FromTimezone(wxDateTime::UTC);
+}
+
+/* true if a cyclone track crosses the probe line, querying the plugin on a
+   miss */
+bool EdgeCrossed(const EdgeKey& key, const wxDateTime& date) {
+  {
+    std::lock_guard<std::mutex> lock(climatology_cache_mutex);
+    auto it = edge_cache.find(key);
+    if (it != edge_cache.end()) return it->second;
+  }
+
+  double spacing = MASK_RESOLUTION / MASK_PROBES;
+  double lat = key.vertical ? key.lat * MASK_RESOLUTION : key.lat * spacing;
+  double lon = key.vertical ? key.lon * spacing : key.lon * MASK_RESOLUTION;
+  bool crossed = RouteMap::ClimatologyCycloneTrackCrossings(
+                     lat, lon, key.vertical ? lat + MASK_RESOLUTION : lat,
+                     key.vertical ? lon : lon + MASK_RESOLUTION, date,
+                     key.dayrange) != 0;
+
+  std::lock_guard<std::mutex> lock(climatology_cache_mutex);
+  if (edge_cache.size() >= MAX_CACHED_RESULTS) edge_cache.clear();
+  edge_cache[key] = crossed;
+  return crossed;
+}
+
+/* true if no cyclone track goes through the cell.  A track entering the cell
+   crosses one of its edges, which neighboring cells share, and a track lying
+   within the cell crosses one of the probe lines in between. */
+bool CellTrackFree(int lat, int lon, const wxDateTime& date, int dayrange) {
+  CellKey cell;
+  cell.setting = dayrange;
+  cell.period = date.GetDayOfYear(wxDateTime::UTC);
+  cell.lat = lat, cell.lon = lon;
+  {
+    std::lock_guard<std::mutex> lock(climatology_cache_mutex);
+    auto it = mask_cache.find(cell);
+    if (it != mask_cache.end()) return it->second;
+  }
+
+  wxDateTime day = MidDay(date);
+  EdgeKey key;
+  key.day = cell.period;
+  key.dayrange = dayrange;
+  bool track_free = true;
+  for (int k = 0; track_free && k <= MASK_PROBES; k++) {
+    key.vertical = false;
+    key.lat = lat * MASK_PROBES + k, key.lon = lon;
+    if (EdgeCrossed(key, day)) track_free = false;
+    key.vertical = true;
+    key.lat = lat, key.lon = lon * MASK_PROBES + k;
+    if (track_free && EdgeCrossed(key, day)) track_free = false;
+  }
+
+  std::lock_guard<std::mutex> lock(climatology_cache_mutex);
+  if (mask_cache.size() >= MAX_CACHED_RESULTS) mask_cache.clear();
+  mask_cache[cell] = track_free;
+  return track_free;
+}
+
+/* true if no cyclone track goes through the cells the segment lies in */
+bool TrackFree(double lat1, double lon1, double lat2, double lon2,
+               const wxDateTime& date, int dayrange) {
+  int lat_min = Quantize(wxMin(lat1, lat2), MASK_RESOLUTION);
+  int lat_max = Quantize(wxMax(lat1, lat2), MASK_RESOLUTION);
+  int lon_min = Quantize(wxMin(lon1, lon2), MASK_RESOLUTION);
+  int lon_max = Quantize(wxMax(lon1, lon2), MASK_RESOLUTION);
+  if ((lat_max - lat_min + 1) * (lon_max - lon_min + 1) > MAX_MASK_CELLS)
+    return false;
+
+  for (int lat = lat_min; lat <= lat_max; lat++)
+    for (int lon = lon_min; lon <= lon_max; lon++)
+      if (!CellTrackFree(lat, lon, date, dayrange)) return false;
+  return true;
+}
+
+}  // namespace
+
+bool ClimatologyCache::Data(int setting, const wxDateTime& date, double lat,
+                            double lon, double& dir, double& speed) {
+  if (!RouteMap::ClimatologyData) return false;
+
+  double resolution;
+  CellKey key;
+  {
+    std::lock_guard<std::mutex> lock(climatology_cache_mutex);
+    resolution = cache_resolution;
+    key.setting = setting;
+    key.period = date.GetMonth(wxDateTime::UTC);
+    key.lat = Quantize(lat, resolution);
+    key.lon = Quantize(lon, resolution);
+
+    auto it = data_cache.find(key);
+    if (it != data_cache.end()) {
+      dir = it->second.dir, speed = it->second.speed;
+      return it->second.ok;
+    }
+  }
+
+  // query the plugin outside of the lock, other threads keep using the cache
+  DataResult result;
+  result.dir = result.speed = 0;
+  result.ok = RouteMap::ClimatologyData(
+      setting, MidMonth(date), CellCenter(key.lat, resolution),
+      CellCenter(key.lon, resolution), result.dir, result.speed);
+
+  {
+    std::lock_guard<std::mutex> lock(climatology_cache_mutex);
+    if (resolution == cache_resolution) {
+      if (data_cache.size() >= MAX_CACHED_RESULTS) data_cache.clear();
+      data_cache[key] = result;
+    }
+  }
+
+  dir = result.dir, speed = result.speed;
+  return result.ok;
+}
+
+bool ClimatologyCache::WindAtlasData(const wxDateTime& date, double lat,
+                                     double lon, int& count,
+                                     double* directions, double* speeds,
+                                     double& storm, double& calm) {
+  if (!RouteMap::ClimatologyWindAtlasData) return false;
+  if (count > MAX_ATLAS_DIRECTIONS) count = MAX_ATLAS_DIRECTIONS;
+
+  double resolution;
+  CellKey key;
+  AtlasResult result;
+  {
+    std::lock_guard<std::mutex> lock(climatology_cache_mutex);
+    resolution = cache_resolution;
+    key.setting = count;
+    key.period = date.GetMonth(wxDateTime::UTC);
+    key.lat = Quantize(lat, resolution);
+    key.lon = Quantize(lon, resolution);
+
+    auto it = atlas_cache.find(key);
+    if (it != atlas_cache.end())
+      result = it->second;
+    else
+      result.count = -1;
+  }
+
+  if (result.count < 0) {
+    result.count = count;
+    result.storm = result.calm = 0;
+    result.ok = RouteMap::ClimatologyWindAtlasData(
+        MidMonth(date), CellCenter(key.lat, resolution),
+        CellCenter(key.lon, resolution), result.count, result.directions,
+        result.speeds, result.storm, result.calm);
+    if (result.count > MAX_ATLAS_DIRECTIONS)
+      result.count = MAX_ATLAS_DIRECTIONS;
+
+    std::lock_guard<std::mutex> lock(climatology_cache_mutex);
+    if (resolution == cache_resolution) {
+      if (atlas_cache.size() >= MAX_CACHED_RESULTS) atlas_cache.clear();
+      atlas_cache[key] = result;
+    }
+  }
+
+  if (result.ok) {
+    count = result.count;
+    for (int i = 0; i < count; i++) {
+      directions[i] = result.directions[i];
+      speeds[i] = result.speeds[i];
+    }
+    storm = result.storm, calm = result.calm;
+  }
+  return result.ok;
+}
+
+int ClimatologyCache::CycloneTrackCrossings(double lat1, double lon1,
+                                            double lat2, double lon2,
+                                            const wxDateTime& date,
+                                            int dayrange) {
+  if (!RouteMap::ClimatologyCycloneTrackCrossings) return -1;
+
+  // no track can be crossed away from every track
+  if (TrackFree(lat1, lon1, lat2, lon2, date, dayrange)) return 0;
+
+  double resolution = GetResolution();
+  // a segment inside a single cell would snap to a point, never cache it
+  if (Quantize(lat1, resolution) == Quantize(lat2, resolution) &&
+      Quantize(lon1, resolution) == Quantize(lon2, resolution))
+    return RouteMap::ClimatologyCycloneTrackCrossings(lat1, lon1, lat2, lon2,
+                                                      date, dayrange);
+
+  TrackKey key;
+  {
+    std::lock_guard<std::mutex> lock(climatology_cache_mutex);
+    resolution = cache_resolution;
+    key.lat1 = Quantize(lat1, resolution);
+    key.lon1 = Quantize(lon1, resolution);
+    key.lat2 = Quantize(lat2, resolution);
+    key.lon2 = Quantize(lon2, resolution);
+    key.day = date.GetDayOfYear(wxDateTime::UTC);
+    key.dayrange = dayrange;
+
+    auto it = track_cache.find(key);
+    if (it != track_cache.end()) return it->second;
+  }
+
+  int crossings = RouteMap::ClimatologyCycloneTrackCrossings(
+      CellCenter(key.lat1, resolution), CellCenter(key.lon1, resolution),
+      CellCenter(key.lat2, resolution), CellCenter(key.lon2, resolution),
+      MidDay(date), dayrange);
+
+  std::lock_guard<std::mutex> lock(climatology_cache_mutex);
+  if (resolution == cache_resolution) {
+    if (track_cache.size() >= MAX_CACHED_RESULTS) track_cache.clear();
+    track_cache[key] = crossings;
+  }
+  return crossings;
+}
+
+void ClimatologyCache::SetResolution(double degrees) {
+  if (!(degrees > 0)) degrees = DEFAULT_RESOLUTION;
+
+  std::lock_guard<std::mutex> lock(climatology_cache_mutex);
+  if (degrees == cache_resolution) return;
+  cache_resolution = degrees;
+  data_cache.clear();
+  atlas_cache.clear();
+  track_cache.clear();
+}
+
+double ClimatologyCache::GetResolution() {
+  std::lock_guard<std::mutex> lock(climatology_cache_mutex);
+  return cache_resolution;
+}
+
+void ClimatologyCache::Clear() {
+  std::lock_guard<std::mutex> lock(climatology_cache_mutex);
+  data_cache.clear();
+  atlas_cache.clear();
+  track_cache.clear();
+  edge_cache.clear();
+  mask_cache.clear();
+}
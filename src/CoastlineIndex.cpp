@@ -0,0 +1,365 @@
+/***************************************************************************
+ *   Copyright (C) 2015 by OpenCPN development team                        *
+ *                                                                         *
+ *   This program is free software; you can redistribute it and/or modify  *
+ *   it under the terms of the GNU General Public License as published by  *
+ *   the Free Software Foundation; either version 3 of the License, or     *
+ *   (at your option) any later version.                                   *
+ *                                                                         *
+ *   This program is distributed in the hope that it will be useful,       *
+ *   but WITHOUT ANY WARRANTY; without even the implied warranty of        *
+ *   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the         *
+ *   GNU General Public License for more details.                          *
+ *                                                                         *
+ *   You should have received a copy of the GNU General Public License     *
+ *   along with this program; if not, write to the                         *
+ *   Free Software Foundation, Inc.,                                       *
+ *   51 Franklin Street, Fifth Floor, Boston, MA 02110-1301,  USA.         *
+ **************************************************************************/
+
+#include <wx/wx.h>
+#include <wx/filename.h>
+
+#include <atomic>
+#include <cmath>
+#include <cstdint>
+#include <cstdio>
+#include <memory>
+#include <mutex>
+#include <vector>
+
+#include "CoastlineIndex.h"
+
+namespace {
+
+/* header of the OpenCPN GSHHS polygon files, followed by the file offset of
+   every cell, and the polygons of every cell for each of the 5 levels */
+struct PolygonFileHeader {
+  int32_t version;
+  int32_t pasx, pasy;
+  int32_t xmin, ymin, xmax, ymax;
+  int32_t p1, p2, p3, p4, p5;
+};
+
+/* vertices are stored in micro-degrees, longitudes from 0 to 360 */
+const double POLY_SCALE = 1.0e-6;
+/* resolutions in order of preference: full, high, intermediate, low, crude */
+const char POLY_QUALITIES[] = "fhilc";
+/* sanity limits, a corrupt file would otherwise allocate anything */
+const int32_t MAX_CONTOURS = 1 << 20;
+const int32_t MAX_VERTICES = 1 << 24;
+
+/* side of the grid of sub-cells in a 1 degree cell */
+const int SUB_CELLS = 16;
+
+struct Edge {
+  double x1, y1, x2, y2;
+};
+
+struct Cell {
+  /* open water, no coastline in the cell */
+  bool water = true;
+  std::vector<Edge> edges;
+  /* edges of sub-cell i are bucket_edges[bucket_start[i]..bucket_start[i+1]] */
+  std::vector<uint32_t> bucket_start;
+  std::vector<uint32_t> bucket_edges;
+};
+
+FILE* poly_file;
+PolygonFileHeader poly_header;
+/* identity of the open file, to notice it was replaced */
+wxString poly_path;
+wxDateTime poly_time;
+std::atomic<bool> index_open{false};
+/* cells are published once loaded and never change until Close() */
+std::atomic<const Cell*> cells[360][180];
+std::vector<std::unique_ptr<Cell>> loaded_cells;
+const Cell water_cell;
+/* guards the file and loaded_cells */
+std::mutex coastline_mutex;
+
+int SubCell(double v, int origin) {
+  int i = (int)floor((v - origin) * SUB_CELLS);
+  return i < 0 ? 0 : i >= SUB_CELLS ? SUB_CELLS - 1 : i;
+}
+
+/* same test as OpenCPN uses for the coastline, Graphics Gems III "Faster Line
+   Segment Intersection" */
+bool Intersects(double x1, double y1, double x2, double y2, const Edge& e) {
+  double ax = x2 - x1, ay = y2 - y1;
+  double bx = e.x1 - e.x2, by = e.y1 - e.y2;
+  double cx = x1 - e.x1, cy = y1 - e.y1;
+
+  double denominator = ay * bx - ax * by;
+  if (denominator == 0) return false;
+  double reciprocal = 1 / denominator;
+  double na = (by * cx - bx * cy) * reciprocal;
+  if (na < 0 || na > 1) return false;
+  double nb = (ax * cy - ay * cx) * reciprocal;
+  return nb >= 0 && nb <= 1;
+}
+
+/* reads the first level (land) polygons of a cell, with the file locked */
+bool ReadCellEdges(int x, int y, std::vector<Edge>& edges) {
+  int tab = (x / poly_header.pasx) * (180 / poly_header.pasy) +
+            (y + 90) / poly_header.pasy;
+  int32_t pos, num_contours;
+  if (fseek(poly_file, sizeof poly_header + tab * sizeof pos, SEEK_SET) ||
+      fread(&pos, sizeof pos, 1, poly_file) != 1 ||
+      fseek(poly_file, pos, SEEK_SET) ||
+      fread(&num_contours, sizeof num_contours, 1, poly_file) != 1 ||
+      num_contours < 0 || num_contours > MAX_CONTOURS)
+    return false;
+
+  std::vector<double> vertices;
+  for (int c = 0; c < num_contours; c++) {
+    int32_t hole, num_vertices;
+    if (fread(&hole, sizeof hole, 1, poly_file) != 1 ||
+        fread(&num_vertices, sizeof num_vertices, 1, poly_file) != 1 ||
+        num_vertices < 0 || num_vertices > MAX_VERTICES)
+      return false;
+    if (num_vertices == 0) continue;
+
+    vertices.resize(2 * num_vertices);
+    if (fread(vertices.data(), sizeof(double), vertices.size(), poly_file) !=
+        vertices.size())
+      return false;
+
+    // closed contour, from the last vertex back to the first
+    double lx = vertices[2 * num_vertices - 2] * POLY_SCALE;
+    double ly = vertices[2 * num_vertices - 1] * POLY_SCALE;
+    for (int v = 0; v < num_vertices; v++) {
+      double vx = vertices[2 * v] * POLY_SCALE;
+      double vy = vertices[2 * v + 1] * POLY_SCALE;
+      edges.push_back(Edge{lx, ly, vx, vy});
+      lx = vx, ly = vy;
+    }
+  }
+  return true;
+}
+
+/* loads a cell, with the file locked */
+const Cell* LoadCell(int x, int y) {
+  std::unique_ptr<Cell> cell(new Cell);
+  if (!ReadCellEdges(x, y, cell->edges)) {
+    wxLogMessage("WeatherRouting: failed reading coastline cell %d %d", x, y);
+    cell->edges.clear();
+  }
+  if (cell->edges.empty()) return &water_cell;
+
+  cell->water = false;
+  // bucket the edges by the sub-cells their bounding box overlaps
+  std::vector<uint32_t> counts(SUB_CELLS * SUB_CELLS + 1, 0);
+  for (int pass = 0; pass < 2; pass++) {
+    for (uint32_t i = 0; i < cell->edges.size(); i++) {
+      const Edge& e = cell->edges[i];
+      int sx1 = SubCell(wxMin(e.x1, e.x2), x);
+      int sx2 = SubCell(wxMax(e.x1, e.x2), x);
+      int sy1 = SubCell(wxMin(e.y1, e.y2), y);
+      int sy2 = SubCell(wxMax(e.y1, e.y2), y);
+      for (int sy = sy1; sy <= sy2; sy++)
+        for (int sx = sx1; sx <= sx2; sx++) {
+          int b = sy * SUB_CELLS + sx;
+          if (pass == 0)
+            counts[b + 1]++;
+          else
+            cell->bucket_edges[counts[b]++] = i;
+        }
+    }
+    if (pass == 0) {
+      for (size_t b = 1; b < counts.size(); b++) counts[b] += counts[b - 1];
+      cell->bucket_start = counts;
+      cell->bucket_edges.resize(counts.back());
+    }
+  }
+
+  loaded_cells.push_back(std::move(cell));
+  return loaded_cells.back().get();
+}
+
+const Cell* GetCell(int x, int y) {
+  std::atomic<const Cell*>& slot = cells[x][y + 90];
+  const Cell* cell = slot.load(std::memory_order_acquire);
+  if (cell) return cell;
+
+  std::lock_guard<std::mutex> lock(coastline_mutex);
+  cell = slot.load(std::memory_order_relaxed);
+  if (!cell) {
+    cell = LoadCell(x, y);
+    slot.store(cell, std::memory_order_release);
+  }
+  return cell;
+}
+
+bool CellCrossesLand(const Cell& cell, int cx, int cy, double x1, double y1,
+                     double x2, double y2) {
+  int sx1 = SubCell(wxMin(x1, x2), cx), sx2 = SubCell(wxMax(x1, x2), cx);
+  int sy1 = SubCell(wxMin(y1, y2), cy), sy2 = SubCell(wxMax(y1, y2), cy);
+  for (int sy = sy1; sy <= sy2; sy++)
+    for (int sx = sx1; sx <= sx2; sx++) {
+      int b = sy * SUB_CELLS + sx;
+      for (uint32_t i = cell.bucket_start[b]; i < cell.bucket_start[b + 1];
+           i++)
+        if (Intersects(x1, y1, x2, y2, cell.edges[cell.bucket_edges[i]]))
+          return true;
+    }
+  return false;
+}
+
+bool CellHasCoastline(const Cell& cell, int cx, int cy, double x1, double y1,
+                      double x2, double y2) {
+  int sx1 = SubCell(x1, cx), sx2 = SubCell(x2, cx);
+  int sy1 = SubCell(y1, cy), sy2 = SubCell(y2, cy);
+  for (int sy = sy1; sy <= sy2; sy++)
+    for (int sx = sx1; sx <= sx2; sx++) {
+      int b = sy * SUB_CELLS + sx;
+      for (uint32_t i = cell.bucket_start[b]; i < cell.bucket_start[b + 1];
+           i++) {
+        // the bounding boxes overlap, close enough for short coastline edges
+        const Edge& e = cell.edges[cell.bucket_edges[i]];
+        if (wxMax(e.x1, e.x2) >= x1 && wxMin(e.x1, e.x2) <= x2 &&
+            wxMax(e.y1, e.y2) >= y1 && wxMin(e.y1, e.y2) <= y2)
+          return true;
+      }
+    }
+  return false;
+}
+
+/* opens the best quality polygon file with a supported header found in the
+   directories, or returns nullptr */
+FILE* OpenPolygonFile(const wxArrayString& directories,
+                      PolygonFileHeader& header, wxFileName& fn) {
+  for (const char* quality = POLY_QUALITIES; *quality; quality++)
+    for (const wxString& directory : directories) {
+      fn = wxFileName(directory, wxString::Format("poly-%c-1.dat", *quality));
+      if (!fn.FileExists()) continue;
+
+      FILE* f = fopen(fn.GetFullPath().mb_str(), "rb");
+      if (!f) continue;
+      if (fread(&header, sizeof header, 1, f) != 1 || header.pasx != 1 ||
+          header.pasy != 1) {
+        wxLogMessage("WeatherRouting: unsupported coastline file %s",
+                     fn.GetFullPath());
+        fclose(f);
+        continue;
+      }
+      return f;
+    }
+  return nullptr;
+}
+
+}  // namespace
+
+bool CoastlineIndex::Open(const wxArrayString& directories) {
+  std::lock_guard<std::mutex> lock(coastline_mutex);
+  if (index_open) return true;
+
+  wxFileName fn;
+  FILE* f = OpenPolygonFile(directories, poly_header, fn);
+  if (!f) return false;
+
+  poly_file = f;
+  poly_path = fn.GetFullPath();
+  poly_time = fn.GetModificationTime();
+  index_open = true;
+  wxLogMessage("WeatherRouting: coastline index using %s", poly_path);
+  return true;
+}
+
+bool CoastlineIndex::IsCurrent(const wxArrayString& directories) {
+  std::lock_guard<std::mutex> lock(coastline_mutex);
+  if (!index_open) return false;
+
+  PolygonFileHeader header;
+  wxFileName fn;
+  FILE* f = OpenPolygonFile(directories, header, fn);
+  if (!f) return false;
+  fclose(f);
+  return fn.GetFullPath() == poly_path &&
+         fn.GetModificationTime() == poly_time;
+}
+
+wxString CoastlineIndex::Source(const wxArrayString& directories) {
+  PolygonFileHeader header;
+  wxFileName fn;
+  FILE* f = OpenPolygonFile(directories, header, fn);
+  if (!f) return wxEmptyString;
+  fclose(f);
+  return fn.GetFullPath() + " " +
+         fn.GetModificationTime().FormatISOCombined(' ');
+}
+
+void CoastlineIndex::Close() {
+  std::lock_guard<std::mutex> lock(coastline_mutex);
+  index_open = false;
+  for (auto& column : cells)
+    for (auto& cell : column) cell.store(nullptr);
+  loaded_cells.clear();
+  if (poly_file) fclose(poly_file);
+  poly_file = nullptr;
+  poly_path.clear();
+}
+
+bool CoastlineIndex::IsOpen() { return index_open; }
+
+bool CoastlineIndex::CrossesLand(double lat1, double lon1, double lat2,
+                                 double lon2) {
+  // longitudes from 0 to 360 like the polygons, the short way around
+  double x1 = fmod(lon1, 360), x2 = fmod(lon2, 360);
+  if (x1 < 0) x1 += 360;
+  if (x2 < 0) x2 += 360;
+  if (x2 - x1 > 180)
+    x1 += 360;
+  else if (x1 - x2 > 180)
+    x2 += 360;
+
+  int cxmin = (int)floor(wxMin(x1, x2)), cxmax = (int)ceil(wxMax(x1, x2));
+  int cymin = (int)floor(wxMin(lat1, lat2));
+  int cymax = (int)ceil(wxMax(lat1, lat2));
+  if (cymin < -90) cymin = -90;
+  if (cymax > 90) cymax = 90;
+
+  for (int cx = cxmin; cx < cxmax; cx++) {
+    int x = cx % 360;
+    // the segment in the coordinates of this cell
+    double offset = cx - x;
+    for (int cy = cymin; cy < cymax; cy++) {
+      const Cell* cell = GetCell(x, cy);
+      if (!cell->water && CellCrossesLand(*cell, x, cy, x1 - offset, lat1,
+                                          x2 - offset, lat2))
+        return true;
+    }
+  }
+  return false;
+}
+
+bool CoastlineIndex::HasCoastline(double lat1, double lon1, double lat2,
+                                  double lon2) {
+  // grown a little so edges lying on the sides are inside despite rounding
+  const double epsilon = 1e-9;
+  double x1 = fmod(lon1, 360);
+  if (x1 < 0) x1 += 360;
+  double x2 = x1 + (lon2 - lon1) + epsilon;
+  x1 -= epsilon;
+  double y1 = lat1 - epsilon, y2 = lat2 + epsilon;
+
+  int cxmin = (int)floor(x1), cxmax = (int)floor(x2);
+  int cymin = wxMax((int)floor(y1), -90), cymax = wxMin((int)floor(y2), 89);
+  for (int cx = cxmin; cx <= cxmax; cx++) {
+    int x = (cx % 360 + 360) % 360;
+    // the box in the coordinates of this cell
+    double offset = cx - x;
+    for (int cy = cymin; cy <= cymax; cy++) {
+      const Cell* cell = GetCell(x, cy);
+      if (!cell->water &&
+          CellHasCoastline(*cell, x, cy, x1 - offset, y1, x2 - offset, y2))
+        return true;
+    }
+  }
+  return false;
+}
+
+size_t CoastlineIndex::LoadedCells() {
+  std::lock_guard<std::mutex> lock(coastline_mutex);
+  return loaded_cells.size();
+}
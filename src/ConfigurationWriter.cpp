@@ -0,0 +1,132 @@
+/***************************************************************************
+ *   Copyright (C) 2015 by OpenCPN development team                        *
+ *                                                                         *
+ *   This program is free software; you can redistribute it and/or modify  *
+ *   it under the terms of the GNU General Public License as published by  *
+ *   the Free Software Foundation; either version 3 of the License, or     *
+ *   (at your option) any later version.                                   *
+ *                                                                         *
+ *   This program is distributed in the hope that it will be useful,       *
+ *   but WITHOUT ANY WARRANTY; without even the implied warranty of        *
+ *   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the         *
+ *   GNU General Public License for more details.                          *
+ *                                                                         *
+ *   You should have received a copy of the GNU General Public License     *
+ *   along with this program; if not, write to the                         *
+ *   Free Software Foundation, Inc.,                                       *
+ *   51 Franklin Street, Fifth Floor, Boston, MA 02110-1301,  USA.         *
+ **************************************************************************/
+
+#include <wx/wx.h>
+#include <wx/file.h>
+
+#include "tinyxml.h"
+
+#include "ConfigurationWriter.h"
+#include "Utilities.h"
+
+class ConfigurationWriterThread : public wxThread {
+public:
+  ConfigurationWriterThread(ConfigurationWriter& writer)
+      : wxThread(wxTHREAD_JOINABLE), m_Writer(writer) {
+    Create();
+  }
+
+  void* Entry() {
+    for (;;) {
+      ConfigurationWriter::Document document;
+      {
+        wxMutexLocker lock(m_Writer.m_Mutex);
+        if (!m_Writer.m_bPending) {
+          m_Writer.m_bWriting = false;
+          return 0;
+        }
+        document = m_Writer.m_Pending;
+        m_Writer.m_Pending = ConfigurationWriter::Document();
+        m_Writer.m_bPending = false;
+      }
+
+      bool ok = ConfigurationWriter::Write(document);
+      if (!ok)
+        wxLogWarning("WeatherRouting: failed to save %s", document.filename);
+
+      wxMutexLocker lock(m_Writer.m_Mutex);
+      m_Writer.m_bFailed = !ok;
+    }
+  }
+
+private:
+  ConfigurationWriter& m_Writer;
+};
+
+ConfigurationWriter::ConfigurationWriter()
+    : m_bPending(false), m_bWriting(false), m_bFailed(false), m_Thread(NULL) {}
+
+ConfigurationWriter::~ConfigurationWriter() { Join(); }
+
+void ConfigurationWriter::Save(const Document& document) {
+  {
+    wxMutexLocker lock(m_Mutex);
+    m_Pending = document;
+    m_bPending = true;
+    if (m_bWriting) return; /* picked up by the running thread */
+    m_bWriting = true;
+  }
+
+  Join();
+  m_Thread = new ConfigurationWriterThread(*this);
+  if (m_Thread->Run() != wxTHREAD_NO_ERROR) {
+    delete m_Thread;
+    m_Thread = NULL;
+
+    /* write synchronously rather than lose the document */
+    wxMutexLocker lock(m_Mutex);
+    m_bFailed = !Write(m_Pending);
+    m_Pending = Document();
+    m_bPending = m_bWriting = false;
+  }
+}
+
+bool ConfigurationWriter::Flush() {
+  Join();
+  wxMutexLocker lock(m_Mutex);
+  return !m_bFailed;
+}
+
+void ConfigurationWriter::Join() {
+  if (!m_Thread) return;
+  m_Thread->Wait();
+  delete m_Thread;
+  m_Thread = NULL;
+}
+
+ConfigurationWriter::Element ConfigurationWriter::Format(
+    const TiXmlElement& element) {
+  TiXmlPrinter printer;
+  printer.SetIndent("    ");
+  element.Accept(&printer);
+  /* children of the root element */
+  return std::make_shared<const std::string>("    " + printer.Str());
+}
+
+bool ConfigurationWriter::Write(const Document& document) {
+  std::string data = "<?xml version=\"1.0\" encoding=\"utf-8\" ?>\n";
+  data += "<OpenCPNWeatherRoutingConfiguration version=\"" + document.version +
+          "\" creator=\"Opencpn Weather Routing plugin\">\n";
+  for (size_t i = 0; i < document.elements.size(); i++)
+    data += *document.elements[i];
+  data += "</OpenCPNWeatherRoutingConfiguration>\n";
+
+  /* never leave a partially written configuration file behind */
+  wxString tmp = document.filename + ".tmp";
+  wxFile file;
+  if (!file.Create(tmp, true)) return false;
+  bool ok = file.Write(data.data(), data.size()) == data.size();
+  ok = file.Close() && ok;
+
+  if (!ok || !replace_file(tmp, document.filename)) {
+    wxRemoveFile(tmp);
+    return false;
+  }
+  return true;
+}
@@ -23,12 +23,16 @@
 #include <unordered_map>
 #include <cmath>
 #include <cstdint>
-#include <chrono>
 #include <vector>
 #include <algorithm>
 #include <mutex>
 #include <atomic>
+#include <chrono>
+#include <memory>
 
+#include "BoundaryCache.h"
+#include "ClimatologyCache.h"
+#include "CoastlineIndex.h"
 #include "ConstraintChecker.h"
 #include "WeatherDataProvider.h"
 #include "RouteMap.h"
@@ -41,91 +45,174 @@
 constexpr double QUANT = 1e5;
 
 /**
- * Thread-safe segment cache with size limit.
+ * Thread-safe segment cache with a bounded memory budget.
  *
- * All cache operations are protected by land_cache_mutex to ensure thread
- * safety during concurrent isochron propagations. Statistics counters use
+ * Segments are spread over LAND_CACHE_SHARDS shards by hash, each protected by
+ * its own mutex, so concurrent isochron propagations rarely wait on each
+ * other.  Each shard owns a fixed number of slots.  Once a shard is full, new
+ * segments replace entries chosen by CLOCK eviction: the hand sweeps the
+ * slots, clearing the reference bit of entries used since its last pass and
+ * evicting the first entry that was not.  Statistics counters use
  * std::atomic for lock-free updates.
  */
-struct SegmentCacheEntry {
-  bool crosses_land;
-  std::chrono::steady_clock::time_point last_used;
-
-  SegmentCacheEntry()
-      : crosses_land(false), last_used(std::chrono::steady_clock::now()) {}
-
-  SegmentCacheEntry(bool crosses)
-      : crosses_land(crosses), last_used(std::chrono::steady_clock::now()) {}
-};
+struct SegmentKey {
+  int32_t la1, lo1, la2, lo2;
 
-constexpr size_t MAX_SEGMENT_CACHE_SIZE = 10000;
+  SegmentKey() : la1(0), lo1(0), la2(0), lo2(0) {}
 
-struct SegmentKey {
-  uint64_t packed;
   SegmentKey(double lat1, double lon1, double lat2, double lon2) {
-    int la1 = static_cast<int>(std::round(lat1 * QUANT));
-    int lo1 = static_cast<int>(std::round(lon1 * QUANT));
-    int la2 = static_cast<int>(std::round(lat2 * QUANT));
-    int lo2 = static_cast<int>(std::round(lon2 * QUANT));
+    la1 = static_cast<int32_t>(std::round(lat1 * QUANT));
+    lo1 = static_cast<int32_t>(std::round(lon1 * QUANT));
+    la2 = static_cast<int32_t>(std::round(lat2 * QUANT));
+    lo2 = static_cast<int32_t>(std::round(lon2 * QUANT));
     // Always store with smaller endpoint first for symmetry
     if (la1 > la2 || (la1 == la2 && lo1 > lo2)) {
       std::swap(la1, la2);
       std::swap(lo1, lo2);
     }
-    // Pack four 16-bit signed ints into a 64-bit value
-    packed =
-        (static_cast<uint64_t>(static_cast<uint32_t>(la1) & 0xFFFF) << 48) |
-        (static_cast<uint64_t>(static_cast<uint32_t>(lo1) & 0xFFFF) << 32) |
-        (static_cast<uint64_t>(static_cast<uint32_t>(la2) & 0xFFFF) << 16) |
-        (static_cast<uint64_t>(static_cast<uint32_t>(lo2) & 0xFFFF));
   }
-  bool operator==(const SegmentKey& o) const { return packed == o.packed; }
+  bool operator==(const SegmentKey& o) const {
+    return la1 == o.la1 && lo1 == o.lo1 && la2 == o.la2 && lo2 == o.lo2;
+  }
 };
 
 template <>
 struct std::hash<SegmentKey> {
   std::size_t operator()(const SegmentKey& k) const {
-    // Use std::hash for uint64_t
-    return std::hash<uint64_t>()(k.packed);
+    // mix both endpoints, the shard is picked from the high bits
+    uint64_t a = static_cast<uint64_t>(static_cast<uint32_t>(k.la1)) << 32 |
+                 static_cast<uint32_t>(k.lo1);
+    uint64_t b = static_cast<uint64_t>(static_cast<uint32_t>(k.la2)) << 32 |
+                 static_cast<uint32_t>(k.lo2);
+    uint64_t h = a ^ (b * 0x9E3779B97F4A7C15ULL);
+    // splitmix64 finalizer
+    h = (h ^ (h >> 30)) * 0xBF58476D1CE4E5B9ULL;
+    h = (h ^ (h >> 27)) * 0x94D049BB133111EBULL;
+    return static_cast<std::size_t>(h ^ (h >> 31));
   }
 };
 
-static std::unordered_map<SegmentKey, SegmentCacheEntry> land_cache;
-static std::mutex land_cache_mutex;
+struct SegmentCacheSlot {
+  SegmentKey key;
+  bool crosses_land;
+  bool referenced;  // used since the clock hand last passed
+};
+
+struct SegmentCacheShard {
+  std::mutex mutex;
+  std::unordered_map<SegmentKey, uint32_t> index;  // slot of each segment
+  std::vector<SegmentCacheSlot> slots;
+  size_t hand = 0;
+};
+
+constexpr size_t LAND_CACHE_SHARDS = 16;
+constexpr size_t LAND_CACHE_BUDGET = 16 * 1024 * 1024;  // bytes
+// a slot, plus the hash map node and its bucket
+constexpr size_t SEGMENT_CACHE_ENTRY_SIZE =
+    sizeof(SegmentCacheSlot) + sizeof(std::pair<const SegmentKey, uint32_t>) +
+    3 * sizeof(void*);
+constexpr size_t SEGMENT_CACHE_SHARD_SLOTS =
+    LAND_CACHE_BUDGET / SEGMENT_CACHE_ENTRY_SIZE / LAND_CACHE_SHARDS;
+
+static SegmentCacheShard land_cache[LAND_CACHE_SHARDS];
 
 static std::atomic<size_t> segment_cache_hits{0}, segment_cache_misses{0},
     segment_cache_queries{0};
 static std::atomic<size_t> df_hits{0}, df_misses{0}, df_queries{0},
     df_safe_water_optimizations{0};
 static std::atomic<size_t> segment_evictions{0}, distance_field_evictions{0};
-constexpr size_t LOG_INTERVAL = 1000;
-
-// LRU eviction for segment cache
-// Note: This function assumes the caller already holds land_cache_mutex
-void evict_oldest_segment_entries() {
-  if (land_cache.size() <= MAX_SEGMENT_CACHE_SIZE) return;
+// log the statistics every this many segment queries; the count is checked
+// once per isochrone, so a busy isochrone logs once even past several
+// intervals
+constexpr size_t LOG_INTERVAL = 100000;
 
-  std::vector<std::pair<SegmentKey, std::chrono::steady_clock::time_point>>
-      entries;
-  entries.reserve(land_cache.size());
+/**
+ * Lazily built land distance field, used to skip the SafetyMarginLand tests
+ * of segments far from the coast.
+ *
+ * The world is divided in square cells of 2^-level degrees, the level being
+ * picked per margin so that cells are no larger than the margin.  A cell is
+ * water when the coastline index proves it holds no coastline at all, its
+ * sides included, so an islet smaller than a cell still marks it as land.
+ * Each cell stores a signed distance to the coast in cells:
+ * - negative if the cell may hold coastline
+ * - d > 0 if every cell within d - 1 cells of it (Chebyshev distance) is water
+ * - 0 if not computed yet
+ *
+ * A water cell may lie inland, but a segment already checked not to cross
+ * land with no coastline in the square around it cannot have offset lines
+ * crossing land either.  Without the coastline index nothing is known about
+ * the cells, and the field is not used.
+ *
+ * Cells are stored in tiles allocated on demand, one set per level, so only
+ * the routing corridor is ever computed.  Tiles are spread over shards each
+ * with its own lock, so the workers rarely wait for one another, and a shard
+ * drops all its tiles at once when its share of the memory budget is used up.
+ */
+constexpr int DF_TILE_SIZE = 64;
+constexpr int DF_MAX_LEVEL = 8;    // cells of 1/256 degree
+constexpr int DF_MAX_RADIUS = 32;  // cells
+constexpr size_t DF_MAX_TILES = 4096;  // 16 MiB
+constexpr size_t DF_SHARDS = 16;
+constexpr size_t DF_MAX_SAMPLES = 1024;
+
+struct DistanceTileKey {
+  int level, ti, tj;
+  bool operator==(const DistanceTileKey& o) const {
+    return level == o.level && ti == o.ti && tj == o.tj;
+  }
+};
 
-  for (const auto& pair : land_cache) {
-    entries.emplace_back(pair.first, pair.second.last_used);
+template <>
+struct std::hash<DistanceTileKey> {
+  std::size_t operator()(const DistanceTileKey& k) const {
+    size_t h = std::hash<int>()(k.ti);
+    h = h * 31 + std::hash<int>()(k.tj);
+    return h * 31 + std::hash<int>()(k.level);
   }
+};
+
+struct DistanceTile {
+  int8_t distance[DF_TILE_SIZE * DF_TILE_SIZE] = {};
+};
+
+struct DistanceFieldShard {
+  std::mutex mutex;
+  std::unordered_map<DistanceTileKey, std::unique_ptr<DistanceTile>> tiles;
+};
+
+static DistanceFieldShard distance_field[DF_SHARDS];
+
+static SegmentCacheShard& land_cache_shard(const SegmentKey& key) {
+  return land_cache[(std::hash<SegmentKey>()(key) >> 32) % LAND_CACHE_SHARDS];
+}
 
-  // Sort by last_used time (oldest first)
-  std::sort(
-      entries.begin(), entries.end(),
-      [](const std::pair<SegmentKey, std::chrono::steady_clock::time_point>& a,
-         const std::pair<SegmentKey, std::chrono::steady_clock::time_point>&
-             b) { return a.second < b.second; });
-
-  // Remove oldest 20% of entries
-  size_t to_remove = land_cache.size() - MAX_SEGMENT_CACHE_SIZE * 0.8;
-  for (size_t i = 0; i < to_remove && i < entries.size(); ++i) {
-    land_cache.erase(entries[i].first);
+// Note: This function assumes the caller holds the shard mutex
+static void insert_segment(SegmentCacheShard& shard, const SegmentKey& key,
+                           bool crosses_land) {
+  if (shard.index.find(key) != shard.index.end())
+    return;  // inserted by another thread meanwhile
+
+  uint32_t slot;
+  if (shard.slots.size() < SEGMENT_CACHE_SHARD_SLOTS) {
+    slot = static_cast<uint32_t>(shard.slots.size());
+    shard.slots.emplace_back();
+  } else {
+    // CLOCK: give entries used since the last sweep a second chance
+    while (shard.slots[shard.hand].referenced) {
+      shard.slots[shard.hand].referenced = false;
+      shard.hand = (shard.hand + 1) % shard.slots.size();
+    }
+    slot = shard.hand;
+    shard.hand = (shard.hand + 1) % shard.slots.size();
+    shard.index.erase(shard.slots[slot].key);
+    segment_evictions.fetch_add(1);
   }
-  segment_evictions.fetch_add(to_remove);
+
+  shard.slots[slot].key = key;
+  shard.slots[slot].crosses_land = crosses_land;
+  shard.slots[slot].referenced = false;
+  shard.index.emplace(key, slot);
 }
 
 void log_cache_stats() {
@@ -136,31 +223,46 @@ void log_cache_stats() {
 
   double segment_hit_rate = queries ? (double)hits / queries : 0.0;
 
-  // Note: land_cache.size() must be called under mutex protection
-  std::lock_guard<std::mutex> lock(land_cache_mutex);
+  // Note: the shard sizes must be read under their mutex
+  size_t size = 0;
+  for (SegmentCacheShard& shard : land_cache) {
+    std::lock_guard<std::mutex> lock(shard.mutex);
+    size += shard.index.size();
+  }
   wxLogMessage(
       "WeatherRouting Segment cache: queries=%zu, hits=%zu, misses=%zu, "
       "size=%zu, hitrate=%.1f%%, evictions=%zu",
-      queries, hits, misses, land_cache.size(), 100.0 * segment_hit_rate,
-      evictions);
+      queries, hits, misses, size, 100.0 * segment_hit_rate, evictions);
+
+  size_t tiles = 0;
+  for (DistanceFieldShard& shard : distance_field) {
+    std::lock_guard<std::mutex> lock(shard.mutex);
+    tiles += shard.tiles.size();
+  }
+  wxLogMessage(
+      "WeatherRouting Distance field: queries=%zu, hits=%zu, misses=%zu, "
+      "safe_water=%zu, tiles=%zu, evictions=%zu",
+      df_queries.load(), df_hits.load(), df_misses.load(),
+      df_safe_water_optimizations.load(), tiles,
+      distance_field_evictions.load());
+
+  size_t boundary_queries, boundary_hits;
+  BoundaryCache::GetStats(boundary_queries, boundary_hits);
+  wxLogMessage(
+      "WeatherRouting Boundary memo: queries=%zu, hits=%zu, hitrate=%.1f%%",
+      boundary_queries, boundary_hits,
+      boundary_queries ? 100.0 * boundary_hits / boundary_queries : 0.0);
 }
 
 void maintain_land_cache() {
-#if 0
+  // eviction happens on insertion, only report the statistics here
   static std::atomic<size_t> last_log_queries{0};
   size_t current_queries = segment_cache_queries.load();
   size_t last_queries = last_log_queries.load();
 
-  {
-    std::lock_guard<std::mutex> lock(land_cache_mutex);
-    evict_oldest_segment_entries();
-  }
-
-  if (current_queries - last_queries > LOG_INTERVAL) {
-    last_log_queries.store(current_queries);
+  if (current_queries - last_queries > LOG_INTERVAL &&
+      last_log_queries.compare_exchange_strong(last_queries, current_queries))
     log_cache_stats();
-  }
-#endif
 }
 
 /**
@@ -178,48 +280,196 @@ void maintain_land_cache() {
  * - If cache hit, return immediately with known result
  *
  * Exact computation fallback:
- * - For near-coastline segments or on-land grid points, use expensive
- * PlugIn_GSHHS_CrossesLand()
+ * - For near-coastline segments or on-land grid points, use the native
+ * CoastlineIndex if open, or else the expensive PlugIn_GSHHS_CrossesLand()
  * - Cache the exact result for future use
  */
 bool Cached_CrossesLand(double lat1, double lon1, double lat2, double lon2) {
-#if 0
   SegmentKey key(lat1, lon1, lat2, lon2);
+  SegmentCacheShard& shard = land_cache_shard(key);
   segment_cache_queries.fetch_add(1);
 
   // Check segment cache first.
   {
-    std::lock_guard<std::mutex> lock(land_cache_mutex);
-    auto it = land_cache.find(key);
-    if (it != land_cache.end()) {
-      it->second.last_used = std::chrono::steady_clock::now();
+    std::lock_guard<std::mutex> lock(shard.mutex);
+    auto it = shard.index.find(key);
+    if (it != shard.index.end()) {
+      SegmentCacheSlot& slot = shard.slots[it->second];
+      slot.referenced = true;
       segment_cache_hits.fetch_add(1);
-      return it->second.crosses_land;
+      return slot.crosses_land;
     }
   }
 
+  // query outside of the lock, other threads keep using the shard
   segment_cache_misses.fetch_add(1);
-  bool result = PlugIn_GSHHS_CrossesLand(lat1, lon1, lat2, lon2);
+  bool result = CoastlineIndex::IsOpen()
+                    ? CoastlineIndex::CrossesLand(lat1, lon1, lat2, lon2)
+                    : PlugIn_GSHHS_CrossesLand(lat1, lon1, lat2, lon2);
   // Cache the result
   {
-    std::lock_guard<std::mutex> lock(land_cache_mutex);
-    if (land_cache.size() >= MAX_SEGMENT_CACHE_SIZE) {
-      evict_oldest_segment_entries();
-    }
-    land_cache.emplace(key, SegmentCacheEntry(result));
+    std::lock_guard<std::mutex> lock(shard.mutex);
+    insert_segment(shard, key, result);
   }
-#endif
-  bool result = PlugIn_GSHHS_CrossesLand(lat1, lon1, lat2, lon2);
   return result;
 }
 
 void clear_land_cache() {
-  std::lock_guard<std::mutex> lock(land_cache_mutex);
-  land_cache.clear();
+  for (SegmentCacheShard& shard : land_cache) {
+    std::lock_guard<std::mutex> lock(shard.mutex);
+    shard.index.clear();
+    shard.slots.clear();
+    shard.hand = 0;
+  }
   segment_cache_hits.store(0);
   segment_cache_misses.store(0);
   segment_cache_queries.store(0);
   segment_evictions.store(0);
+
+  for (DistanceFieldShard& shard : distance_field) {
+    std::lock_guard<std::mutex> lock(shard.mutex);
+    shard.tiles.clear();
+  }
+  df_hits.store(0);
+  df_misses.store(0);
+  df_queries.store(0);
+  df_safe_water_optimizations.store(0);
+  distance_field_evictions.store(0);
+}
+
+static int floor_div(int a, int b) { return a / b - (a % b < 0); }
+
+// longitude index of a cell wrapped to -180..180
+static int wrap_cell_lon(int level, int j) {
+  int n = 360 << level;
+  return ((j + n / 2) % n + n) % n - n / 2;
+}
+
+static DistanceFieldShard& distance_field_shard(const DistanceTileKey& key) {
+  return distance_field[std::hash<DistanceTileKey>()(key) % DF_SHARDS];
+}
+
+static int8_t get_cell_distance(int level, int i, int j) {
+  DistanceTileKey key{level, floor_div(i, DF_TILE_SIZE),
+                      floor_div(j, DF_TILE_SIZE)};
+  DistanceFieldShard& shard = distance_field_shard(key);
+  std::lock_guard<std::mutex> lock(shard.mutex);
+  auto it = shard.tiles.find(key);
+  if (it == shard.tiles.end()) return 0;
+  return it->second->distance[(i - key.ti * DF_TILE_SIZE) * DF_TILE_SIZE +
+                              j - key.tj * DF_TILE_SIZE];
+}
+
+static void set_cell_distance(int level, int i, int j, int8_t distance) {
+  DistanceTileKey key{level, floor_div(i, DF_TILE_SIZE),
+                      floor_div(j, DF_TILE_SIZE)};
+  DistanceFieldShard& shard = distance_field_shard(key);
+  std::lock_guard<std::mutex> lock(shard.mutex);
+  auto it = shard.tiles.find(key);
+  if (it == shard.tiles.end()) {
+    if (shard.tiles.size() >= DF_MAX_TILES / DF_SHARDS) {
+      distance_field_evictions.fetch_add(shard.tiles.size());
+      shard.tiles.clear();
+    }
+    it = shard.tiles
+             .emplace(key, std::unique_ptr<DistanceTile>(new DistanceTile))
+             .first;
+  }
+  it->second->distance[(i - key.ti * DF_TILE_SIZE) * DF_TILE_SIZE + j -
+                       key.tj * DF_TILE_SIZE] = distance;
+}
+
+// signed distance of a cell, computing whether it is water if unknown
+static int8_t cell_distance(int level, int i, int j) {
+  double size = ldexp(1.0, -level);
+  double lat0 = i * size, lat1 = lat0 + size;
+  // cells past the poles are never water
+  if (lat0 < -90 || lat1 > 90) return -1;
+
+  j = wrap_cell_lon(level, j);
+
+  int8_t distance = get_cell_distance(level, i, j);
+  if (distance) {
+    df_hits.fetch_add(1);
+    return distance;
+  }
+
+  df_misses.fetch_add(1);
+  double lon0 = j * size, lon1 = lon0 + size;
+  distance = CoastlineIndex::HasCoastline(lat0, lon0, lat1, lon1) ? -1 : 1;
+  set_cell_distance(level, i, j, distance);
+  return distance;
+}
+
+// true if every cell within radius cells of cell i, j is water
+static bool cell_clear_of_land(int level, int i, int j, int radius) {
+  int8_t distance = cell_distance(level, i, j);
+  if (distance < 0) return false;
+
+  int wrapped_j = wrap_cell_lon(level, j);
+  for (int ring = distance; ring <= radius; ring++) {
+    for (int di = -ring; di <= ring; di++) {
+      int step = (di == -ring || di == ring) ? 1 : 2 * ring;
+      for (int dj = -ring; dj <= ring; dj += step) {
+        if (cell_distance(level, i + di, j + dj) < 0) {
+          // every cell closer than this ring is water
+          set_cell_distance(level, i, wrapped_j, ring);
+          return false;
+        }
+      }
+    }
+  }
+  set_cell_distance(level, i, wrapped_j,
+                    std::max<int>(distance, radius + 1));
+  return true;
+}
+
+/**
+ * Returns true if the distance field shows land is farther than margin (nm)
+ * from every point of the segment, in which case the offset lines of the
+ * safety margin cannot cross land either.  Returns false if land may be
+ * closer, or if the field cannot tell at a reasonable cost.
+ */
+static bool distance_field_clear_of_land(double lat1, double lon1,
+                                         double lat2, double lon2,
+                                         double margin) {
+  df_queries.fetch_add(1);
+  // only the coastline index tells which cells hold no coastline
+  if (!CoastlineIndex::IsOpen()) return false;
+
+  // pick the largest cells that are no larger than the margin
+  double margin_degrees = margin / 60;
+  int level = static_cast<int>(std::ceil(-std::log2(margin_degrees)));
+  if (level < 0) level = 0;
+  if (level > DF_MAX_LEVEL) return false;
+  double size = ldexp(1.0, -level);
+
+  double max_lat = wxMax(fabs(lat1), fabs(lat2));
+  if (max_lat > 80) return false;
+  // one more cell than needed, since a cell only bounds where a point lies
+  int radius = static_cast<int>(std::ceil(
+                   margin_degrees / cos(deg2rad(max_lat)) / size)) +
+               1;
+  if (radius > DF_MAX_RADIUS) return false;
+
+  if (lon2 - lon1 > 180) lon2 -= 360;
+  if (lon1 - lon2 > 180) lon2 += 360;
+  double span = wxMax(fabs(lat2 - lat1), fabs(lon2 - lon1));
+  size_t samples = static_cast<size_t>(span / (size / 2)) + 2;
+  if (samples > DF_MAX_SAMPLES) return false;
+
+  int last_i = INT32_MIN, last_j = INT32_MIN;
+  for (size_t k = 0; k < samples; k++) {
+    double t = static_cast<double>(k) / (samples - 1);
+    int i = static_cast<int>(std::floor((lat1 + t * (lat2 - lat1)) / size));
+    int j = static_cast<int>(std::floor((lon1 + t * (lon2 - lon1)) / size));
+    if (i == last_i && j == last_j) continue;
+    last_i = i, last_j = j;
+    if (!cell_clear_of_land(level, i, j, radius)) return false;
+  }
+
+  df_safe_water_optimizations.fetch_add(1);
+  return true;
 }
 
 bool ConstraintChecker::CheckSwellConstraint(
@@ -257,7 +507,7 @@ bool ConstraintChecker::CheckCycloneTrackConstraint(
     double dlon) {
   if (configuration.AvoidCycloneTracks &&
       RouteMap::ClimatologyCycloneTrackCrossings) {
-    int crossings = RouteMap::ClimatologyCycloneTrackCrossings(
+    int crossings = ClimatologyCache::CycloneTrackCrossings(
         lat, lon, dlat, dlon, configuration.time,
         configuration.CycloneMonths * 30 + configuration.CycloneDays);
     if (crossings > 0) {
@@ -324,6 +574,11 @@ bool ConstraintChecker::CheckLandConstraint(
       return false;
     }
     double distSecure = configuration.SafetyMarginLand;
+    // far from the coast the offset lines cannot cross land either
+    if (distSecure <= 0 ||
+        distance_field_clear_of_land(lat, lon, dlat1, ndlon1, distSecure)) {
+      return true;
+    }
     double latBorderUp1, lonBorderUp1, latBorderUp2, lonBorderUp2;
     double latBorderDown1, lonBorderDown1, latBorderDown2, lonBorderDown2;
     ll_gc_ll(lat, lon, heading_resolve(cog) - 90, distSecure, &latBorderUp1,
@@ -391,3 +646,155 @@ bool ConstraintChecker::CheckWindVsCurrentConstraint(
   }
   return true;
 }
+
+static bool CheckCourseAngle(RouteMapConfiguration& configuration,
+                             const PropagationCandidate& c,
+                             PropagationError& error_code) {
+  return ConstraintChecker::CheckMaxCourseAngleConstraint(configuration,
+                                                          c.dlat, c.dlon);
+}
+
+static bool CheckDivertedCourse(RouteMapConfiguration& configuration,
+                                const PropagationCandidate& c,
+                                PropagationError& error_code) {
+  return ConstraintChecker::CheckMaxDivertedCourse(configuration, c.dlat,
+                                                   c.dlon);
+}
+
+static bool CheckApparentWind(RouteMapConfiguration& configuration,
+                              const PropagationCandidate& c,
+                              PropagationError& error_code) {
+  return ConstraintChecker::CheckMaxApparentWindConstraint(
+      configuration, c.stw, c.twa, c.twsOverWater, error_code);
+}
+
+static bool CheckLandAndBoundary(RouteMapConfiguration& configuration,
+                                 const PropagationCandidate& c,
+                                 PropagationError& error_code) {
+  if (!configuration.DetectLand && !configuration.DetectBoundary) return true;
+
+  double dlat1, dlon1;
+  double bearing, dist2end;
+
+  // it's not an error if there's boundaries after we reach destination
+  ll_gc_ll_reverse(c.lat, c.lon, configuration.EndLat, configuration.EndLon,
+                   &bearing, &dist2end);
+  if (dist2end < c.dist) {
+    ll_gc_ll(c.lat, c.lon, heading_resolve(c.cog), dist2end, &dlat1, &dlon1);
+  } else {
+    dlat1 = c.dlat;
+    dlon1 = c.dlon;
+  }
+
+  /* landfall test */
+  if (!ConstraintChecker::CheckLandConstraint(configuration, c.lat, c.lon,
+                                              dlat1, dlon1, c.cog)) {
+    configuration.land_crossing = true;
+    return false;
+  }
+
+  /* Boundary test */
+  if (configuration.DetectBoundary &&
+      BoundaryCache::EntersBoundary(c.lat, c.lon, dlat1, dlon1)) {
+    configuration.boundary_crossing = true;
+    return false;
+  }
+  return true;
+}
+
+static bool CheckCycloneTrack(RouteMapConfiguration& configuration,
+                              const PropagationCandidate& c,
+                              PropagationError& error_code) {
+  return ConstraintChecker::CheckCycloneTrackConstraint(configuration, c.lat,
+                                                        c.lon, c.dlat, c.dlon);
+}
+
+/* the checks, by CheckType */
+static bool (*const constraint_checks[ConstraintPipeline::CHECK_COUNT])(
+    RouteMapConfiguration&, const PropagationCandidate&, PropagationError&) = {
+    CheckCourseAngle, CheckDivertedCourse, CheckApparentWind,
+    CheckLandAndBoundary, CheckCycloneTrack};
+
+ConstraintPipeline::ConstraintPipeline() { Reset(); }
+
+bool ConstraintPipeline::Check(RouteMapConfiguration& configuration,
+                               const PropagationCandidate& candidate,
+                               PropagationError& error_code) {
+  if (++m_candidates % REORDER_INTERVAL == 0) Reorder();
+
+  bool timed = m_candidates % TIMING_INTERVAL == 0;
+  for (CheckStats& check : m_checks) {
+    check.calls++;
+    bool passed;
+    if (timed) {
+      auto start = std::chrono::steady_clock::now();
+      passed = constraint_checks[check.type](configuration, candidate,
+                                             error_code);
+      check.timed_seconds += std::chrono::duration<double>(
+                                 std::chrono::steady_clock::now() - start)
+                                 .count();
+      check.timed_calls++;
+    } else
+      passed =
+          constraint_checks[check.type](configuration, candidate, error_code);
+
+    if (!passed) {
+      check.rejections++;
+      return false;
+    }
+  }
+  return true;
+}
+
+void ConstraintPipeline::Reset() {
+  for (int i = 0; i < CHECK_COUNT; i++)
+    m_checks[i] = CheckStats{(CheckType)i, 0, 0, 0, 0.0};
+  m_candidates = 0;
+}
+
+void ConstraintPipeline::Reorder() {
+  // the land and boundary check flags the candidates reaching it, so it and
+  // the checks after it keep their place; only the checks before it move.
+  // Expected cost of a check per candidate it rejects, checks which never
+  // reject anything go last
+  auto cost_per_rejection = [](const CheckStats& check) -> double {
+    if (!check.rejections || !check.timed_calls) return INFINITY;
+    double cost = check.timed_seconds / check.timed_calls;
+    return cost * check.calls / check.rejections;
+  };
+  std::stable_sort(std::begin(m_checks), m_checks + LAND_AND_BOUNDARY,
+                   [&](const CheckStats& a, const CheckStats& b) {
+                     return cost_per_rejection(a) < cost_per_rejection(b);
+                   });
+}
+
+void ConstraintPipeline::LogProfile() const {
+  for (const CheckStats& check : m_checks) {
+    double average = check.timed_calls
+                         ? 1e6 * check.timed_seconds / check.timed_calls
+                         : 0.0;
+    double rejected = check.calls ? 100.0 * check.rejections / check.calls : 0;
+    wxLogMessage(
+        "WeatherRouting Constraint %s: calls=%zu, rejected=%zu (%.1f%%), "
+        "average=%.2fus",
+        GetCheckName(check.type), check.calls, check.rejections, rejected,
+        average);
+  }
+}
+
+const char* ConstraintPipeline::GetCheckName(CheckType type) {
+  switch (type) {
+    case COURSE_ANGLE:
+      return "course angle";
+    case DIVERTED_COURSE:
+      return "diverted course";
+    case APPARENT_WIND:
+      return "apparent wind";
+    case LAND_AND_BOUNDARY:
+      return "land and boundary";
+    case CYCLONE_TRACK:
+      return "cyclone track";
+    default:
+      return "unknown";
+  }
+}
@@ -945,17 +945,16 @@ time_t GribRecord::makeDate(zuint year, zuint month, zuint day, zuint hour,
 
 //===============================================================================================
 
-double GribRecord::getInterpolatedValue(double px, double py,
-                                        bool numericalInterpolation,
-                                        bool dir) const {
-  if (!ok || Di == 0 || Dj == 0) return GRIB_NOTDEF;
+bool GribRecord::getInterpolationCell(double px, double py,
+                                      InterpolationCell &cell) const {
+  if (!ok || Di == 0 || Dj == 0) return false;
 
   if (!isPointInMap(px, py)) {
     px += 360.0;  // tour du monde  droite ?
     if (!isPointInMap(px, py)) {
       px -= 2 * 360.0;  // tour du monde  gauche ?
       if (!isPointInMap(px, py)) {
-        return GRIB_NOTDEF;
+        return false;
       }
     }
   }
@@ -965,26 +964,56 @@ double GribRecord::getInterpolatedValue(double px, double py,
 
   // 00 10      point is in a square
   // 01 11
-  int i0 = (int)pi;  // point 00
-  int j0 = (int)pj;
+  cell.i0 = (int)pi;  // point 00
+  cell.j0 = (int)pj;
 
   unsigned int i1 = pi + 1, j1 = pj + 1;
 
-  if (i1 >= Ni) i1 = i0;
+  if (i1 >= Ni) i1 = cell.i0;
+
+  if (j1 >= Nj) j1 = cell.j0;
 
-  if (j1 >= Nj) j1 = j0;
+  cell.i1 = i1, cell.j1 = j1;
 
   // distances to 00
-  double dx = pi - i0;
-  double dy = pj - j0;
+  cell.fx = pi - cell.i0;
+  cell.fy = pj - cell.j0;
+
+  // pseudo hermite interpolation
+  cell.dx = (3.0 - 2.0 * cell.fx) * cell.fx * cell.fx;
+  cell.dy = (3.0 - 2.0 * cell.fy) * cell.fy * cell.fy;
+  return true;
+}
+
+bool GribRecord::hasSameGrid(const GribRecord &other) const {
+  return Ni == other.Ni && Nj == other.Nj && Di == other.Di &&
+         Dj == other.Dj && Lo1 == other.Lo1 && La1 == other.La1 &&
+         Lo2 == other.Lo2 && La2 == other.La2;
+}
+
+double GribRecord::getInterpolatedValue(double px, double py,
+                                        bool numericalInterpolation,
+                                        bool dir) const {
+  InterpolationCell cell;
+  if (!getInterpolationCell(px, py, cell)) return GRIB_NOTDEF;
 
   if (!numericalInterpolation) {
-    if (dx >= 0.5) i0 = i1;
-    if (dy >= 0.5) j0 = j1;
+    int i0 = cell.i0, j0 = cell.j0;
+    if (cell.fx >= 0.5) i0 = cell.i1;
+    if (cell.fy >= 0.5) j0 = cell.j1;
 
     return getValue(i0, j0);
   }
 
+  return getInterpolatedValue(cell, dir);
+}
+
+double GribRecord::getInterpolatedValue(const InterpolationCell &cell,
+                                        bool dir) const {
+  if (!ok) return GRIB_NOTDEF;
+
+  int i0 = cell.i0, j0 = cell.j0, i1 = cell.i1, j1 = cell.j1;
+
   //     bool h00,h01,h10,h11;
   //     int nbval = 0;     // how many values in grid ?
   //     if ((h00=isDefined(i0, j0)))
@@ -1004,8 +1033,7 @@ double GribRecord::getInterpolatedValue(double px, double py,
 
   if (nbval < 3) return GRIB_NOTDEF;
 
-  dx = (3.0 - 2.0 * dx) * dx * dx;  // pseudo hermite interpolation
-  dy = (3.0 - 2.0 * dy) * dy * dy;
+  double dx = cell.dx, dy = cell.dy;
 
   double xa, xb, xc, kx, ky;
   // Triangle :
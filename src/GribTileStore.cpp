@@ -0,0 +1,569 @@
+/***************************************************************************
+ *   Copyright (C) 2015 by OpenCPN development team                        *
+ *                                                                         *
+ *   This program is free software; you can redistribute it and/or modify  *
+ *   it under the terms of the GNU General Public License as published by  *
+ *   the Free Software Foundation; either version 3 of the License, or     *
+ *   (at your option) any later version.                                   *
+ *                                                                         *
+ *   This program is distributed in the hope that it will be useful,       *
+ *   but WITHOUT ANY WARRANTY; without even the implied warranty of        *
+ *   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the         *
+ *   GNU General Public License for more details.                          *
+ *                                                                         *
+ *   You should have received a copy of the GNU General Public License     *
+ *   along with this program; if not, write to the                         *
+ *   Free Software Foundation, Inc.,                                       *
+ *   51 Franklin Street, Fifth Floor, Boston, MA 02110-1301,  USA.         *
+ **************************************************************************/
+
+#include <wx/wx.h>
+#include <wx/dir.h>
+#include <wx/file.h>
+#include <wx/filename.h>
+#include <wx/thread.h>
+
+#include <cstring>
+#include <list>
+#include <map>
+#include <memory>
+#include <tuple>
+#include <vector>
+
+#include "GribTileStore.h"
+#include "Utilities.h"
+#include "WeatherDataProvider.h"
+#include "weather_routing_pi.h"
+
+namespace {
+
+/* tiles are square blocks of TILE_SIZE x TILE_SIZE values */
+const int TILE_SIZE = 64;
+const int TILE_VALUES = TILE_SIZE * TILE_SIZE;
+/* 256 tiles of 32 KiB */
+const size_t MAX_CACHED_TILES = 256;
+/* tile files kept open between tile misses */
+const size_t MAX_OPEN_FILES = 32;
+/* grids smaller than this (512 KiB of data) are kept on the heap */
+const int MIN_STORED_POINTS = 65536;
+const int TILE_FILE_VERSION = 2;
+const int PRUNE_AGE_DAYS = 7;
+
+/* The GRIB plugin does not tell which file a record set was read from, so
+   the source is identified by the decoded record itself: its dates, origin,
+   parameter and a checksum of every value. */
+struct TileFileHeader {
+  char magic[4];
+  int version;
+  int Ni, Nj;
+  int tile_size;
+  int reserved;
+  double Lo1, La1, Di, Dj;
+  long long ref_date, cur_date;
+  int center, model, grid;
+  int data_type, level_type, level_value;
+  unsigned long long checksum;
+};
+
+/* a field is read from the copied record until its tile file is written */
+struct StoredField {
+  std::shared_ptr<GribRecord> record;
+  wxString path;
+  unsigned long generation;
+  int Ni, Nj;
+  int tiles_x;
+  double Lo1, La1, Lo2, La2, Di, Dj;
+};
+
+typedef std::tuple<time_t, unsigned int, int> FieldKey;
+typedef std::tuple<time_t, unsigned int, int, int> TileKey;
+
+struct CachedTile {
+  std::vector<double> values;
+  unsigned long last_used;
+};
+
+struct OpenTileFile {
+  std::shared_ptr<wxFile> file;
+  unsigned long last_used;
+};
+
+/* registered fields and cached tiles, never held during file I/O */
+std::map<FieldKey, StoredField> stored_fields;
+std::map<TileKey, CachedTile> tile_cache;
+unsigned long tile_clock = 0;
+unsigned long store_generation = 0;
+wxString store_directory;
+bool store_pruned = false;
+wxMutex s_store_mutex;
+
+/* open tile files, reads seek a shared handle */
+std::map<wxString, OpenTileFile> open_files;
+unsigned long open_clock = 0;
+wxMutex s_file_mutex;
+
+FieldKey KeyOf(const WR_GribRecordSet& set, int idx) {
+  return FieldKey(set.m_Reference_Time, set.m_ID, idx);
+}
+
+unsigned long long Checksum(const GribRecord& rec) {
+  /* 64 bit FNV-1a */
+  unsigned long long hash = 14695981039346656037ULL;
+  for (int j = 0; j < rec.getNj(); j++)
+    for (int i = 0; i < rec.getNi(); i++) {
+      double v = rec.getValue(i, j);
+      const unsigned char* p = reinterpret_cast<const unsigned char*>(&v);
+      for (size_t k = 0; k < sizeof v; k++) {
+        hash ^= p[k];
+        hash *= 1099511628211ULL;
+      }
+    }
+  return hash;
+}
+
+void MakeHeader(TileFileHeader& h, const GribRecord& rec) {
+  memset(&h, 0, sizeof h);
+  memcpy(h.magic, "WRTS", 4);
+  h.version = TILE_FILE_VERSION;
+  h.Ni = rec.getNi(), h.Nj = rec.getNj();
+  h.tile_size = TILE_SIZE;
+  h.Lo1 = rec.getX(0), h.La1 = rec.getY(0);
+  h.Di = rec.getDi(), h.Dj = rec.getDj();
+  h.ref_date = rec.getRecordRefDate();
+  h.cur_date = rec.getRecordCurrentDate();
+  h.center = rec.getIdCenter(), h.model = rec.getIdModel();
+  h.grid = rec.getIdGrid();
+  h.data_type = rec.getDataType(), h.level_type = rec.getLevelType();
+  h.level_value = rec.getLevelValue();
+  h.checksum = Checksum(rec);
+}
+
+bool HeaderMatches(const TileFileHeader& a, const TileFileHeader& b) {
+  return !memcmp(a.magic, b.magic, 4) && a.version == b.version &&
+         a.Ni == b.Ni && a.Nj == b.Nj && a.tile_size == b.tile_size &&
+         a.Lo1 == b.Lo1 && a.La1 == b.La1 && a.Di == b.Di && a.Dj == b.Dj &&
+         a.ref_date == b.ref_date && a.cur_date == b.cur_date &&
+         a.center == b.center && a.model == b.model && a.grid == b.grid &&
+         a.data_type == b.data_type && a.level_type == b.level_type &&
+         a.level_value == b.level_value && a.checksum == b.checksum;
+}
+
+/* remove tile files which no session used for a while */
+void PruneStore(const wxString& dir) {
+  wxArrayString files;
+  wxDir::GetAllFiles(dir, &files, "*.wrtiles", wxDIR_FILES);
+  wxDateTime limit = wxDateTime::Now() - wxDateSpan::Days(PRUNE_AGE_DAYS);
+  for (size_t i = 0; i < files.GetCount(); i++) {
+    wxFileName fn(files[i]);
+    if (fn.GetModificationTime() < limit) wxRemoveFile(files[i]);
+  }
+}
+
+bool WriteTileFile(const wxString& path, const TileFileHeader& h,
+                   const GribRecord& rec) {
+  /* write to a temporary file first so a concurrent session, or another
+     thread storing the same field, never sees a partially written file */
+  wxString tmp =
+      path + wxString::Format(".%lu.%lu.tmp", wxGetProcessId(),
+                              (unsigned long)wxThread::GetCurrentId());
+  wxFile file;
+  if (!file.Create(tmp, true)) return false;
+
+  bool ok = file.Write(&h, sizeof h) == sizeof h;
+  int tiles_x = (h.Ni + TILE_SIZE - 1) / TILE_SIZE;
+  int tiles_y = (h.Nj + TILE_SIZE - 1) / TILE_SIZE;
+  std::vector<double> tile(TILE_VALUES);
+  for (int ty = 0; ok && ty < tiles_y; ty++)
+    for (int tx = 0; ok && tx < tiles_x; tx++) {
+      for (int j = 0; j < TILE_SIZE; j++)
+        for (int i = 0; i < TILE_SIZE; i++) {
+          int gi = tx * TILE_SIZE + i, gj = ty * TILE_SIZE + j;
+          tile[j * TILE_SIZE + i] = gi < h.Ni && gj < h.Nj
+                                        ? rec.getValue(gi, gj)
+                                        : GRIB_NOTDEF;
+        }
+      size_t size = TILE_VALUES * sizeof(double);
+      ok = file.Write(&tile[0], size) == size;
+    }
+  ok = file.Close() && ok;
+
+  if (!ok || !replace_file(tmp, path)) {
+    wxRemoveFile(tmp);
+    return false;
+  }
+  return true;
+}
+
+bool ReadTileFileHeader(const wxString& path, TileFileHeader& h) {
+  wxFile file;
+  if (!file.Open(path)) return false;
+  return file.Read(&h, sizeof h) == (ssize_t)sizeof h;
+}
+
+/* true if path holds a tile file for exactly this record */
+bool TileFileMatches(const wxString& path, const TileFileHeader& h) {
+  TileFileHeader existing;
+  return wxFileExists(path) && ReadTileFileHeader(path, existing) &&
+         HeaderMatches(existing, h);
+}
+
+bool ReadTile(const wxString& path, int tile, double* values) {
+  wxMutexLocker lock(s_file_mutex);
+  std::map<wxString, OpenTileFile>::iterator it = open_files.find(path);
+  if (it == open_files.end()) {
+    if (open_files.size() >= MAX_OPEN_FILES) {
+      std::map<wxString, OpenTileFile>::iterator oldest = open_files.begin();
+      for (std::map<wxString, OpenTileFile>::iterator fit = open_files.begin();
+           fit != open_files.end(); ++fit)
+        if (fit->second.last_used < oldest->second.last_used) oldest = fit;
+      open_files.erase(oldest);
+    }
+    OpenTileFile f;
+    f.file = std::make_shared<wxFile>();
+    if (!f.file->Open(path)) return false;
+    it = open_files.insert(std::make_pair(path, f)).first;
+  }
+  it->second.last_used = ++open_clock;
+
+  wxFile& file = *it->second.file;
+  size_t size = TILE_VALUES * sizeof(double);
+  if (file.Seek(sizeof(TileFileHeader) + (wxFileOffset)tile * size) ==
+          wxInvalidOffset ||
+      file.Read(values, size) != (ssize_t)size) {
+    open_files.erase(it);
+    return false;
+  }
+  return true;
+}
+
+double Value(const FieldKey& key, const StoredField& field, int i, int j) {
+  int tile = (j / TILE_SIZE) * field.tiles_x + i / TILE_SIZE;
+  TileKey tkey(std::get<0>(key), std::get<1>(key), std::get<2>(key), tile);
+  int offset = (j % TILE_SIZE) * TILE_SIZE + i % TILE_SIZE;
+
+  {
+    wxMutexLocker lock(s_store_mutex);
+    std::map<TileKey, CachedTile>::iterator it = tile_cache.find(tkey);
+    if (it != tile_cache.end()) {
+      it->second.last_used = ++tile_clock;
+      return it->second.values[offset];
+    }
+  }
+
+  /* page the tile in without blocking lookups of cached tiles */
+  CachedTile ct;
+  ct.values.resize(TILE_VALUES);
+  if (!ReadTile(field.path, tile, &ct.values[0])) {
+    wxLogGeneric(wxLOG_Debug, "WeatherRouting: failed to read tile %d of %s",
+                 tile, field.path);
+    return GRIB_NOTDEF;
+  }
+  double value = ct.values[offset];
+
+  wxMutexLocker lock(s_store_mutex);
+  std::map<FieldKey, StoredField>::iterator fit = stored_fields.find(key);
+  /* the field was replaced by another record while reading */
+  if (fit == stored_fields.end() || fit->second.generation != field.generation)
+    return value;
+
+  if (tile_cache.find(tkey) == tile_cache.end()) {
+    if (tile_cache.size() >= MAX_CACHED_TILES) {
+      std::map<TileKey, CachedTile>::iterator oldest = tile_cache.begin();
+      for (std::map<TileKey, CachedTile>::iterator cit = tile_cache.begin();
+           cit != tile_cache.end(); ++cit)
+        if (cit->second.last_used < oldest->second.last_used) oldest = cit;
+      tile_cache.erase(oldest);
+    }
+    ct.last_used = ++tile_clock;
+    tile_cache.insert(std::make_pair(tkey, ct));
+  }
+  return value;
+}
+
+/* must be called with s_store_mutex held */
+void DropCachedTiles(const FieldKey& key) {
+  TileKey first(std::get<0>(key), std::get<1>(key), std::get<2>(key), 0);
+  std::map<TileKey, CachedTile>::iterator it = tile_cache.lower_bound(first);
+  while (it != tile_cache.end() && std::get<0>(it->first) == std::get<0>(key) &&
+         std::get<1>(it->first) == std::get<1>(key) &&
+         std::get<2>(it->first) == std::get<2>(key))
+    it = tile_cache.erase(it);
+}
+
+bool IsXInMap(const StoredField& f, double x) {
+  double maxLo;
+  if (f.Di > 0) {
+    maxLo = f.Lo2;
+    if (f.Lo2 + f.Di >= 360) /* grib that covers the whole world */
+      maxLo += f.Di;
+    return x >= f.Lo1 && x <= maxLo;
+  }
+  maxLo = f.Lo1;
+  if (f.Lo2 + f.Di >= 360) maxLo += f.Di;
+  return x >= f.Lo2 && x <= maxLo;
+}
+
+bool IsYInMap(const StoredField& f, double y) {
+  if (f.Dj < 0) return y <= f.La1 && y >= f.La2;
+  return y >= f.La1 && y <= f.La2;
+}
+
+/* fields queued for the writer thread */
+struct PendingTileFile {
+  wxString dir;
+  FieldKey key;
+  unsigned long generation;
+  std::shared_ptr<GribRecord> record;
+};
+std::list<PendingTileFile> pending_tile_files;
+bool s_writing;
+wxMutex s_write_mutex;
+
+/* checksums and writes a field, then reads it from the tile file */
+void WriteField(const PendingTileFile& pending) {
+  bool prune;
+  {
+    wxMutexLocker lock(s_store_mutex);
+    prune = !store_pruned;
+    store_pruned = true;
+  }
+  if (prune) PruneStore(pending.dir);
+
+  const GribRecord& rec = *pending.record;
+  TileFileHeader h;
+  MakeHeader(h, rec);
+  wxString path =
+      pending.dir +
+      wxString::Format("%08x_%lld_%02d_%016llx.wrtiles",
+                       std::get<1>(pending.key),
+                       (long long)std::get<0>(pending.key),
+                       std::get<2>(pending.key), h.checksum);
+  /* reuse a tile file written earlier, possibly by another session */
+  if (TileFileMatches(path, h)) {
+    wxFileName(path).Touch();
+  } else if (!WriteTileFile(path, h, rec) && !TileFileMatches(path, h)) {
+    /* the field stays readable from the copied record */
+    wxLogGeneric(wxLOG_Debug, "WeatherRouting: failed to write %s", path);
+    return;
+  }
+
+  wxMutexLocker lock(s_store_mutex);
+  std::map<FieldKey, StoredField>::iterator it =
+      stored_fields.find(pending.key);
+  /* stored again, or forgotten by SetDirectory(), meanwhile */
+  if (it == stored_fields.end() || it->second.generation != pending.generation)
+    return;
+  it->second.path = path;
+  it->second.record.reset();
+}
+
+class TileWriterThread : public wxThread {
+public:
+  TileWriterThread() : wxThread(wxTHREAD_JOINABLE) { Create(); }
+
+  void* Entry() {
+    for (;;) {
+      PendingTileFile pending;
+      {
+        wxMutexLocker lock(s_write_mutex);
+        if (pending_tile_files.empty()) {
+          s_writing = false;
+          return 0;
+        }
+        pending = pending_tile_files.front();
+        pending_tile_files.pop_front();
+      }
+      WriteField(pending);
+    }
+  }
+};
+
+TileWriterThread* s_writer_thread;
+
+void JoinWriter() {
+  if (!s_writer_thread) return;
+  s_writer_thread->Wait();
+  delete s_writer_thread;
+  s_writer_thread = NULL;
+}
+
+void WriteInBackground(const PendingTileFile& pending) {
+  {
+    wxMutexLocker lock(s_write_mutex);
+    pending_tile_files.push_back(pending);
+    if (s_writing) return; /* picked up by the running thread */
+    s_writing = true;
+  }
+
+  JoinWriter();
+  s_writer_thread = new TileWriterThread;
+  if (s_writer_thread->Run() != wxTHREAD_NO_ERROR) {
+    delete s_writer_thread;
+    s_writer_thread = NULL;
+
+    /* write synchronously rather than keep the copies in memory */
+    std::list<PendingTileFile> pending_files;
+    {
+      wxMutexLocker lock(s_write_mutex);
+      pending_files.swap(pending_tile_files);
+      s_writing = false;
+    }
+    for (std::list<PendingTileFile>::iterator it = pending_files.begin();
+         it != pending_files.end(); ++it)
+      WriteField(*it);
+  }
+}
+
+}  // namespace
+
+bool GribTileStore::IsWorthStoring(const GribRecord& rec) {
+  return rec.isOk() && rec.getNi() * rec.getNj() >= MIN_STORED_POINTS;
+}
+
+wxString GribTileStore::Directory() {
+  wxMutexLocker lock(s_store_mutex);
+  if (store_directory.IsEmpty()) {
+    wxString dir = weather_routing_pi::StandardPath() + "gribcache";
+    if (!wxDirExists(dir)) wxMkdir(dir);
+    store_directory = dir + wxFileName::GetPathSeparator();
+  }
+  return store_directory;
+}
+
+void GribTileStore::SetDirectory(const wxString& dir) {
+  /* queued fields are written to the directory they were stored for */
+  Flush();
+  {
+    wxMutexLocker lock(s_store_mutex);
+    store_directory = dir;
+    if (!store_directory.IsEmpty() &&
+        !store_directory.EndsWith(wxFileName::GetPathSeparator()))
+      store_directory += wxFileName::GetPathSeparator();
+    store_pruned = false;
+    stored_fields.clear();
+    tile_cache.clear();
+  }
+  wxMutexLocker lock(s_file_mutex);
+  open_files.clear();
+}
+
+bool GribTileStore::Store(const WR_GribRecordSet& set, int idx,
+                          const GribRecord& rec) {
+  if (set.m_Interpolated || !IsWorthStoring(rec)) return false;
+
+  PendingTileFile pending;
+  pending.dir = Directory();
+  if (!wxDirExists(pending.dir)) return false;
+
+  /* the checksum and the file are left to the writer thread, lookups read
+     this copy meanwhile */
+  StoredField field;
+  field.record = std::make_shared<GribRecord>(rec);
+  field.Ni = rec.getNi(), field.Nj = rec.getNj();
+  field.tiles_x = (field.Ni + TILE_SIZE - 1) / TILE_SIZE;
+  field.Lo1 = rec.getX(0), field.La1 = rec.getY(0);
+  field.Lo2 = rec.getX(field.Ni - 1), field.La2 = rec.getY(field.Nj - 1);
+  field.Di = rec.getDi(), field.Dj = rec.getDj();
+
+  pending.key = KeyOf(set, idx);
+  pending.record = field.record;
+  {
+    wxMutexLocker lock(s_store_mutex);
+    field.generation = pending.generation = ++store_generation;
+    /* possibly a different GRIB with the same id and time: tiles cached for
+       the field are stale */
+    DropCachedTiles(pending.key);
+    stored_fields[pending.key] = field;
+  }
+
+  WriteInBackground(pending);
+  return true;
+}
+
+void GribTileStore::Flush() { JoinWriter(); }
+
+bool GribTileStore::Contains(const WR_GribRecordSet& set, int idx) {
+  if (set.m_Interpolated) return false;
+  wxMutexLocker lock(s_store_mutex);
+  return stored_fields.find(KeyOf(set, idx)) != stored_fields.end();
+}
+
+size_t GribTileStore::CachedTiles() {
+  wxMutexLocker lock(s_store_mutex);
+  return tile_cache.size();
+}
+
+double GribTileStore::GetInterpolatedValue(const WR_GribRecordSet& set,
+                                           int idx, double px, double py) {
+  if (set.m_Interpolated) return GRIB_NOTDEF;
+  FieldKey key = KeyOf(set, idx);
+  StoredField f;
+  {
+    wxMutexLocker lock(s_store_mutex);
+    std::map<FieldKey, StoredField>::iterator it = stored_fields.find(key);
+    if (it == stored_fields.end()) return GRIB_NOTDEF;
+    f = it->second;
+  }
+  if (f.record) return f.record->getInterpolatedValue(px, py, true);
+  if (f.Di == 0 || f.Dj == 0) return GRIB_NOTDEF;
+
+  if (!IsXInMap(f, px) || !IsYInMap(f, py)) {
+    px += 360.0;
+    if (!IsXInMap(f, px) || !IsYInMap(f, py)) {
+      px -= 2 * 360.0;
+      if (!IsXInMap(f, px) || !IsYInMap(f, py)) return GRIB_NOTDEF;
+    }
+  }
+
+  /* same scheme as GribRecord::getInterpolatedValue */
+  double pi = (px - f.Lo1) / f.Di;
+  double pj = (py - f.La1) / f.Dj;
+  int i0 = wxMin((int)pi, f.Ni - 1);
+  int j0 = wxMin((int)pj, f.Nj - 1);
+  int i1 = pi + 1, j1 = pj + 1;
+  if (i1 >= f.Ni) i1 = i0;
+  if (j1 >= f.Nj) j1 = j0;
+
+  double dx = pi - i0;
+  double dy = pj - j0;
+
+  double x00 = Value(key, f, i0, j0), x10 = Value(key, f, i1, j0);
+  double x01 = Value(key, f, i0, j1), x11 = Value(key, f, i1, j1);
+
+  int nbval = (x00 != GRIB_NOTDEF) + (x10 != GRIB_NOTDEF) +
+              (x01 != GRIB_NOTDEF) + (x11 != GRIB_NOTDEF);
+  if (nbval < 3) return GRIB_NOTDEF;
+
+  dx = (3.0 - 2.0 * dx) * dx * dx;  // pseudo hermite interpolation
+  dy = (3.0 - 2.0 * dy) * dy * dy;
+
+  if (nbval == 4) {
+    double x1 = (1.0 - dx) * x00 + dx * x10;
+    double x2 = (1.0 - dx) * x01 + dx * x11;
+    return (1.0 - dy) * x1 + dy * x2;
+  }
+
+  double xa, xb, xc, kx, ky;
+  if (x00 == GRIB_NOTDEF) {
+    xa = x11, xb = x01, xc = x10;
+    kx = 1 - dx, ky = 1 - dy;
+  } else if (x01 == GRIB_NOTDEF) {
+    xa = x10, xb = x11, xc = x00;
+    kx = dy, ky = 1 - dx;
+  } else if (x10 == GRIB_NOTDEF) {
+    xa = x01, xb = x00, xc = x11;
+    kx = 1 - dy, ky = dx;
+  } else {
+    xa = x00, xb = x10, xc = x01;
+    kx = dx, ky = dy;
+  }
+
+  double k = kx + ky;
+  if (k < 0 || k > 1) return GRIB_NOTDEF;
+  if (k == 0) return xa;
+
+  double vx = k * xb + (1 - k) * xa;
+  double vy = k * xc + (1 - k) * xa;
+  double k2 = kx / k;
+  return k2 * vx + (1 - k2) * vy;
+}
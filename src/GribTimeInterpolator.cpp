@@ -0,0 +1,159 @@
+/***************************************************************************
+ *   Copyright (C) 2015 by OpenCPN development team                        *
+ *                                                                         *
+ *   This program is free software; you can redistribute it and/or modify  *
+ *   it under the terms of the GNU General Public License as published by  *
+ *   the Free Software Foundation; either version 3 of the License, or     *
+ *   (at your option) any later version.                                   *
+ *                                                                         *
+ *   This program is distributed in the hope that it will be useful,       *
+ *   but WITHOUT ANY WARRANTY; without even the implied warranty of        *
+ *   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the         *
+ *   GNU General Public License for more details.                          *
+ *                                                                         *
+ *   You should have received a copy of the GNU General Public License     *
+ *   along with this program; if not, write to the                         *
+ *   Free Software Foundation, Inc.,                                       *
+ *   51 Franklin Street, Fifth Floor, Boston, MA 02110-1301,  USA.         *
+ **************************************************************************/
+
+#include <wx/wx.h>
+
+#include <map>
+#include <mutex>
+#include <tuple>
+
+#include "GribTimeInterpolator.h"
+#include "WeatherDataProvider.h"
+
+namespace {
+
+// Each slab is a full copy of the weather grids, keep only a few around.
+// Routes computed together propagate through the same few timestamps.
+const size_t MAX_CACHED_SLABS = 8;
+
+// Record sets are identified by reference time and id rather than by address,
+// so routes holding separate copies of the same GRIB share their blends.
+typedef std::tuple<time_t, unsigned int, time_t, unsigned int, time_t> SlabKey;
+
+struct SlabEntry {
+  GribTimeInterpolator::Slab slab;
+  unsigned long last_used;
+};
+
+std::map<SlabKey, SlabEntry> slab_cache;
+unsigned long slab_clock = 0;
+std::mutex slab_cache_mutex;
+
+void EvictSlabs() {
+  while (slab_cache.size() > MAX_CACHED_SLABS) {
+    std::map<SlabKey, SlabEntry>::iterator oldest = slab_cache.begin();
+    for (std::map<SlabKey, SlabEntry>::iterator it = slab_cache.begin();
+         it != slab_cache.end(); ++it)
+      if (it->second.last_used < oldest->second.last_used) oldest = it;
+    slab_cache.erase(oldest);
+  }
+}
+
+}  // namespace
+
+WR_GribRecordSet* GribTimeInterpolator::GribAt(WR_GribRecordSet* before,
+                                               WR_GribRecordSet* after,
+                                               time_t time, Slab& holder) {
+  if (!before || !after) return before;
+  // blends are not identified by their id, never blend them again
+  if (before->m_Interpolated || after->m_Interpolated) return before;
+
+  time_t t1 = before->m_Reference_Time, t2 = after->m_Reference_Time;
+  // data deficient routes reuse an older grib, nothing to interpolate
+  if (t2 <= t1 || time <= t1) return before;
+  if (time >= t2) return after;
+
+  SlabKey key(t1, before->m_ID, t2, after->m_ID, time);
+  {
+    std::lock_guard<std::mutex> lock(slab_cache_mutex);
+    std::map<SlabKey, SlabEntry>::iterator it = slab_cache.find(key);
+    if (it != slab_cache.end()) {
+      it->second.last_used = ++slab_clock;
+      holder = it->second.slab;
+      return holder.get();
+    }
+  }
+
+  // blend outside of the lock, other threads may use already cached slabs
+  double d = (double)(time - t1) / (t2 - t1);
+  Slab slab(Blend(*before, *after, d, time));
+
+  std::lock_guard<std::mutex> lock(slab_cache_mutex);
+  std::pair<std::map<SlabKey, SlabEntry>::iterator, bool> ins =
+      slab_cache.insert(std::make_pair(key, SlabEntry{slab, 0}));
+  // if another thread computed the same slab meanwhile, share theirs
+  ins.first->second.last_used = ++slab_clock;
+  holder = ins.first->second.slab;
+  EvictSlabs();
+  return holder.get();
+}
+
+void GribTimeInterpolator::Clear() {
+  std::lock_guard<std::mutex> lock(slab_cache_mutex);
+  slab_cache.clear();
+}
+
+size_t GribTimeInterpolator::CachedSlabs() {
+  std::lock_guard<std::mutex> lock(slab_cache_mutex);
+  return slab_cache.size();
+}
+
+WR_GribRecordSet* GribTimeInterpolator::Blend(const WR_GribRecordSet& before,
+                                              const WR_GribRecordSet& after,
+                                              double d, time_t time) {
+  WR_GribRecordSet* set = new WR_GribRecordSet(before.m_ID);
+  set->m_Reference_Time = time;
+  set->m_Interpolated = true;
+
+  GribRecord* const* r1 = before.m_GribRecordPtrArray;
+  GribRecord* const* r2 = after.m_GribRecordPtrArray;
+
+  /* vector fields must be interpolated as magnitude and angle */
+  static const int vector_fields[][2] = {
+      {Idx_WIND_VX, Idx_WIND_VY},       {Idx_WIND_VX850, Idx_WIND_VY850},
+      {Idx_WIND_VX700, Idx_WIND_VY700}, {Idx_WIND_VX500, Idx_WIND_VY500},
+      {Idx_WIND_VX300, Idx_WIND_VY300}, {Idx_SEACURRENT_VX, Idx_SEACURRENT_VY}};
+  bool done[Idx_COUNT] = {false};
+
+  for (size_t v = 0; v < sizeof vector_fields / sizeof *vector_fields; v++) {
+    int x = vector_fields[v][0], y = vector_fields[v][1];
+    done[x] = done[y] = true;
+    if (r1[x] && r1[y] && r2[x] && r2[y]) {
+      GribRecord* ry;
+      GribRecord* rx = GribRecord::Interpolated2DRecord(ry, *r1[x], *r1[y],
+                                                        *r2[x], *r2[y], d);
+      if (rx && ry) {
+        set->SetUnRefGribRecord(x, rx);
+        set->SetUnRefGribRecord(y, ry);
+        continue;
+      }
+      delete rx;
+      delete ry;
+    }
+    if (r1[x] && r1[y]) {
+      set->SetUnRefGribRecord(x, new GribRecord(*r1[x]));
+      set->SetUnRefGribRecord(y, new GribRecord(*r1[y]));
+    } else if (r2[x] && r2[y]) {
+      set->SetUnRefGribRecord(x, new GribRecord(*r2[x]));
+      set->SetUnRefGribRecord(y, new GribRecord(*r2[y]));
+    }
+  }
+
+  for (int i = 0; i < Idx_COUNT; i++) {
+    if (done[i]) continue;
+    GribRecord* rec = nullptr;
+    if (r1[i] && r2[i])
+      rec = GribRecord::InterpolatedRecord(*r1[i], *r2[i], d, i == Idx_WVDIR);
+    if (!rec && r1[i]) rec = new GribRecord(*r1[i]);
+    if (!rec && r2[i]) rec = new GribRecord(*r2[i]);
+    if (rec) set->SetUnRefGribRecord(i, rec);
+  }
+
+  return set;
+}
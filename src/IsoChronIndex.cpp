@@ -0,0 +1,189 @@
+/***************************************************************************
+ *   Copyright (C) 2015 by OpenCPN development team                        *
+ *                                                                         *
+ *   This program is free software; you can redistribute it and/or modify  *
+ *   it under the terms of the GNU General Public License as published by  *
+ *   the Free Software Foundation; either version 3 of the License, or     *
+ *   (at your option) any later version.                                   *
+ *                                                                         *
+ *   This program is distributed in the hope that it will be useful,       *
+ *   but WITHOUT ANY WARRANTY; without even the implied warranty of        *
+ *   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the         *
+ *   GNU General Public License for more details.                          *
+ *                                                                         *
+ *   You should have received a copy of the GNU General Public License     *
+ *   along with this program; if not, write to the                         *
+ *   Free Software Foundation, Inc.,                                       *
+ *   51 Franklin Street, Fifth Floor, Boston, MA 02110-1301,  USA.         *
+ **************************************************************************/
+
+#include <wx/wx.h>
+
+#include <algorithm>
+#include <cmath>
+
+#include "IsoChronIndex.h"
+#include "Position.h"
+
+#define MAX_COLUMNS 1024
+
+IsoChronIndex::IsoChronIndex(const IsoRouteList& routes)
+    : m_RouteCount(0),
+      m_MinLon(INFINITY),
+      m_MaxLon(-INFINITY),
+      m_ColumnScale(0),
+      m_Columns(0) {
+  std::vector<Edge> edges;
+  for (IsoRouteList::const_iterator it = routes.begin(); it != routes.end();
+       ++it)
+    AddRoute(*it, m_RouteCount++, edges);
+
+  for (const Edge& e : edges) {
+    m_MinLon = fmin(m_MinLon, fmin(e.lon1, e.lon2));
+    m_MaxLon = fmax(m_MaxLon, fmax(e.lon1, e.lon2));
+  }
+
+  if (!edges.empty()) {
+    m_Columns =
+        std::min(MAX_COLUMNS, std::max(1, (int)sqrt((double)edges.size())));
+    if (m_MaxLon > m_MinLon) m_ColumnScale = m_Columns / (m_MaxLon - m_MinLon);
+
+    /* an edge is tested by every column its longitudes overlap */
+    m_ColumnStart.assign(m_Columns + 1, 0);
+    for (const Edge& e : edges) {
+      int last = Column(fmax(e.lon1, e.lon2));
+      for (int c = Column(fmin(e.lon1, e.lon2)); c <= last; c++)
+        m_ColumnStart[c + 1]++;
+    }
+    for (int c = 0; c < m_Columns; c++)
+      m_ColumnStart[c + 1] += m_ColumnStart[c];
+
+    m_ColumnEdges.resize(m_ColumnStart.back());
+    std::vector<int> fill(m_ColumnStart.begin(), m_ColumnStart.end() - 1);
+    for (const Edge& e : edges) {
+      int last = Column(fmax(e.lon1, e.lon2));
+      for (int c = Column(fmin(e.lon1, e.lon2)); c <= last; c++)
+        m_ColumnEdges[fill[c]++] = e;
+    }
+
+    for (int c = 0; c < m_Columns; c++)
+      std::sort(m_ColumnEdges.begin() + m_ColumnStart[c],
+                m_ColumnEdges.begin() + m_ColumnStart[c + 1],
+                [](const Edge& a, const Edge& b) {
+                  return a.maxlat > b.maxlat;
+                });
+  }
+
+  BuildTree(0, m_Points.size(), 0);
+}
+
+/* add the edges and positions of a route and its children */
+void IsoChronIndex::AddRoute(IsoRoute* route, int index,
+                             std::vector<Edge>& edges) {
+  if (route->skippoints) {
+    Position* p = route->skippoints->point;
+    do {
+      Position* q = p->next;
+      /* edges along a meridian never cross the ray */
+      if (p->lon != q->lon) {
+        Edge e = {p->lat, p->lon, q->lat, q->lon, fmax(p->lat, q->lat), index};
+        edges.push_back(e);
+      }
+      Point point = {p->lat, p->lon, p};
+      m_Points.push_back(point);
+      p = q;
+    } while (p != route->skippoints->point);
+  }
+
+  for (IsoRouteList::iterator it = route->children.begin();
+       it != route->children.end(); ++it)
+    AddRoute(*it, index, edges);
+}
+
+int IsoChronIndex::Column(double lon) const {
+  int c = (int)((lon - m_MinLon) * m_ColumnScale);
+  return c < 0 ? 0 : c >= m_Columns ? m_Columns - 1 : c;
+}
+
+/* A point is inside a route when the ray crosses the route and its children
+an odd number of times in total, see IsoRoute::Contains */
+bool IsoChronIndex::Contains(double lat, double lon) const {
+  if (!m_Columns || lon < m_MinLon || lon >= m_MaxLon) return false;
+
+  std::vector<char> odd(m_RouteCount, 0);
+  int c = Column(lon);
+  for (int i = m_ColumnStart[c]; i < m_ColumnStart[c + 1]; i++) {
+    const Edge& e = m_ColumnEdges[i];
+    if (e.maxlat <= lat) break; /* the rest is south of the point */
+
+    if ((lon < e.lon1) == (lon < e.lon2)) continue;
+
+    switch ((lat < e.lat1) + (lat < e.lat2)) {
+      case 1: { /* must perform exact intersection test */
+        double m1 = (lat - e.lat1) * (e.lon2 - e.lon1);
+        double m2 = (lon - e.lon1) * (e.lat2 - e.lat1);
+        if (e.lon1 < e.lon2 ? m1 < m2 : m1 > m2) odd[e.route] ^= 1;
+      } break;
+      case 2: /* must intersect, we are below */
+        odd[e.route] ^= 1;
+    }
+  }
+
+  return std::find(odd.begin(), odd.end(), 1) != odd.end();
+}
+
+void IsoChronIndex::BuildTree(int begin, int end, int depth) {
+  if (end - begin < 2) return;
+
+  int mid = (begin + end) / 2;
+  bool bylat = depth & 1;
+  std::nth_element(m_Points.begin() + begin, m_Points.begin() + mid,
+                   m_Points.begin() + end,
+                   [bylat](const Point& a, const Point& b) {
+                     return bylat ? a.lat < b.lat : a.lon < b.lon;
+                   });
+  BuildTree(begin, mid, depth + 1);
+  BuildTree(mid + 1, end, depth + 1);
+}
+
+void IsoChronIndex::Nearest(int begin, int end, int depth, double lat,
+                            double lon, int& best, double& bestdist) const {
+  if (begin >= end) return;
+
+  int mid = (begin + end) / 2;
+  const Point& p = m_Points[mid];
+  double dlat = lat - p.lat, dlon = lon - p.lon;
+  double dist = dlat * dlat + dlon * dlon;
+  if (dist < bestdist) {
+    best = mid;
+    bestdist = dist;
+  }
+
+  double split = depth & 1 ? dlat : dlon;
+  /* search the side of the query first, the other only if it can be closer */
+  if (split < 0) {
+    Nearest(begin, mid, depth + 1, lat, lon, best, bestdist);
+    if (split * split < bestdist)
+      Nearest(mid + 1, end, depth + 1, lat, lon, best, bestdist);
+  } else {
+    Nearest(mid + 1, end, depth + 1, lat, lon, best, bestdist);
+    if (split * split < bestdist)
+      Nearest(begin, mid, depth + 1, lat, lon, best, bestdist);
+  }
+}
+
+Position* IsoChronIndex::ClosestPosition(double lat, double lon,
+                                         double* dist) const {
+  int best = -1;
+  double bestdist = INFINITY;
+  Nearest(0, m_Points.size(), 0, lat, lon, best, bestdist);
+
+  if (dist) *dist = bestdist;
+  return best < 0 ? nullptr : m_Points[best].position;
+}
+
+size_t IsoChronIndex::MemoryUsage() const {
+  return sizeof(IsoChronIndex) + m_ColumnStart.capacity() * sizeof(int) +
+         m_ColumnEdges.capacity() * sizeof(Edge) +
+         m_Points.capacity() * sizeof(Point);
+}
@@ -19,8 +19,15 @@
 
 #include <wx/wx.h>
 
+#include <algorithm>
+#include <cmath>
 #include <map>
+#include <queue>
+#include <unordered_map>
+#include <unordered_set>
+#include <vector>
 
+#include "IsoChronIndex.h"
 #include "IsoRoute.h"
 #include "Position.h"
 #include "RouteMap.h"
@@ -232,6 +239,7 @@ void IsoRoute::UpdateStatistics(int& routes, int& invroutes, int& skippositions,
 }
 
 IsoChron::~IsoChron() {
+  DeleteIndex();
   for (IsoRouteList::iterator it = routes.begin(); it != routes.end(); ++it)
     delete *it;
 }
@@ -285,7 +293,40 @@ void IsoChron::PropagateIntoList(IsoRouteList& routelist,
   }
 }
 
+IsoChronIndex* IsoChron::GetIndex() {
+  IsoChronIndex* index = m_Index.load(std::memory_order_acquire);
+  if (index || ++m_Queries < IsoChronIndex::MIN_QUERIES) return index;
+
+  std::lock_guard<std::mutex> lock(m_IndexMutex);
+  index = m_Index.load(std::memory_order_relaxed);
+  if (!index) {
+    index = new IsoChronIndex(routes);
+    if (m_IndexMemory) *m_IndexMemory += index->MemoryUsage();
+    m_Index.store(index, std::memory_order_release);
+  }
+  return index;
+}
+
+void IsoChron::DeleteIndex() {
+  std::lock_guard<std::mutex> lock(m_IndexMutex);
+  IsoChronIndex* index = m_Index.exchange(nullptr);
+  if (index && m_IndexMemory) *m_IndexMemory -= index->MemoryUsage();
+  delete index;
+}
+
+void IsoChron::SetIndexMemory(std::atomic<size_t>* counter) {
+  std::lock_guard<std::mutex> lock(m_IndexMutex);
+  if (counter == m_IndexMemory) return;
+  if (IsoChronIndex* index = m_Index.load()) {
+    if (m_IndexMemory) *m_IndexMemory -= index->MemoryUsage();
+    if (counter) *counter += index->MemoryUsage();
+  }
+  m_IndexMemory = counter;
+}
+
 bool IsoChron::Contains(Position& p) {
+  if (IsoChronIndex* index = GetIndex()) return index->Contains(p.lat, p.lon);
+
   for (IsoRouteList::iterator it = routes.begin(); it != routes.end(); ++it)
     switch ((*it)->Contains(p, true)) {
       case -1:  // treat too close to call as not contained
@@ -307,15 +348,20 @@ Position* IsoChron::ClosestPosition(double lat, double lon, wxDateTime* t,
   Position* minpos = nullptr;
   double mindist = INFINITY;
   wxDateTime mint;
-  for (IsoRouteList::iterator it = routes.begin(); it != routes.end(); ++it) {
-    double dist;
-    Position* pos = (*it)->ClosestPosition(lat, lon, &dist);
-    if (pos && dist < mindist) {
-      minpos = pos;
-      mindist = dist;
-      mint = time;
+  if (IsoChronIndex* index = GetIndex()) {
+    minpos = index->ClosestPosition(lat, lon, &mindist);
+    if (minpos) mint = time;
+  } else
+    for (IsoRouteList::iterator it = routes.begin(); it != routes.end();
+         ++it) {
+      double dist;
+      Position* pos = (*it)->ClosestPosition(lat, lon, &dist);
+      if (pos && dist < mindist) {
+        minpos = pos;
+        mindist = dist;
+        mint = time;
+      }
     }
-  }
   if (d) *d = mindist;
   if (t) *t = mint;
   return minpos;
@@ -326,6 +372,65 @@ void IsoChron::ResetDrawnFlag() {
     (*it)->ResetDrawnFlag();
 }
 
+void IsoChron::Freeze() { m_Frozen = true; }
+
+/* delete the positions of route and its children not in keep, appending the
+   others to kept, and leave the routes empty */
+static void KeepRoutePositions(IsoRoute* route,
+                               const std::unordered_set<Position*>& keep,
+                               std::vector<Position*>& kept) {
+  for (IsoRouteList::iterator it = route->children.begin();
+       it != route->children.end(); it++)
+    KeepRoutePositions(*it, keep, kept);
+
+  if (!route->skippoints) return;
+
+  Position* point = route->skippoints->point;
+  Position* p = point;
+  do {
+    Position* q = p;
+    p = p->next;
+    if (keep.count(q))
+      kept.push_back(q);
+    else
+      delete q;
+  } while (p != point);
+
+  DeleteSkipPoints(route->skippoints);
+  route->skippoints = nullptr;
+}
+
+void IsoChron::KeepPositions(const std::unordered_set<Position*>& keep) {
+  std::vector<Position*> kept;
+  for (IsoRouteList::iterator it = routes.begin(); it != routes.end(); ++it) {
+    KeepRoutePositions(*it, keep, kept);
+    delete *it;
+  }
+  routes.clear();
+
+  DeleteIndex();
+  m_Queries = 0;
+
+  if (!kept.empty()) {
+    for (size_t i = 0; i < kept.size(); i++) {
+      kept[i]->next = kept[(i + 1) % kept.size()];
+      kept[(i + 1) % kept.size()]->prev = kept[i];
+    }
+    routes.push_back(new IsoRoute(kept.front()->BuildSkipList()));
+  }
+  m_Frozen = true;
+}
+
+void IsoChron::GetMemoryUsage(RouteMapMemory& memory) {
+  int routecount = 0, invroutes = 0, skippositions = 0, positions = 0;
+  for (IsoRouteList::iterator it = routes.begin(); it != routes.end(); ++it)
+    (*it)->UpdateStatistics(routecount, invroutes, skippositions, positions);
+
+  memory.positions += positions * sizeof(Position);
+  memory.skippositions += skippositions * sizeof(SkipPosition);
+  memory.routes += sizeof(IsoChron) + routecount * sizeof(IsoRoute);
+}
+
 IsoRoute::IsoRoute(SkipPosition* s, int dir)
     : skippoints(s), direction(dir), parent(nullptr) {
   /* make sure the skip points start at the minimum
@@ -337,6 +442,18 @@ IsoRoute::IsoRoute(SkipPosition* s, int dir)
 IsoRoute::IsoRoute(IsoRoute* r, IsoRoute* p)
     : skippoints(r->skippoints->Copy()), direction(r->direction), parent(p) {}
 
+void* IsoRoute::operator new(size_t size) {
+  if (size != sizeof(IsoRoute)) return ::operator new(size);
+  return FreeListPool<sizeof(IsoRoute)>::Allocate();
+}
+
+void IsoRoute::operator delete(void* p, size_t size) {
+  if (size != sizeof(IsoRoute))
+    ::operator delete(p);
+  else
+    FreeListPool<sizeof(IsoRoute)>::Release(p);
+}
+
 IsoRoute::~IsoRoute() {
   for (IsoRouteList::iterator it = children.begin(); it != children.end(); ++it)
     delete *it;
@@ -582,27 +699,186 @@ bool IsoRoute::ContainsRoute(IsoRoute* r) {
   return true; /* probably good to say it is contained in this unlikely case */
 }
 
+/* skip positions by the position their run starts at */
+typedef std::unordered_map<Position*, SkipPosition*> SkipPositionMap;
+
+static void RemoveSkipPosition(IsoRoute* route, SkipPosition* s,
+                               SkipPositionMap& skipat) {
+  skipat.erase(s->point);
+  if (route->skippoints == s) route->skippoints = s->next;
+  s->Remove();
+}
+
+/* remove and delete position q, updating the skip list around it instead of
+rebuilding it.  Removing a position inside a run of one quadrant leaves the
+skip list valid, since the edge replacing it keeps that quadrant.  Removing
+the first position of a run merges the edges around it into the run before,
+which may split off or join a run. */
+static void ReducePosition(IsoRoute* route, Position* q,
+                           SkipPositionMap& skipat, bool& rebuild) {
+  Position *p = q->prev, *n = q->next;
+  p->next = n;
+  n->prev = p;
+
+  SkipPositionMap::iterator it = skipat.find(q);
+  if (it != skipat.end() && !rebuild) {
+    if (skipat.size() < 4) {
+      /* too few runs to fix up, build the skip list again when done */
+      rebuild = true;
+    } else {
+      SkipPosition* s = it->second;
+      SkipPosition* a = s->prev; /* the run the edge p q ended */
+      if (s->next->point == n)
+        RemoveSkipPosition(route, s, skipat);
+      else {
+        skipat.erase(it);
+        s->point = n;
+        skipat[n] = s;
+      }
+
+      int quadrant = ComputeQuadrantFast(p, n);
+      if (quadrant != a->quadrant) {
+        if (a->point == p)
+          a->quadrant = quadrant;
+        else {
+          SkipPosition* b = new SkipPosition(p, quadrant);
+          b->prev = a;
+          b->next = a->next;
+          a->next->prev = b;
+          a->next = b;
+          skipat[p] = b;
+          a = b;
+        }
+      }
+
+      /* neighboring runs always have different quadrants */
+      if (a->next->quadrant == a->quadrant)
+        RemoveSkipPosition(route, a->next, skipat);
+      if (a->prev->quadrant == a->quadrant)
+        RemoveSkipPosition(route, a, skipat);
+    }
+  }
+  delete q;
+}
+
+/* twice the area of the triangle p q r */
+static inline double TriangleArea(const Position* p, const Position* q,
+                                  const Position* r) {
+  return fabs((q->lon - p->lon) * (r->lat - p->lat) -
+              (r->lon - p->lon) * (q->lat - p->lat));
+}
+
+/* Visvalingam decimation: repeatedly remove the position spanning the smallest
+triangle with its neighbors, while that triangle is smaller than half a square
+of the resolution, or while there are more than max_positions positions.  The
+first positions of runs are kept, so the skip list stays valid.  Returns a
+position of the route left after decimating. */
+static Position* DecimatePositions(IsoRoute* route, double resolution,
+                                   int max_positions, SkipPositionMap& skipat,
+                                   bool& rebuild) {
+  std::vector<Position*> positions;
+  Position* p = route->skippoints->point;
+  do {
+    positions.push_back(p);
+    p = p->next;
+  } while (p != route->skippoints->point);
+
+  int count = positions.size();
+  std::vector<int> prev(count), next(count);
+  std::vector<double> area(count);
+  typedef std::pair<double, int> Candidate;
+  std::priority_queue<Candidate, std::vector<Candidate>,
+                      std::greater<Candidate> >
+      candidates;
+  for (int i = 0; i < count; i++) {
+    prev[i] = i ? i - 1 : count - 1;
+    next[i] = i + 1 < count ? i + 1 : 0;
+    area[i] = TriangleArea(positions[prev[i]], positions[i],
+                           positions[next[i]]);
+    if (!skipat.count(positions[i])) candidates.push(Candidate(area[i], i));
+  }
+
+  double threshold = resolution * resolution, last = 0;
+  while (!candidates.empty() && count > 3) {
+    Candidate c = candidates.top();
+    int i = c.second;
+    if (!positions[i] || c.first != area[i]) {
+      candidates.pop(); /* removed, or its area changed since */
+      continue;
+    }
+    if (c.first >= threshold && (max_positions <= 0 || count <= max_positions))
+      break;
+    candidates.pop();
+
+    ReducePosition(route, positions[i], skipat, rebuild);
+    positions[i] = nullptr;
+    count--;
+    next[prev[i]] = next[i];
+    prev[next[i]] = prev[i];
+
+    /* the triangles of the neighbors change, and never get smaller than the
+       one removed so they are removed in order of significance */
+    last = std::max(last, c.first);
+    for (int j : {prev[i], next[i]}) {
+      if (skipat.count(positions[j])) continue;
+      area[j] = std::max(last, TriangleArea(positions[prev[j]], positions[j],
+                                            positions[next[j]]));
+      candidates.push(Candidate(area[j], j));
+    }
+  }
+
+  for (int i = 0;; i++)
+    if (positions[i]) return positions[i];
+}
+
 /* remove points which are right next to eachother on the graph to speed
-computation time */
-void IsoRoute::ReduceClosePoints() {
-  const double eps = 2e-5; /* resolution of 2 meters should be sufficient */
-  Position* p = skippoints->point;
-  while (p != skippoints->point->prev) {
+computation time, and optionally decimate the route to the given resolution in
+degrees, or to at most max_positions.  Without decimation the skip list is
+rebuilt as it always was; only decimation updates it in place. */
+void IsoRoute::ReduceClosePoints(double resolution, int max_positions) {
+  bool decimate = resolution > 0 || max_positions > 0;
+  /* resolution of 2 meters should be sufficient */
+  const double eps = std::max(2e-5, resolution);
+
+  SkipPositionMap skipat;
+  if (decimate) {
+    SkipPosition* s = skippoints;
+    do {
+      skipat[s->point] = s;
+      s = s->next;
+    } while (s != skippoints);
+  }
+
+  bool rebuild = !decimate;
+  /* p is never removed, start may be once it no longer starts a run */
+  Position *start = skippoints->point, *p = start;
+  while (p != start->prev) {
     Position* n = p->next;
     double dlat = p->lat - n->lat, dlon = p->lon - n->lon;
-    if (fabs(dlat) < eps && fabs(dlon) < eps) {
-      p->next = n->next;
-      n->next->prev = p;
-      delete n;
-    } else
+    if (fabs(dlat) < eps && fabs(dlon) < eps)
+      ReducePosition(this, n, skipat, rebuild);
+    else
       p = n;
   }
 
-  DeleteSkipPoints(skippoints);
-  skippoints = p->BuildSkipList();
+  if (!decimate) {
+    DeleteSkipPoints(skippoints);
+    skippoints = p->BuildSkipList();
+  } else {
+    if (!rebuild)
+      p = DecimatePositions(this, resolution, max_positions, skipat, rebuild);
+
+    if (rebuild) {
+      DeleteSkipPoints(skippoints);
+      skippoints = p->BuildSkipList();
+    }
+    /* make sure the skip points start at the minimum
+       latitude so we know we are on the outside */
+    MinimizeLat();
+  }
 
   for (IsoRouteList::iterator it = children.begin(); it != children.end(); it++)
-    (*it)->ReduceClosePoints();
+    (*it)->ReduceClosePoints(resolution, max_positions);
 }
 
 /* apply current to given route, and return if it changed at all */
@@ -975,6 +1251,152 @@ bool UpdateEnd(SkipPosition* spend, SkipPosition* sr) {
       goto skip;                                      \
   }
 
+/* Uniform grid screen run before the flip logic of Normalize.
+
+The skip list walk below only tests segment pairs with overlapping bounds, but
+it still visits every pair of skip segments, which is quadratic in dense
+isochrones.  Hashing the segment bounds of one route into a grid finds the
+candidate pairs in time proportional to the number of segments plus the number
+of overlaps.  Without a candidate pair the walk cannot find an intersection, so
+it is skipped entirely; otherwise the walk runs unchanged since the order the
+intersections are flipped in matters.
+*/
+struct SegmentBounds {
+  double minx, maxx, miny, maxy;
+};
+
+/* segments closer than this are candidates, the walk treats touching bounds as
+ * overlapping */
+#define SCREEN_MARGIN 1e-9
+/* below this many segments the walk is cheaper than building the grid */
+#define SCREEN_MIN_SEGMENTS 32
+#define SCREEN_MAX_GRID 256
+
+static void CollectSegmentBounds(IsoRoute* route,
+                                 std::vector<SegmentBounds>& bounds) {
+  bounds.clear();
+  Position* p = route->skippoints->point;
+  do {
+    Position* q = p->next;
+    SegmentBounds b = {fmin(p->lon, q->lon) - SCREEN_MARGIN,
+                       fmax(p->lon, q->lon) + SCREEN_MARGIN,
+                       fmin(p->lat, q->lat) - SCREEN_MARGIN,
+                       fmax(p->lat, q->lat) + SCREEN_MARGIN};
+    bounds.push_back(b);
+    p = q;
+  } while (p != route->skippoints->point);
+}
+
+class SegmentGrid {
+public:
+  void Build(const std::vector<SegmentBounds>& bounds) {
+    m_minx = m_miny = INFINITY;
+    m_maxx = m_maxy = -INFINITY;
+    for (const SegmentBounds& b : bounds) {
+      m_minx = fmin(m_minx, b.minx), m_maxx = fmax(m_maxx, b.maxx);
+      m_miny = fmin(m_miny, b.miny), m_maxy = fmax(m_maxy, b.maxy);
+    }
+
+    m_size = std::min(SCREEN_MAX_GRID,
+                      std::max(1, (int)sqrt((double)bounds.size())));
+    m_scalex = m_size / (m_maxx - m_minx);
+    m_scaley = m_size / (m_maxy - m_miny);
+
+    /* compressed rows: count the segments of each cell, then fill */
+    m_start.assign(m_size * m_size + 1, 0);
+    for (const SegmentBounds& b : bounds) {
+      int x0, x1, y0, y1;
+      CellRange(b, x0, x1, y0, y1);
+      for (int y = y0; y <= y1; y++)
+        for (int x = x0; x <= x1; x++) m_start[y * m_size + x + 1]++;
+    }
+    for (int i = 0; i < m_size * m_size; i++) m_start[i + 1] += m_start[i];
+
+    m_segments.resize(m_start.back());
+    m_fill.assign(m_start.begin(), m_start.end() - 1);
+    for (int i = 0; i < (int)bounds.size(); i++) {
+      int x0, x1, y0, y1;
+      CellRange(bounds[i], x0, x1, y0, y1);
+      for (int y = y0; y <= y1; y++)
+        for (int x = x0; x <= x1; x++) m_segments[m_fill[y * m_size + x]++] = i;
+    }
+  }
+
+  /* true if a segment other than skip(index) has bounds overlapping b */
+  template <typename Skip>
+  bool Overlaps(const SegmentBounds& b,
+                const std::vector<SegmentBounds>& bounds, Skip skip) const {
+    if (b.maxx < m_minx || b.minx > m_maxx || b.maxy < m_miny ||
+        b.miny > m_maxy)
+      return false;
+
+    int x0, x1, y0, y1;
+    CellRange(b, x0, x1, y0, y1);
+    for (int y = y0; y <= y1; y++)
+      for (int x = x0; x <= x1; x++) {
+        int cell = y * m_size + x;
+        for (int k = m_start[cell]; k < m_start[cell + 1]; k++) {
+          int j = m_segments[k];
+          const SegmentBounds& c = bounds[j];
+          if (c.maxx < b.minx || c.minx > b.maxx || c.maxy < b.miny ||
+              c.miny > b.maxy || skip(j))
+            continue;
+          return true;
+        }
+      }
+    return false;
+  }
+
+private:
+  int Cell(double v, double min, double scale) const {
+    int c = (int)((v - min) * scale);
+    return c < 0 ? 0 : c >= m_size ? m_size - 1 : c;
+  }
+
+  void CellRange(const SegmentBounds& b, int& x0, int& x1, int& y0,
+                 int& y1) const {
+    x0 = Cell(b.minx, m_minx, m_scalex), x1 = Cell(b.maxx, m_minx, m_scalex);
+    y0 = Cell(b.miny, m_miny, m_scaley), y1 = Cell(b.maxy, m_miny, m_scaley);
+  }
+
+  double m_minx, m_maxx, m_miny, m_maxy, m_scalex, m_scaley;
+  int m_size;
+  std::vector<int> m_start, m_fill, m_segments;
+};
+
+/* false only if no segment of route1 can intersect a segment of route2, or when
+ * normalizing (route1 == route2) a non adjacent segment of the same route */
+static bool MayIntersect(IsoRoute* route1, IsoRoute* route2) {
+  /* Normalize runs concurrently for different route maps */
+  thread_local std::vector<SegmentBounds> bounds1, bounds2;
+  thread_local SegmentGrid grid;
+
+  CollectSegmentBounds(route2, bounds2);
+  if (route1 == route2) {
+    int n = bounds2.size();
+    if (n < SCREEN_MIN_SEGMENTS) return true;
+
+    grid.Build(bounds2);
+    for (int i = 0; i < n; i++) {
+      int prev = i ? i - 1 : n - 1, next = i + 1 < n ? i + 1 : 0;
+      /* each pair is found from both of its segments, test it once */
+      if (grid.Overlaps(bounds2[i], bounds2, [i, prev, next](int j) {
+            return j <= i || j == prev || j == next;
+          }))
+        return true;
+    }
+    return false;
+  }
+
+  CollectSegmentBounds(route1, bounds1);
+  if (bounds1.size() + bounds2.size() < SCREEN_MIN_SEGMENTS) return true;
+
+  grid.Build(bounds2);
+  for (const SegmentBounds& b : bounds1)
+    if (grid.Overlaps(b, bounds2, [](int) { return false; })) return true;
+  return false;
+}
+
 /* This function is the heart of the route map algorithm.
 Essentially search for intersecting line segments, and flip them correctly
 while maintaining a skip list.
@@ -982,6 +1404,7 @@ while maintaining a skip list.
 bool Normalize(IsoRouteList& rl, IsoRoute* route1, IsoRoute* route2, int level,
                bool inverted_regions) {
   bool normalizing;
+  bool screened = false;
 
 reset:
   SkipPosition *spend = route1->skippoints, *ssend = route2->skippoints;
@@ -1004,6 +1427,16 @@ reset:
     normalizing = false;
   }
 
+  if (!screened) {
+    screened = true;
+    if (!MayIntersect(route1, route2)) {
+      if (!normalizing) return false;
+      route1->MinimizeLat();
+      rl.push_back(route1);
+      return true;
+    }
+  }
+
   SkipPosition* sp = spend;
 startnormalizing:
   do {
@@ -1449,10 +1882,26 @@ IsoChron::IsoChron(IsoRouteList r, wxDateTime t, double d,
       delta(d),
       m_SharedGrib(g),
       m_Grib(0),
-      m_Grib_is_data_deficient(grib_is_data_deficient) {
+      m_Grib_is_data_deficient(grib_is_data_deficient),
+      m_Index(nullptr),
+      m_IndexMemory(nullptr),
+      m_Queries(0),
+      m_Frozen(false) {
   m_Grib = m_SharedGrib.GetGribRecordSet();
   if (m_Grib) {
     wxMutexLocker lock(s_key_mutex);
     grib_key[m_Grib->m_Reference_Time] = &m_SharedGrib;
   }
 }
+
+void IsoChron::ReleaseGrib() {
+  if (m_Grib) {
+    wxMutexLocker lock(s_key_mutex);
+    std::map<time_t, Shared_GribRecordSetRef>::iterator it =
+        grib_key.find(m_Grib->m_Reference_Time);
+    if (it != grib_key.end() && it->second.get() == &m_SharedGrib)
+      grib_key.erase(it);
+  }
+  m_SharedGrib = Shared_GribRecordSet();
+  m_Grib = nullptr;
+}
@@ -0,0 +1,52 @@
+/***************************************************************************
+ *   Copyright (C) 2015 by OpenCPN development team                        *
+ *                                                                         *
+ *   This program is free software; you can redistribute it and/or modify  *
+ *   it under the terms of the GNU General Public License as published by  *
+ *   the Free Software Foundation; either version 3 of the License, or     *
+ *   (at your option) any later version.                                   *
+ *                                                                         *
+ *   This program is distributed in the hope that it will be useful,       *
+ *   but WITHOUT ANY WARRANTY; without even the implied warranty of        *
+ *   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the         *
+ *   GNU General Public License for more details.                          *
+ *                                                                         *
+ *   You should have received a copy of the GNU General Public License     *
+ *   along with this program; if not, write to the                         *
+ *   Free Software Foundation, Inc.,                                       *
+ *   51 Franklin Street, Fifth Floor, Boston, MA 02110-1301,  USA.         *
+ **************************************************************************/
+
+#include <wx/wx.h>
+
+#include <atomic>
+
+#include "MemoryGovernor.h"
+
+const int MemoryGovernor::DEFAULT_BUDGET = sizeof(void*) == 4 ? 1024 : 8192;
+const double MemoryGovernor::THROTTLE_LOAD = 0.9;
+const double MemoryGovernor::RESUME_LOAD = 0.75;
+
+static std::atomic<int> s_budget(MemoryGovernor::DEFAULT_BUDGET);
+
+MemoryGovernor::State MemoryGovernor::Update(double load) {
+  if (load >= 1)
+    m_State = SHEDDING;
+  else if (load >= THROTTLE_LOAD) {
+    if (m_State == NORMAL) m_State = THROTTLED;
+  } else if (load >= RESUME_LOAD) {
+    if (m_State == SHEDDING) m_State = THROTTLED;
+  } else
+    m_State = NORMAL;
+  return m_State;
+}
+
+void MemoryGovernor::SetBudget(int megabytes) {
+  s_budget = megabytes > 0 ? megabytes : 0;
+}
+
+int MemoryGovernor::GetBudget() { return s_budget; }
+
+size_t MemoryGovernor::GetBudgetBytes() {
+  return (size_t)s_budget.load() * 1024 * 1024;
+}
@@ -187,11 +187,22 @@ bool Position::rk_step(double timeseconds, double cog, double dist, double twa,
   double k1_lat, k1_lon;
   ll_gc_ll(lat, lon, cog, dist, &k1_lat, &k1_lon);
 
+  // read the weather valid at the substep time when it was interpolated
+  WR_GribRecordSet* step_grib = configuration.grib;
+  wxDateTime step_time = configuration.time;
+  if (grib && grib != configuration.grib) {
+    configuration.grib = grib;
+    configuration.time = time;
+  }
+
   WeatherData weather_data(this);
   Position rk(k1_lat, k1_lon,
               parent);  // parent so deficient data can find parent
-  if (!weather_data.ReadWeatherDataAndCheckConstraints(
-          configuration, &rk, data_mask, propagation_error, false /*end*/)) {
+  bool ok = weather_data.ReadWeatherDataAndCheckConstraints(
+      configuration, &rk, data_mask, propagation_error, false /*end*/);
+  configuration.grib = step_grib;
+  configuration.time = step_time;
+  if (!ok) {
     return false;
   }
   double ctw =
@@ -235,6 +246,12 @@ bool Position::Propagate(IsoRouteList& routelist,
     return false;
   }
 
+  // route maps keep their own pipeline, the default order is used otherwise
+  ConstraintPipeline default_constraints;
+  ConstraintPipeline& constraints = configuration.constraints
+                                        ? *configuration.constraints
+                                        : default_constraints;
+
   bool first_avoid = true;
   Position* rp;
 
@@ -363,22 +380,21 @@ bool Position::Propagate(IsoRouteList& routelist,
       double dlat, dlon;
       if (configuration.Integrator == RouteMapConfiguration::RUNGE_KUTTA) {
         double k2_dist, k2_BG, k3_dist, k3_BG, k4_dist, k4_BG;
-        // a lot more experimentation is needed here, maybe use grib for the
-        // right time??
+        // substeps use the grib interpolated to their own time
         wxDateTime rk_time_2 =
             configuration.time + wxTimeSpan::Seconds(timeseconds / 2);
         wxDateTime rk_time =
             configuration.time + wxTimeSpan::Seconds(timeseconds);
         if (!rk_step(timeseconds, boat_data.cog, boat_data.dist / 2, twa,
-                     configuration, configuration.grib, rk_time_2, newpolar,
-                     k2_BG, k2_dist, data_mask) ||
+                     configuration, configuration.rk_grib_2, rk_time_2,
+                     newpolar, k2_BG, k2_dist, data_mask) ||
             !rk_step(timeseconds, boat_data.cog, k2_dist / 2,
                      twa + k2_BG - boat_data.cog, configuration,
-                     configuration.grib, rk_time_2, newpolar, k3_BG, k3_dist,
-                     data_mask) ||
+                     configuration.rk_grib_2, rk_time_2, newpolar, k3_BG,
+                     k3_dist, data_mask) ||
             !rk_step(timeseconds, boat_data.cog, k3_dist,
                      twa + k3_BG - boat_data.cog, configuration,
-                     configuration.grib, rk_time, newpolar, k4_BG, k4_dist,
+                     configuration.rk_grib, rk_time, newpolar, k4_BG, k4_dist,
                      data_mask)) {
           continue;
         }
@@ -400,57 +416,12 @@ bool Position::Propagate(IsoRouteList& routelist,
 #endif
 
       if (configuration.positive_longitudes && dlon < 0) dlon += 360;
-      if (!ConstraintChecker::CheckMaxCourseAngleConstraint(configuration, dlat,
-                                                            dlon)) {
-        continue;
-      }
-      if (!ConstraintChecker::CheckMaxDivertedCourse(configuration, dlat,
-                                                     dlon)) {
-        continue;
-      }
-
-      /* quick test first to avoid slower calculation */
-      if (!ConstraintChecker::CheckMaxApparentWindConstraint(
-              configuration, boat_data.stw, twa, weather_data.twsOverWater,
-              propagation_error)) {
-        continue;
-      }
-
-      if (configuration.DetectLand || configuration.DetectBoundary) {
-        double dlat1, dlon1;
-        double bearing, dist2end;
-        double dist2test;
-
-        // it's not an error if there's boundaries after we reach destination
-        ll_gc_ll_reverse(lat, lon, configuration.EndLat, configuration.EndLon,
-                         &bearing, &dist2end);
-        if (dist2end < boat_data.dist) {
-          dist2test = dist2end;
-          ll_gc_ll(lat, lon, heading_resolve(boat_data.cog), dist2test, &dlat1,
-                   &dlon1);
-        } else {
-          dlat1 = dlat;
-          dlon1 = dlon;
-        }
-
-        /* landfall test */
-        if (!ConstraintChecker::CheckLandConstraint(
-                configuration, lat, lon, dlat1, dlon1, boat_data.cog)) {
-          configuration.land_crossing = true;
-          continue;
-        }
-
-        /* Boundary test */
-        if (configuration.DetectBoundary) {
-          if (EntersBoundary(dlat1, dlon1)) {
-            configuration.boundary_crossing = true;
-            continue;
-          }
-        }
-      }
-      /* crosses cyclone track(s)? */
-      if (!ConstraintChecker::CheckCycloneTrackConstraint(configuration, lat,
-                                                          lon, dlat, dlon)) {
+      PropagationCandidate candidate = {lat,           lon,
+                                        dlat,          dlon,
+                                        boat_data.cog, boat_data.dist,
+                                        boat_data.stw, twa,
+                                        weather_data.twsOverWater};
+      if (!constraints.Check(configuration, candidate, propagation_error)) {
         continue;
       }
 
@@ -69,12 +69,16 @@
 #include <list>
 #include <map>
 #include <algorithm>
+#include <iterator>
 
 #include "Utilities.h"
 #include "ConstraintChecker.h"
+#include "GribTileStore.h"
+#include "GribTimeInterpolator.h"
 #include "RoutePoint.h"
 #include "IsoRoute.h"
 #include "RouteMap.h"
+#include "RouteMapSnapshot.h"
 #include "WeatherDataProvider.h"
 #include "weather_routing_pi.h"
 
@@ -86,6 +90,50 @@ Shared_GribRecordSetData::~Shared_GribRecordSetData() {
   delete m_GribRecordSet;
 }
 
+RouteMapMemory& RouteMapMemory::operator+=(const RouteMapMemory& m) {
+  positions += m.positions;
+  skippositions += m.skippositions;
+  routes += m.routes;
+  grib += m.grib;
+  plotdata += m.plotdata;
+  render += m.render;
+  return *this;
+}
+
+RouteMapMemory& RouteMapMemory::operator-=(const RouteMapMemory& m) {
+  positions -= m.positions;
+  skippositions -= m.skippositions;
+  routes -= m.routes;
+  grib -= m.grib;
+  plotdata -= m.plotdata;
+  render -= m.render;
+  return *this;
+}
+
+Json::Value RouteMapMemory::ToJSON() const {
+  Json::Value v;
+  v["positions"] = (Json::UInt64)positions;
+  v["skippositions"] = (Json::UInt64)skippositions;
+  v["routes"] = (Json::UInt64)routes;
+  v["grib"] = (Json::UInt64)grib;
+  v["plotdata"] = (Json::UInt64)plotdata;
+  v["render"] = (Json::UInt64)render;
+  v["total"] = (Json::UInt64)Total();
+  return v;
+}
+
+/* heap memory of a copied grib record set */
+static size_t GribMemory(WR_GribRecordSet* grib) {
+  size_t bytes = sizeof(WR_GribRecordSet);
+  for (int i = 0; i < Idx_COUNT; i++) {
+    GribRecord* rec = grib->m_GribRecordPtrArray[i];
+    if (rec)
+      bytes += sizeof(GribRecord) +
+               (size_t)rec->getNi() * rec->getNj() * sizeof(double);
+  }
+  return bytes;
+}
+
 weather_routing_pi* RouteMapConfiguration::s_plugin_instance = nullptr;
 
 RouteMapConfiguration::RouteMapConfiguration()
@@ -96,9 +144,15 @@ RouteMapConfiguration::RouteMapConfiguration()
       UseMotor(false),
       MotorSpeedThreshold(2.0),
       MotorSpeed(5.0),
+      DecimationFactor(0),
+      MaxRoutePositions(0),
+      Retention(RETAIN_FULL),
       StartLon(0),
       EndLon(0),
       grib(nullptr),
+      rk_grib_2(nullptr),
+      rk_grib(nullptr),
+      constraints(nullptr),
       grib_is_data_deficient(false) {}
 
 double RouteMapConfiguration::GetBoatLat() {
@@ -231,7 +285,7 @@ OD_FindClosestBoundaryLineCrossing RouteMap::ODFindClosestBoundaryLineCrossing =
 
 std::list<RouteMapPosition> RouteMap::Positions;
 
-RouteMap::RouteMap() {}
+RouteMap::RouteMap() : m_ConfigurationVersion(0), m_IndexMemory(0) {}
 
 RouteMap::~RouteMap() { RouteMap::Clear(); }
 
@@ -273,6 +327,25 @@ bool RouteMap::ReduceList(IsoRouteList& merged, IsoRouteList& routelist,
   return true;
 }
 
+/* mean distance in degrees from the positions of routes to their parents,
+the distance sailed in one step */
+static double MeanStepDistance(IsoRouteList& routes) {
+  double total = 0;
+  int count = 0;
+  for (IsoRouteList::iterator it = routes.begin(); it != routes.end(); ++it) {
+    Position* p = (*it)->skippoints->point;
+    do {
+      if (p->parent) {
+        double dlat = p->lat - p->parent->lat, dlon = p->lon - p->parent->lon;
+        total += sqrt(dlat * dlat + dlon * dlon);
+        count++;
+      }
+      p = p->next;
+    } while (p != (*it)->skippoints->point);
+  }
+  return count ? total / count : 0;
+}
+
 /* enlarge the map by 1 level */
 bool RouteMap::Propagate() {
   Lock();
@@ -294,6 +367,7 @@ bool RouteMap::Propagate() {
   configuration.wind_data_status = wxEmptyString;
   configuration.boundary_crossing = false;
   configuration.land_crossing = false;
+  configuration.constraints = &m_Constraints;
 
   // reset grib data deficient flag
   bool grib_is_data_deficient = false;
@@ -324,6 +398,8 @@ bool RouteMap::Propagate() {
 
   Unlock();
 
+  if (configuration.UseGrib) GribNeeded();
+
   IsoRouteList routelist;
   if (origin.empty()) {
     // The routing calculation has not started yet.
@@ -378,6 +454,21 @@ bool RouteMap::Propagate() {
       return false;
     }
 
+    // Runge-Kutta substeps sample the weather between this isochrone and the
+    // grib already received for the next one.
+    GribTimeInterpolator::Slab rk_slab_2, rk_slab;
+    configuration.rk_grib_2 = configuration.rk_grib = configuration.grib;
+    if (configuration.Integrator == RouteMapConfiguration::RUNGE_KUTTA) {
+      WR_GribRecordSet* next_grib = shared_grib.GetGribRecordSet();
+      wxDateTime rk_time_2 =
+          configuration.time +
+          wxTimeSpan::Seconds(configuration.UsedDeltaTime / 2);
+      configuration.rk_grib_2 = GribTimeInterpolator::GribAt(
+          configuration.grib, next_grib, rk_time_2.GetTicks(), rk_slab_2);
+      configuration.rk_grib = GribTimeInterpolator::GribAt(
+          configuration.grib, next_grib, time.GetTicks(), rk_slab);
+    }
+
     origin.back()->PropagateIntoList(routelist, configuration);
   }
 
@@ -388,8 +479,11 @@ bool RouteMap::Propagate() {
     IsoRouteList merged;
     if (!ReduceList(merged, routelist, configuration)) return false;
 
+    double resolution = 0;
+    if (configuration.DecimationFactor > 0)
+      resolution = configuration.DecimationFactor * MeanStepDistance(merged);
     for (IsoRouteList::iterator it = merged.begin(); it != merged.end(); ++it)
-      (*it)->ReduceClosePoints();
+      (*it)->ReduceClosePoints(resolution, configuration.MaxRoutePositions);
 
     update =
         new IsoChron(merged, time, delta, shared_grib, grib_is_data_deficient);
@@ -397,7 +491,18 @@ bool RouteMap::Propagate() {
 
   Lock();
   if (update) {
+    /* the previous isochrone is propagated, only rendering and lookups use it
+       from now on */
+    if (!origin.empty()) origin.back()->Freeze();
+    // the grib records are counted by the first isochrone using them
+    if (update->m_Grib &&
+        (origin.empty() || origin.back()->m_Grib != update->m_Grib)) {
+      size_t bytes = GribMemory(update->m_Grib);
+      m_IsoChronMemory[update].grib = bytes;
+      m_Memory.grib += bytes;
+    }
     origin.push_back(update);
+    UpdateMemoryUsage(update);
     if (update->Contains(m_Configuration.EndLat, m_Configuration.EndLon)) {
       SetFinished(true);  // Route reached the destination
     }
@@ -409,6 +514,7 @@ bool RouteMap::Propagate() {
 
   // take note of possible failure reasons
   UpdateStatus(configuration);
+  if (m_bFinished) m_Constraints.LogProfile();
 
   // Maintain land cache periodically
   maintain_land_cache();
@@ -557,6 +663,7 @@ void RouteMap::Reset() {
   m_bFinished = false;
   m_bLandCrossing = false;
   m_bBoundaryCrossing = false;
+  m_Constraints.Reset();
 
   Unlock();
 }
@@ -565,19 +672,21 @@ typedef wxWeakRef<Shared_GribRecordSet> Shared_GribRecordSetRef;
 std::map<time_t, Shared_GribRecordSetRef> grib_key;
 wxMutex s_key_mutex;
 
+unsigned int RouteMap::GribRecordSetID(GribRecordSet* grib) {
+  // XXX should be grib->m_ID in a newer OpenCPN version
+  GribRecord* tmp = grib->m_GribRecordPtrArray[Idx_WIND_VX];
+  // RecordRefDate is time_t and high byte is likely the same in many grib
+  // files, add some entropy
+  return tmp->getRecordRefDate() ^ (tmp->getIdCenter() << 24) ^
+         (tmp->getNi() << 16);
+}
+
 void RouteMap::SetNewGrib(GribRecordSet* grib) {
   if (!grib || !grib->m_GribRecordPtrArray[Idx_WIND_VX] ||
       !grib->m_GribRecordPtrArray[Idx_WIND_VY])
     return;
 
-  // XXX should be grib->m_ID in a newer OpenCPN version
-  unsigned int bogus_ID;  // grib->m_ID
-
-  GribRecord* tmp = grib->m_GribRecordPtrArray[Idx_WIND_VX];
-  // RecordRefDate is time_t and high byte is likely the same in many grib
-  // files, add some entropy
-  bogus_ID = tmp->getRecordRefDate() ^ (tmp->getIdCenter() << 24) ^
-             (tmp->getNi() << 16);
+  unsigned int bogus_ID = GribRecordSetID(grib);  // grib->m_ID
 
   {
     std::map<time_t, Shared_GribRecordSetRef>::iterator it;
@@ -595,16 +704,10 @@ void RouteMap::SetNewGrib(GribRecordSet* grib) {
   /* copy the grib record set */
   m_NewGrib = new WR_GribRecordSet(bogus_ID /* XXX */);
   m_NewGrib->m_Reference_Time = grib->m_Reference_Time;
+  m_NewGrib->m_Fingerprint = RouteMapSnapshot::GribFingerprint(
+      grib->m_Reference_Time, grib->m_GribRecordPtrArray);
   for (int i = 0; i < Idx_COUNT; i++) {
     switch (i) {
-      case Idx_HTSIGW:  // significant wave height
-      case Idx_WVDIR:   // wave direction
-      case Idx_WVPER:   // wave period
-      case Idx_WIND_GUST:
-      case Idx_WIND_VX:
-      case Idx_WIND_VY:
-      case Idx_SEACURRENT_VX:
-      case Idx_SEACURRENT_VY:
       case Idx_AIR_TEMP:
       case Idx_CAPE:
       case Idx_CLOUD_TOT:
@@ -613,6 +716,21 @@ void RouteMap::SetNewGrib(GribRecordSet* grib) {
       case Idx_SEA_TEMP:
       case Idx_PRESSURE:
       case Idx_COMP_REFL:
+        // only displayed, never read while propagating: large grids are
+        // paged in from the tile store on demand instead of copied
+        if (grib->m_GribRecordPtrArray[i] &&
+            GribTileStore::Store(*m_NewGrib, i,
+                                 *grib->m_GribRecordPtrArray[i]))
+          break;
+        // fall through
+      case Idx_HTSIGW:  // significant wave height
+      case Idx_WVDIR:   // wave direction
+      case Idx_WVPER:   // wave period
+      case Idx_WIND_GUST:
+      case Idx_WIND_VX:
+      case Idx_WIND_VY:
+      case Idx_SEACURRENT_VX:
+      case Idx_SEACURRENT_VY:
         if (grib->m_GribRecordPtrArray[i]) {
           m_NewGrib->SetUnRefGribRecord(
               i, new GribRecord(*grib->m_GribRecordPtrArray[i]));
@@ -637,7 +755,7 @@ void RouteMap::SetNewGrib(WR_GribRecordSet* grib) {
     if (it != grib_key.end() && it->second != 0) {
       m_SharedNewGrib = *it->second;
       m_NewGrib = m_SharedNewGrib.GetGribRecordSet();
-      if (m_NewGrib->m_ID == grib->m_ID) {
+      if (m_NewGrib->m_ID == grib->m_ID && !grib->m_Interpolated) {
         return;
       }
     }
@@ -645,6 +763,8 @@ void RouteMap::SetNewGrib(WR_GribRecordSet* grib) {
   /* copy the grib record set */
   m_NewGrib = new WR_GribRecordSet(grib->m_ID);
   m_NewGrib->m_Reference_Time = grib->m_Reference_Time;
+  m_NewGrib->m_Fingerprint = grib->m_Fingerprint;
+  m_NewGrib->m_Interpolated = grib->m_Interpolated;
   for (int i = 0; i < Idx_COUNT; i++) {
     switch (i) {
       case Idx_HTSIGW:
@@ -677,11 +797,45 @@ void RouteMap::GetStatistics(int& isochrones, int& routes, int& invroutes,
   Unlock();
 }
 
+RouteMapMemory RouteMap::GetMemoryUsage() {
+  Lock();
+  RouteMapMemory memory = m_Memory;
+  Unlock();
+  memory.routes += m_IndexMemory;
+  return memory;
+}
+
+void RouteMap::GetGribMemory(std::map<WR_GribRecordSet*, size_t>& gribs) {
+  Lock();
+  for (IsoChronList::iterator it = origin.begin(); it != origin.end(); ++it) {
+    std::map<IsoChron*, RouteMapMemory>::iterator m =
+        m_IsoChronMemory.find(*it);
+    if ((*it)->m_Grib && m != m_IsoChronMemory.end() && m->second.grib)
+      gribs[(*it)->m_Grib] = m->second.grib;
+  }
+  Unlock();
+}
+
+void RouteMap::UpdateMemoryUsage(IsoChron* isochron) {
+  isochron->SetIndexMemory(&m_IndexMemory);
+  RouteMapMemory& accounted = m_IsoChronMemory[isochron];
+  RouteMapMemory memory;
+  isochron->GetMemoryUsage(memory);
+  // the grib records stay accounted as long as they are referenced
+  if (isochron->m_Grib) memory.grib = accounted.grib;
+
+  m_Memory -= accounted;
+  m_Memory += memory;
+  accounted = memory;
+}
+
 void RouteMap::Clear() {
   for (IsoChronList::iterator it = origin.begin(); it != origin.end(); ++it)
     delete *it;
 
   origin.clear();
+  m_IsoChronMemory.clear();
+  m_Memory = RouteMapMemory();
 }
 
 /**
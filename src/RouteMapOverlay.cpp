@@ -25,12 +25,17 @@
 #include "heap_checker.h"
 #include <chrono>
 #include <string>
+#include <unordered_set>
+#include <utility>
+#include <vector>
 
 #include "ocpn_plugin.h"
 #include "pidc.h"
 #include "Utilities.h"
 #include "RouteMapOverlay.h"
+#include "RouteMapSnapshot.h"
 #include "SettingsDialog.h"
+#include "WeatherDataProvider.h"
 
 void WR_GetCanvasPixLL(PlugIn_ViewPort* vp, wxPoint* pp, double lat,
                        double lon) {
@@ -40,32 +45,68 @@ void WR_GetCanvasPixLL(PlugIn_ViewPort* vp, wxPoint* pp, double lat,
   pp->y = (int)wxRound(pix_double.m_y);
 }
 
+wxDEFINE_EVENT(wxEVT_ROUTEMAP_COMPUTATION, wxThreadEvent);
+
 RouteMapOverlayThread::RouteMapOverlayThread(RouteMapOverlay& routemapoverlay)
-    : wxThread(wxTHREAD_JOINABLE), m_RouteMapOverlay(routemapoverlay) {
+    : wxThread(wxTHREAD_JOINABLE),
+      m_RouteMapOverlay(routemapoverlay),
+      m_WakeCondition(m_WakeMutex),
+      m_bWake(false),
+      m_bAbort(false),
+      m_bDone(false) {
   Create();
 }
 
+void RouteMapOverlayThread::Wake() {
+  wxMutexLocker lock(m_WakeMutex);
+  m_bWake = true;
+  m_WakeCondition.Signal();
+}
+
+void RouteMapOverlayThread::Abort() {
+  wxMutexLocker lock(m_WakeMutex);
+  m_bAbort = true;
+  m_WakeCondition.Signal();
+}
+
+bool RouteMapOverlayThread::WaitForWake() {
+  wxMutexLocker lock(m_WakeMutex);
+  while (!m_bWake && !m_bAbort) m_WakeCondition.Wait();
+  m_bWake = false;
+  return !m_bAbort;
+}
+
 void* RouteMapOverlayThread::Entry() {
   RouteMapConfiguration cf = m_RouteMapOverlay.GetConfiguration();
 
   if (!cf.RouteGUID.IsEmpty()) {
     std::unique_ptr<PlugIn_Route> rte = GetRoute_Plugin(cf.RouteGUID);
     PlugIn_Route* proute = rte.get();
-    if (proute == nullptr) return 0;
-
-    m_RouteMapOverlay.RouteAnalysis(proute);
+    if (proute != nullptr) m_RouteMapOverlay.RouteAnalysis(proute);
   } else {
     // start periodic heap-check timer (do this once per thread entry)
     auto last_check = std::chrono::steady_clock::now();
+    auto last_progress = last_check;
 
     while (!TestDestroy() && !m_RouteMapOverlay.Finished()) {
-      if (!m_RouteMapOverlay.Propagate())
-        wxThread::Sleep(50);
-      else {
+      if (!m_RouteMapOverlay.Propagate()) {
+        // waiting for the main thread to request the grib
+        if (m_RouteMapOverlay.NeedsGrib()) {
+          m_RouteMapOverlay.PostComputationEvent(
+              RouteMapOverlay::COMPUTATION_NEEDS_GRIB);
+          if (!WaitForWake()) break;
+        }
+      } else {
         // don't do it inside worker thread, race
         // m_RouteMapOverlay.UpdateCursorPosition();
         m_RouteMapOverlay.UpdateDestination();
-        wxThread::Sleep(5);
+
+        auto now = std::chrono::steady_clock::now();
+        if (now - last_progress >= std::chrono::milliseconds(250)) {
+          m_RouteMapOverlay.PostComputationEvent(
+              RouteMapOverlay::COMPUTATION_PROGRESS);
+          last_progress = now;
+        }
       }
 
       // Periodic 1-minute heap integrity check
@@ -82,6 +123,8 @@ void* RouteMapOverlayThread::Entry() {
     }
   }
   //    m_RouteMapOverlay.m_Thread = nullptr;
+  m_bDone = true;
+  m_RouteMapOverlay.PostComputationEvent(RouteMapOverlay::COMPUTATION_FINISHED);
   return 0;
 }
 
@@ -89,6 +132,7 @@ RouteMapOverlay::RouteMapOverlay()
     : m_UpdateOverlay(true),
       m_bEndRouteVisible(false),
       m_Thread(nullptr),
+      m_EventHandler(nullptr),
       last_cursor_lat(0),
       last_cursor_lon(0),
       last_cursor_position(nullptr),
@@ -100,7 +144,10 @@ RouteMapOverlay::RouteMapOverlay()
       wind_barb_cache_scale(NAN),
       wind_barb_cache_origin_size(0),
       current_cache_scale(NAN),
-      current_cache_origin_size(0) {}
+      current_cache_origin_size(0),
+      m_MinimumRetention(RouteMapConfiguration::RETAIN_FULL),
+      m_AppliedRetention(RouteMapConfiguration::RETAIN_FULL),
+      m_ResultKey(0) {}
 
 RouteMapOverlay::~RouteMapOverlay() {
   delete destination_position;
@@ -110,7 +157,7 @@ RouteMapOverlay::~RouteMapOverlay() {
   Clear();
 }
 
-bool RouteMapOverlay::Start(wxString& error) {
+bool RouteMapOverlay::Start(wxString& error, wxEvtHandler* handler) {
   if (m_Thread) {
     error = _("error, thread already created\n");
     return false;
@@ -144,11 +191,28 @@ bool RouteMapOverlay::Start(wxString& error) {
     return false;
   }
 
+  m_EventHandler = handler;
   m_Thread = new RouteMapOverlayThread(*this);
   m_Thread->Run();
   return true;
 }
 
+void RouteMapOverlay::Stop() {
+  RouteMap::Stop();
+  if (m_Thread) m_Thread->Wake();
+}
+
+void RouteMapOverlay::GribNeeded() {
+  PostComputationEvent(COMPUTATION_NEEDS_GRIB);
+}
+
+void RouteMapOverlay::PostComputationEvent(ComputationEvent event) {
+  if (!m_EventHandler) return;
+  wxThreadEvent* e = new wxThreadEvent(wxEVT_ROUTEMAP_COMPUTATION);
+  e->SetInt(event);
+  wxQueueEvent(m_EventHandler, e);
+}
+
 void RouteMapOverlay::RouteAnalysis(PlugIn_Route* proute) {
   std::list<PlotData>& plotdata = last_destination_plotdata;
   RouteMapConfiguration configuration = GetConfiguration();
@@ -184,6 +248,17 @@ void RouteMapOverlay::RouteAnalysis(PlugIn_Route* proute) {
     pwpnode = pwpnode->GetNext();  // PlugInWaypoint
     if (pwpnode == nullptr) break;
 
+    /* without a local GRIB copy every field read by PropagateToPoint() and
+       GetPlotData() would be a message to the GRIB plugin, fetch them all at
+       once */
+    if (!configuration.grib && configuration.UseGrib) {
+      GribValuePoint point;
+      point.time = configuration.time;
+      point.lat = data.lat, point.lon = data.lon;
+      WeatherDataProvider::RequestGribValues(
+          point, WeatherDataProvider::GRIB_VALUE_ALL);
+    }
+
     DataMask data_mask = DataMask::NONE;
     double H;
     pwp = pwpnode->GetData();
@@ -220,6 +295,8 @@ void RouteMapOverlay::RouteAnalysis(PlugIn_Route* proute) {
     if (!ok) break;
     data.time = curtime;
   }
+  WeatherDataProvider::ClearGribValues();
+
   Lock();
   m_bUpdated = true;
   m_UpdateOverlay = true;
@@ -241,6 +318,7 @@ void RouteMapOverlay::RouteAnalysis(PlugIn_Route* proute) {
 void RouteMapOverlay::DeleteThread() {
   if (!m_Thread) return;
 
+  m_Thread->Abort();
   m_Thread->Delete();
   delete m_Thread;
   m_Thread = nullptr;
@@ -341,17 +419,27 @@ static wxColour TransparentColor(wxColor c) {
   return wxColor(c.Red(), c.Green(), c.Blue(), c.Alpha() * 7 / 24);
 }
 
-void RouteMapOverlay::RenderIsoRoute(IsoRoute* r, wxDateTime time,
+/* the first position of route and of its children, with whether each is a
+   child.  Must be called with the route map locked: the propagation thread
+   releases the skip lists of an isochrone once it is propagated, but never
+   its positions, so they can be drawn from once unlocked. */
+static void GetIsoRouteStarts(IsoRoute* r, bool child,
+                              std::vector<std::pair<Position*, bool>>& starts) {
+  if (r->skippoints)
+    starts.push_back(std::make_pair(r->skippoints->point, child));
+  for (IsoRouteList::iterator it = r->children.begin(); it != r->children.end();
+       ++it)
+    GetIsoRouteStarts(*it, true, starts);
+}
+
+void RouteMapOverlay::RenderIsoRoute(Position* start, wxDateTime time,
                                      wxColour& grib_color,
                                      wxColour& climatology_color, piDC& dc,
                                      PlugIn_ViewPort& vp) {
-  SkipPosition* s = r->skippoints;
-  if (!s) return;
-
   wxColour grib_deficient_color = TransparentColor(grib_color);
   wxColour climatology_deficient_color = TransparentColor(climatology_color);
 
-  Position* p = s->point;
+  Position* p = start;
   wxColour* pcolor =
       &PositionColor(p, grib_color, climatology_color, grib_deficient_color,
                      climatology_deficient_color);
@@ -366,16 +454,11 @@ void RouteMapOverlay::RenderIsoRoute(IsoRoute* r, wxDateTime time,
       DrawLine(p, *pcolor, p->next, ncolor, dc, vp);
     pcolor = &ncolor;
     p = p->next;
-  } while (p != s->point);
+  } while (p != start);
 
 #ifndef __OCPN__ANDROID__
   if (!dc.GetDC()) glEnd();
 #endif
-  /* now render any children */
-  wxColour cyan(0, 255, 255), magenta(255, 0, 255);
-  for (IsoRouteList::iterator it = r->children.begin(); it != r->children.end();
-       ++it)
-    RenderIsoRoute(*it, time, cyan, magenta, dc, vp);
 }
 
 void RouteMapOverlay::RenderAlternateRoute(IsoRoute* r, bool each_parent,
@@ -573,8 +656,14 @@ void RouteMapOverlay::Render(wxDateTime time, SettingsDialog& settingsdialog,
             }
           }
         }
+        wxColour cyan(0, 255, 255), magenta(255, 0, 255);
+        std::vector<std::pair<Position*, bool>> starts;
         for (IsoChronList::iterator i = origin.begin(); i != origin.end();
              ++i) {
+          starts.clear();
+          for (IsoRouteList::iterator j = (*i)->routes.begin();
+               j != (*i)->routes.end(); ++j)
+            GetIsoRouteStarts(*j, false, starts);
           Unlock();
           wxColor grib_color(routecolors[c][0], routecolors[c][1],
                              routecolors[c][2], 224);
@@ -587,9 +676,13 @@ void RouteMapOverlay::Render(wxDateTime time, SettingsDialog& settingsdialog,
           } else {
             SetWidth(dc, IsoChronThickness);
           }
-          for (IsoRouteList::iterator j = (*i)->routes.begin();
-               j != (*i)->routes.end(); ++j)
-            RenderIsoRoute(*j, time, grib_color, climatology_color, dc, nvp);
+          /* children are drawn in cyan and magenta */
+          for (size_t j = 0; j < starts.size(); j++)
+            if (starts[j].second)
+              RenderIsoRoute(starts[j].first, time, cyan, magenta, dc, nvp);
+            else
+              RenderIsoRoute(starts[j].first, time, grib_color,
+                             climatology_color, dc, nvp);
 
           if (++c == (sizeof routecolors) / (sizeof *routecolors)) c = 0;
           Lock();
@@ -1419,6 +1512,8 @@ void RouteMapOverlay::GetLLBounds(double& latmin, double& latmax,
   latmin = INFINITY, lonmin = INFINITY;
   latmax = -INFINITY, lonmax = -INFINITY;
 
+  /* the propagation thread may be appending an isochrone */
+  wxMutexLocker lock(routemutex);
   IsoChron* last = origin.back();
   for (IsoRouteList::iterator it = last->routes.begin();
        it != last->routes.end(); ++it) {
@@ -1434,6 +1529,16 @@ void RouteMapOverlay::GetLLBounds(double& latmin, double& latmax,
 }
 
 void RouteMapOverlay::RequestGrib(wxDateTime time) {
+  RequestGribRecord(time);
+
+  Lock();
+  m_bNeedsGrib = false;
+  Unlock();
+
+  if (m_Thread) m_Thread->Wake();
+}
+
+void RouteMapOverlay::RequestGribRecord(wxDateTime time) {
   Json::Value v;
   v["Day"] = time.GetDay();
   v["Month"] = time.GetMonth();
@@ -1445,10 +1550,6 @@ void RouteMapOverlay::RequestGrib(wxDateTime time) {
   Json::FastWriter w;
 
   SendPluginMessage("GRIB_TIMELINE_RECORD_REQUEST", w.write(v));
-
-  Lock();
-  m_bNeedsGrib = false;
-  Unlock();
 }
 
 std::list<PlotData>& RouteMapOverlay::GetPlotData(bool cursor_route) {
@@ -1643,6 +1744,62 @@ int RouteMapOverlay::Cyclones(int* months) {
   return cyclones;
 }
 
+bool RouteMapOverlay::SaveSnapshot() {
+  if (!m_ResultKey) return false;
+  bool reached = ReachedDestination();
+  // needs the grib records, like ApplyRetention
+  std::list<PlotData> plotdata = GetPlotData(false);
+
+  // serialize under the lock, the file is written in the background
+  std::vector<char> data;
+  Lock();
+  RouteMapSnapshot::Serialize(m_ResultKey, origin, destination_position,
+                              reached, m_EndTime, plotdata, data);
+  Unlock();
+  RouteMapSnapshot::WriteInBackground(RouteMapSnapshot::Path(m_ResultKey),
+                                      data);
+  return true;
+}
+
+void RouteMapOverlay::RestoreSnapshot(wxUint64 key,
+                                      RouteMapSnapshot::Contents& contents) {
+  RouteMapConfiguration configuration = GetConfiguration();
+  Reset();
+  m_ResultKey = key;
+
+  Lock();
+  origin = contents.origin;
+  delete destination_position;
+  destination_position = contents.destination;
+  m_EndTime = contents.end_time;
+  m_bNeedsGrib = false;
+  SetFinished(contents.reached_destination);
+  for (IsoChronList::iterator it = origin.begin(); it != origin.end(); ++it)
+    UpdateMemoryUsage(*it);
+  Unlock();
+
+  last_destination_position =
+      destination_position
+          ? destination_position
+          : ClosestPosition(configuration.EndLat, configuration.EndLon);
+  last_destination_plotdata = contents.plotdata;
+
+  if (!contents.gribs.empty() && contents.gribs.front().reference_time != -1)
+    wxLogMessage("WeatherRouting: reloaded %d isochrones computed with the "
+                 "GRIB of %s",
+                 (int)origin.size(),
+                 wxDateTime(contents.gribs.front().reference_time)
+                     .FormatISOCombined(' '));
+
+  // the isochrones are frozen without grib records, as if retention had
+  // released them, but a retention keeping less still applies
+  m_AppliedRetention = RouteMapConfiguration::RETAIN_OUTLINES;
+  ApplyRetention();
+
+  m_bUpdated = true;
+  m_UpdateOverlay = true;
+}
+
 void RouteMapOverlay::Clear() {
   RouteMap::Clear();
   last_cursor_position = nullptr;
@@ -1651,9 +1808,26 @@ void RouteMapOverlay::Clear() {
   // clear_cursor_plotdata = false;
   last_cursor_plotdata.clear();
   last_destination_plotdata.clear();
+  m_MinimumRetention = m_AppliedRetention = RouteMapConfiguration::RETAIN_FULL;
+  m_ResultKey = 0;
   m_UpdateOverlay = true;
 }
 
+RouteMapMemory RouteMapOverlay::GetMemoryUsage() {
+  RouteMapMemory memory = RouteMap::GetMemoryUsage();
+
+  // std::list nodes hold two pointers besides the element
+  size_t node = sizeof(PlotData) + 2 * sizeof(void*);
+  memory.plotdata =
+      (last_destination_plotdata.size() + last_cursor_plotdata.size()) * node;
+
+  // four coordinates per line
+  memory.render = (wind_barb_cache.count + wind_barb_route_cache.count +
+                   current_cache.count) *
+                  4 * sizeof(float);
+  return memory;
+}
+
 void RouteMapOverlay::UpdateCursorPosition() {
   // only called in main thread, no race
   Position* last_last_cursor_position = last_cursor_position;
@@ -1761,6 +1935,43 @@ void RouteMapOverlay::UpdateDestination() {
   m_UpdateOverlay = true;
 }
 
+void RouteMapOverlay::ApplyRetention() {
+  RouteMapConfiguration::RetentionType retention =
+      GetConfiguration().Retention;
+  if (m_MinimumRetention > retention) retention = m_MinimumRetention;
+  if (retention <= m_AppliedRetention) return;
+  m_AppliedRetention = retention;
+
+  // needs the grib records, computed while they are still referenced
+  GetPlotData(false);
+
+  Lock();
+  if (retention == RouteMapConfiguration::RETAIN_BEST_ROUTE) {
+    std::unordered_set<Position*> keep;
+    for (Position* p = last_destination_position; p; p = p->parent)
+      keep.insert(p);
+    for (IsoChronList::iterator it = origin.begin(); it != origin.end(); ++it)
+      (*it)->KeepPositions(keep);
+  }
+
+  for (IsoChronList::iterator it = origin.begin(); it != origin.end(); ++it) {
+    (*it)->ReleaseGrib();
+    (*it)->Freeze();
+    UpdateMemoryUsage(*it);
+  }
+  Unlock();
+
+  last_cursor_position = nullptr;
+  last_cursor_plotdata.clear();
+
+  // the cached arrows were computed from the released grib records,
+  // finalizing the empty buffers drops them
+  wind_barb_cache.Finalize();
+  current_cache.Finalize();
+
+  m_UpdateOverlay = true;
+}
+
 // CUSTOMIZATION
 
 Position* RouteMapOverlay::getClosestRoutePositionFromCursor(
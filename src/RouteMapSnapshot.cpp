@@ -0,0 +1,763 @@
+/***************************************************************************
+ *   Copyright (C) 2015 by OpenCPN development team                        *
+ *                                                                         *
+ *   This program is free software; you can redistribute it and/or modify  *
+ *   it under the terms of the GNU General Public License as published by  *
+ *   the Free Software Foundation; either version 3 of the License, or     *
+ *   (at your option) any later version.                                   *
+ *                                                                         *
+ *   This program is distributed in the hope that it will be useful,       *
+ *   but WITHOUT ANY WARRANTY; without even the implied warranty of        *
+ *   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the         *
+ *   GNU General Public License for more details.                          *
+ *                                                                         *
+ *   You should have received a copy of the GNU General Public License     *
+ *   along with this program; if not, write to the                         *
+ *   Free Software Foundation, Inc.,                                       *
+ *   51 Franklin Street, Fifth Floor, Boston, MA 02110-1301,  USA.         *
+ **************************************************************************/
+
+#include <wx/wx.h>
+#include <wx/dir.h>
+#include <wx/file.h>
+#include <wx/filename.h>
+
+#include <cstddef>
+#include <cstring>
+#include <limits>
+#include <list>
+#include <map>
+#include <unordered_map>
+#include <utility>
+#include <vector>
+
+#include "RouteMapSnapshot.h"
+#include "RouteMap.h"
+#include "Utilities.h"
+#include "WeatherDataProvider.h"
+#include "weather_routing_pi.h"
+
+namespace {
+
+const int SNAPSHOT_VERSION = 2;
+const int PRUNE_AGE_DAYS = 30;
+/* inverted regions inside of regions, deeper nesting means a corrupt file */
+const int MAX_ROUTE_DEPTH = 64;
+/* values sampled along each axis of a GRIB record for its fingerprint */
+const int FINGERPRINT_SAMPLES = 16;
+const wxInt64 INVALID_TIME = std::numeric_limits<wxInt64>::min();
+
+struct SnapshotHeader {
+  char magic[4];
+  wxInt32 version;
+  wxUint64 key;
+  wxInt32 position_size;
+  wxInt32 isochrons;
+  wxInt32 positions;
+  wxInt32 destination; /* index of the destination position, or -1 */
+  wxInt32 reached_destination;
+  wxInt32 plotdata; /* plot data records of the route to the destination */
+  wxInt64 end_time; /* milliseconds since the epoch, or INVALID_TIME */
+};
+
+struct IsoChronRecord {
+  wxInt64 time;
+  double delta;
+  wxInt64 grib_reference_time;
+  wxUint64 grib_fingerprint;
+  wxInt32 grib_is_data_deficient;
+  wxInt32 routes;
+};
+
+/* followed by its positions, then by its children */
+struct RouteRecord {
+  wxInt32 positions;
+  wxInt32 direction;
+  wxInt32 children;
+};
+
+enum { POSITION_DATA_DEFICIENT = 1, POSITION_PROPAGATED = 2 };
+
+struct PositionRecord {
+  double lat, lon;
+  float parent_heading, parent_bearing;
+  wxInt32 parent; /* index of the parent position, or -1 */
+  wxInt16 polar;
+  wxUint16 tacks, jibes, sail_plan_changes;
+  wxUint8 data_mask;
+  wxUint8 flags;
+};
+
+/* the weather along the route, which can't be computed again without the
+   grib records */
+struct PlotDataRecord {
+  double lat, lon;
+  wxInt64 time;
+  double delta, sog, cog, stw, ctw, hdg;
+  double twsOverWater, twdOverWater, twsOverGround, twdOverGround;
+  double currentSpeed, currentDir;
+  double WVHT, WVDIR, WVREL, WVPER, VW_GUST;
+  double cloud_cover, rain_mm_per_hour, air_temp, sea_surface_temp, cape;
+  double relative_humidity, air_pressure, reflectivity;
+  wxInt32 polar, tacks, jibes, sail_plan_changes;
+  wxUint32 data_mask;
+  wxInt32 grib_is_data_deficient;
+};
+
+wxString snapshot_directory;
+wxMutex s_snapshot_mutex;
+
+struct FileHashEntry {
+  wxDateTime modified;
+  wxULongLong size;
+  wxUint64 hash;
+};
+
+/* snapshots queued for the writer thread, the front one is removed once
+   written so Read() finds it meanwhile */
+struct PendingSnapshot {
+  wxString path;
+  std::vector<char> data;
+};
+std::list<PendingSnapshot> pending_snapshots;
+bool s_writing;
+wxMutex s_write_mutex;
+
+class SnapshotWriterThread : public wxThread {
+public:
+  SnapshotWriterThread() : wxThread(wxTHREAD_JOINABLE) { Create(); }
+
+  void* Entry() {
+    for (;;) {
+      PendingSnapshot* snapshot;
+      {
+        wxMutexLocker lock(s_write_mutex);
+        if (pending_snapshots.empty()) {
+          s_writing = false;
+          return 0;
+        }
+        /* only this thread removes elements, the list keeps it in place */
+        snapshot = &pending_snapshots.front();
+      }
+
+      RouteMapSnapshot::WriteData(snapshot->path, snapshot->data);
+
+      wxMutexLocker lock(s_write_mutex);
+      pending_snapshots.pop_front();
+    }
+  }
+};
+
+SnapshotWriterThread* s_writer_thread;
+
+void JoinWriter() {
+  if (!s_writer_thread) return;
+  s_writer_thread->Wait();
+  delete s_writer_thread;
+  s_writer_thread = NULL;
+}
+
+/* boat and polar files are shared by many configurations */
+std::map<wxString, FileHashEntry> file_hashes;
+wxMutex s_file_hash_mutex;
+
+/* 64 bit FNV-1a */
+class Hasher {
+public:
+  Hasher() : m_Hash(14695981039346656037ULL) {}
+
+  void AddBytes(const void* data, size_t size) {
+    const unsigned char* bytes = static_cast<const unsigned char*>(data);
+    for (size_t i = 0; i < size; i++) {
+      m_Hash ^= bytes[i];
+      m_Hash *= 1099511628211ULL;
+    }
+  }
+
+  template <class T>
+  void Add(T value) {
+    AddBytes(&value, sizeof value);
+  }
+
+  void Add(const wxString& s) {
+    wxCharBuffer utf8 = s.ToUTF8();
+    Add(utf8.length());
+    AddBytes(utf8.data(), utf8.length());
+  }
+
+  wxUint64 Hash() const { return m_Hash; }
+
+private:
+  wxUint64 m_Hash;
+};
+
+wxInt64 TimeValue(const wxDateTime& t) {
+  return t.IsValid() ? t.GetValue().GetValue() : INVALID_TIME;
+}
+
+wxDateTime DateTime(wxInt64 value) {
+  return value == INVALID_TIME ? wxDateTime() : wxDateTime(wxLongLong(value));
+}
+
+template <class T>
+void Append(std::vector<char>& data, const T& value) {
+  const char* bytes = reinterpret_cast<const char*>(&value);
+  data.insert(data.end(), bytes, bytes + sizeof value);
+}
+
+wxUint16 Count16(int count) {
+  return count < 0 ? 0 : count > 0xffff ? 0xffff : count;
+}
+
+/* offsets of the position records, to fill in their parents once every
+   position has an index */
+typedef std::vector<std::pair<size_t, Position*> > PositionOffsets;
+
+void AppendPosition(std::vector<char>& data, Position* p,
+                    PositionOffsets& offsets) {
+  PositionRecord r;
+  memset(&r, 0, sizeof r);
+  r.lat = p->lat, r.lon = p->lon;
+  r.parent_heading = p->parent_heading;
+  r.parent_bearing = p->parent_bearing;
+  r.parent = -1;
+  r.polar = p->polar;
+  r.tacks = Count16(p->tacks);
+  r.jibes = Count16(p->jibes);
+  r.sail_plan_changes = Count16(p->sail_plan_changes);
+  r.data_mask = static_cast<wxUint8>(static_cast<uint32_t>(p->data_mask));
+  r.flags = (p->grib_is_data_deficient ? POSITION_DATA_DEFICIENT : 0) |
+            (p->propagated ? POSITION_PROPAGATED : 0);
+  offsets.push_back(std::make_pair(data.size(), p));
+  Append(data, r);
+}
+
+int StoredChildren(IsoRoute* route) {
+  int count = 0;
+  for (IsoRouteList::iterator it = route->children.begin();
+       it != route->children.end(); ++it)
+    if ((*it)->skippoints) count++;
+  return count;
+}
+
+/* routes left without positions by KeepPositions are not stored */
+void AppendRoute(std::vector<char>& data, IsoRoute* route,
+                 PositionOffsets& offsets) {
+  RouteRecord r;
+  r.positions = route->Count();
+  r.direction = route->direction;
+  r.children = StoredChildren(route);
+  Append(data, r);
+
+  Position* point = route->skippoints->point;
+  Position* p = point;
+  do {
+    AppendPosition(data, p, offsets);
+    p = p->next;
+  } while (p != point);
+
+  for (IsoRouteList::iterator it = route->children.begin();
+       it != route->children.end(); ++it)
+    if ((*it)->skippoints) AppendRoute(data, *it, offsets);
+}
+
+#define PLOTDATA_FIELDS(X)                                                   \
+  X(lat) X(lon) X(delta) X(sog) X(cog) X(stw) X(ctw) X(hdg) X(twsOverWater)  \
+  X(twdOverWater) X(twsOverGround) X(twdOverGround) X(currentSpeed)          \
+  X(currentDir) X(WVHT) X(WVDIR) X(WVREL) X(WVPER) X(VW_GUST) X(cloud_cover) \
+  X(rain_mm_per_hour) X(air_temp) X(sea_surface_temp) X(cape)                \
+  X(relative_humidity) X(air_pressure) X(reflectivity) X(polar) X(tacks)     \
+  X(jibes) X(sail_plan_changes)
+
+void AppendPlotData(std::vector<char>& data, const PlotData& d) {
+  PlotDataRecord r;
+  memset(&r, 0, sizeof r);
+#define COPY_FIELD(name) r.name = d.name;
+  PLOTDATA_FIELDS(COPY_FIELD)
+#undef COPY_FIELD
+  r.time = TimeValue(d.time);
+  r.data_mask = static_cast<uint32_t>(d.data_mask);
+  r.grib_is_data_deficient = d.grib_is_data_deficient;
+  Append(data, r);
+}
+
+PlotData ToPlotData(const PlotDataRecord& r) {
+  PlotData d;
+#define COPY_FIELD(name) d.name = r.name;
+  PLOTDATA_FIELDS(COPY_FIELD)
+#undef COPY_FIELD
+  d.time = DateTime(r.time);
+  d.data_mask = static_cast<DataMask>(r.data_mask);
+  d.grib_is_data_deficient = r.grib_is_data_deficient != 0;
+  return d;
+}
+
+class Reader {
+public:
+  Reader(const std::vector<char>& data) : m_Data(data), m_Offset(0) {}
+
+  template <class T>
+  bool Get(T& value) {
+    if (m_Data.size() - m_Offset < sizeof value) return false;
+    memcpy(&value, &m_Data[m_Offset], sizeof value);
+    m_Offset += sizeof value;
+    return true;
+  }
+
+  size_t Remaining() const { return m_Data.size() - m_Offset; }
+
+private:
+  const std::vector<char>& m_Data;
+  size_t m_Offset;
+};
+
+Position* NewPosition(const PositionRecord& r) {
+  Position* p = new Position(
+      r.lat, r.lon, nullptr, r.parent_heading, r.parent_bearing, r.polar,
+      r.tacks, r.jibes, r.sail_plan_changes, static_cast<DataMask>(r.data_mask),
+      (r.flags & POSITION_DATA_DEFICIENT) != 0);
+  p->propagated = (r.flags & POSITION_PROPAGATED) != 0;
+  return p;
+}
+
+/* returns null if the file is corrupt, positions and parents receive the
+   positions of the route in file order and the index of their parents */
+IsoRoute* ReadRoute(Reader& reader, std::vector<Position*>& positions,
+                    std::vector<wxInt32>& parents, int depth) {
+  RouteRecord r;
+  if (depth > MAX_ROUTE_DEPTH || !reader.Get(r) || r.positions < 1 ||
+      (r.direction != 1 && r.direction != -1) || r.children < 0 ||
+      reader.Remaining() / sizeof(PositionRecord) < (size_t)r.positions)
+    return nullptr;
+
+  Position *first = nullptr, *last = nullptr;
+  for (int i = 0; i < r.positions; i++) {
+    PositionRecord pr;
+    reader.Get(pr);
+    Position* p = NewPosition(pr);
+    if (last) {
+      last->next = p;
+      p->prev = last;
+    } else
+      first = p;
+    last = p;
+    positions.push_back(p);
+    parents.push_back(pr.parent);
+  }
+  last->next = first;
+  first->prev = last;
+
+  IsoRoute* route = new IsoRoute(first->BuildSkipList(), r.direction);
+  for (int i = 0; i < r.children; i++) {
+    IsoRoute* child = ReadRoute(reader, positions, parents, depth + 1);
+    if (!child) {
+      delete route;
+      return nullptr;
+    }
+    child->parent = route;
+    route->children.push_back(child);
+  }
+  return route;
+}
+
+/* remove snapshots which no session opened for a while */
+void PruneSnapshots(const wxString& dir) {
+  wxArrayString files;
+  wxDir::GetAllFiles(dir, &files, "*.wrroutemap", wxDIR_FILES);
+  wxDateTime limit = wxDateTime::Now() - wxDateSpan::Days(PRUNE_AGE_DAYS);
+  for (size_t i = 0; i < files.GetCount(); i++) {
+    wxFileName fn(files[i]);
+    if (fn.GetModificationTime() < limit) wxRemoveFile(files[i]);
+  }
+}
+
+}  // namespace
+
+wxUint64 RouteMapSnapshot::ConfigurationHash(const RouteMapConfiguration& c) {
+  Hasher h;
+  h.Add(SNAPSHOT_VERSION);
+  h.Add(c.StartLat), h.Add(c.StartLon);
+  h.Add(c.EndLat), h.Add(c.EndLon);
+  h.Add(TimeValue(c.StartTime));
+  h.Add(c.DeltaTime);
+  h.Add(c.boatFileName);
+  h.Add(c.Integrator);
+
+  h.Add(c.MaxDivertedCourse), h.Add(c.MaxCourseAngle);
+  h.Add(c.MaxSearchAngle), h.Add(c.MaxTrueWindKnots);
+  h.Add(c.MaxApparentWindKnots), h.Add(c.MaxSwellMeters);
+  h.Add(c.MaxLatitude);
+  h.Add(c.TackingTime), h.Add(c.JibingTime), h.Add(c.SailPlanChangeTime);
+  h.Add(c.WindVSCurrent), h.Add(c.SafetyMarginLand);
+
+  h.Add(c.AvoidCycloneTracks), h.Add(c.CycloneMonths), h.Add(c.CycloneDays);
+
+  h.Add(c.UseGrib), h.Add(c.ClimatologyType), h.Add(c.AllowDataDeficient);
+  h.Add(c.WindStrength);
+  h.Add(c.UpwindEfficiency), h.Add(c.DownwindEfficiency);
+  h.Add(c.NightCumulativeEfficiency);
+
+  h.Add(c.DetectLand), h.Add(c.DetectBoundary), h.Add(c.Currents);
+  h.Add(c.OptimizeTacking), h.Add(c.InvertedRegions), h.Add(c.Anchoring);
+
+  h.Add(c.FromDegree), h.Add(c.ToDegree), h.Add(c.ByDegrees);
+  h.Add(c.UseOptimalAngles);
+
+  h.Add(c.UseMotor), h.Add(c.MotorSpeedThreshold), h.Add(c.MotorSpeed);
+
+  h.Add(c.DecimationFactor), h.Add(c.MaxRoutePositions);
+  return h.Hash();
+}
+
+wxUint64 RouteMapSnapshot::FileHash(const wxString& path) {
+  wxFileName fn(path);
+  if (!fn.FileExists()) return 0;
+  wxDateTime modified = fn.GetModificationTime();
+  wxULongLong size = fn.GetSize();
+
+  {
+    wxMutexLocker lock(s_file_hash_mutex);
+    std::map<wxString, FileHashEntry>::iterator it = file_hashes.find(path);
+    if (it != file_hashes.end() && it->second.modified == modified &&
+        it->second.size == size)
+      return it->second.hash;
+  }
+
+  wxFile file;
+  if (!file.Open(path)) return 0;
+  std::vector<char> data(file.Length());
+  if (!data.empty() &&
+      file.Read(&data[0], data.size()) != (ssize_t)data.size())
+    return 0;
+
+  Hasher h;
+  h.Add(data.size());
+  if (!data.empty()) h.AddBytes(&data[0], data.size());
+
+  FileHashEntry entry;
+  entry.modified = modified;
+  entry.size = size;
+  entry.hash = h.Hash();
+  wxMutexLocker lock(s_file_hash_mutex);
+  file_hashes[path] = entry;
+  return entry.hash;
+}
+
+wxUint64 RouteMapSnapshot::GribFingerprint(time_t reference_time,
+                                           GribRecord* const* records) {
+  Hasher h;
+  h.Add(static_cast<wxInt64>(reference_time));
+  for (int i = 0; i < Idx_COUNT; i++) {
+    const GribRecord* r = records[i];
+    if (!r || !r->isOk()) continue;
+    h.Add(i);
+    h.Add(static_cast<wxInt64>(r->getRecordRefDate()));
+    h.Add(static_cast<wxInt64>(r->getRecordCurrentDate()));
+    h.Add(r->getDataCenterModel()), h.Add(r->getIdCenter());
+    h.Add(r->getIdModel()), h.Add(r->getIdGrid());
+    h.Add(r->getDataType()), h.Add(r->getLevelType());
+    h.Add(r->getLevelValue());
+    h.Add(r->getPeriodP1()), h.Add(r->getPeriodP2());
+    h.Add(r->getNi()), h.Add(r->getNj());
+    h.Add(r->getX(0)), h.Add(r->getY(0));
+    h.Add(r->getDi()), h.Add(r->getDj());
+
+    /* a grid of samples rather than every value, this is computed for each
+       record set copied from the GRIB plugin */
+    int ni = r->getNi(), nj = r->getNj();
+    int si = wxMin(ni, FINGERPRINT_SAMPLES);
+    int sj = wxMin(nj, FINGERPRINT_SAMPLES);
+    for (int j = 0; j < sj; j++)
+      for (int k = 0; k < si; k++)
+        h.Add(r->getValue(k * ni / si, j * nj / sj));
+  }
+  return h.Hash();
+}
+
+wxUint64 RouteMapSnapshot::ResultKey(const RouteMapConfiguration& c,
+                                     const GribProvenance& forecast,
+                                     const Environment& environment) {
+  Hasher h;
+  h.Add(ConfigurationHash(c));
+  h.Add(FileHash(c.boatFileName));
+  for (size_t i = 0; i < c.boat.Polars.size(); i++)
+    h.Add(FileHash(c.boat.Polars[i].FileName));
+  h.Add(environment.coastline);
+  h.Add(environment.climatology.size());
+  for (size_t i = 0; i < environment.climatology.size(); i++)
+    h.Add(environment.climatology[i]);
+  if (c.UseGrib) {
+    h.Add(static_cast<wxInt64>(forecast.reference_time));
+    h.Add(forecast.fingerprint);
+  }
+  return h.Hash();
+}
+
+wxString RouteMapSnapshot::Directory() {
+  wxMutexLocker lock(s_snapshot_mutex);
+  if (snapshot_directory.IsEmpty()) {
+    wxString dir = weather_routing_pi::StandardPath() + "routemaps";
+    if (!wxDirExists(dir))
+      wxMkdir(dir);
+    else
+      PruneSnapshots(dir);
+    snapshot_directory = dir + wxFileName::GetPathSeparator();
+  }
+  return snapshot_directory;
+}
+
+wxString RouteMapSnapshot::Path(wxUint64 key) {
+  return Directory() +
+         wxString::Format("%016llx.wrroutemap", (unsigned long long)key);
+}
+
+void RouteMapSnapshot::Remove(wxUint64 key) {
+  wxString path = Path(key);
+  Flush();
+  if (wxFileExists(path)) wxRemoveFile(path);
+}
+
+void RouteMapSnapshot::Serialize(wxUint64 key, const IsoChronList& origin,
+                                 Position* destination,
+                                 bool reached_destination,
+                                 const wxDateTime& end_time,
+                                 const std::list<PlotData>& plotdata,
+                                 std::vector<char>& data) {
+  data.clear();
+  SnapshotHeader h;
+  memset(&h, 0, sizeof h);
+  Append(data, h);
+
+  PositionOffsets offsets;
+  for (IsoChronList::const_iterator it = origin.begin(); it != origin.end();
+       ++it) {
+    IsoChron* isochron = *it;
+    IsoChronRecord r;
+    memset(&r, 0, sizeof r);
+    r.time = TimeValue(isochron->time);
+    r.delta = isochron->delta;
+    r.grib_reference_time = -1;
+    if (isochron->m_Grib) {
+      r.grib_reference_time = isochron->m_Grib->m_Reference_Time;
+      r.grib_fingerprint = isochron->m_Grib->m_Fingerprint;
+    }
+    r.grib_is_data_deficient = isochron->m_Grib_is_data_deficient;
+    for (IsoRouteList::iterator rit = isochron->routes.begin();
+         rit != isochron->routes.end(); ++rit)
+      if ((*rit)->skippoints) r.routes++;
+    Append(data, r);
+
+    for (IsoRouteList::iterator rit = isochron->routes.begin();
+         rit != isochron->routes.end(); ++rit)
+      if ((*rit)->skippoints) AppendRoute(data, *rit, offsets);
+  }
+  if (destination) AppendPosition(data, destination, offsets);
+  for (std::list<PlotData>::const_iterator it = plotdata.begin();
+       it != plotdata.end(); ++it)
+    AppendPlotData(data, *it);
+
+  std::unordered_map<Position*, wxInt32> indices;
+  for (size_t i = 0; i < offsets.size(); i++)
+    indices[offsets[i].second] = i;
+  for (size_t i = 0; i < offsets.size(); i++) {
+    std::unordered_map<Position*, wxInt32>::iterator it =
+        indices.find(offsets[i].second->parent);
+    if (it != indices.end())
+      memcpy(&data[offsets[i].first + offsetof(PositionRecord, parent)],
+             &it->second, sizeof it->second);
+  }
+
+  memcpy(h.magic, "WRRM", 4);
+  h.version = SNAPSHOT_VERSION;
+  h.key = key;
+  h.position_size = sizeof(PositionRecord);
+  h.isochrons = origin.size();
+  h.positions = offsets.size();
+  h.destination = destination ? (wxInt32)offsets.size() - 1 : -1;
+  h.reached_destination = reached_destination;
+  h.plotdata = plotdata.size();
+  h.end_time = TimeValue(end_time);
+  memcpy(&data[0], &h, sizeof h);
+}
+
+bool RouteMapSnapshot::WriteData(const wxString& path,
+                                 const std::vector<char>& data) {
+  /* write to a temporary file first so a concurrent session never reads a
+     partially written snapshot */
+  wxString tmp = path + wxString::Format(".%lu.tmp", wxGetProcessId());
+  wxFile file;
+  if (!file.Create(tmp, true)) return false;
+  bool ok = file.Write(&data[0], data.size()) == data.size();
+  ok = file.Close() && ok;
+
+  if (!ok || !replace_file(tmp, path)) {
+    wxRemoveFile(tmp);
+    wxLogGeneric(wxLOG_Debug, "WeatherRouting: failed to write %s", path);
+    return false;
+  }
+  return true;
+}
+
+bool RouteMapSnapshot::Write(const wxString& path, wxUint64 key,
+                             const IsoChronList& origin, Position* destination,
+                             bool reached_destination,
+                             const wxDateTime& end_time,
+                             const std::list<PlotData>& plotdata) {
+  std::vector<char> data;
+  Serialize(key, origin, destination, reached_destination, end_time, plotdata,
+            data);
+  return WriteData(path, data);
+}
+
+void RouteMapSnapshot::WriteInBackground(const wxString& path,
+                                         std::vector<char>& data) {
+  {
+    wxMutexLocker lock(s_write_mutex);
+    pending_snapshots.push_back(PendingSnapshot());
+    pending_snapshots.back().path = path;
+    pending_snapshots.back().data.swap(data);
+    if (s_writing) return; /* picked up by the running thread */
+    s_writing = true;
+  }
+
+  JoinWriter();
+  s_writer_thread = new SnapshotWriterThread;
+  if (s_writer_thread->Run() != wxTHREAD_NO_ERROR) {
+    delete s_writer_thread;
+    s_writer_thread = NULL;
+
+    /* write synchronously rather than lose the snapshots */
+    std::list<PendingSnapshot> snapshots;
+    {
+      wxMutexLocker lock(s_write_mutex);
+      snapshots.swap(pending_snapshots);
+      s_writing = false;
+    }
+    for (std::list<PendingSnapshot>::iterator it = snapshots.begin();
+         it != snapshots.end(); ++it)
+      WriteData(it->path, it->data);
+  }
+}
+
+void RouteMapSnapshot::Flush() { JoinWriter(); }
+
+bool RouteMapSnapshot::Read(const wxString& path, wxUint64 key,
+                            Contents& contents) {
+  contents.origin.clear();
+  contents.destination = nullptr;
+  contents.gribs.clear();
+  contents.plotdata.clear();
+
+  /* a snapshot still queued for writing is newer than the file */
+  std::vector<char> data;
+  {
+    wxMutexLocker lock(s_write_mutex);
+    for (std::list<PendingSnapshot>::reverse_iterator it =
+             pending_snapshots.rbegin();
+         it != pending_snapshots.rend(); ++it)
+      if (it->path == path) {
+        data = it->data;
+        break;
+      }
+  }
+
+  /* read in one go and decode from memory */
+  bool queued = !data.empty();
+  if (!queued) {
+    wxFile file;
+    if (!wxFileExists(path) || !file.Open(path)) return false;
+    wxFileOffset length = file.Length();
+    if (length < (wxFileOffset)sizeof(SnapshotHeader)) return false;
+    data.resize(length);
+    if (file.Read(&data[0], length) != length) return false;
+  }
+  if (data.size() < sizeof(SnapshotHeader)) return false;
+
+  Reader reader(data);
+  SnapshotHeader h;
+  reader.Get(h);
+  if (memcmp(h.magic, "WRRM", 4) || h.version != SNAPSHOT_VERSION ||
+      h.key != key || h.position_size != sizeof(PositionRecord) ||
+      h.isochrons < 0 || h.positions < 0 || h.plotdata < 0)
+    return false;
+
+  std::vector<Position*> positions;
+  std::vector<wxInt32> parents;
+  bool ok = true;
+  for (int i = 0; ok && i < h.isochrons; i++) {
+    IsoChronRecord r;
+    if (!reader.Get(r) || r.routes < 0) {
+      ok = false;
+      break;
+    }
+
+    IsoRouteList routes;
+    for (int j = 0; ok && j < r.routes; j++) {
+      IsoRoute* route = ReadRoute(reader, positions, parents, 0);
+      if (route)
+        routes.push_back(route);
+      else
+        ok = false;
+    }
+
+    Shared_GribRecordSet grib;
+    IsoChron* isochron = new IsoChron(routes, DateTime(r.time), r.delta, grib,
+                                      r.grib_is_data_deficient != 0);
+    isochron->Freeze();
+    contents.origin.push_back(isochron);
+
+    GribProvenance provenance;
+    provenance.reference_time = r.grib_reference_time;
+    provenance.fingerprint = r.grib_fingerprint;
+    contents.gribs.push_back(provenance);
+  }
+
+  if (ok && h.destination >= 0) {
+    PositionRecord r;
+    ok = h.destination == (wxInt32)positions.size() && reader.Get(r);
+    if (ok) {
+      contents.destination = NewPosition(r);
+      positions.push_back(contents.destination);
+      parents.push_back(r.parent);
+    }
+  }
+
+  for (int i = 0; ok && i < h.plotdata; i++) {
+    PlotDataRecord r;
+    ok = reader.Get(r);
+    if (ok) contents.plotdata.push_back(ToPlotData(r));
+  }
+
+  ok = ok && reader.Remaining() == 0 &&
+       positions.size() == (size_t)h.positions;
+  for (size_t i = 0; ok && i < positions.size(); i++) {
+    if (parents[i] >= (wxInt32)positions.size() || parents[i] == (wxInt32)i) {
+      ok = false;
+      break;
+    }
+    if (parents[i] >= 0) positions[i]->parent = positions[parents[i]];
+  }
+
+  if (!ok) {
+    wxLogGeneric(wxLOG_Debug, "WeatherRouting: corrupt snapshot %s", path);
+    Discard(contents);
+    return false;
+  }
+
+  contents.reached_destination = h.reached_destination != 0;
+  contents.end_time = DateTime(h.end_time);
+  /* keep snapshots in use from being pruned */
+  if (!queued) wxFileName(path).Touch();
+  return true;
+}
+
+void RouteMapSnapshot::Discard(Contents& contents) {
+  for (IsoChronList::iterator it = contents.origin.begin();
+       it != contents.origin.end(); ++it)
+    delete *it;
+  contents.origin.clear();
+  delete contents.destination;
+  contents.destination = nullptr;
+  contents.gribs.clear();
+  contents.plotdata.clear();
+}
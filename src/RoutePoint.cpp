@@ -20,6 +20,8 @@
 #include <wx/wx.h>
 
 #include "RoutePoint.h"
+#include "BoundaryCache.h"
+#include "CoastlineIndex.h"
 #include "WeatherDataProvider.h"
 #include "RouteMap.h"
 #include "Utilities.h"
@@ -53,27 +55,9 @@ bool RoutePoint::GetPlotData(RoutePoint* next, double dt,
   data.sail_plan_changes = sail_plan_changes;
   data.polar = polar;
 
-  data.WVHT = WeatherDataProvider::GetSwell(configuration, lat, lon);
-  data.WVDIR = WeatherDataProvider::GetWaveDirection(configuration, lat, lon);
-  data.WVPER = WeatherDataProvider::GetWavePeriod(configuration, lat, lon);
-  data.VW_GUST = WeatherDataProvider::GetGust(configuration, lat, lon);
   data.delta = dt;
 
-  data.cloud_cover =
-      WeatherDataProvider::GetCloudCover(configuration, lat, lon);
-  data.rain_mm_per_hour =
-      WeatherDataProvider::GetRainfall(configuration, lat, lon);
-  data.air_temp =
-      WeatherDataProvider::GetAirTemperature(configuration, lat, lon);
-  data.sea_surface_temp =
-      WeatherDataProvider::GetSeaTemperature(configuration, lat, lon);
-  data.cape = WeatherDataProvider::GetCAPE(configuration, lat, lon);
-  data.relative_humidity =
-      WeatherDataProvider::GetRelativeHumidity(configuration, lat, lon);
-  data.reflectivity =
-      WeatherDataProvider::GetReflectivity(configuration, lat, lon);
-  data.air_pressure =
-      WeatherDataProvider::GetAirPressure(configuration, lat, lon);
+  WeatherDataProvider::GetPlotWeather(configuration, lat, lon, data);
 
   climatology_wind_atlas atlas;
 
@@ -162,27 +146,9 @@ bool BoatData::GetBoatSpeedForPolar(RouteMapConfiguration& configuration,
       (configuration.ClimatologyType == RouteMapConfiguration::CUMULATIVE_MAP ||
        configuration.ClimatologyType ==
            RouteMapConfiguration::CUMULATIVE_MINUS_CALMS)) {
-    /* build map */
-    stw = 0;
-    int windatlas_count = 8;
-    for (int i = 0; i < windatlas_count; i++) {
-      // Calculate relative wind angle (difference between heading and wind
-      // direction).
-      double dir = twa - weather_data.twdOverWater + weather_data.atlas.W[i];
-      if (dir > 180) dir = 360 - dir;
-      double boatSpeed, mind = polar.MinDegreeStep();
-      // if tacking
-      if (fabs(dir) < mind)
-        boatSpeed = polar.Speed(mind, weather_data.atlas.VW[i], &polar_status,
-                                bound, configuration.OptimizeTacking) *
-                    cos(deg2rad(mind)) / cos(deg2rad(dir));
-      else
-        boatSpeed = polar.Speed(dir, weather_data.atlas.VW[i], &polar_status,
-                                bound, configuration.OptimizeTacking);
-      // Accumulate weighted boat speed based on probability of each wind
-      // direction
-      stw += weather_data.atlas.directions[i] * boatSpeed;
-    }
+    /* probability weighted speed over the 8 atlas directions */
+    stw = AtlasSpeedTable::Speed(configuration, newpolar, weather_data, twa,
+                                 bound, &polar_status);
 
     if (configuration.ClimatologyType ==
         RouteMapConfiguration::CUMULATIVE_MINUS_CALMS)
@@ -607,17 +573,13 @@ double RoutePoint::PropagateToPoint(double dlat, double dlon,
 }
 
 bool RoutePoint::CrossesLand(double dlat, double dlon) const {
+  if (CoastlineIndex::IsOpen())
+    return CoastlineIndex::CrossesLand(lat, lon, dlat, dlon);
   return PlugIn_GSHHS_CrossesLand(lat, lon, dlat, dlon);
 }
 
 bool RoutePoint::EntersBoundary(double dlat, double dlon) const {
-  struct FindClosestBoundaryLineCrossing_t t;
-  t.dStartLat = lat, t.dStartLon = heading_resolve(lon);
-  t.dEndLat = dlat, t.dEndLon = heading_resolve(dlon);
-  t.sBoundaryState = wxT("Active");
-
-  // we request any type
-  return RouteMap::ODFindClosestBoundaryLineCrossing(&t);
+  return BoundaryCache::EntersBoundary(lat, lon, dlat, dlon);
 }
 
   void RoutePoint::toJson(Json::Value &json) const {
@@ -871,18 +871,16 @@ Position* RouteSimplifier::FindClosestPositionInRoute(IsoRoute* route,
   Position* closest = nullptr;
   double minDist = INFINITY;
 
-  SkipPosition* skippos = route->skippoints;
+  // Walk every position, not only the first one of each skip run.
+  Position* pos = route->skippoints->point;
   do {
-    Position* pos = skippos->point;
-    if (pos) {
-      double dist = DistGreatCircle_Plugin(pos->lat, pos->lon, lat, lon);
-      if (dist < minDist) {
-        minDist = dist;
-        closest = pos;
-      }
+    double dist = DistGreatCircle_Plugin(pos->lat, pos->lon, lat, lon);
+    if (dist < minDist) {
+      minDist = dist;
+      closest = pos;
     }
-    skippos = skippos->next;
-  } while (skippos != route->skippoints);
+    pos = pos->next;
+  } while (pos != route->skippoints->point);
 
   return closest;
 }
@@ -910,9 +908,9 @@ wxTimeSpan RouteSimplifier::FindPositionTime(
       if (!route || !route->skippoints) continue;
 
       // Check each position in this route
-      SkipPosition* skippos = route->skippoints;
+      Position* pos = route->skippoints->point;
       do {
-        if (skippos->point == position) {
+        if (pos == position) {
           // Found the position! Return the time difference from start
           wxTimeSpan timeFromStart = isochron->time - startTime;
           wxLogGeneric(wxLOG_Debug,
@@ -921,8 +919,8 @@ wxTimeSpan RouteSimplifier::FindPositionTime(
                        timeFromStart.Format("%D days %H:%M:%S"));
           return timeFromStart;
         }
-        skippos = skippos->next;
-      } while (skippos != route->skippoints);
+        pos = pos->next;
+      } while (pos != route->skippoints->point);
     }
   }
 
@@ -957,10 +955,9 @@ wxTimeSpan RouteSimplifier::FindPositionTime(
     for (IsoRoute* route : isochron->routes) {
       if (!route || !route->skippoints) continue;
 
-      SkipPosition* skippos = route->skippoints;
+      Position* pos = route->skippoints->point;
       do {
-        Position* pos = skippos->point;
-        if (pos && std::abs(pos->lat - position->lat) < tolerance &&
+        if (std::abs(pos->lat - position->lat) < tolerance &&
             std::abs(pos->lon - position->lon) < tolerance) {
           wxTimeSpan timeFromStart = isochron->time - startTime;
           wxLogGeneric(
@@ -971,8 +968,8 @@ wxTimeSpan RouteSimplifier::FindPositionTime(
               timeFromStart.Format("%D days %H:%M:%S"));
           return timeFromStart;
         }
-        skippos = skippos->next;
-      } while (skippos != route->skippoints);
+        pos = pos->next;
+      } while (pos != route->skippoints->point);
     }
   }
 
@@ -1007,9 +1004,9 @@ wxTimeSpan RouteSimplifier::FindPositionTimeByParentChain(
       for (IsoRoute* route : isochron->routes) {
         if (!route || !route->skippoints) continue;
 
-        SkipPosition* skippos = route->skippoints;
+        Position* pos = route->skippoints->point;
         do {
-          if (skippos->point == current) {
+          if (pos == current) {
             // Found a parent position in the isochrones!
             wxTimeSpan parentTime = isochron->time - startTime;
 
@@ -1049,8 +1046,8 @@ wxTimeSpan RouteSimplifier::FindPositionTimeByParentChain(
                          parentTime.Format("%D days %H:%M:%S"));
             return parentTime;
           }
-          skippos = skippos->next;
-        } while (skippos != route->skippoints);
+          pos = pos->next;
+        } while (pos != route->skippoints->point);
       }
     }
 
@@ -30,6 +30,8 @@
 #include <math.h>
 
 #include "SettingsDialog.h"
+#include "ClimatologyCache.h"
+#include "MemoryGovernor.h"
 #include "RouteMapOverlay.h"
 #include "weather_routing_pi.h"
 #include "WeatherRouting.h"
@@ -464,6 +466,17 @@ void SettingsDialog::LoadSettings() {
   pConf->Read(_T("ConcurrentThreads"), &ConcurrentThreads, ConcurrentThreads);
   m_sConcurrentThreads->SetValue(ConcurrentThreads);
 
+  // Not exposed in the dialog, only in the configuration file.
+  double ClimatologyCacheResolution = ClimatologyCache::GetResolution();
+  pConf->Read(_T("ClimatologyCacheResolution"), &ClimatologyCacheResolution,
+              ClimatologyCacheResolution);
+  ClimatologyCache::SetResolution(ClimatologyCacheResolution);
+
+  // Not exposed in the dialog either, in megabytes, 0 to disable.
+  int MemoryBudget = MemoryGovernor::GetBudget();
+  pConf->Read(_T("MemoryBudget"), &MemoryBudget, MemoryBudget);
+  MemoryGovernor::SetBudget(MemoryBudget);
+
   // Set defaults
   bool columns[WeatherRouting::NUM_COLS];
   for (int i = 0; i < WeatherRouting::NUM_COLS; i++)
@@ -520,6 +533,9 @@ void SettingsDialog::SaveSettings() {
   pConf->Write(_T("DisplayComfortOnRoute"), m_cbDisplayComfort->GetValue());
   pConf->Write(_T("DisplayCurrent"), m_cbDisplayCurrent->GetValue());
   pConf->Write(_T("ConcurrentThreads"), m_sConcurrentThreads->GetValue());
+  pConf->Write(_T("ClimatologyCacheResolution"),
+               ClimatologyCache::GetResolution());
+  pConf->Write(_T("MemoryBudget"), MemoryGovernor::GetBudget());
 
   for (int i = 0; i < WeatherRouting::NUM_COLS; i++)
     pConf->Write(wxString::Format(_T("Column_") + _(column_names[i]), i),
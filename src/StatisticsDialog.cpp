@@ -30,11 +30,21 @@
 #include <math.h>
 
 #include <list>
+#include <map>
+#include <string>
+
+#include <wx/clipbrd.h>
 
 #include "StatisticsDialog.h"
 
 #include "RouteMapOverlay.h"
 
+static wxString FormatBytes(size_t bytes) {
+  if (bytes < 1024 * 1024)
+    return wxString::Format("%.1f KB", bytes / 1024.0);
+  return wxString::Format("%.1f MB", bytes / (1024.0 * 1024.0));
+}
+
 StatisticsDialog::StatisticsDialog(wxWindow* parent)
 #ifndef __WXOSX__
     : StatisticsDialogBase(parent)
@@ -44,6 +54,32 @@ StatisticsDialog::StatisticsDialog(wxWindow* parent)
                            wxDEFAULT_DIALOG_STYLE | wxSTAY_ON_TOP)
 #endif
 {
+  // memory held by the route maps, below the route statistics
+  wxStaticBoxSizer* sbMemory = new wxStaticBoxSizer(
+      new wxStaticBox(this, wxID_ANY, _("Memory")), wxVERTICAL);
+  wxWindow* box = sbMemory->GetStaticBox();
+
+  wxFlexGridSizer* fgMemory = new wxFlexGridSizer(0, 4, 0, 0);
+  fgMemory->SetFlexibleDirection(wxBOTH);
+  fgMemory->SetNonFlexibleGrowMode(wxFLEX_GROWMODE_SPECIFIED);
+  m_stMemoryPositions = AddMemoryLabel(box, fgMemory, _("Positions"));
+  m_stMemorySkipPositions = AddMemoryLabel(box, fgMemory, _("Skip Positions"));
+  m_stMemoryRoutes = AddMemoryLabel(box, fgMemory, _("Routes"));
+  m_stMemoryGrib = AddMemoryLabel(box, fgMemory, _("GRIB"));
+  m_stMemoryPlotData = AddMemoryLabel(box, fgMemory, _("Plot Data"));
+  m_stMemoryRender = AddMemoryLabel(box, fgMemory, _("Render"));
+  m_stMemoryTotal = AddMemoryLabel(box, fgMemory, _("Total"));
+  sbMemory->Add(fgMemory, 1, wxEXPAND, 5);
+
+  wxButton* bCopy = new wxButton(box, wxID_ANY, _("Copy Report"));
+  bCopy->SetToolTip(_("Copy the memory of each route as JSON"));
+  bCopy->Bind(wxEVT_BUTTON, &StatisticsDialog::OnCopyMemory, this);
+  sbMemory->Add(bCopy, 0, wxALL, 5);
+
+  // before the dialog buttons
+  wxSizer* sizer = GetSizer();
+  sizer->Insert(sizer->GetItemCount() - 1, sbMemory, 1, wxEXPAND | wxALL, 5);
+
   SetRouteMapOverlays(std::list<RouteMapOverlay*>());
 #ifdef __OCPN__ANDROID__
   wxSize sz = ::wxGetDisplaySize();
@@ -56,6 +92,9 @@ void StatisticsDialog::SetRouteMapOverlays(
   bool running = false;
   int tisochrons = 0, troutes = 0, tinvroutes = 0, tskippositions = 0,
       tpositions = 0;
+  RouteMapMemory tmemory;
+  std::map<WR_GribRecordSet*, size_t> gribs;
+  Json::Value report(Json::arrayValue);
   for (std::list<RouteMapOverlay*>::iterator it = routemapoverlays.begin();
        it != routemapoverlays.end(); it++) {
     if ((*it)->Running()) running = true;
@@ -65,7 +104,28 @@ void StatisticsDialog::SetRouteMapOverlays(
                          positions);
     tisochrons += isochrones, troutes += routes, tinvroutes += invroutes;
     tskippositions += skippositions, tpositions += positions;
+
+    RouteMapMemory memory = (*it)->GetMemoryUsage();
+    tmemory += memory;
+    (*it)->GetGribMemory(gribs);
+
+    RouteMapConfiguration configuration = (*it)->GetConfiguration();
+    Json::Value route = memory.ToJSON();
+    route["start"] = std::string(configuration.Start.ToUTF8());
+    route["end"] = std::string(configuration.End.ToUTF8());
+    route["start_time"] =
+        std::string(configuration.StartTime.FormatISOCombined().ToUTF8());
+    route["running"] = (*it)->Running();
+    route["isochrones"] = isochrones;
+    report.append(route);
   }
+  /* GRIB record sets shared by several routes are held once */
+  tmemory.grib = 0;
+  for (std::map<WR_GribRecordSet*, size_t>::iterator it = gribs.begin();
+       it != gribs.end(); it++)
+    tmemory.grib += it->second;
+  m_MemoryReport["routes"] = report;
+  m_MemoryReport["total"] = tmemory.ToJSON();
 
   m_stState->SetLabel(routemapoverlays.empty() ? _("No Route")
                       : running                ? _("Running")
@@ -76,9 +136,37 @@ void StatisticsDialog::SetRouteMapOverlays(
   m_stSkipPositions->SetLabel(wxString::Format("%d", tskippositions));
   m_stPositions->SetLabel(wxString::Format("%d", tpositions));
 
+  m_stMemoryPositions->SetLabel(FormatBytes(tmemory.positions));
+  m_stMemorySkipPositions->SetLabel(FormatBytes(tmemory.skippositions));
+  m_stMemoryRoutes->SetLabel(FormatBytes(tmemory.routes));
+  m_stMemoryGrib->SetLabel(FormatBytes(tmemory.grib));
+  m_stMemoryPlotData->SetLabel(FormatBytes(tmemory.plotdata));
+  m_stMemoryRender->SetLabel(FormatBytes(tmemory.render));
+  m_stMemoryTotal->SetLabel(FormatBytes(tmemory.Total()));
+
   Fit();
 }
 
 void StatisticsDialog::SetRunTime(wxTimeSpan RunTime) {
   m_stRunTime->SetLabel(RunTime.Format());
 }
+
+wxStaticText* StatisticsDialog::AddMemoryLabel(wxWindow* parent,
+                                               wxSizer* sizer,
+                                               const wxString& label) {
+  wxStaticText* name = new wxStaticText(parent, wxID_ANY, label);
+  sizer->Add(name, 0, wxALL, 5);
+
+  wxStaticText* value = new wxStaticText(parent, wxID_ANY, _("0"));
+  sizer->Add(value, 0, wxALL, 5);
+  return value;
+}
+
+void StatisticsDialog::OnCopyMemory(wxCommandEvent& event) {
+  Json::FastWriter writer;
+  wxString report = wxString::FromUTF8(writer.write(m_MemoryReport).c_str());
+  if (wxTheClipboard->Open()) {
+    wxTheClipboard->SetData(new wxTextDataObject(report));
+    wxTheClipboard->Close();
+  }
+}
@@ -24,8 +24,12 @@
  */
 
 #include <stdlib.h>
+#include <stdio.h>
 #include <math.h>
 #include <wx/wx.h>
+#ifdef __WXMSW__
+#include <wx/msw/wrapwin.h>
+#endif
 
 #include "tinyxml.h"
 
@@ -106,6 +110,15 @@ wxString calculateTimeDelta(wxDateTime startTime, wxDateTime endTime) {
   return timeStr;
 }
 
+bool replace_file(const wxString& temp, const wxString& path) {
+#ifdef __WXMSW__
+  return MoveFileExW(temp.wc_str(), path.wc_str(),
+                     MOVEFILE_REPLACE_EXISTING | MOVEFILE_WRITE_THROUGH) != 0;
+#else
+  return rename(temp.fn_str(), path.fn_str()) == 0;
+#endif
+}
+
 #ifdef __MINGW32__
 char* strtok_r(char* str, const char* delim, char** save) {
   char *res, *last;
@@ -20,9 +20,14 @@
 #include <wx/wx.h>
 
 #include <functional>
+#include <map>
+#include <mutex>
+#include <tuple>
 
 #include "RoutePoint.h"
 #include "WeatherDataProvider.h"
+#include "ClimatologyCache.h"
+#include "GribTileStore.h"
 #include "RouteMap.h"
 #include "Utilities.h"
 #include "ocpn_plugin.h"
@@ -32,33 +37,129 @@
 extern Json::Value g_ReceivedJSONMsg;
 extern wxString g_ReceivedMessage;
 
-static Json::Value RequestGRIB(const wxDateTime& time, const wxString& what,
-                               double lat, double lon) {
-  Json::Value error;
-  Json::Value v;
-  Json::FastWriter writer;
-  if (!time.IsValid()) return error;
+namespace {
+
+/* request keys of the GribValueField flags, in bit order */
+const char* const grib_value_keys[] = {
+    "WIND SPEED", "CURRENT SPEED", "SWELL",    "WAVE DIR", "WAVE PERIOD",
+    "GUST",       "CLOUD",         "RAIN",     "AIR TEMP", "SEA TEMP",
+    "CAPE",       "REL HUM",       "PRESSURE", "REFLECTIVITY"};
+const int GRIB_VALUE_KEY_COUNT =
+    sizeof grib_value_keys / sizeof *grib_value_keys;
+
+/* replies are dropped when this many points are held */
+const size_t MAX_GRIB_VALUE_POINTS = 4096;
 
+struct GribValueReply {
+  int fields;  // fields the plugin was asked for
+  Json::Value values;
+};
+
+typedef std::tuple<time_t, double, double> GribValueKey;
+
+std::map<GribValueKey, GribValueReply> grib_values;
+std::mutex grib_values_mutex;
+/* g_ReceivedJSONMsg is shared by every thread sending requests */
+std::mutex grib_request_mutex;
+
+int GribValueField(const wxString& what) {
+  for (int i = 0; i < GRIB_VALUE_KEY_COUNT; i++)
+    if (what == grib_value_keys[i]) return 1 << i;
+  return 0;
+}
+
+GribValueKey MakeGribValueKey(const wxDateTime& time, double lat, double lon) {
+  return std::make_tuple(time.GetTicks(), lat, lon);
+}
+
+void SetRequestTimeAndPosition(Json::Value& v, const wxDateTime& time,
+                               double lat, double lon) {
   v["Day"] = time.GetDay();
   v["Month"] = time.GetMonth();
   v["Year"] = time.GetYear();
   v["Hour"] = time.GetHour();
   v["Minute"] = time.GetMinute();
   v["Second"] = time.GetSecond();
-
-  v["Source"] = "WEATHER_ROUTING_PI";
-  v["Type"] = "Request";
-  v["Msg"] = "GRIB_VALUES_REQUEST";
   v["lat"] = lat;
   v["lon"] = lon;
-  v[what] = 1;
+}
+
+void SetRequestFields(Json::Value& v, int fields) {
+  for (int i = 0; i < GRIB_VALUE_KEY_COUNT; i++)
+    if (fields & (1 << i)) v[grib_value_keys[i]] = 1;
+}
 
+/* sends a request and returns the reply, or a null value */
+Json::Value SendGribValuesRequest(const Json::Value& v) {
+  Json::FastWriter writer;
+  std::lock_guard<std::mutex> lock(grib_request_mutex);
+  g_ReceivedMessage = wxEmptyString;
   SendPluginMessage("GRIB_VALUES_REQUEST", writer.write(v));
   if (g_ReceivedMessage != wxEmptyString &&
-      g_ReceivedJSONMsg["Type"].asString() == "Reply") {
+      g_ReceivedJSONMsg["Type"].asString() == "Reply")
     return g_ReceivedJSONMsg;
+  return Json::Value();
+}
+
+void StoreGribValues(const GribValuePoint& point, int fields,
+                     const Json::Value& values) {
+  std::lock_guard<std::mutex> lock(grib_values_mutex);
+  if (grib_values.size() >= MAX_GRIB_VALUE_POINTS) grib_values.clear();
+  GribValueReply& reply =
+      grib_values[MakeGribValueKey(point.time, point.lat, point.lon)];
+  reply.fields = fields;
+  reply.values = values;
+}
+
+Json::Value NewGribValuesRequest() {
+  Json::Value v;
+  v["Source"] = "WEATHER_ROUTING_PI";
+  v["Type"] = "Request";
+  v["Msg"] = "GRIB_VALUES_REQUEST";
+  return v;
+}
+
+}  // namespace
+
+static Json::Value RequestGRIB(const wxDateTime& time, const wxString& what,
+                               double lat, double lon) {
+  Json::Value error;
+  if (!time.IsValid()) return error;
+
+  // answer from the values fetched by RequestGribValues() if possible
+  int field = GribValueField(what);
+  if (field) {
+    std::lock_guard<std::mutex> lock(grib_values_mutex);
+    auto it = grib_values.find(MakeGribValueKey(time, lat, lon));
+    if (it != grib_values.end() && (it->second.fields & field))
+      return it->second.values;
   }
-  return error;
+
+  Json::Value v = NewGribValuesRequest();
+  SetRequestTimeAndPosition(v, time, lat, lon);
+  v[what] = 1;
+
+  Json::Value r = SendGribValuesRequest(v);
+  return r.isNull() ? error : r;
+}
+
+bool WeatherDataProvider::RequestGribValues(const GribValuePoint& point,
+                                            int fields) {
+  if (!point.time.IsValid()) return false;
+
+  Json::Value v = NewGribValuesRequest();
+  SetRequestTimeAndPosition(v, point.time, point.lat, point.lon);
+  SetRequestFields(v, fields);
+
+  Json::Value r = SendGribValuesRequest(v);
+  if (r.isNull()) return false;
+  StoreGribValues(point, fields, r);
+  return true;
+}
+
+void WeatherDataProvider::ClearGribValues() {
+  std::lock_guard<std::mutex> lock(grib_values_mutex);
+  grib_values.clear();
 }
 
 /**
@@ -148,8 +249,8 @@ bool WeatherDataProvider::GetCurrent(RouteMapConfiguration& configuration,
 
   if (configuration.ClimatologyType != RouteMapConfiguration::DISABLED &&
       RouteMap::ClimatologyData &&
-      RouteMap::ClimatologyData(CURRENT, configuration.time, lat, lon,
-                                currentDir, currentSpeed)) {
+      ClimatologyCache::Data(CURRENT, configuration.time, lat, lon,
+                             currentDir, currentSpeed)) {
     data_mask |= DataMask::CLIMATOLOGY_CURRENT;
     return true;
   }
@@ -320,9 +421,8 @@ bool WeatherDataProvider::ReadWindAndCurrents(
 
     if (configuration.ClimatologyType == RouteMapConfiguration::AVERAGE &&
         RouteMap::ClimatologyData &&
-        RouteMap::ClimatologyData(WIND, configuration.time, position->lat,
-                                  position->lon, twdOverGround,
-                                  twsOverGround)) {
+        ClimatologyCache::Data(WIND, configuration.time, position->lat,
+                               position->lon, twdOverGround, twsOverGround)) {
       twdOverGround = heading_resolve(twdOverGround);
 
       data_mask |= DataMask::CLIMATOLOGY_WIND;
@@ -333,7 +433,7 @@ bool WeatherDataProvider::ReadWindAndCurrents(
                RouteMap::ClimatologyWindAtlasData) {
       int windatlas_count = 8;
       double speeds[8];
-      if (RouteMap::ClimatologyWindAtlasData(
+      if (ClimatologyCache::WindAtlasData(
               configuration.time, position->lat, position->lon, windatlas_count,
               atlas.directions, speeds, atlas.storm, atlas.calm)) {
         /* compute wind speeds over water with the given current */
@@ -439,16 +539,108 @@ double WeatherDataProvider::GetWeatherParameter(
   // Return early if no GRIB data at all
   if (!grib) return returnOnEmpty;
 
-  // Try to retrieve the data from local GRIB
+  // Try to retrieve the data from local GRIB, large display only fields may
+  // have been moved to the tile store
   GribRecord* grh = grib->m_GribRecordPtrArray[gribIndex];
-  if (!grh) return returnOnEmpty;
-
-  double value = grh->getInterpolatedValue(lon, lat, true);
+  double value;
+  if (grh)
+    value = grh->getInterpolatedValue(lon, lat, true);
+  else
+    value = GribTileStore::GetInterpolatedValue(*grib, gribIndex, lon, lat);
   if (value == GRIB_NOTDEF) return returnOnEmpty;
 
   return postProcessFn ? postProcessFn(value) : value;
 }
 
+namespace {
+
+double NotNegative(double value) { return value < 0 ? 0 : value; }
+
+double GustToKnots(double gust) { return gust * 3.6 / 1.852; }
+
+/* PlotData members filled by GetPlotWeather(), with the same post processing
+   as the individual getters */
+struct PlotField {
+  int idx;
+  double PlotData::*value;
+  double (*postProcessFn)(double);
+};
+
+const PlotField plot_fields[] = {
+    {Idx_HTSIGW, &PlotData::WVHT, NotNegative},
+    {Idx_WVDIR, &PlotData::WVDIR, NotNegative},
+    {Idx_WVPER, &PlotData::WVPER, NotNegative},
+    {Idx_WIND_GUST, &PlotData::VW_GUST, GustToKnots},
+    {Idx_CLOUD_TOT, &PlotData::cloud_cover, nullptr},
+    {Idx_PRECIP_TOT, &PlotData::rain_mm_per_hour, nullptr},
+    {Idx_AIR_TEMP, &PlotData::air_temp, nullptr},
+    {Idx_SEA_TEMP, &PlotData::sea_surface_temp, nullptr},
+    {Idx_CAPE, &PlotData::cape, nullptr},
+    {Idx_HUMID_RE, &PlotData::relative_humidity, nullptr},
+    {Idx_COMP_REFL, &PlotData::reflectivity, nullptr},
+    {Idx_PRESSURE, &PlotData::air_pressure, nullptr}};
+
+/* distinct grids located per point, GRIB files rarely use more than two */
+const int MAX_PLOT_GRIDS = 4;
+
+}  // namespace
+
+void WeatherDataProvider::GetPlotWeather(RouteMapConfiguration& configuration,
+                                         double lat, double lon,
+                                         PlotData& data) {
+  WR_GribRecordSet* grib = configuration.grib;
+
+  if (!grib) {
+    // remote GRIB or no GRIB at all
+    data.WVHT = GetSwell(configuration, lat, lon);
+    data.WVDIR = GetWaveDirection(configuration, lat, lon);
+    data.WVPER = GetWavePeriod(configuration, lat, lon);
+    data.VW_GUST = GetGust(configuration, lat, lon);
+    data.cloud_cover = GetCloudCover(configuration, lat, lon);
+    data.rain_mm_per_hour = GetRainfall(configuration, lat, lon);
+    data.air_temp = GetAirTemperature(configuration, lat, lon);
+    data.sea_surface_temp = GetSeaTemperature(configuration, lat, lon);
+    data.cape = GetCAPE(configuration, lat, lon);
+    data.relative_humidity = GetRelativeHumidity(configuration, lat, lon);
+    data.reflectivity = GetReflectivity(configuration, lat, lon);
+    data.air_pressure = GetAirPressure(configuration, lat, lon);
+    return;
+  }
+
+  const GribRecord* grids[MAX_PLOT_GRIDS];
+  GribRecord::InterpolationCell cells[MAX_PLOT_GRIDS];
+  bool inside[MAX_PLOT_GRIDS];
+  int grid_count = 0;
+
+  for (const PlotField& field : plot_fields) {
+    const GribRecord* rec = grib->m_GribRecordPtrArray[field.idx];
+    double value = GRIB_NOTDEF;
+    if (!rec) {
+      // large display only fields may have been moved to the tile store
+      value = GribTileStore::GetInterpolatedValue(*grib, field.idx, lon, lat);
+    } else if (rec->isOk()) {
+      int g = 0;
+      while (g < grid_count && !grids[g]->hasSameGrid(*rec)) g++;
+      if (g == grid_count && g < MAX_PLOT_GRIDS) {
+        grids[g] = rec;
+        inside[g] = rec->getInterpolationCell(lon, lat, cells[g]);
+        grid_count++;
+      }
+
+      if (g == grid_count)
+        value = rec->getInterpolatedValue(lon, lat, true);
+      else if (inside[g])
+        value = rec->getInterpolatedValue(cells[g]);
+    }
+
+    if (value == GRIB_NOTDEF)
+      data.*field.value = NAN;
+    else
+      data.*field.value =
+          field.postProcessFn ? field.postProcessFn(value) : value;
+  }
+}
+
 /**
  * Return the swell height at the specified lat/long location.
  * @return the swell height in meters. 0 if no data is available.
@@ -25,7 +25,11 @@
 
 #include <stdlib.h>
 #include <math.h>
+#include <algorithm>
+#include <atomic>
 #include <cmath>
+#include <map>
+#include <memory>
 #include <time.h>
 
 #include <wx/glcanvas.h>
@@ -36,6 +40,12 @@
 #include "Boat.h"
 #include "BoatDialog.h"
 #include "RouteMapOverlay.h"
+#include "GribTimeInterpolator.h"
+#include "AtlasSpeedTable.h"
+#include "BoundaryCache.h"
+#include "ClimatologyCache.h"
+#include "CoastlineIndex.h"
+#include "ConstraintChecker.h"
 #include "weather_routing_pi.h"
 #include "WeatherRouting.h"
 #include "RouteSimplifier.h"
@@ -91,7 +101,8 @@ static const char* eye[] = {"20 20 7 1",
                             "....................",
                             "...................."};
 
-WeatherRoute::WeatherRoute() : routemapoverlay(new RouteMapOverlay) {}
+WeatherRoute::WeatherRoute()
+    : routemapoverlay(new RouteMapOverlay), SavedConfigurationVersion(0) {}
 WeatherRoute::~WeatherRoute() { delete routemapoverlay; }
 
 const wxString WeatherRouting::column_names[NUM_COLS] = {_("Visible"),
@@ -174,6 +185,10 @@ WeatherRouting::WeatherRouting(wxWindow* parent, weather_routing_pi& plugin)
       m_weather_routing_pi(plugin),
       m_positionOnRoute(nullptr),
       m_RoutingTablePanel(nullptr) {
+  m_RouteMapOverlayNeedingGrib = NULL;
+  m_GribIdentityRequest = NULL;
+  m_GribIdentityCache = NULL;
+
   wxFileConfig* pConf = GetOCPNConfigObject();
   pConf->SetPath("/Plugins/WeatherRouting");
 
@@ -337,10 +352,21 @@ WeatherRouting::WeatherRouting(wxWindow* parent, weather_routing_pi& plugin)
 
   pConf->Read(_T ( "DialogSplit" ), &sashpos, 0);
 
-  /* periodically check for updates from computation thread */
+  /* the computation threads post events when they need attention, the
+     timer periodically checks the rest */
   m_tCompute.Connect(wxEVT_TIMER,
                      wxTimerEventHandler(WeatherRouting::OnComputationTimer),
                      NULL, this);
+  Connect(wxEVT_ROUTEMAP_COMPUTATION,
+          wxThreadEventHandler(WeatherRouting::OnComputationEvent), NULL,
+          this);
+
+  /* finished routes and the address space usage are checked against the
+     memory budget even when nothing is computing */
+  m_tMemory.Connect(wxEVT_TIMER,
+                    wxTimerEventHandler(WeatherRouting::OnMemoryTimer), NULL,
+                    this);
+  m_tMemory.Start(5000);
 
   m_tHideConfiguration.Connect(
       wxEVT_TIMER,
@@ -491,7 +517,15 @@ WeatherRouting::~WeatherRouting() {
       wxEVT_TIMER, wxTimerEventHandler(WeatherRouting::OnAutoSaveXMLTimer),
       NULL, this);
 
+  m_tMemory.Stop();
+  m_tMemory.Disconnect(wxEVT_TIMER,
+                       wxTimerEventHandler(WeatherRouting::OnMemoryTimer),
+                       NULL, this);
+
   StopAll();
+  Disconnect(wxEVT_ROUTEMAP_COMPUTATION,
+             wxThreadEventHandler(WeatherRouting::OnComputationEvent), NULL,
+             this);
 
   m_SettingsDialog.SaveSettings();
 
@@ -942,6 +976,15 @@ static void CursorPositionDialogMessage(CursorPositionDialog& dlg,
   dlg.Fit();
 }
 
+/* the directories CoastlineIndex reads the GSHHS polygon files from */
+static wxArrayString CoastlineDirectories() {
+  wxArrayString directories;
+  directories.Add(*GetpPrivateApplicationDataLocation() +
+                  wxFileName::GetPathSeparator() + "gshhs");
+  directories.Add(*GetpSharedDataLocation() + "gshhs");
+  return directories;
+}
+
 static void RoutePositionDialogMessage(RoutePositionDialog& dlg, wxString msg) {
   dlg.m_stPosition->SetLabel(msg);
   dlg.m_stPosition->Fit();
@@ -1518,7 +1561,10 @@ void WeatherRouting::OnWeatherRoutesListLeftDown(wxMouseEvent& event) {
 void WeatherRouting::UpdateComputeState() {
   m_panel->m_gProgress->SetRange(m_RoutesToRun);
 
-  if (m_bRunning) return;
+  if (m_bRunning) {
+    m_tCompute.Start(1, true); /* start the new routes on free threads */
+    return;
+  }
 
   m_bRunning = true;
   m_panel->m_gProgress->SetValue(0);
@@ -1531,8 +1577,10 @@ void WeatherRouting::UpdateComputeState() {
 
 void WeatherRouting::OnCompute(wxCommandEvent& event) {
   std::list<RouteMapOverlay*> currentroutemaps = CurrentRouteMaps();
+  /* computing the selected routes explicitly never reloads a snapshot, so
+     results can be refreshed when something the key can't see changed */
   for (auto it = currentroutemaps.begin(); it != currentroutemaps.end(); it++) {
-    Start(*it);
+    Start(*it, false);
   }
   UpdateComputeState();
 }
@@ -1800,6 +1848,12 @@ void WeatherRouting::OnFilter(wxCommandEvent& event) {
 }
 
 void WeatherRouting::OnResetAll(wxCommandEvent& event) {
+  /* the results are computed again rather than reloaded */
+  for (std::list<WeatherRoute*>::iterator it = m_WeatherRoutes.begin();
+       it != m_WeatherRoutes.end(); it++)
+    if ((*it)->routemapoverlay->GetResultKey())
+      RouteMapSnapshot::Remove((*it)->routemapoverlay->GetResultKey());
+
   m_StatisticsDialog.SetRunTime(m_RunTime = wxTimeSpan(0));
   Reset();
   UpdateStates();
@@ -2079,14 +2133,54 @@ void WeatherRouting::OnAbout(wxCommandEvent& event) {
 }
 
 void WeatherRouting::OnComputationTimer(wxTimerEvent&) {
+  if (!m_bRunning) return;
+
+  GovernMemory();
+  RefreshComputations();
+  ScheduleComputations();
+}
+
+void WeatherRouting::OnMemoryTimer(wxTimerEvent&) {
+  /* the computation timer governs memory while routes compute */
+  if (!m_bRunning) GovernMemory();
+}
+
+void WeatherRouting::OnComputationEvent(wxThreadEvent& event) {
+  if (!m_bRunning) return;
 
+  if (event.GetInt() == RouteMapOverlay::COMPUTATION_PROGRESS) {
+    static wxLongLong last_refresh; /* don't refresh all the time */
+    wxLongLong now = wxGetLocalTimeMillis();
+    if (now - last_refresh >= 1000) {
+      last_refresh = now;
+      RefreshComputations();
+    }
+    return;
+  }
+
+  ScheduleComputations();
+}
+
+void WeatherRouting::ScheduleComputations() {
+  /* a dialog shown below dispatches further events */
+  static bool scheduling;
+  if (scheduling) return;
+  scheduling = true;
+
+  bool finished = false;
   for (std::list<RouteMapOverlay*>::iterator it = m_RunningRouteMaps.begin();
        it != m_RunningRouteMaps.end();) {
     RouteMapOverlay* routemapoverlay = *it;
     if (!routemapoverlay->Running()) {
       routemapoverlay->DeleteThread();
+      if (routemapoverlay->Finished() && routemapoverlay->Valid() &&
+          routemapoverlay->GetWeatherForecastStatus() ==
+              WEATHER_FORECAST_SUCCESS)
+        routemapoverlay->SaveSnapshot();
+      routemapoverlay->ApplyRetention();
 
       it = m_RunningRouteMaps.erase(it);
+      finished = true;
 
       m_panel->m_gProgress->SetValue(m_RoutesToRun - m_WaitingRouteMaps.size() -
                                      m_RunningRouteMaps.size());
@@ -2116,14 +2210,20 @@ void WeatherRouting::OnComputationTimer(wxTimerEvent&) {
       m_RouteMapOverlayNeedingGrib = NULL;
     }
   }
-
-  if ((int)m_RunningRouteMaps.size() <
-          m_SettingsDialog.m_sConcurrentThreads->GetValue() &&
-      m_WaitingRouteMaps.size()) {
+  if (finished) RefreshComputations();
+
+  /* fill every free thread, when throttled a route is only started once
+     nothing else is running so routes are computed one at a time */
+  while ((int)m_RunningRouteMaps.size() <
+             m_SettingsDialog.m_sConcurrentThreads->GetValue() &&
+         m_WaitingRouteMaps.size() &&
+         (m_MemoryGovernor.CanStart() ||
+          (m_MemoryGovernor.GetState() == MemoryGovernor::THROTTLED &&
+           m_RunningRouteMaps.empty()))) {
     RouteMapOverlay* routemapoverlay = m_WaitingRouteMaps.front();
     m_WaitingRouteMaps.pop_front();
     wxString error;
-    if (routemapoverlay->Start(error))
+    if (routemapoverlay->Start(error, this))
       m_RunningRouteMaps.push_back(routemapoverlay);
     else {
       wxMessageDialog mdlg(this, _("Failed to start configuration: ") + error,
@@ -2134,44 +2234,108 @@ void WeatherRouting::OnComputationTimer(wxTimerEvent&) {
     UpdateRouteMap(routemapoverlay);
   }
 
-  static int cycles; /* don't refresh all the time */
-  if (++cycles > 50 || !m_RunningRouteMaps.size()) {
-    cycles = 0;
-
-    std::list<RouteMapOverlay*> currentroutemaps = CurrentRouteMaps();
-    for (std::list<RouteMapOverlay*>::iterator it = currentroutemaps.begin();
-         it != currentroutemaps.end(); it++)
-      if ((*it)->Updated()) {
-        m_StatisticsDialog.SetRunTime(m_RunTime +=
-                                      wxDateTime::Now() - m_StartTime);
-        if (m_StatisticsDialog.IsShown())
-          m_StatisticsDialog.SetRouteMapOverlays(CurrentRouteMaps());
-        if (m_PlotDialog.IsShown())
-          m_PlotDialog.SetRouteMapOverlay(FirstCurrentRouteMap());
-
-        m_StartTime = wxDateTime::Now();
-        GetParent()->Refresh();
-        break;
-      }
-  }
+  scheduling = false;
 
-  if (m_RunningRouteMaps.size()) {
-    /* todo, instead of respawning the funky timer here,
-       maybe we can do it from the thread instead to eliminate the delay */
-    m_tCompute.Start(25, true);
+  if (m_RunningRouteMaps.size() || m_WaitingRouteMaps.size()) {
+    /* the threads post events as they need grib data or finish, the timer
+       only governs memory, refreshes the display and resumes waiting routes
+       once the governor releases them */
+    if (!m_tCompute.IsRunning()) m_tCompute.Start(1000, true);
     return;
   }
 
   StopAll();
 }
 
+void WeatherRouting::RefreshComputations() {
+  std::list<RouteMapOverlay*> currentroutemaps = CurrentRouteMaps();
+  for (std::list<RouteMapOverlay*>::iterator it = currentroutemaps.begin();
+       it != currentroutemaps.end(); it++)
+    if ((*it)->Updated()) {
+      m_StatisticsDialog.SetRunTime(m_RunTime +=
+                                    wxDateTime::Now() - m_StartTime);
+      if (m_StatisticsDialog.IsShown())
+        m_StatisticsDialog.SetRouteMapOverlays(CurrentRouteMaps());
+      if (m_PlotDialog.IsShown())
+        m_PlotDialog.SetRouteMapOverlay(FirstCurrentRouteMap());
+
+      m_StartTime = wxDateTime::Now();
+      GetParent()->Refresh();
+      break;
+    }
+}
+
+void WeatherRouting::GovernMemory() {
+  /* routes computed together share their GRIB record sets, count each once */
+  size_t used = 0;
+  std::map<WR_GribRecordSet*, size_t> gribs;
+  for (std::list<WeatherRoute*>::iterator it = m_WeatherRoutes.begin();
+       it != m_WeatherRoutes.end(); it++) {
+    RouteMapMemory memory = (*it)->routemapoverlay->GetMemoryUsage();
+    used += memory.Total() - memory.grib;
+    (*it)->routemapoverlay->GetGribMemory(gribs);
+  }
+  for (std::map<WR_GribRecordSet*, size_t>::iterator it = gribs.begin();
+       it != gribs.end(); it++)
+    used += it->second;
+
+  double load = 0;
+  size_t budget = MemoryGovernor::GetBudgetBytes();
+  if (budget) load = (double)used / budget;
+#ifdef __WXMSW__
+  AddressSpaceMonitor& monitor = m_weather_routing_pi.GetAddressSpaceMonitor();
+  if (monitor.IsValid() && monitor.thresholdPercent > 0)
+    load = wxMax(load, monitor.GetUsagePercent() / monitor.thresholdPercent);
+#endif
+
+  MemoryGovernor::State previous = m_MemoryGovernor.GetState();
+  MemoryGovernor::State state = m_MemoryGovernor.Update(load);
+  if (state != previous) {
+    static const char* names[] = {"normal", "throttled", "shedding"};
+    wxLogMessage(
+        "WeatherRouting memory governor: %s, route maps hold %.1f MB (%.0f%% "
+        "of budget)",
+        names[state], used / (1024.0 * 1024.0), 100 * load);
+  }
+
+  if (state == MemoryGovernor::SHEDDING) {
+    bool shed = false;
+    for (std::list<WeatherRoute*>::iterator it = m_WeatherRoutes.begin();
+         it != m_WeatherRoutes.end(); it++) {
+      RouteMapOverlay* routemapoverlay = (*it)->routemapoverlay;
+      if (routemapoverlay->GetMinimumRetention() >=
+              RouteMapConfiguration::RETAIN_OUTLINES ||
+          std::find(m_WaitingRouteMaps.begin(), m_WaitingRouteMaps.end(),
+                    routemapoverlay) != m_WaitingRouteMaps.end())
+        continue;
+      routemapoverlay->SetMinimumRetention(
+          RouteMapConfiguration::RETAIN_OUTLINES);
+      shed = true;
+
+      // running routes are released when they finish
+      if (std::find(m_RunningRouteMaps.begin(), m_RunningRouteMaps.end(),
+                    routemapoverlay) == m_RunningRouteMaps.end())
+        routemapoverlay->ApplyRetention();
+    }
+    /* the timers keep calling while shedding, only redraw on changes */
+    if (shed) GetParent()->Refresh();
+  } else if (state == MemoryGovernor::NORMAL && previous != state) {
+    // routes still running keep everything again
+    for (std::list<RouteMapOverlay*>::iterator it = m_RunningRouteMaps.begin();
+         it != m_RunningRouteMaps.end(); it++)
+      (*it)->SetMinimumRetention(RouteMapConfiguration::RETAIN_FULL);
+  }
+}
+
 void WeatherRouting::OnHideConfigurationTimer(wxTimerEvent&) {
   m_ConfigurationDialog.Hide();
 }
 
 void WeatherRouting::OnAutoSaveXMLTimer(wxTimerEvent&) { AutoSaveXML(); }
 
-void WeatherRouting::AutoSaveXML() { SaveXML(m_FileName.GetFullPath()); }
+void WeatherRouting::AutoSaveXML() {
+  SaveXML(m_FileName.GetFullPath(), true);
+}
 
 void WeatherRouting::OnRenderedTimer(wxTimerEvent&) {
   // don't do it until the window system is up and running
@@ -2183,6 +2347,52 @@ void WeatherRouting::OnRenderedTimer(wxTimerEvent&) {
   }
 }
 
+/* boat shared by the configurations of a file, parsed once */
+struct SharedBoat {
+  Boat boat;
+  wxString error;
+  bool generate_contours;
+};
+
+/* state of parsing the boats of the configurations of a file, worker
+   threads only touch their own boat and never call into OpenCPN */
+struct BoatLoad {
+  /* by file name, all entries are created before loading starts */
+  std::vector<std::pair<const wxString, SharedBoat>*> boats;
+  wxString polars;
+  std::atomic<size_t> next, done;
+  std::atomic<bool> abort;
+};
+
+static void LoadBoats(BoatLoad& load) {
+  while (!load.abort) {
+    size_t i = load.next++;
+    if (i >= load.boats.size()) return;
+
+    std::pair<const wxString, SharedBoat>& entry = *load.boats[i];
+    SharedBoat& shared = entry.second;
+    shared.error = shared.boat.ParseXML(entry.first, load.polars,
+                                        shared.generate_contours);
+    load.done++;
+  }
+}
+
+class BoatLoaderThread : public wxThread {
+public:
+  BoatLoaderThread(BoatLoad& load)
+      : wxThread(wxTHREAD_JOINABLE), m_Load(load) {
+    Create();
+  }
+
+  void* Entry() {
+    LoadBoats(m_Load);
+    return 0;
+  }
+
+private:
+  BoatLoad& m_Load;
+};
+
 bool WeatherRouting::OpenXML(wxString filename, bool reportfailure) {
   TiXmlDocument doc;
   wxString error;
@@ -2193,9 +2403,22 @@ bool WeatherRouting::OpenXML(wxString filename, bool reportfailure) {
 
   wxProgressDialog* progressdialog = NULL;
   wxDateTime start = wxDateTime::UNow();
+  int total = 0;
+  auto progress = [&](int i) {
+    if (progressdialog) return progressdialog->Update(i);
+    wxDateTime now = wxDateTime::UNow();
+    /* if it's going to take more than a half second, show a progress dialog
+     */
+    if ((now - start).GetMilliseconds() > 250 && i < total / 2) {
+      progressdialog = new wxProgressDialog(
+          _("Load"), _("Weather Routing"), total, this,
+          wxPD_CAN_ABORT | wxPD_ELAPSED_TIME | wxPD_REMAINING_TIME);
+    }
+    return true;
+  };
 
-  wxString lastboatFileName;
-  Boat lastboat;
+  std::vector<RouteMapConfiguration> configurations;
+  std::map<wxString, SharedBoat> boats;
 
   if (!doc.LoadFile(filename.mb_str()))
     FAIL(_("Failed to load file."));
@@ -2207,28 +2430,22 @@ bool WeatherRouting::OpenXML(wxString filename, bool reportfailure) {
 
     RouteMap::Positions.clear();
 
-    int count = 0;
+    int count = 0, configurationcount = 0;
     for (TiXmlElement* e = root.FirstChild().Element(); e;
-         e = e->NextSiblingElement())
+         e = e->NextSiblingElement()) {
       count++;
+      if (!strcmp(e->Value(), "Configuration")) configurationcount++;
+    }
+    /* parse the file, then load the boats and add each configuration */
+    total = count + 2 * configurationcount;
+    configurations.reserve(configurationcount);
 
     int i = 0;
     for (TiXmlElement* e = root.FirstChild().Element(); e;
          e = e->NextSiblingElement(), i++) {
-      if (progressdialog) {
-        if (!progressdialog->Update(i)) {
-          delete progressdialog;
-          return true;
-        }
-      } else {
-        wxDateTime now = wxDateTime::UNow();
-        /* if it's going to take more than a half second, show a progress dialog
-         */
-        if ((now - start).GetMilliseconds() > 250 && i < count / 2) {
-          progressdialog = new wxProgressDialog(
-              _("Load"), _("Weather Routing"), count, this,
-              wxPD_CAN_ABORT | wxPD_ELAPSED_TIME | wxPD_REMAINING_TIME);
-        }
+      if (!progress(i)) {
+        delete progressdialog;
+        return true;
       }
 
       if (!strcmp(e->Value(), "Position")) {
@@ -2259,7 +2476,8 @@ bool WeatherRouting::OpenXML(wxString filename, bool reportfailure) {
       } else if (!strcmp(e->Value(), "Configuration")) {
         // Ideally the name of the XML element should be "Routings" but it is
         // kept as "Configuration" for backward compatibility.
-        RouteMapConfiguration configuration;
+        configurations.push_back(RouteMapConfiguration());
+        RouteMapConfiguration& configuration = configurations.back();
         configuration.RouteGUID = wxString::FromUTF8(e->Attribute("GUID"));
         configuration.StartType =
             (RouteMapConfiguration::StartDataType)AttributeInt(
@@ -2370,18 +2588,81 @@ bool WeatherRouting::OpenXML(wxString filename, bool reportfailure) {
             AttributeDouble(e, "MotorSpeedThreshold", 2.0);
         configuration.MotorSpeed = AttributeDouble(e, "MotorSpeed", 5.0);
 
-        if (configuration.boatFileName == lastboatFileName)
-          configuration.boat = lastboat;
-
-        AddConfiguration(configuration);
+        configuration.DecimationFactor =
+            AttributeDouble(e, "DecimationFactor", 0);
+        configuration.MaxRoutePositions =
+            AttributeInt(e, "MaxRoutePositions", 0);
+        configuration.Retention =
+            (RouteMapConfiguration::RetentionType)AttributeInt(e, "Retention",
+                                                               0);
 
-        lastboatFileName = configuration.boatFileName;
-        m_WeatherRoutes.back()->routemapoverlay->LoadBoat();
-        lastboat =
-            m_WeatherRoutes.back()->routemapoverlay->GetConfiguration().boat;
+        boats[configuration.boatFileName];
       } else
         FAIL(_("Unrecognized xml node"));
     }
+
+    /* parse each boat once, on all processors, as loading polars is slow;
+       the data directory is resolved and created here */
+    BoatLoad load;
+    for (std::map<wxString, SharedBoat>::iterator it = boats.begin();
+         it != boats.end(); it++)
+      load.boats.push_back(&*it);
+    load.polars = weather_routing_pi::StandardPath() + "polars" +
+                  wxFileName::GetPathSeparator();
+    load.next = load.done = 0;
+    load.abort = false;
+
+    std::vector<BoatLoaderThread*> threads;
+    for (int t = 0;
+         t < wxThread::GetCPUCount() && t < (int)load.boats.size(); t++) {
+      BoatLoaderThread* thread = new BoatLoaderThread(load);
+      if (thread->Run() == wxTHREAD_NO_ERROR)
+        threads.push_back(thread);
+      else
+        delete thread;
+    }
+    if (threads.empty()) LoadBoats(load);
+
+    while (load.done < load.boats.size()) {
+      wxThread::Sleep(10);
+      if (!progress(count + load.done * configurations.size() /
+                                load.boats.size())) {
+        load.abort = true;
+        break;
+      }
+    }
+    for (size_t t = 0; t < threads.size(); t++) {
+      threads[t]->Wait();
+      delete threads[t];
+    }
+    if (load.abort) {
+      delete progressdialog;
+      return true;
+    }
+
+    /* boats without saved cross over contours are completed and saved
+       from the main thread, as OpenXML does */
+    for (std::map<wxString, SharedBoat>::iterator it = boats.begin();
+         it != boats.end(); it++) {
+      SharedBoat& shared = it->second;
+      if (!shared.error.IsEmpty())
+        wxLogMessage("WeatherRouting: failed to load boat %s: %s", it->first,
+                     shared.error);
+      else if (shared.generate_contours) {
+        wxString error = shared.boat.GenerateContours(it->first);
+        if (!error.IsEmpty())
+          wxLogMessage("WeatherRouting: %s", error);
+      }
+    }
+
+    /* positions and routes are looked up through OpenCPN, which is only
+       possible from the main thread */
+    for (size_t c = 0; c < configurations.size(); c++) {
+      if (!progress(count + configurations.size() + c)) break;
+      configurations[c].boat = boats[configurations[c].boatFileName].boat;
+      AddConfiguration(configurations[c]);
+      configurations[c].boat = Boat(); /* copied by the route map */
+    }
   }
 
   delete progressdialog;
@@ -2397,42 +2678,59 @@ failed:
   return false;
 }
 
-void WeatherRouting::SaveXML(wxString filename) {
+void WeatherRouting::SaveXML(wxString filename, bool background) {
   wxFileName fn(filename);
   SetTitle(_("Weather Routing") + wxString(" - ") + fn.GetFullName());
   m_FileName = fn;
 
-  TiXmlDocument doc;
-  TiXmlDeclaration* decl = new TiXmlDeclaration("1.0", "utf-8", "");
-  doc.LinkEndChild(decl);
+  m_ConfigurationWriter.Save(XMLDocument(filename));
+  if (background) return;
 
-  TiXmlElement* root = new TiXmlElement("OpenCPNWeatherRoutingConfiguration");
-  doc.LinkEndChild(root);
+  if (!m_ConfigurationWriter.Flush()) {
+    wxMessageDialog mdlg(this, _("Failed to save xml file: ") + filename,
+                         _("Weather Routing"), wxOK | wxICON_ERROR);
+    mdlg.ShowModal();
+  }
+}
+
+ConfigurationWriter::Document WeatherRouting::XMLDocument(
+    const wxString& filename) {
+  ConfigurationWriter::Document document;
+  document.filename = filename;
 
   char version[24];
   sprintf(version, "%d.%d", PLUGIN_VERSION_MAJOR, PLUGIN_VERSION_MINOR);
-  root->SetAttribute("version", version);
-  root->SetAttribute("creator", "Opencpn Weather Routing plugin");
+  document.version = version;
 
   for (std::list<RouteMapPosition>::iterator it = RouteMap::Positions.begin();
        it != RouteMap::Positions.end(); it++) {
-    TiXmlElement* c = new TiXmlElement("Position");
+    TiXmlElement c("Position");
 
-    c->SetAttribute("Name", (*it).Name.mb_str());
-    c->SetAttribute("Latitude", wxString::Format("%.6f", (*it).lat).mb_str());
-    c->SetAttribute("Longitude", wxString::Format("%.6f", (*it).lon).mb_str());
-    if (!(*it).GUID.IsEmpty()) c->SetAttribute("GUID", (*it).GUID.mb_str());
+    c.SetAttribute("Name", (*it).Name.mb_str());
+    c.SetAttribute("Latitude", wxString::Format("%.6f", (*it).lat).mb_str());
+    c.SetAttribute("Longitude", wxString::Format("%.6f", (*it).lon).mb_str());
+    if (!(*it).GUID.IsEmpty()) c.SetAttribute("GUID", (*it).GUID.mb_str());
 
-    root->LinkEndChild(c);
+    document.elements.push_back(ConfigurationWriter::Format(c));
   }
 
   for (auto it = m_WeatherRoutes.begin(); it != m_WeatherRoutes.end(); it++) {
-    // Ideally the name of the XML element should be "Routings" but it is kept
-    // as "Configuration" for backward compatibility.
-    TiXmlElement* c = new TiXmlElement("Configuration");
+    WeatherRoute* weatherroute = *it;
+    unsigned int version =
+        weatherroute->routemapoverlay->GetConfigurationVersion();
+    if (weatherroute->SavedConfiguration &&
+        weatherroute->SavedConfigurationVersion == version) {
+      document.elements.push_back(weatherroute->SavedConfiguration);
+      continue;
+    }
 
     RouteMapConfiguration configuration =
-        (*it)->routemapoverlay->GetConfiguration();
+        weatherroute->routemapoverlay->GetConfiguration();
+
+    // Ideally the name of the XML element should be "Routings" but it is kept
+    // as "Configuration" for backward compatibility.
+    TiXmlElement element("Configuration");
+    TiXmlElement* c = &element;
 
     if (!configuration.RouteGUID.IsEmpty())
       c->SetAttribute("GUID", configuration.RouteGUID.mb_str());
@@ -2501,14 +2799,16 @@ void WeatherRouting::SaveXML(wxString filename) {
                           configuration.MotorSpeedThreshold);
     c->SetDoubleAttribute("MotorSpeed", configuration.MotorSpeed);
 
-    root->LinkEndChild(c);
-  }
+    c->SetDoubleAttribute("DecimationFactor", configuration.DecimationFactor);
+    c->SetAttribute("MaxRoutePositions", configuration.MaxRoutePositions);
+    c->SetAttribute("Retention", configuration.Retention);
 
-  if (!doc.SaveFile(filename.mb_str())) {
-    wxMessageDialog mdlg(this, _("Failed to save xml file: ") + filename,
-                         _("Weather Routing"), wxOK | wxICON_ERROR);
-    mdlg.ShowModal();
+    weatherroute->SavedConfiguration = ConfigurationWriter::Format(element);
+    weatherroute->SavedConfigurationVersion = version;
+    document.elements.push_back(weatherroute->SavedConfiguration);
   }
+
+  return document;
 }
 
 void WeatherRouting::SetEnableConfigurationMenu() {
@@ -2984,6 +3284,16 @@ void WeatherRouting::SetConfigurationRoute(WeatherRoute* weatherroute) {
        it != m_RunningRouteMaps.end(); it++)
     if (*it == rmo && rmo->Running()) rmo->DeleteThread();
 
+  // the configuration may have been reverted to one computed before
+  wxUint64 key;
+  if (!rmo->Finished() &&
+      std::find(m_RunningRouteMaps.begin(), m_RunningRouteMaps.end(), rmo) ==
+          m_RunningRouteMaps.end() &&
+      std::find(m_WaitingRouteMaps.begin(), m_WaitingRouteMaps.end(), rmo) ==
+          m_WaitingRouteMaps.end() &&
+      ResultKey(rmo, key))
+    LoadResult(rmo, key);
+
   weatherroute->Update(this);
 
   for (long index = 0; index < m_panel->m_lWeatherRoutes->GetItemCount();
@@ -2998,6 +3308,9 @@ void WeatherRouting::SetConfigurationRoute(WeatherRoute* weatherroute) {
 }
 
 void WeatherRouting::UpdateBoatFilename(wxString boatFileName) {
+  /* the polars may have been edited */
+  AtlasSpeedTable::Clear();
+
   for (long index = 0; index < m_panel->m_lWeatherRoutes->GetItemCount();
        index++) {
     WeatherRoute* weatherroute = reinterpret_cast<WeatherRoute*>(
@@ -3315,7 +3628,7 @@ void WeatherRouting::ExportRoute(RouteMapOverlay& routemapoverlay) {
   GetParent()->Refresh();
 }
 
-void WeatherRouting::Start(RouteMapOverlay* routemapoverlay) {
+void WeatherRouting::Start(RouteMapOverlay* routemapoverlay, bool reuse) {
   if (!routemapoverlay) return;
 
   RouteMapConfiguration configuration = routemapoverlay->GetConfiguration();
@@ -3375,6 +3688,8 @@ void WeatherRouting::Start(RouteMapOverlay* routemapoverlay) {
     return;
   }
   if (configuration.DetectBoundary) {
+    // boundaries may have been edited since the last computation
+    BoundaryCache::Clear();
     if (m_weather_routing_pi.InBoundary(configuration.EndLat,
                                         configuration.EndLon) ||
         m_weather_routing_pi.InBoundary(configuration.StartLat,
@@ -3390,9 +3705,24 @@ void WeatherRouting::Start(RouteMapOverlay* routemapoverlay) {
     return;
   }
 
-  /* initialize crossing land routine from main thread as it is
-     not re-entrant, and cannot be done by worker-threads later */
-  if (configuration.DetectLand) PlugIn_GSHHS_CrossesLand(0, 0, 0, 0);
+  /* read the coastline ourselves if we can, otherwise initialize crossing
+     land routine from main thread as it is not re-entrant, and cannot be
+     done by worker-threads later */
+  if (configuration.DetectLand) {
+    wxArrayString gshhs_dirs = CoastlineDirectories();
+    /* coastline data may have been installed or updated since the index
+       was opened; it can only be replaced while no route is computing */
+    if (CoastlineIndex::IsOpen() && m_RunningRouteMaps.empty() &&
+        !CoastlineIndex::IsCurrent(gshhs_dirs)) {
+      CoastlineIndex::Close();
+      clear_land_cache();
+    }
+    bool was_open = CoastlineIndex::IsOpen();
+    if (!CoastlineIndex::Open(gshhs_dirs))
+      PlugIn_GSHHS_CrossesLand(0, 0, 0, 0);
+    else if (!was_open)
+      clear_land_cache();  // answers cached from another coastline source
+  }
 
   /* same with grib */
   if (!configuration.RouteGUID.IsEmpty() && configuration.UseGrib)
@@ -3417,19 +3747,128 @@ void WeatherRouting::Start(RouteMapOverlay* routemapoverlay) {
        it != m_WaitingRouteMaps.end(); it++) {
     if (*it == routemapoverlay) return;
   }
+
+  // the same configuration, boat and forecast were computed before
+  wxUint64 key;
+  bool cached = ResultKey(routemapoverlay, key);
+  if (cached && reuse && LoadResult(routemapoverlay, key)) {
+    wxLogMessage("WeatherRouting: reused the route %s to %s computed before",
+                 configuration.Start, configuration.End);
+    UpdateRouteMap(routemapoverlay);
+    return;
+  }
+  if (cached && !reuse) RouteMapSnapshot::Remove(key);
+
   routemapoverlay->Reset();
+  routemapoverlay->SetResultKey(cached ? key : 0);
   m_RoutesToRun++;
   m_WaitingRouteMaps.push_back(routemapoverlay);
   SetEnableConfigurationMenu();
   UpdateRouteMap(routemapoverlay);
 }
 
+bool WeatherRouting::ResultKey(RouteMapOverlay* routemapoverlay,
+                               wxUint64& key) {
+  if (!routemapoverlay->LoadBoat().IsEmpty()) return false;
+  RouteMapConfiguration configuration = routemapoverlay->GetConfiguration();
+  if (!configuration.RouteGUID.IsEmpty() || configuration.DetectBoundary)
+    return false;
+
+  RouteMapSnapshot::GribProvenance forecast = {-1, 0};
+  if (configuration.UseGrib &&
+      !GribIdentity(configuration.StartTime, forecast))
+    return false;
+
+  RouteMapSnapshot::Environment environment;
+  if (configuration.DetectLand)
+    environment.coastline = CoastlineIndex::Source(CoastlineDirectories());
+  if (configuration.ClimatologyType != RouteMapConfiguration::DISABLED ||
+      configuration.AvoidCycloneTracks) {
+    std::vector<double>& climatology = environment.climatology;
+    climatology.push_back(ClimatologyCache::GetResolution());
+    climatology.push_back(RouteMap::ClimatologyData != nullptr);
+    climatology.push_back(RouteMap::ClimatologyWindAtlasData != nullptr);
+    climatology.push_back(RouteMap::ClimatologyCycloneTrackCrossings !=
+                          nullptr);
+    /* wind then current, as WeatherDataProvider asks for them */
+    double lat[2] = {configuration.StartLat, configuration.EndLat};
+    double lon[2] = {configuration.StartLon, configuration.EndLon};
+    for (int i = 0; RouteMap::ClimatologyData && i < 2; i++)
+      for (int setting = 0; setting < 2; setting++) {
+        double dir = 0, speed = 0;
+        climatology.push_back(ClimatologyCache::Data(
+            setting, configuration.StartTime, lat[i], lon[i], dir, speed));
+        climatology.push_back(dir);
+        climatology.push_back(speed);
+      }
+  }
+
+  key = RouteMapSnapshot::ResultKey(configuration, forecast, environment);
+  return true;
+}
+
+bool WeatherRouting::LoadResult(RouteMapOverlay* routemapoverlay,
+                                wxUint64 key) {
+  RouteMapSnapshot::Contents contents;
+  if (!key ||
+      !RouteMapSnapshot::Read(RouteMapSnapshot::Path(key), key, contents))
+    return false;
+
+  /* the key only covers the GRIB record set at the start time, later
+     isochrones may have been computed from a GRIB file replaced since */
+  time_t checked = -1;
+  IsoChronList::iterator it = contents.origin.begin();
+  for (size_t i = 0; i < contents.gribs.size(); i++, it++) {
+    const RouteMapSnapshot::GribProvenance& grib = contents.gribs[i];
+    if (grib.reference_time == -1 || grib.reference_time == checked ||
+        (*it)->m_Grib_is_data_deficient)
+      continue;
+
+    RouteMapSnapshot::GribProvenance forecast;
+    if (!GribIdentity((*it)->time, forecast) ||
+        forecast.reference_time != grib.reference_time ||
+        forecast.fingerprint != grib.fingerprint) {
+      wxLogMessage("WeatherRouting: GRIB data changed since %s, recomputing",
+                   (*it)->time.FormatISOCombined(' '));
+      RouteMapSnapshot::Discard(contents);
+      return false;
+    }
+    checked = grib.reference_time;
+  }
+
+  routemapoverlay->RestoreSnapshot(key, contents);
+  return true;
+}
+
+bool WeatherRouting::GribIdentity(const wxDateTime& time,
+                                  RouteMapSnapshot::GribProvenance& forecast) {
+  time_t ticks = time.GetTicks();
+  std::map<time_t, RouteMapSnapshot::GribProvenance>::iterator it;
+  if (m_GribIdentityCache &&
+      (it = m_GribIdentityCache->find(ticks)) != m_GribIdentityCache->end())
+    forecast = it->second;
+  else {
+    // answered synchronously by the GRIB plugin
+    forecast.reference_time = 0;
+    forecast.fingerprint = 0;
+    m_GribIdentityRequest = &forecast;
+    RouteMapOverlay::RequestGribRecord(time);
+    m_GribIdentityRequest = NULL;
+    if (m_GribIdentityCache) (*m_GribIdentityCache)[ticks] = forecast;
+  }
+  return forecast.reference_time != 0;
+}
+
 void WeatherRouting::StartAll() {
+  /* routes sharing start or isochrone times ask the GRIB plugin once */
+  std::map<time_t, RouteMapSnapshot::GribProvenance> forecasts;
+  m_GribIdentityCache = &forecasts;
   for (int i = 0; i < m_panel->m_lWeatherRoutes->GetItemCount(); i++) {
     WeatherRoute* weatherroute = reinterpret_cast<WeatherRoute*>(
         wxUIntToPtr(m_panel->m_lWeatherRoutes->GetItemData(i)));
     Start(weatherroute->routemapoverlay);
   }
+  m_GribIdentityCache = NULL;
 }
 
 void WeatherRouting::Stop(RouteMapOverlay* routemapoverlay) {
@@ -3464,11 +3903,16 @@ void WeatherRouting::StopAll() {
   m_RunningRouteMaps.clear();
   m_WaitingRouteMaps.clear();
 
+  /* interpolated grib slabs are only useful while routes are computing */
+  GribTimeInterpolator::Clear();
+  AtlasSpeedTable::Clear();
+
   UpdateStates();
 
   m_RoutesToRun = 0;
   m_panel->m_gProgress->SetValue(0);
   m_bRunning = false;
+  m_tCompute.Stop();
 
   SetEnableConfigurationMenu();
   if (m_StartTime.IsValid())
@@ -3483,6 +3927,9 @@ void WeatherRouting::Reset() {
         wxUIntToPtr(m_panel->m_lWeatherRoutes->GetItemData(i)));
     weatherroute->routemapoverlay->Reset();
   }
+  /* nothing is computing anymore, start over with empty land caches, the
+     coastline or the charts may have changed since they were filled */
+  clear_land_cache();
   m_positionOnRoute = nullptr;
   UpdateDialogs();
 
@@ -3600,6 +4047,10 @@ RouteMapConfiguration WeatherRouting::DefaultConfiguration() {
   configuration.UseOptimalAngles = false;
   configuration.ByDegrees = 5;
 
+  configuration.DecimationFactor = 0;
+  configuration.MaxRoutePositions = 0;
+  configuration.Retention = RouteMapConfiguration::RETAIN_FULL;
+
   return configuration;
 }
 
@@ -30,9 +30,15 @@
 
 #include <sstream>
 
+#include "BoundaryCache.h"
+#include "ClimatologyCache.h"
+#include "CoastlineIndex.h"
+#include "ConstraintChecker.h"
+#include "GribTileStore.h"
 #include "RoutePoint.h"
 #include "RouteMap.h"
 #include "RouteMapOverlay.h"
+#include "RouteMapSnapshot.h"
 #include "WeatherRouting.h"
 #include "weather_routing_pi.h"
 
@@ -274,7 +280,9 @@ int weather_routing_pi::Init() {
  * 3. Process events to clear queued timer events
  * 4. Close WeatherRouting dialog (which includes SettingsDialog)
  * 5. Delete WeatherRouting object
- * 6. Final event processing to handle destruction events
+ * 6. Close the coastline index and drop the land caches
+ * 7. Wait for the route map snapshots still being written
+ * 8. Final event processing to handle destruction events
  *
  * @note Monitor MUST be shutdown before closing WeatherRouting to allow
  * SettingsDialog's timer to stop cleanly.
@@ -319,6 +327,14 @@ bool weather_routing_pi::DeInit() {
       NULL; /* needed first as destructor may call event loop */
   delete wr;
 
+  // the computations are stopped, nothing queries the coastline any more
+  CoastlineIndex::Close();
+  clear_land_cache();
+
+  // the writer threads must not outlive the plugin
+  RouteMapSnapshot::Flush();
+  GribTileStore::Flush();
+
   // Additional event processing after deletion
   if (wxTheApp) {
     wxTheApp->ProcessPendingEvents();
@@ -461,10 +477,18 @@ void weather_routing_pi::SetPluginMessage(wxString& message_id,
     if (m_pWeather_Routing) {
       RouteMapOverlay* routemapoverlay =
           m_pWeather_Routing->m_RouteMapOverlayNeedingGrib;
+      RouteMapSnapshot::GribProvenance* identity =
+          m_pWeather_Routing->m_GribIdentityRequest;
       if (routemapoverlay) {
         routemapoverlay->Lock();
         routemapoverlay->SetNewGrib(gptr);
         routemapoverlay->Unlock();
+      } else if (identity && gptr &&
+                 gptr->m_GribRecordPtrArray[Idx_WIND_VX] &&
+                 gptr->m_GribRecordPtrArray[Idx_WIND_VY]) {
+        identity->reference_time = gptr->m_Reference_Time;
+        identity->fingerprint = RouteMapSnapshot::GribFingerprint(
+            gptr->m_Reference_Time, gptr->m_GribRecordPtrArray);
       }
     }
   } else if (message_id == "CLIMATOLOGY") {
@@ -501,6 +525,9 @@ void weather_routing_pi::SetPluginMessage(wxString& message_id,
     sscanf(sptr.To8BitData().data(), "%p",
            &RouteMap::ClimatologyCycloneTrackCrossings);
 
+    // results memoized from a previous climatology instance are stale
+    ClimatologyCache::Clear();
+
     if (m_pWeather_Routing) {
       if (RouteMap::ClimatologyData == nullptr) {
         m_pWeather_Routing->m_ConfigurationDialog.m_cClimatologyType->Enable(
@@ -514,7 +541,7 @@ void weather_routing_pi::SetPluginMessage(wxString& message_id,
     }
   } else if (message_id == wxS("OCPN_DRAW_PI_READY_FOR_REQUESTS")) {
     if (message_body == "FALSE") {
-      RouteMap::ODFindClosestBoundaryLineCrossing = nullptr;
+      BoundaryCache::SetCrossingFunction(nullptr);
     } else if (message_body == "TRUE" && m_pWeather_Routing) {
       RequestOcpnDrawSetting();
     }
@@ -535,8 +562,9 @@ void weather_routing_pi::SetPluginMessage(wxString& message_id,
           g_ReceivedODVersionJSONMsg = root;
       } else if (root["Msg"].asString() == "GetAPIAddresses") {
         wxString sptr = root["OD_FindClosestBoundaryLineCrossing"].asString();
-        sscanf(sptr.To8BitData().data(), "%p",
-               &RouteMap::ODFindClosestBoundaryLineCrossing);
+        OD_FindClosestBoundaryLineCrossing function = nullptr;
+        sscanf(sptr.To8BitData().data(), "%p", &function);
+        BoundaryCache::SetCrossingFunction(function);
       } else if (root["Msg"].asString() == "FindPointInAnyBoundary") {
         if (root["MsgId"].asString() == "exist") {
           b_in_boundary_reply = root["Found"].asBool() == true;
@@ -0,0 +1,145 @@
+/***************************************************************************
+ *   Copyright (C) 2024 by OpenCPN development team                        *
+ *                                                                         *
+ *   This program is free software; you can redistribute it and/or modify  *
+ *   it under the terms of the GNU General Public License as published by  *
+ *   the Free Software Foundation; either version 2 of the License, or     *
+ *   (at your option) any later version.                                   *
+ *                                                                         *
+ *   This program is distributed in the hope that it will be useful,       *
+ *   but WITHOUT ANY WARRANTY; without even the implied warranty of        *
+ *   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the         *
+ *   GNU General Public License for more details.                          *
+ *                                                                         *
+ *   You should have received a copy of the GNU General Public License     *
+ *   along with this program; if not, write to the                         *
+ *   Free Software Foundation, Inc.,                                       *
+ *   59 Temple Place - Suite 330, Boston, MA  02111-1307, USA.             *
+ **************************************************************************/
+
+#include <gtest/gtest.h>
+#include <algorithm>
+#include <cmath>
+#include "AtlasSpeedTable.h"
+#include "RouteMap.h"
+#include "RoutePoint.h"
+
+class AtlasSpeedTableTest : public ::testing::Test {
+protected:
+  void SetUp() override {
+    Polar polar;
+    wxString message;
+    bool success = polar.Open(m_testPolarFileName, message);
+    EXPECT_EQ(success, true) << "Failed to open polar file: "
+                             << m_testPolarFileName;
+    m_configuration.boat.Polars.push_back(polar);
+    m_configuration.OptimizeTacking = false;
+    m_configuration.DegreeSteps.clear();
+    for (double twa = -180; twa < 180; twa += 5)
+      m_configuration.DegreeSteps.push_back(twa);
+
+    for (int i = 0; i < 8; i++) {
+      m_weather_data.atlas.W[i] = i * 45 + 3;
+      m_weather_data.atlas.VW[i] = 8 + i;
+      m_weather_data.atlas.directions[i] = (i + 1) / 36.0;
+    }
+    m_weather_data.twdOverWater = 93;
+    AtlasSpeedTable::Clear();
+  }
+
+  void TearDown() override { AtlasSpeedTable::Clear(); }
+
+  double Direct(double twa, PolarSpeedStatus* status) {
+    return AtlasSpeedTable::CumulativeSpeed(
+        m_configuration.boat.Polars[0], m_weather_data.atlas,
+        m_weather_data.twdOverWater, twa, false,
+        m_configuration.OptimizeTacking, status);
+  }
+
+  wxString m_testPolarFileName =
+      wxString(TESTDATADIR) + "/polars/Hallberg-Rassy_40_test.pol";
+  RouteMapConfiguration m_configuration;
+  RoutePoint m_point{10.0, 20.0};
+  WeatherData m_weather_data{&m_point};
+};
+
+TEST_F(AtlasSpeedTableTest, MatchesDirectComputation) {
+  for (double twa : m_configuration.DegreeSteps) {
+    PolarSpeedStatus table_status, direct_status;
+    double table = AtlasSpeedTable::Speed(m_configuration, 0, m_weather_data,
+                                          twa, false, &table_status);
+    double direct = Direct(twa, &direct_status);
+    if (std::isnan(direct))
+      EXPECT_TRUE(std::isnan(table)) << "twa=" << twa;
+    else
+      EXPECT_DOUBLE_EQ(table, direct) << "twa=" << twa;
+    EXPECT_EQ(table_status, direct_status) << "twa=" << twa;
+  }
+  EXPECT_EQ(AtlasSpeedTable::Size(), 1u);
+}
+
+TEST_F(AtlasSpeedTableTest, HeadingOutsideDegreeSteps) {
+  PolarSpeedStatus status;
+  double twa = 72.5;
+  double speed = AtlasSpeedTable::Speed(m_configuration, 0, m_weather_data,
+                                        twa, false, &status);
+  EXPECT_DOUBLE_EQ(speed, Direct(twa, nullptr));
+}
+
+TEST_F(AtlasSpeedTableTest, SharedBetweenPositionsWithSameAtlas) {
+  RoutePoint other_point(10.1, 20.1);
+  WeatherData other(&other_point);
+  other.atlas = m_weather_data.atlas;
+  other.twdOverWater = m_weather_data.twdOverWater;
+
+  AtlasSpeedTable::Speed(m_configuration, 0, m_weather_data, 90, false,
+                         nullptr);
+  AtlasSpeedTable::Speed(m_configuration, 0, other, 90, false, nullptr);
+  EXPECT_EQ(AtlasSpeedTable::Size(), 1u);
+  EXPECT_EQ(m_weather_data.atlas_speeds, other.atlas_speeds);
+
+  // a different wind direction over water needs its own table
+  RoutePoint third_point(10.2, 20.2);
+  WeatherData third(&third_point);
+  third.atlas = m_weather_data.atlas;
+  third.twdOverWater = 100;
+  AtlasSpeedTable::Speed(m_configuration, 0, third, 90, false, nullptr);
+  EXPECT_EQ(AtlasSpeedTable::Size(), 2u);
+
+  AtlasSpeedTable::Clear();
+  EXPECT_EQ(AtlasSpeedTable::Size(), 0u);
+}
+
+TEST_F(AtlasSpeedTableTest, KeyedOnTheSetOfDegreeSteps) {
+  AtlasSpeedTable::Speed(m_configuration, 0, m_weather_data, 90, false,
+                         nullptr);
+  AtlasSpeedTable::TablePtr sorted = m_weather_data.atlas_speeds;
+
+  // the same steps in another order share the table
+  RoutePoint other_point(10.1, 20.1);
+  WeatherData other(&other_point);
+  other.atlas = m_weather_data.atlas;
+  other.twdOverWater = m_weather_data.twdOverWater;
+  std::reverse(m_configuration.DegreeSteps.begin(),
+               m_configuration.DegreeSteps.end());
+  AtlasSpeedTable::Speed(m_configuration, 0, other, 90, false, nullptr);
+  EXPECT_EQ(other.atlas_speeds, sorted);
+  EXPECT_EQ(AtlasSpeedTable::Size(), 1u);
+
+  // as many steps but not the same ones need another table
+  RoutePoint third_point(10.2, 20.2);
+  WeatherData third(&third_point);
+  third.atlas = m_weather_data.atlas;
+  third.twdOverWater = m_weather_data.twdOverWater;
+  for (double& step : m_configuration.DegreeSteps) step += 1;
+  PolarSpeedStatus status;
+  double speed =
+      AtlasSpeedTable::Speed(m_configuration, 0, third, 91, false, &status);
+  EXPECT_NE(third.atlas_speeds, sorted);
+  EXPECT_EQ(AtlasSpeedTable::Size(), 2u);
+  double direct = Direct(91, nullptr);
+  if (std::isnan(direct))
+    EXPECT_TRUE(std::isnan(speed));
+  else
+    EXPECT_DOUBLE_EQ(speed, direct);
+}
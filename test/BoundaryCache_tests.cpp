@@ -0,0 +1,154 @@
+/***************************************************************************
+ *   Copyright (C) 2024 by OpenCPN development team                        *
+ *                                                                         *
+ *   This program is free software; you can redistribute it and/or modify  *
+ *   it under the terms of the GNU General Public License as published by  *
+ *   the Free Software Foundation; either version 2 of the License, or     *
+ *   (at your option) any later version.                                   *
+ *                                                                         *
+ *   This program is distributed in the hope that it will be useful,       *
+ *   but WITHOUT ANY WARRANTY; without even the implied warranty of        *
+ *   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the         *
+ *   GNU General Public License for more details.                          *
+ *                                                                         *
+ *   You should have received a copy of the GNU General Public License     *
+ *   along with this program; if not, write to the                         *
+ *   Free Software Foundation, Inc.,                                       *
+ *   59 Temple Place - Suite 330, Boston, MA  02111-1307, USA.             *
+ **************************************************************************/
+
+#include <gtest/gtest.h>
+
+#include <atomic>
+#include <thread>
+#include <vector>
+
+#include "BoundaryCache.h"
+#include "RouteMap.h"
+
+namespace {
+
+std::atomic<int> crossing_calls;
+
+/* a boundary along the 10th parallel */
+bool FakeFindClosestBoundaryLineCrossing(FindClosestBoundaryLineCrossing_t* t) {
+  crossing_calls++;
+  return (t->dStartLat < 10) != (t->dEndLat < 10);
+}
+
+class BoundaryCacheTest : public ::testing::Test {
+protected:
+  void SetUp() override {
+    crossing_calls = 0;
+    RouteMap::ODFindClosestBoundaryLineCrossing =
+        FakeFindClosestBoundaryLineCrossing;
+    BoundaryCache::Clear();
+  }
+
+  void TearDown() override {
+    RouteMap::ODFindClosestBoundaryLineCrossing = nullptr;
+    BoundaryCache::Clear();
+  }
+};
+
+}  // namespace
+
+TEST_F(BoundaryCacheTest, SameSegmentQueriesPluginOnce) {
+  EXPECT_TRUE(BoundaryCache::EntersBoundary(9.5, 20, 10.5, 20));
+  EXPECT_TRUE(BoundaryCache::EntersBoundary(9.5, 20, 10.5, 20));
+  EXPECT_FALSE(BoundaryCache::EntersBoundary(8.5, 20, 9.5, 20));
+  EXPECT_FALSE(BoundaryCache::EntersBoundary(8.5, 20, 9.5, 20));
+  EXPECT_EQ(crossing_calls, 2);
+  EXPECT_EQ(BoundaryCache::Size(), 2u);
+
+  // snapped to about a meter, longitudes in either convention
+  BoundaryCache::EntersBoundary(9.5 + 1e-7, 20, 10.5, 20 - 1e-7);
+  BoundaryCache::EntersBoundary(8.5, 380, 9.5, 20);
+  EXPECT_EQ(crossing_calls, 2);
+  BoundaryCache::EntersBoundary(9.5 + 1e-4, 20, 10.5, 20);
+  EXPECT_EQ(crossing_calls, 3);
+}
+
+TEST_F(BoundaryCacheTest, ClearDropsResults) {
+  BoundaryCache::EntersBoundary(9.5, 20, 10.5, 20);
+  BoundaryCache::Clear();
+  EXPECT_EQ(BoundaryCache::Size(), 0u);
+  BoundaryCache::EntersBoundary(9.5, 20, 10.5, 20);
+  EXPECT_EQ(crossing_calls, 2);
+}
+
+TEST_F(BoundaryCacheTest, MissingPluginFunction) {
+  RouteMap::ODFindClosestBoundaryLineCrossing = nullptr;
+  EXPECT_FALSE(BoundaryCache::EntersBoundary(9.5, 20, 10.5, 20));
+  EXPECT_EQ(BoundaryCache::Size(), 0u);
+}
+
+TEST_F(BoundaryCacheTest, SetCrossingFunction) {
+  BoundaryCache::EntersBoundary(9.5, 20, 10.5, 20);
+  BoundaryCache::SetCrossingFunction(nullptr);
+  EXPECT_EQ(BoundaryCache::Size(), 0u);
+  EXPECT_FALSE(BoundaryCache::EntersBoundary(9.5, 20, 10.5, 20));
+
+  BoundaryCache::SetCrossingFunction(FakeFindClosestBoundaryLineCrossing);
+  EXPECT_TRUE(BoundaryCache::EntersBoundary(9.5, 20, 10.5, 20));
+  EXPECT_EQ(crossing_calls, 2);
+}
+
+TEST_F(BoundaryCacheTest, HitRate) {
+  size_t queries, hits;
+  BoundaryCache::EntersBoundary(9.5, 20, 10.5, 20);
+  BoundaryCache::EntersBoundary(9.5, 20, 10.5, 20);
+  BoundaryCache::GetStats(queries, hits);
+  EXPECT_EQ(queries, 2u);
+  EXPECT_EQ(hits, 1u);
+  BoundaryCache::Clear();
+  BoundaryCache::GetStats(queries, hits);
+  EXPECT_EQ(queries, 0u);
+  EXPECT_EQ(hits, 0u);
+}
+
+TEST_F(BoundaryCacheTest, BypassesAMemoThatNeverHits) {
+  // every segment once, like the isochrone propagation
+  const int segments = 20000;
+  for (int i = 0; i < segments; i++)
+    BoundaryCache::EntersBoundary(9 + i * 1e-4, 20, 9.1 + i * 1e-4, 20.1);
+  EXPECT_EQ(crossing_calls, segments);
+  size_t queries, hits;
+  BoundaryCache::GetStats(queries, hits);
+  EXPECT_EQ(hits, 0u);
+  EXPECT_LT(queries, (size_t)segments);
+  EXPECT_LT(BoundaryCache::Size(), (size_t)segments);
+
+  // the answers stay right without the memo
+  EXPECT_TRUE(BoundaryCache::EntersBoundary(9.5, 20, 10.5, 20));
+  EXPECT_FALSE(BoundaryCache::EntersBoundary(8.5, 20, 9.5, 20));
+
+  // enabled again for the next computation
+  BoundaryCache::Clear();
+  BoundaryCache::EntersBoundary(9.5, 20, 10.5, 20);
+  BoundaryCache::EntersBoundary(9.5, 20, 10.5, 20);
+  EXPECT_EQ(crossing_calls, segments + 3);
+}
+
+TEST_F(BoundaryCacheTest, ConcurrentQueries) {
+  const int threads = 4, segments = 500;
+  std::vector<int> mismatches(threads, 0);
+  auto query = [&](int t) {
+    for (int i = 0; i < segments; i++) {
+      double lat = 9 + i * 0.004;
+      if (BoundaryCache::EntersBoundary(lat, 20, lat + 0.1, 20.1) !=
+          (lat < 10 && lat + 0.1 >= 10))
+        mismatches[t]++;
+    }
+  };
+
+  std::vector<std::thread> workers;
+  for (int t = 0; t < threads; t++) workers.emplace_back(query, t);
+  for (std::thread& worker : workers) worker.join();
+
+  for (int t = 0; t < threads; t++) EXPECT_EQ(mismatches[t], 0);
+  EXPECT_EQ(BoundaryCache::Size(), (size_t)segments);
+  // racing workers may each miss the same segment, but not much more
+  EXPECT_LE(crossing_calls, threads * segments);
+  EXPECT_GE(crossing_calls, segments);
+}
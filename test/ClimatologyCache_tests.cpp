@@ -0,0 +1,192 @@
+/***************************************************************************
+ *   Copyright (C) 2024 by OpenCPN development team                        *
+ *                                                                         *
+ *   This program is free software; you can redistribute it and/or modify  *
+ *   it under the terms of the GNU General Public License as published by  *
+ *   the Free Software Foundation; either version 2 of the License, or     *
+ *   (at your option) any later version.                                   *
+ *                                                                         *
+ *   This program is distributed in the hope that it will be useful,       *
+ *   but WITHOUT ANY WARRANTY; without even the implied warranty of        *
+ *   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the         *
+ *   GNU General Public License for more details.                          *
+ *                                                                         *
+ *   You should have received a copy of the GNU General Public License     *
+ *   along with this program; if not, write to the                         *
+ *   Free Software Foundation, Inc.,                                       *
+ *   59 Temple Place - Suite 330, Boston, MA  02111-1307, USA.             *
+ **************************************************************************/
+
+#include <gtest/gtest.h>
+#include "ClimatologyCache.h"
+#include "RouteMap.h"
+
+namespace {
+
+int data_calls;
+int crossing_calls;
+
+bool FakeClimatologyData(int setting, const wxDateTime& date, double lat,
+                         double lon, double& dir, double& speed) {
+  data_calls++;
+  dir = lat + setting;
+  speed = lon;
+  return true;
+}
+
+int FakeCycloneTrackCrossings(double lat1, double lon1, double lat2,
+                              double lon2, const wxDateTime& date,
+                              int dayrange) {
+  crossing_calls++;
+  return lat2 > 10 ? 1 : 0;
+}
+
+/* a single track segment lying within the 1 degree cell at 20N 30E */
+int ShortTrackCrossings(double lat1, double lon1, double lat2, double lon2,
+                        const wxDateTime& date, int dayrange) {
+  crossing_calls++;
+  const double tlat1 = 20.3, tlon1 = 30.3, tlat2 = 20.5, tlon2 = 30.6;
+  auto side = [](double px, double py, double qx, double qy, double rx,
+                 double ry) {
+    return (qx - px) * (ry - py) - (qy - py) * (rx - px);
+  };
+  bool crosses = side(lon1, lat1, lon2, lat2, tlon1, tlat1) *
+                         side(lon1, lat1, lon2, lat2, tlon2, tlat2) <=
+                     0 &&
+                 side(tlon1, tlat1, tlon2, tlat2, lon1, lat1) *
+                         side(tlon1, tlat1, tlon2, tlat2, lon2, lat2) <=
+                     0;
+  return crosses ? 1 : 0;
+}
+
+class ClimatologyCacheTest : public ::testing::Test {
+protected:
+  void SetUp() override {
+    data_calls = crossing_calls = 0;
+    RouteMap::ClimatologyData = FakeClimatologyData;
+    RouteMap::ClimatologyCycloneTrackCrossings = FakeCycloneTrackCrossings;
+    ClimatologyCache::SetResolution(ClimatologyCache::DEFAULT_RESOLUTION);
+    ClimatologyCache::Clear();
+  }
+
+  void TearDown() override {
+    RouteMap::ClimatologyData = nullptr;
+    RouteMap::ClimatologyCycloneTrackCrossings = nullptr;
+    ClimatologyCache::Clear();
+  }
+
+  wxDateTime m_date = wxDateTime(10, wxDateTime::Mar, 2024, 6);
+};
+
+}  // namespace
+
+TEST_F(ClimatologyCacheTest, SameCellQueriesPluginOnce) {
+  double dir1, speed1, dir2, speed2;
+  EXPECT_TRUE(ClimatologyCache::Data(0, m_date, 10.01, 20.01, dir1, speed1));
+  EXPECT_TRUE(ClimatologyCache::Data(0, m_date, 10.2, 20.2, dir2, speed2));
+  EXPECT_EQ(data_calls, 1);
+  EXPECT_DOUBLE_EQ(dir1, dir2);
+  EXPECT_DOUBLE_EQ(speed1, speed2);
+  // queried at the center of the cell
+  EXPECT_DOUBLE_EQ(dir1, 10.125);
+  EXPECT_DOUBLE_EQ(speed1, 20.125);
+}
+
+TEST_F(ClimatologyCacheTest, KeyedBySettingMonthAndCell) {
+  double dir, speed;
+  ClimatologyCache::Data(0, m_date, 10.1, 20.1, dir, speed);
+  ClimatologyCache::Data(1, m_date, 10.1, 20.1, dir, speed);
+  ClimatologyCache::Data(0, m_date + wxDateSpan::Month(), 10.1, 20.1, dir,
+                         speed);
+  ClimatologyCache::Data(0, m_date, 10.3, 20.1, dir, speed);
+  EXPECT_EQ(data_calls, 4);
+  // later in the same month
+  ClimatologyCache::Data(0, m_date + wxDateSpan::Days(5), 10.1, 20.1, dir,
+                         speed);
+  EXPECT_EQ(data_calls, 4);
+}
+
+TEST_F(ClimatologyCacheTest, ClearAndResolutionDropResults) {
+  double dir, speed;
+  ClimatologyCache::Data(0, m_date, 10.1, 20.1, dir, speed);
+  ClimatologyCache::Clear();
+  ClimatologyCache::Data(0, m_date, 10.1, 20.1, dir, speed);
+  EXPECT_EQ(data_calls, 2);
+
+  ClimatologyCache::SetResolution(1.0);
+  EXPECT_DOUBLE_EQ(ClimatologyCache::GetResolution(), 1.0);
+  ClimatologyCache::Data(0, m_date, 10.1, 20.1, dir, speed);
+  ClimatologyCache::Data(0, m_date, 10.9, 20.9, dir, speed);
+  EXPECT_EQ(data_calls, 3);
+  EXPECT_DOUBLE_EQ(dir, 10.5);
+}
+
+TEST_F(ClimatologyCacheTest, CycloneTrackCrossings) {
+  EXPECT_EQ(ClimatologyCache::CycloneTrackCrossings(5, 5, 11, 11, m_date, 30),
+            1);
+  EXPECT_EQ(ClimatologyCache::CycloneTrackCrossings(5, 5, 11, 11, m_date, 30),
+            1);
+  EXPECT_EQ(crossing_calls, 1);
+  EXPECT_EQ(ClimatologyCache::CycloneTrackCrossings(5, 5, 11, 11, m_date, 60),
+            1);
+  EXPECT_EQ(crossing_calls, 2);
+
+  // segments within a single cell are never cached
+  ClimatologyCache::CycloneTrackCrossings(11.01, 5.01, 11.02, 5.02, m_date, 30);
+  int calls = crossing_calls;
+  ClimatologyCache::CycloneTrackCrossings(11.01, 5.01, 11.02, 5.02, m_date, 30);
+  EXPECT_EQ(crossing_calls, calls + 1);
+}
+
+TEST_F(ClimatologyCacheTest, CycloneMaskSkipsTrackFreeCells) {
+  // two cells without tracks, only their 35 probe lines are queried
+  EXPECT_EQ(ClimatologyCache::CycloneTrackCrossings(5.2, 5.2, 5.8, 6.5, m_date,
+                                                    30),
+            0);
+  EXPECT_EQ(crossing_calls, 35);
+  EXPECT_EQ(ClimatologyCache::CycloneTrackCrossings(5.9, 6.9, 5.1, 5.1, m_date,
+                                                    30),
+            0);
+  EXPECT_EQ(crossing_calls, 35);
+
+  // the edges are crossed by a track, the segment is checked exactly
+  EXPECT_EQ(ClimatologyCache::CycloneTrackCrossings(9.2, 5.2, 10.5, 5.5, m_date,
+                                                    30),
+            1);
+}
+
+TEST_F(ClimatologyCacheTest, CycloneMaskSeesTrackWithinACell) {
+  RouteMap::ClimatologyCycloneTrackCrossings = ShortTrackCrossings;
+
+  // the track crosses no cell edge
+  EXPECT_EQ(ShortTrackCrossings(20, 30, 20, 31, m_date, 30), 0);
+  EXPECT_EQ(ShortTrackCrossings(21, 30, 21, 31, m_date, 30), 0);
+  EXPECT_EQ(ShortTrackCrossings(20, 30, 21, 30, m_date, 30), 0);
+  EXPECT_EQ(ShortTrackCrossings(20, 31, 21, 31, m_date, 30), 0);
+
+  // within the cell, and across cells
+  EXPECT_EQ(ClimatologyCache::CycloneTrackCrossings(20.2, 30.45, 20.8, 30.45,
+                                                    m_date, 30),
+            1);
+  EXPECT_EQ(ClimatologyCache::CycloneTrackCrossings(20.4, 29.5, 20.4, 30.9,
+                                                    m_date, 30),
+            1);
+  // the neighboring cell is still free, and answered from the mask
+  EXPECT_EQ(ClimatologyCache::CycloneTrackCrossings(20.5, 31.2, 20.6, 31.8,
+                                                    m_date, 30),
+            0);
+  int calls = crossing_calls;
+  EXPECT_EQ(ClimatologyCache::CycloneTrackCrossings(20.5, 31.2, 20.6, 31.8,
+                                                    m_date, 30),
+            0);
+  EXPECT_EQ(crossing_calls, calls);
+}
+
+TEST_F(ClimatologyCacheTest, MissingPluginFunctions) {
+  RouteMap::ClimatologyData = nullptr;
+  RouteMap::ClimatologyCycloneTrackCrossings = nullptr;
+  double dir, speed;
+  EXPECT_FALSE(ClimatologyCache::Data(0, m_date, 10, 20, dir, speed));
+  EXPECT_EQ(ClimatologyCache::CycloneTrackCrossings(0, 0, 1, 1, m_date, 30),
+            -1);
+}
@@ -0,0 +1,237 @@
+/***************************************************************************
+ *   Copyright (C) 2024 by OpenCPN development team                        *
+ *                                                                         *
+ *   This program is free software; you can redistribute it and/or modify  *
+ *   it under the terms of the GNU General Public License as published by  *
+ *   the Free Software Foundation; either version 2 of the License, or     *
+ *   (at your option) any later version.                                   *
+ *                                                                         *
+ *   This program is distributed in the hope that it will be useful,       *
+ *   but WITHOUT ANY WARRANTY; without even the implied warranty of        *
+ *   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the         *
+ *   GNU General Public License for more details.                          *
+ *                                                                         *
+ *   You should have received a copy of the GNU General Public License     *
+ *   along with this program; if not, write to the                         *
+ *   Free Software Foundation, Inc.,                                       *
+ *   59 Temple Place - Suite 330, Boston, MA  02111-1307, USA.             *
+ **************************************************************************/
+
+#include <gtest/gtest.h>
+#include <wx/filename.h>
+
+#include <cmath>
+#include <cstdint>
+#include <cstdio>
+#include <random>
+#include <thread>
+#include <vector>
+
+#include "CoastlineIndex.h"
+
+namespace {
+
+struct Point {
+  double lon, lat;
+};
+
+/* islands, each within a single 1 degree cell, longitudes from 0 to 360 as
+   in the polygon files */
+const std::vector<std::vector<Point>> islands = {
+    {{10.2, 10.2}, {10.8, 10.2}, {10.8, 10.8}, {10.2, 10.8}},
+    {{359.3, -0.7}, {359.7, -0.5}, {359.5, -0.3}},
+    {{179.4, 5.2}, {179.9, 5.3}, {179.6, 5.6}},
+};
+
+/* writes a polygon file in the format of the OpenCPN GSHHS poly-?-1.dat
+   files, with the islands as the first level polygons */
+void WritePolygonFile(const wxString& path) {
+  FILE* f = fopen(path.mb_str(), "wb");
+  ASSERT_NE(f, nullptr);
+
+  int32_t header[12] = {1, 1, 1, 0, -90, 360, 90, 0, 0, 0, 0, 0};
+  fwrite(header, sizeof header, 1, f);
+  long table = ftell(f);
+  std::vector<int32_t> offsets(360 * 180);
+  fwrite(offsets.data(), sizeof(int32_t), offsets.size(), f);
+
+  int32_t zero = 0;
+  int32_t empty = (int32_t)ftell(f);
+  for (int level = 0; level < 5; level++) fwrite(&zero, sizeof zero, 1, f);
+  for (auto& offset : offsets) offset = empty;
+
+  for (const auto& island : islands) {
+    int x = (int)floor(island[0].lon), y = (int)floor(island[0].lat);
+    offsets[x * 180 + y + 90] = (int32_t)ftell(f);
+    int32_t contours = 1, vertices = (int32_t)island.size();
+    fwrite(&contours, sizeof contours, 1, f);
+    fwrite(&zero, sizeof zero, 1, f);
+    fwrite(&vertices, sizeof vertices, 1, f);
+    for (const Point& p : island) {
+      double xy[2] = {p.lon * 1e6, p.lat * 1e6};
+      fwrite(xy, sizeof xy, 1, f);
+    }
+    for (int level = 1; level < 5; level++) fwrite(&zero, sizeof zero, 1, f);
+  }
+
+  fseek(f, table, SEEK_SET);
+  fwrite(offsets.data(), sizeof(int32_t), offsets.size(), f);
+  fclose(f);
+}
+
+bool SegmentsIntersect(double ax, double ay, double bx, double by, double cx,
+                       double cy, double dx, double dy) {
+  auto side = [](double px, double py, double qx, double qy, double rx,
+                 double ry) {
+    return (qx - px) * (ry - py) - (qy - py) * (rx - px);
+  };
+  return side(ax, ay, bx, by, cx, cy) * side(ax, ay, bx, by, dx, dy) <= 0 &&
+         side(cx, cy, dx, dy, ax, ay) * side(cx, cy, dx, dy, bx, by) <= 0;
+}
+
+/* what PlugIn_GSHHS_CrossesLand answers for the same polygons: whether the
+   segment, the short way around, intersects any edge of an island */
+bool ReferenceCrossesLand(double lat1, double lon1, double lat2,
+                          double lon2) {
+  if (lon2 - lon1 > 180) lon2 -= 360;
+  if (lon1 - lon2 > 180) lon2 += 360;
+  for (const auto& island : islands)
+    for (int turn = -2; turn <= 1; turn++)
+      for (size_t i = 0; i < island.size(); i++) {
+        const Point& a = island[i];
+        const Point& b = island[(i + 1) % island.size()];
+        if (SegmentsIntersect(lon1, lat1, lon2, lat2, a.lon + 360 * turn,
+                              a.lat, b.lon + 360 * turn, b.lat))
+          return true;
+      }
+  return false;
+}
+
+class CoastlineIndexTest : public ::testing::Test {
+protected:
+  void SetUp() override {
+    m_dir = wxFileName::GetTempDir() + wxFileName::GetPathSeparator() +
+            "weather_routing_coastline_tests";
+    wxFileName::Mkdir(m_dir, wxS_DIR_DEFAULT, wxPATH_MKDIR_FULL);
+    m_file = wxFileName(m_dir, "poly-c-1.dat").GetFullPath();
+    WritePolygonFile(m_file);
+    wxArrayString dirs;
+    dirs.Add(m_dir);
+    ASSERT_TRUE(CoastlineIndex::Open(dirs));
+  }
+
+  void TearDown() override {
+    CoastlineIndex::Close();
+    wxRemoveFile(m_file);
+    wxFileName::Rmdir(m_dir);
+  }
+
+  wxString m_dir, m_file;
+};
+
+}  // namespace
+
+TEST_F(CoastlineIndexTest, OpenAndClose) {
+  EXPECT_TRUE(CoastlineIndex::IsOpen());
+  CoastlineIndex::Close();
+  EXPECT_FALSE(CoastlineIndex::IsOpen());
+
+  wxArrayString dirs;
+  dirs.Add(m_dir + wxFileName::GetPathSeparator() + "missing");
+  EXPECT_FALSE(CoastlineIndex::Open(dirs));
+  EXPECT_FALSE(CoastlineIndex::IsOpen());
+}
+
+TEST_F(CoastlineIndexTest, NoticesNewCoastlineData) {
+  wxArrayString dirs;
+  dirs.Add(m_dir);
+  EXPECT_TRUE(CoastlineIndex::IsCurrent(dirs));
+  wxString source = CoastlineIndex::Source(dirs);
+  EXPECT_FALSE(source.IsEmpty());
+
+  // a better quality file was installed
+  wxString better = wxFileName(m_dir, "poly-h-1.dat").GetFullPath();
+  WritePolygonFile(better);
+  EXPECT_FALSE(CoastlineIndex::IsCurrent(dirs));
+  EXPECT_NE(CoastlineIndex::Source(dirs), source);
+
+  CoastlineIndex::Close();
+  EXPECT_FALSE(CoastlineIndex::IsCurrent(dirs));
+  ASSERT_TRUE(CoastlineIndex::Open(dirs));
+  EXPECT_TRUE(CoastlineIndex::IsCurrent(dirs));
+  EXPECT_TRUE(CoastlineIndex::CrossesLand(10.5, 10, 10.5, 11));
+
+  // and removed again
+  CoastlineIndex::Close();
+  wxRemoveFile(better);
+  ASSERT_TRUE(CoastlineIndex::Open(dirs));
+  EXPECT_TRUE(CoastlineIndex::IsCurrent(dirs));
+  EXPECT_EQ(CoastlineIndex::Source(dirs), source);
+
+  wxArrayString none;
+  none.Add(m_dir + "missing");
+  EXPECT_TRUE(CoastlineIndex::Source(none).IsEmpty());
+}
+
+TEST_F(CoastlineIndexTest, CrossesIsland) {
+  EXPECT_TRUE(CoastlineIndex::CrossesLand(10.5, 10, 10.5, 11));
+  EXPECT_FALSE(CoastlineIndex::CrossesLand(10.1, 10, 10.1, 11));
+  // across several cells
+  EXPECT_TRUE(CoastlineIndex::CrossesLand(9.5, 9.5, 11.5, 11.5));
+  EXPECT_FALSE(CoastlineIndex::CrossesLand(9.5, 9.5, 9.5, 11.5));
+  // only the cells with a coastline are kept
+  EXPECT_EQ(CoastlineIndex::LoadedCells(), 1u);
+}
+
+TEST_F(CoastlineIndexTest, CrossesAroundTheWorld) {
+  // west of Greenwich, given either way
+  EXPECT_TRUE(CoastlineIndex::CrossesLand(-0.5, -0.9, -0.5, -0.1));
+  EXPECT_TRUE(CoastlineIndex::CrossesLand(-0.5, 359.1, -0.5, 0.5));
+  EXPECT_FALSE(CoastlineIndex::CrossesLand(-0.5, -0.2, -0.5, 0.5));
+  // across the antimeridian
+  EXPECT_TRUE(CoastlineIndex::CrossesLand(5.4, 179, 5.4, -179.5));
+  EXPECT_FALSE(CoastlineIndex::CrossesLand(5.4, -179.9, 5.4, -179.5));
+}
+
+TEST_F(CoastlineIndexTest, MatchesPluginResults) {
+  std::mt19937 gen(1);
+  std::uniform_real_distribution<double> offset(-1.5, 1.5);
+  const Point centers[] = {{10.5, 10.5}, {-0.5, -0.5}, {179.7, 5.4}};
+  int crossings = 0;
+  for (int i = 0; i < 3000; i++) {
+    const Point& c = centers[i % 3];
+    double lat1 = c.lat + offset(gen), lon1 = c.lon + offset(gen);
+    double lat2 = c.lat + offset(gen), lon2 = c.lon + offset(gen);
+    bool expected = ReferenceCrossesLand(lat1, lon1, lat2, lon2);
+    EXPECT_EQ(CoastlineIndex::CrossesLand(lat1, lon1, lat2, lon2), expected)
+        << lat1 << " " << lon1 << " " << lat2 << " " << lon2;
+    crossings += expected;
+  }
+  // both answers were exercised
+  EXPECT_GT(crossings, 100);
+  EXPECT_LT(crossings, 2900);
+}
+
+TEST_F(CoastlineIndexTest, ConcurrentQueries) {
+  // every worker starts with the cells not loaded yet
+  const int threads = 4, queries = 2000;
+  std::vector<int> mismatches(threads, 0);
+  auto query = [&](int t) {
+    std::mt19937 gen(t);
+    std::uniform_real_distribution<double> pos(9, 12);
+    for (int i = 0; i < queries; i++) {
+      double lat1 = pos(gen), lon1 = pos(gen), lat2 = pos(gen),
+             lon2 = pos(gen);
+      if (CoastlineIndex::CrossesLand(lat1, lon1, lat2, lon2) !=
+          ReferenceCrossesLand(lat1, lon1, lat2, lon2))
+        mismatches[t]++;
+    }
+  };
+
+  std::vector<std::thread> workers;
+  for (int t = 0; t < threads; t++) workers.emplace_back(query, t);
+  for (std::thread& worker : workers) worker.join();
+
+  for (int t = 0; t < threads; t++) EXPECT_EQ(mismatches[t], 0);
+  EXPECT_EQ(CoastlineIndex::LoadedCells(), 1u);
+}
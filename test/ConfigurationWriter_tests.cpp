@@ -0,0 +1,100 @@
+/***************************************************************************
+ *   Copyright (C) 2024 by OpenCPN development team                        *
+ *                                                                         *
+ *   This program is free software; you can redistribute it and/or modify  *
+ *   it under the terms of the GNU General Public License as published by  *
+ *   the Free Software Foundation; either version 2 of the License, or     *
+ *   (at your option) any later version.                                   *
+ *                                                                         *
+ *   This program is distributed in the hope that it will be useful,       *
+ *   but WITHOUT ANY WARRANTY; without even the implied warranty of        *
+ *   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the         *
+ *   GNU General Public License for more details.                          *
+ *                                                                         *
+ *   You should have received a copy of the GNU General Public License     *
+ *   along with this program; if not, write to the                         *
+ *   Free Software Foundation, Inc.,                                       *
+ *   59 Temple Place - Suite 330, Boston, MA  02111-1307, USA.             *
+ **************************************************************************/
+
+#include <gtest/gtest.h>
+#include <wx/filename.h>
+#include <tinyxml.h>
+
+#include "ConfigurationWriter.h"
+
+namespace {
+
+class ConfigurationWriterTest : public ::testing::Test {
+protected:
+  void SetUp() override {
+    m_path = wxFileName::CreateTempFileName("wrconfiguration");
+
+    m_document.filename = m_path;
+    m_document.version = "1.15";
+    TiXmlElement position("Position");
+    position.SetAttribute("Name", "Start & end");
+    position.SetAttribute("Latitude", "10.500000");
+    m_document.elements.push_back(ConfigurationWriter::Format(position));
+    TiXmlElement configuration("Configuration");
+    configuration.SetAttribute("Start", "Start & end");
+    configuration.SetAttribute("dt", 3600);
+    m_document.elements.push_back(ConfigurationWriter::Format(configuration));
+  }
+
+  void TearDown() override { wxRemoveFile(m_path); }
+
+  // Loads the file as the plugin does.
+  void Load(TiXmlDocument& doc) {
+    ASSERT_TRUE(doc.LoadFile(m_path.mb_str()));
+    TiXmlElement* root = doc.RootElement();
+    ASSERT_NE(root, nullptr);
+    EXPECT_STREQ(root->Value(), "OpenCPNWeatherRoutingConfiguration");
+    EXPECT_STREQ(root->Attribute("version"), "1.15");
+  }
+
+  wxString m_path;
+  ConfigurationWriter::Document m_document;
+};
+
+}  // namespace
+
+TEST_F(ConfigurationWriterTest, WritesLoadableFile) {
+  ASSERT_TRUE(ConfigurationWriter::Write(m_document));
+  EXPECT_FALSE(wxFileExists(m_path + ".tmp"));
+
+  TiXmlDocument doc;
+  Load(doc);
+  TiXmlElement* e = doc.RootElement()->FirstChildElement();
+  ASSERT_NE(e, nullptr);
+  EXPECT_STREQ(e->Value(), "Position");
+  EXPECT_STREQ(e->Attribute("Name"), "Start & end");
+  e = e->NextSiblingElement();
+  ASSERT_NE(e, nullptr);
+  EXPECT_STREQ(e->Value(), "Configuration");
+  int dt = 0;
+  e->Attribute("dt", &dt);
+  EXPECT_EQ(dt, 3600);
+  EXPECT_EQ(e->NextSiblingElement(), nullptr);
+}
+
+TEST_F(ConfigurationWriterTest, BackgroundSavesWriteLastDocument) {
+  ConfigurationWriter writer;
+  ConfigurationWriter::Document first = m_document;
+  first.elements.pop_back();
+  writer.Save(first);
+  writer.Save(m_document);
+  EXPECT_TRUE(writer.Flush());
+
+  TiXmlDocument doc;
+  Load(doc);
+  TiXmlElement* e = doc.RootElement()->FirstChildElement("Configuration");
+  EXPECT_NE(e, nullptr);
+
+  // the file is left untouched when it cannot be replaced
+  ConfigurationWriter::Document missing = m_document;
+  missing.filename = m_path + "missing" + wxFileName::GetPathSeparator() + "x";
+  writer.Save(missing);
+  EXPECT_FALSE(writer.Flush());
+  Load(doc);
+}
@@ -0,0 +1,237 @@
+/***************************************************************************
+ *   Copyright (C) 2024 by OpenCPN development team                        *
+ *                                                                         *
+ *   This program is free software; you can redistribute it and/or modify  *
+ *   it under the terms of the GNU General Public License as published by  *
+ *   the Free Software Foundation; either version 2 of the License, or     *
+ *   (at your option) any later version.                                   *
+ *                                                                         *
+ *   This program is distributed in the hope that it will be useful,       *
+ *   but WITHOUT ANY WARRANTY; without even the implied warranty of        *
+ *   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the         *
+ *   GNU General Public License for more details.                          *
+ *                                                                         *
+ *   You should have received a copy of the GNU General Public License     *
+ *   along with this program; if not, write to the                         *
+ *   Free Software Foundation, Inc.,                                       *
+ *   59 Temple Place - Suite 330, Boston, MA  02111-1307, USA.             *
+ **************************************************************************/
+
+#include <gtest/gtest.h>
+#include <wx/filename.h>
+
+#include <cmath>
+#include <cstdint>
+#include <cstdio>
+#include <random>
+#include <vector>
+
+#include "CoastlineIndex.h"
+#include "ConstraintChecker.h"
+#include "RouteMap.h"
+#include "Utilities.h"
+#include "georef.h"
+
+namespace {
+
+struct Point {
+  double lon, lat;
+};
+
+/* an islet far smaller than the distance field cells, and an island clipped
+   along the 40th parallel like the polygons of the GSHHS files */
+const std::vector<std::vector<Point>> islands = {
+    {{30.51, 20.51}, {30.52, 20.51}, {30.52, 20.52}, {30.51, 20.52}},
+    {{50.2, 40.0}, {50.5, 40.0}, {50.35, 40.2}},
+};
+
+void WritePolygonFile(const wxString& path) {
+  FILE* f = fopen(path.mb_str(), "wb");
+  ASSERT_NE(f, nullptr);
+
+  int32_t header[12] = {1, 1, 1, 0, -90, 360, 90, 0, 0, 0, 0, 0};
+  fwrite(header, sizeof header, 1, f);
+  long table = ftell(f);
+  std::vector<int32_t> offsets(360 * 180);
+  fwrite(offsets.data(), sizeof(int32_t), offsets.size(), f);
+
+  int32_t zero = 0;
+  int32_t empty = (int32_t)ftell(f);
+  for (int level = 0; level < 5; level++) fwrite(&zero, sizeof zero, 1, f);
+  for (auto& offset : offsets) offset = empty;
+
+  for (const auto& island : islands) {
+    int x = (int)floor(island[0].lon), y = (int)floor(island[0].lat);
+    offsets[x * 180 + y + 90] = (int32_t)ftell(f);
+    int32_t contours = 1, vertices = (int32_t)island.size();
+    fwrite(&contours, sizeof contours, 1, f);
+    fwrite(&zero, sizeof zero, 1, f);
+    fwrite(&vertices, sizeof vertices, 1, f);
+    for (const Point& p : island) {
+      double xy[2] = {p.lon * 1e6, p.lat * 1e6};
+      fwrite(xy, sizeof xy, 1, f);
+    }
+    for (int level = 1; level < 5; level++) fwrite(&zero, sizeof zero, 1, f);
+  }
+
+  fseek(f, table, SEEK_SET);
+  fwrite(offsets.data(), sizeof(int32_t), offsets.size(), f);
+  fclose(f);
+}
+
+/* the land test without the distance field: the segment and the lines
+   offset by the margin on both sides must not cross land */
+bool ReferenceLandConstraint(double lat, double lon, double dlat, double dlon,
+                             double cog, double margin) {
+  if (CoastlineIndex::CrossesLand(lat, lon, dlat, dlon)) return false;
+  double lat_up1, lon_up1, lat_up2, lon_up2;
+  double lat_down1, lon_down1, lat_down2, lon_down2;
+  ll_gc_ll(lat, lon, heading_resolve(cog) - 90, margin, &lat_up1, &lon_up1);
+  ll_gc_ll(dlat, dlon, heading_resolve(cog) - 90, margin, &lat_up2, &lon_up2);
+  ll_gc_ll(lat, lon, heading_resolve(cog) + 90, margin, &lat_down1,
+           &lon_down1);
+  ll_gc_ll(dlat, dlon, heading_resolve(cog) + 90, margin, &lat_down2,
+           &lon_down2);
+  return !CoastlineIndex::CrossesLand(lat_up1, lon_up1, lat_up2, lon_up2) &&
+         !CoastlineIndex::CrossesLand(lat_down1, lon_down1, lat_down2,
+                                      lon_down2) &&
+         !CoastlineIndex::CrossesLand(lat_up1, lon_up1, lat_down2,
+                                      lon_down2) &&
+         !CoastlineIndex::CrossesLand(lat_down1, lon_down1, lat_up2, lon_up2);
+}
+
+class ConstraintCheckerTest : public ::testing::Test {
+protected:
+  void SetUp() override {
+    m_dir = wxFileName::GetTempDir() + wxFileName::GetPathSeparator() +
+            "weather_routing_constraint_tests";
+    wxFileName::Mkdir(m_dir, wxS_DIR_DEFAULT, wxPATH_MKDIR_FULL);
+    m_file = wxFileName(m_dir, "poly-c-1.dat").GetFullPath();
+    WritePolygonFile(m_file);
+    wxArrayString dirs;
+    dirs.Add(m_dir);
+    ASSERT_TRUE(CoastlineIndex::Open(dirs));
+    clear_land_cache();
+
+    m_configuration.DetectLand = true;
+    m_configuration.SafetyMarginLand = 5;
+  }
+
+  void TearDown() override {
+    clear_land_cache();
+    CoastlineIndex::Close();
+    wxRemoveFile(m_file);
+    wxFileName::Rmdir(m_dir);
+  }
+
+  bool CheckLand(double lat, double lon, double dlat, double dlon) {
+    double cog, dist;
+    ll_gc_ll_reverse(lat, lon, dlat, dlon, &cog, &dist);
+    return ConstraintChecker::CheckLandConstraint(m_configuration, lat, lon,
+                                                  dlat, dlon, cog);
+  }
+
+  bool Reference(double lat, double lon, double dlat, double dlon) {
+    double cog, dist;
+    ll_gc_ll_reverse(lat, lon, dlat, dlon, &cog, &dist);
+    return ReferenceLandConstraint(lat, lon, dlat, dlon, cog,
+                                   m_configuration.SafetyMarginLand);
+  }
+
+  wxString m_dir, m_file;
+  RouteMapConfiguration m_configuration;
+};
+
+}  // namespace
+
+TEST_F(ConstraintCheckerTest, IsletInsideACellIsWithinTheMargin) {
+  // 3 nm north of the islet, which is smaller than a cell of the field
+  EXPECT_FALSE(Reference(20.565, 30.3, 20.565, 30.7));
+  EXPECT_FALSE(CheckLand(20.565, 30.3, 20.565, 30.7));
+  // and clear of it farther away
+  EXPECT_TRUE(CheckLand(20.7, 30.3, 20.7, 30.7));
+  EXPECT_FALSE(CheckLand(20.565, 30.3, 20.565, 30.7));
+}
+
+TEST_F(ConstraintCheckerTest, CoastOnAGridLineIsWithinTheMargin) {
+  // 2 nm south of an edge lying on the 40th parallel
+  EXPECT_FALSE(Reference(39.97, 50.3, 39.97, 50.4));
+  EXPECT_TRUE(CheckLand(39.5, 50.3, 39.5, 50.4));
+  EXPECT_FALSE(CheckLand(39.97, 50.3, 39.97, 50.4));
+}
+
+TEST_F(ConstraintCheckerTest, MatchesTheBruteForceTest) {
+  std::mt19937 rng(33);
+  std::uniform_real_distribution<double> offset(-0.5, 0.5);
+  std::uniform_real_distribution<double> step(-0.2, 0.2);
+  const Point centers[] = {{30.515, 20.515}, {50.35, 40.0}};
+
+  // twice, the second time with the distance field already computed
+  for (int pass = 0; pass < 2; pass++) {
+    std::mt19937 segments = rng;
+    for (const Point& center : centers)
+      for (int k = 0; k < 2000; k++) {
+        double lat = center.lat + offset(segments);
+        double lon = center.lon + offset(segments);
+        double dlat = lat + step(segments), dlon = lon + step(segments);
+        ASSERT_EQ(CheckLand(lat, lon, dlat, dlon),
+                  Reference(lat, lon, dlat, dlon))
+            << "pass " << pass << " from " << lat << ", " << lon << " to "
+            << dlat << ", " << dlon;
+      }
+  }
+}
+
+TEST_F(ConstraintCheckerTest, HasCoastline) {
+  EXPECT_TRUE(CoastlineIndex::HasCoastline(20.5, 30.5, 20.5625, 30.5625));
+  EXPECT_FALSE(CoastlineIndex::HasCoastline(20.5625, 30.5, 20.625, 30.5625));
+  // edges on a side count for the boxes on both sides
+  EXPECT_TRUE(CoastlineIndex::HasCoastline(39.9375, 50.25, 40.0, 50.3125));
+  EXPECT_TRUE(CoastlineIndex::HasCoastline(40.0, 50.25, 40.0625, 50.3125));
+  EXPECT_FALSE(CoastlineIndex::HasCoastline(39.875, 50.25, 39.9375, 50.3125));
+  // longitudes wrap around
+  EXPECT_TRUE(
+      CoastlineIndex::HasCoastline(20.5, 30.5 - 360, 20.5625, 30.5625 - 360));
+}
+
+TEST_F(ConstraintCheckerTest, PipelineOrderKeepsResultsAndFlags) {
+  m_configuration.DetectBoundary = false;
+  m_configuration.AvoidCycloneTracks = false;
+  m_configuration.MaxCourseAngle = 180;
+  m_configuration.MaxDivertedCourse = 180;
+  m_configuration.MaxApparentWindKnots = 40;
+  m_configuration.EndLat = 0, m_configuration.EndLon = 0;
+
+  std::mt19937 rng(37);
+  std::uniform_real_distribution<double> offset(-0.3, 0.3);
+  std::uniform_real_distribution<double> step(-0.15, 0.15);
+
+  // the apparent wind rejects nothing at first, so land alone would be
+  // moved ahead of it
+  ConstraintPipeline adaptive, reference;
+  for (int k = 0; k < 4 * (int)ConstraintPipeline::REORDER_INTERVAL; k++) {
+    PropagationCandidate c;
+    c.lat = 20.515 + offset(rng), c.lon = 30.515 + offset(rng);
+    c.dlat = c.lat + step(rng), c.dlon = c.lon + step(rng);
+    ll_gc_ll_reverse(c.lat, c.lon, c.dlat, c.dlon, &c.cog, &c.dist);
+    c.stw = 5, c.twa = 90;
+    bool gust =
+        k >= 2 * (int)ConstraintPipeline::REORDER_INTERVAL && k % 3 == 0;
+    c.twsOverWater = gust ? 60 : 10;
+
+    m_configuration.land_crossing = m_configuration.boundary_crossing = false;
+    PropagationError error = PROPAGATION_NO_ERROR;
+    bool passed = adaptive.Check(m_configuration, c, error);
+    bool land_crossing = m_configuration.land_crossing;
+
+    m_configuration.land_crossing = m_configuration.boundary_crossing = false;
+    PropagationError reference_error = PROPAGATION_NO_ERROR;
+    reference.Reset();
+    ASSERT_EQ(passed, reference.Check(m_configuration, c, reference_error))
+        << "candidate " << k;
+    ASSERT_EQ(land_crossing, m_configuration.land_crossing)
+        << "candidate " << k;
+    ASSERT_FALSE(m_configuration.boundary_crossing);
+    ASSERT_EQ(error, reference_error) << "candidate " << k;
+  }
+}
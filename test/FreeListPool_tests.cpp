@@ -0,0 +1,60 @@
+/***************************************************************************
+ *   Copyright (C) 2024 by OpenCPN development team                        *
+ *                                                                         *
+ *   This program is free software; you can redistribute it and/or modify  *
+ *   it under the terms of the GNU General Public License as published by  *
+ *   the Free Software Foundation; either version 2 of the License, or     *
+ *   (at your option) any later version.                                   *
+ *                                                                         *
+ *   This program is distributed in the hope that it will be useful,       *
+ *   but WITHOUT ANY WARRANTY; without even the implied warranty of        *
+ *   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the         *
+ *   GNU General Public License for more details.                          *
+ *                                                                         *
+ *   You should have received a copy of the GNU General Public License     *
+ *   along with this program; if not, write to the                         *
+ *   Free Software Foundation, Inc.,                                       *
+ *   59 Temple Place - Suite 330, Boston, MA  02111-1307, USA.             *
+ **************************************************************************/
+
+#include <gtest/gtest.h>
+#include <list>
+#include "FreeListPool.h"
+#include "IsoRoute.h"
+
+TEST(FreeListPoolTest, RecyclesReleasedBlocks) {
+  void* p = FreeListPool<40>::Allocate();
+  FreeListPool<40>::Release(p);
+  EXPECT_EQ(FreeListPool<40>::Allocate(), p);
+  FreeListPool<40>::Release(p);
+}
+
+TEST(FreeListPoolTest, ListNodesAreRecycled) {
+  std::list<int, PoolAllocator<int> > a, b;
+  for (int i = 0; i < 100; i++) a.push_back(i);
+  b.splice(b.end(), a);
+  EXPECT_TRUE(a.empty());
+  EXPECT_EQ(b.size(), 100u);
+  EXPECT_EQ(b.back(), 99);
+
+  // the node of the last element is the first one handed out again
+  const int* last = &b.back();
+  b.pop_back();
+  b.push_front(-1);
+  EXPECT_EQ(&b.front(), last);
+}
+
+TEST(FreeListPoolTest, IsoRoutesAreRecycled) {
+  Position* p = new Position(1, 2);
+  p->prev = p->next = p;
+  IsoRoute* route = new IsoRoute(p->BuildSkipList());
+  void* address = route;
+  delete route;
+
+  p = new Position(3, 4);
+  p->prev = p->next = p;
+  route = new IsoRoute(p->BuildSkipList());
+  EXPECT_EQ((void*)route, address);
+  EXPECT_EQ(route->Count(), 1);
+  delete route;
+}
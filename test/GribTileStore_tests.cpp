@@ -0,0 +1,208 @@
+/***************************************************************************
+ *   Copyright (C) 2024 by OpenCPN development team                        *
+ *                                                                         *
+ *   This program is free software; you can redistribute it and/or modify  *
+ *   it under the terms of the GNU General Public License as published by  *
+ *   the Free Software Foundation; either version 2 of the License, or     *
+ *   (at your option) any later version.                                   *
+ *                                                                         *
+ *   This program is distributed in the hope that it will be useful,       *
+ *   but WITHOUT ANY WARRANTY; without even the implied warranty of        *
+ *   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the         *
+ *   GNU General Public License for more details.                          *
+ *                                                                         *
+ *   You should have received a copy of the GNU General Public License     *
+ *   along with this program; if not, write to the                         *
+ *   Free Software Foundation, Inc.,                                       *
+ *   59 Temple Place - Suite 330, Boston, MA  02111-1307, USA.             *
+ **************************************************************************/
+
+#include <gtest/gtest.h>
+#include <wx/dir.h>
+#include <wx/file.h>
+#include <wx/filename.h>
+
+#include <cstring>
+
+#include "GribRecord.h"
+#include "GribTileStore.h"
+#include "WeatherDataProvider.h"
+
+namespace {
+
+const time_t TIME = 1000000;
+
+// Ni x Nj grid with a step of 0.1 degree and value i + 1000 * j + offset.
+class GridRecord : public GribRecord {
+public:
+  GridRecord(int ni, int nj, double offset = 0) {
+    ok = true;
+    knownData = true;
+    Ni = ni, Nj = nj;
+    La1 = Lo1 = 0;
+    Di = Dj = 0.1;
+    La2 = latMax = (Nj - 1) * Dj;
+    Lo2 = lonMax = (Ni - 1) * Di;
+    latMin = lonMin = 0;
+    refDate = TIME, curDate = TIME;
+    data = new double[Ni * Nj];
+    for (zuint j = 0; j < Nj; j++)
+      for (zuint i = 0; i < Ni; i++) data[j * Ni + i] = i + 1000. * j + offset;
+  }
+};
+
+class GribTileStoreTest : public ::testing::Test {
+protected:
+  GribTileStoreTest() : m_set(42) { m_set.m_Reference_Time = TIME; }
+
+  void SetUp() override {
+    m_dir = wxFileName::CreateTempFileName("wrtiles");
+    wxRemoveFile(m_dir);
+    ASSERT_TRUE(wxMkdir(m_dir));
+    GribTileStore::SetDirectory(m_dir);
+  }
+
+  void TearDown() override {
+    GribTileStore::SetDirectory("");
+    wxFileName::Rmdir(m_dir, wxPATH_RMDIR_RECURSIVE);
+  }
+
+  wxArrayString TileFiles() {
+    wxArrayString files;
+    wxDir::GetAllFiles(m_dir, &files, "*.wrtiles", wxDIR_FILES);
+    return files;
+  }
+
+  double Value(int i, int j) {
+    return GribTileStore::GetInterpolatedValue(m_set, Idx_PRESSURE, i * 0.1,
+                                               j * 0.1);
+  }
+
+  wxString m_dir;
+  WR_GribRecordSet m_set;
+};
+
+}  // namespace
+
+TEST_F(GribTileStoreTest, SmallAndBlendedRecordsStayOnTheHeap) {
+  GridRecord small(16, 16);
+  EXPECT_FALSE(GribTileStore::IsWorthStoring(small));
+  EXPECT_FALSE(GribTileStore::Store(m_set, Idx_PRESSURE, small));
+
+  GridRecord large(256, 256);
+  WR_GribRecordSet blended(42);
+  blended.m_Reference_Time = TIME;
+  blended.m_Interpolated = true;
+  EXPECT_FALSE(GribTileStore::Store(blended, Idx_PRESSURE, large));
+  EXPECT_FALSE(GribTileStore::Contains(blended, Idx_PRESSURE));
+  EXPECT_EQ(TileFiles().GetCount(), 0u);
+}
+
+TEST_F(GribTileStoreTest, RoundTrip) {
+  GridRecord rec(300, 260);
+  ASSERT_TRUE(GribTileStore::Store(m_set, Idx_PRESSURE, rec));
+  GribTileStore::Flush();
+  EXPECT_TRUE(GribTileStore::Contains(m_set, Idx_PRESSURE));
+  EXPECT_FALSE(GribTileStore::Contains(m_set, Idx_AIR_TEMP));
+
+  for (int j = 0; j < 260; j += 37)
+    for (int i = 0; i < 300; i += 41)
+      EXPECT_NEAR(Value(i, j), rec.getValue(i, j), 1e-6);
+  // last row and column of the partial edge tiles
+  EXPECT_NEAR(Value(299, 259), rec.getValue(299, 259), 1e-6);
+  // between grid points, same as the record interpolation
+  EXPECT_NEAR(
+      GribTileStore::GetInterpolatedValue(m_set, Idx_PRESSURE, 10.05, 7.05),
+      rec.getInterpolatedValue(10.05, 7.05), 1e-6);
+  EXPECT_EQ(GribTileStore::GetInterpolatedValue(m_set, Idx_PRESSURE, 10, 40),
+            GRIB_NOTDEF);
+}
+
+TEST_F(GribTileStoreTest, ReadableWhileTheTileFileIsWritten) {
+  // the GRIB plugin frees its records once the request is served
+  GridRecord* rec = new GridRecord(256, 256);
+  ASSERT_TRUE(GribTileStore::Store(m_set, Idx_PRESSURE, *rec));
+  delete rec;
+  EXPECT_TRUE(GribTileStore::Contains(m_set, Idx_PRESSURE));
+  EXPECT_NEAR(Value(100, 200), 100 + 1000. * 200, 1e-6);
+
+  GribTileStore::Flush();
+  EXPECT_EQ(TileFiles().GetCount(), 1u);
+  EXPECT_NEAR(Value(100, 200), 100 + 1000. * 200, 1e-6);
+  EXPECT_GT(GribTileStore::CachedTiles(), 0u);
+}
+
+TEST_F(GribTileStoreTest, ReusesMatchingTileFile) {
+  GridRecord rec(256, 256);
+  ASSERT_TRUE(GribTileStore::Store(m_set, Idx_PRESSURE, rec));
+  GribTileStore::Flush();
+  ASSERT_EQ(TileFiles().GetCount(), 1u);
+
+  // a later session finds the file written by this one
+  GribTileStore::SetDirectory(m_dir);
+  EXPECT_FALSE(GribTileStore::Contains(m_set, Idx_PRESSURE));
+  ASSERT_TRUE(GribTileStore::Store(m_set, Idx_PRESSURE, rec));
+  GribTileStore::Flush();
+  EXPECT_EQ(TileFiles().GetCount(), 1u);
+  EXPECT_NEAR(Value(100, 200), rec.getValue(100, 200), 1e-6);
+}
+
+TEST_F(GribTileStoreTest, MismatchedHeaderIsRewritten) {
+  GridRecord rec(256, 256);
+  ASSERT_TRUE(GribTileStore::Store(m_set, Idx_PRESSURE, rec));
+  GribTileStore::Flush();
+  wxArrayString files = TileFiles();
+  ASSERT_EQ(files.GetCount(), 1u);
+
+  char original[128], header[128];
+  {
+    wxFile file(files[0], wxFile::read_write);
+    ASSERT_EQ(file.Read(original, sizeof original), (ssize_t)sizeof original);
+    // corrupt the source identity following the grid geometry
+    memcpy(header, original, sizeof header);
+    for (int i = 56; i < 80; i++) header[i] ^= 0x5a;
+    ASSERT_TRUE(file.Seek(0) == 0);
+    ASSERT_EQ(file.Write(header, sizeof header), sizeof header);
+  }
+
+  GribTileStore::SetDirectory(m_dir);
+  ASSERT_TRUE(GribTileStore::Store(m_set, Idx_PRESSURE, rec));
+  GribTileStore::Flush();
+  {
+    wxFile file(files[0]);
+    ASSERT_EQ(file.Read(header, sizeof header), (ssize_t)sizeof header);
+  }
+  EXPECT_EQ(memcmp(header, original, sizeof header), 0);
+  EXPECT_NEAR(Value(5, 250), rec.getValue(5, 250), 1e-6);
+}
+
+TEST_F(GribTileStoreTest, SameIdFromAnotherGrib) {
+  // two GRIB files can produce the same record set id and time
+  GridRecord first(256, 256), second(256, 256, 0.5);
+  ASSERT_TRUE(GribTileStore::Store(m_set, Idx_PRESSURE, first));
+  EXPECT_NEAR(Value(3, 4), first.getValue(3, 4), 1e-6);
+
+  ASSERT_TRUE(GribTileStore::Store(m_set, Idx_PRESSURE, second));
+  EXPECT_NEAR(Value(3, 4), second.getValue(3, 4), 1e-6);
+  GribTileStore::Flush();
+  EXPECT_EQ(TileFiles().GetCount(), 2u);
+  EXPECT_NEAR(Value(3, 4), second.getValue(3, 4), 1e-6);
+}
+
+TEST_F(GribTileStoreTest, EvictsLeastRecentlyUsedTiles) {
+  // 17 x 16 tiles of 64 x 64 values, more than the store keeps in memory
+  GridRecord rec(17 * 64, 16 * 64);
+  ASSERT_TRUE(GribTileStore::Store(m_set, Idx_PRESSURE, rec));
+  GribTileStore::Flush();
+
+  for (int j = 0; j < 16; j++)
+    for (int i = 0; i < 17; i++)
+      EXPECT_NEAR(Value(i * 64 + 1, j * 64 + 1),
+                  rec.getValue(i * 64 + 1, j * 64 + 1), 1e-6);
+  EXPECT_LE(GribTileStore::CachedTiles(), 256u);
+  EXPECT_GT(GribTileStore::CachedTiles(), 0u);
+
+  // the first tiles were evicted and are paged in again
+  EXPECT_NEAR(Value(1, 1), rec.getValue(1, 1), 1e-6);
+  EXPECT_NEAR(Value(65, 1), rec.getValue(65, 1), 1e-6);
+}
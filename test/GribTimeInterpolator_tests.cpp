@@ -0,0 +1,195 @@
+/***************************************************************************
+ *   Copyright (C) 2024 by OpenCPN development team                        *
+ *                                                                         *
+ *   This program is free software; you can redistribute it and/or modify  *
+ *   it under the terms of the GNU General Public License as published by  *
+ *   the Free Software Foundation; either version 2 of the License, or     *
+ *   (at your option) any later version.                                   *
+ *                                                                         *
+ *   This program is distributed in the hope that it will be useful,       *
+ *   but WITHOUT ANY WARRANTY; without even the implied warranty of        *
+ *   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the         *
+ *   GNU General Public License for more details.                          *
+ *                                                                         *
+ *   You should have received a copy of the GNU General Public License     *
+ *   along with this program; if not, write to the                         *
+ *   Free Software Foundation, Inc.,                                       *
+ *   59 Temple Place - Suite 330, Boston, MA  02111-1307, USA.             *
+ **************************************************************************/
+
+#include <gtest/gtest.h>
+
+#include <cmath>
+
+#include "GribRecord.h"
+#include "GribTimeInterpolator.h"
+#include "WeatherDataProvider.h"
+
+namespace {
+
+const time_t T1 = 1000000;
+const time_t T2 = T1 + 3600;
+
+// 2x2 grid over one degree with the same value everywhere.
+class UniformRecord : public GribRecord {
+public:
+  explicit UniformRecord(double value) {
+    ok = true;
+    knownData = true;
+    Ni = Nj = 2;
+    La1 = Lo1 = 0;
+    La2 = Lo2 = 1;
+    latMin = lonMin = 0;
+    latMax = lonMax = 1;
+    Di = Dj = 1;
+    data = new double[Ni * Nj];
+    for (zuint i = 0; i < Ni * Nj; i++) data[i] = value;
+  }
+};
+
+// Sets a vector field from its magnitude and mathematical angle in degrees.
+void SetVector(WR_GribRecordSet& set, int x, int y, double m, double a) {
+  set.SetUnRefGribRecord(x, new UniformRecord(m * cos(a * M_PI / 180)));
+  set.SetUnRefGribRecord(y, new UniformRecord(m * sin(a * M_PI / 180)));
+}
+
+double AngleDistance(double a, double b) {
+  double d = fabs(fmod(a - b, 360.));
+  return d > 180 ? 360 - d : d;
+}
+
+class GribTimeInterpolatorTest : public ::testing::Test {
+protected:
+  GribTimeInterpolatorTest() : m_before(42), m_after(43) {}
+
+  void SetUp() override {
+    GribTimeInterpolator::Clear();
+    m_before.m_Reference_Time = T1;
+    m_after.m_Reference_Time = T2;
+    SetVector(m_before, Idx_WIND_VX, Idx_WIND_VY, 10, 0);
+    SetVector(m_after, Idx_WIND_VX, Idx_WIND_VY, 20, 0);
+    m_before.SetUnRefGribRecord(Idx_PRESSURE, new UniformRecord(100000));
+    m_after.SetUnRefGribRecord(Idx_PRESSURE, new UniformRecord(101000));
+  }
+
+  void TearDown() override { GribTimeInterpolator::Clear(); }
+
+  WR_GribRecordSet m_before, m_after;
+};
+
+}  // namespace
+
+TEST_F(GribTimeInterpolatorTest, EndpointsReturnTheRecordSets) {
+  GribTimeInterpolator::Slab holder;
+  EXPECT_EQ(GribTimeInterpolator::GribAt(&m_before, &m_after, T1, holder),
+            &m_before);
+  EXPECT_EQ(GribTimeInterpolator::GribAt(&m_before, &m_after, T1 - 60, holder),
+            &m_before);
+  EXPECT_EQ(GribTimeInterpolator::GribAt(&m_before, &m_after, T2, holder),
+            &m_after);
+  EXPECT_EQ(GribTimeInterpolator::GribAt(&m_before, &m_after, T2 + 60, holder),
+            &m_after);
+  EXPECT_EQ(holder, nullptr);
+  EXPECT_EQ(GribTimeInterpolator::CachedSlabs(), 0u);
+}
+
+TEST_F(GribTimeInterpolatorTest, MidpointBlendsEveryField) {
+  GribTimeInterpolator::Slab holder;
+  WR_GribRecordSet* mid = GribTimeInterpolator::GribAt(
+      &m_before, &m_after, T1 + 1800, holder);
+  ASSERT_NE(mid, nullptr);
+  EXPECT_EQ(mid, holder.get());
+  EXPECT_EQ(mid->m_Reference_Time, T1 + 1800);
+
+  ASSERT_NE(mid->m_GribRecordPtrArray[Idx_PRESSURE], nullptr);
+  EXPECT_DOUBLE_EQ(mid->m_GribRecordPtrArray[Idx_PRESSURE]->getValue(0, 0),
+                   100500);
+  ASSERT_NE(mid->m_GribRecordPtrArray[Idx_WIND_VX], nullptr);
+  EXPECT_NEAR(mid->m_GribRecordPtrArray[Idx_WIND_VX]->getValue(1, 1), 15,
+              1e-9);
+  EXPECT_NEAR(mid->m_GribRecordPtrArray[Idx_WIND_VY]->getValue(1, 1), 0, 1e-9);
+
+  // the same request is served from the cache
+  GribTimeInterpolator::Slab again;
+  EXPECT_EQ(GribTimeInterpolator::GribAt(&m_before, &m_after, T1 + 1800,
+                                         again),
+            mid);
+  EXPECT_EQ(GribTimeInterpolator::CachedSlabs(), 1u);
+}
+
+TEST_F(GribTimeInterpolatorTest, BlendIsNotMistakenForTheEarlierSet) {
+  GribTimeInterpolator::Slab holder;
+  WR_GribRecordSet* mid = GribTimeInterpolator::GribAt(
+      &m_before, &m_after, T1 + 1800, holder);
+  ASSERT_NE(mid, &m_before);
+  EXPECT_TRUE(mid->m_Interpolated);
+  EXPECT_FALSE(m_before.m_Interpolated);
+  EXPECT_FALSE(m_after.m_Interpolated);
+
+  // a blend is never blended again
+  GribTimeInterpolator::Slab other;
+  EXPECT_EQ(GribTimeInterpolator::GribAt(mid, &m_after, T1 + 2700, other), mid);
+  EXPECT_EQ(other, nullptr);
+}
+
+TEST_F(GribTimeInterpolatorTest, WindDirectionWrapsAround) {
+  // 170 and -170 degrees straddle the discontinuity of atan2, the blend must
+  // turn through 180 degrees and not through 0
+  SetVector(m_before, Idx_WIND_VX, Idx_WIND_VY, 10, 170);
+  SetVector(m_after, Idx_WIND_VX, Idx_WIND_VY, 10, -170);
+
+  GribTimeInterpolator::Slab holder;
+  WR_GribRecordSet* mid = GribTimeInterpolator::GribAt(
+      &m_before, &m_after, T1 + 1800, holder);
+  EXPECT_NEAR(mid->m_GribRecordPtrArray[Idx_WIND_VX]->getValue(0, 0), -10,
+              1e-9);
+  EXPECT_NEAR(mid->m_GribRecordPtrArray[Idx_WIND_VY]->getValue(0, 0), 0, 1e-9);
+}
+
+TEST_F(GribTimeInterpolatorTest, CurrentDirectionWrapsAround) {
+  SetVector(m_before, Idx_SEACURRENT_VX, Idx_SEACURRENT_VY, 2, -160);
+  SetVector(m_after, Idx_SEACURRENT_VX, Idx_SEACURRENT_VY, 2, 160);
+
+  GribTimeInterpolator::Slab holder;
+  WR_GribRecordSet* rk = GribTimeInterpolator::GribAt(
+      &m_before, &m_after, T1 + 900, holder);
+  GribRecord* x = rk->m_GribRecordPtrArray[Idx_SEACURRENT_VX];
+  GribRecord* y = rk->m_GribRecordPtrArray[Idx_SEACURRENT_VY];
+  ASSERT_NE(x, nullptr);
+  ASSERT_NE(y, nullptr);
+  double a = atan2(y->getValue(0, 0), x->getValue(0, 0)) * 180 / M_PI;
+  EXPECT_NEAR(AngleDistance(a, -170), 0, 1e-9);
+  EXPECT_NEAR(hypot(x->getValue(0, 0), y->getValue(0, 0)), 2, 1e-9);
+}
+
+TEST_F(GribTimeInterpolatorTest, WaveDirectionWrapsAround) {
+  m_before.SetUnRefGribRecord(Idx_WVDIR, new UniformRecord(350));
+  m_after.SetUnRefGribRecord(Idx_WVDIR, new UniformRecord(10));
+
+  GribTimeInterpolator::Slab holder;
+  WR_GribRecordSet* mid = GribTimeInterpolator::GribAt(
+      &m_before, &m_after, T1 + 1800, holder);
+  ASSERT_NE(mid->m_GribRecordPtrArray[Idx_WVDIR], nullptr);
+  EXPECT_NEAR(
+      AngleDistance(mid->m_GribRecordPtrArray[Idx_WVDIR]->getValue(0, 0), 0),
+      0, 1e-9);
+}
+
+TEST_F(GribTimeInterpolatorTest, MissingBracketingRecord) {
+  GribTimeInterpolator::Slab holder;
+  EXPECT_EQ(GribTimeInterpolator::GribAt(&m_before, nullptr, T1 + 1800, holder),
+            &m_before);
+  EXPECT_EQ(holder, nullptr);
+
+  // a field missing at one end is carried over unchanged from the other
+  m_before.SetUnRefGribRecord(Idx_AIR_TEMP, new UniformRecord(20));
+  m_after.SetUnRefGribRecord(Idx_HTSIGW, new UniformRecord(3));
+  WR_GribRecordSet* mid = GribTimeInterpolator::GribAt(
+      &m_before, &m_after, T1 + 1800, holder);
+  ASSERT_NE(mid->m_GribRecordPtrArray[Idx_AIR_TEMP], nullptr);
+  EXPECT_DOUBLE_EQ(mid->m_GribRecordPtrArray[Idx_AIR_TEMP]->getValue(0, 0),
+                   20);
+  ASSERT_NE(mid->m_GribRecordPtrArray[Idx_HTSIGW], nullptr);
+  EXPECT_DOUBLE_EQ(mid->m_GribRecordPtrArray[Idx_HTSIGW]->getValue(0, 0), 3);
+  EXPECT_EQ(mid->m_GribRecordPtrArray[Idx_CAPE], nullptr);
+}
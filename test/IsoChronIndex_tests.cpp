@@ -0,0 +1,110 @@
+/***************************************************************************
+ *   Copyright (C) 2024 by OpenCPN development team                        *
+ *                                                                         *
+ *   This program is free software; you can redistribute it and/or modify  *
+ *   it under the terms of the GNU General Public License as published by  *
+ *   the Free Software Foundation; either version 2 of the License, or     *
+ *   (at your option) any later version.                                   *
+ *                                                                         *
+ *   This program is distributed in the hope that it will be useful,       *
+ *   but WITHOUT ANY WARRANTY; without even the implied warranty of        *
+ *   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the         *
+ *   GNU General Public License for more details.                          *
+ *                                                                         *
+ *   You should have received a copy of the GNU General Public License     *
+ *   along with this program; if not, write to the                         *
+ *   Free Software Foundation, Inc.,                                       *
+ *   59 Temple Place - Suite 330, Boston, MA  02111-1307, USA.             *
+ **************************************************************************/
+
+
+#include <gtest/gtest.h>
+#include <cmath>
+#include <vector>
+#include "IsoChronIndex.h"
+#include "Position.h"
+
+namespace {
+
+// Builds a closed route of count positions on a circle.
+IsoRoute* CircleRoute(double lat, double lon, double radius, int count,
+                      int direction = 1) {
+  std::vector<Position*> positions;
+  for (int i = 0; i < count; ++i) {
+    double angle = 2 * M_PI * i / count;
+    positions.push_back(new Position(lat + radius * sin(angle),
+                                     lon + radius * cos(angle)));
+  }
+  for (int i = 0; i < count; ++i) {
+    positions[i]->prev = positions[(i + count - 1) % count];
+    positions[i]->next = positions[(i + 1) % count];
+  }
+  return new IsoRoute(positions[0]->BuildSkipList(), direction);
+}
+
+class IsoChronIndexTest : public ::testing::Test {
+protected:
+  void SetUp() override {
+    // an island inside the first route, and a second separate route
+    m_route = CircleRoute(0, 0, 2, 200);
+    IsoRoute* child = CircleRoute(0, 0, 0.5, 50, -1);
+    child->parent = m_route;
+    m_route->children.push_back(child);
+    m_routes.push_back(m_route);
+    m_routes.push_back(CircleRoute(0, 5, 1, 100));
+  }
+
+  void TearDown() override {
+    for (IsoRoute* route : m_routes) delete route;
+  }
+
+  IsoRoute* m_route;
+  IsoRouteList m_routes;
+};
+
+}  // namespace
+
+TEST_F(IsoChronIndexTest, ContainsMatchesRoutes) {
+  IsoChronIndex index(m_routes);
+  EXPECT_TRUE(index.Contains(1.5, 0));
+  EXPECT_FALSE(index.Contains(0, 0));  // inside the island
+  EXPECT_TRUE(index.Contains(0, 5));
+  EXPECT_FALSE(index.Contains(0, 3.5));
+  EXPECT_FALSE(index.Contains(10, 10));
+
+  for (double lat = -3; lat <= 3; lat += 0.37)
+    for (double lon = -3; lon <= 7; lon += 0.41) {
+      Position p(lat, lon);
+      bool contains = false;
+      for (IsoRoute* route : m_routes)
+        if (route->Contains(p, true) == 1) contains = true;
+      EXPECT_EQ(index.Contains(lat, lon), contains) << lat << " " << lon;
+    }
+}
+
+TEST_F(IsoChronIndexTest, ClosestPositionMatchesRoutes) {
+  IsoChronIndex index(m_routes);
+  for (double lat = -3; lat <= 3; lat += 0.53)
+    for (double lon = -3; lon <= 7; lon += 0.47) {
+      double mindist = INFINITY;
+      for (IsoRoute* route : m_routes) {
+        double dist;
+        route->ClosestPosition(lat, lon, &dist);
+        mindist = std::min(mindist, dist);
+      }
+      double dist;
+      Position* closest = index.ClosestPosition(lat, lon, &dist);
+      ASSERT_TRUE(closest != nullptr);
+      EXPECT_DOUBLE_EQ(dist, mindist);
+      double dlat = closest->lat - lat, dlon = closest->lon - lon;
+      EXPECT_DOUBLE_EQ(dlat * dlat + dlon * dlon, dist);
+    }
+}
+
+TEST(IsoChronIndexEmptyTest, NoRoutes) {
+  IsoChronIndex index{IsoRouteList()};
+  double dist;
+  EXPECT_FALSE(index.Contains(0, 0));
+  EXPECT_EQ(index.ClosestPosition(0, 0, &dist), nullptr);
+  EXPECT_TRUE(std::isinf(dist));
+}
@@ -2,7 +2,14 @@
 #include <gmock/gmock.h>
 #include <IsoRoute.h>
 #include "PlugIn_Waypoint_mock.h"
+#include <atomic>
+#include <cmath>
+#include <random>
+#include <set>
 #include <string>
+#include <unordered_set>
+#include <vector>
+#include "IsoChronIndex.h"
 #include "Position.h"
 #include "RouteMap.h"
  class IsoRouteTest: public ::testing::Test {
@@ -168,6 +175,213 @@
   EXPECT_TRUE(isoRouteList.size() >= 1); // Should have at least one route in the list
  }
 
+ // Builds a closed route of count positions on a circle.
+ static IsoRoute* CircleRoute(double lat, double lon, double radius, int count) {
+  std::vector<Position*> positions;
+  for (int i = 0; i < count; ++i) {
+    double angle = 2 * M_PI * i / count;
+    positions.push_back(new Position(lat + radius * sin(angle),
+                                     lon + radius * cos(angle)));
+  }
+  for (int i = 0; i < count; ++i) {
+    positions[i]->prev = positions[(i + count - 1) % count];
+    positions[i]->next = positions[(i + 1) % count];
+  }
+  return new IsoRoute(positions[0]->BuildSkipList(), 1);
+ }
+
+ TEST_F(IsoRouteTest, NormalizeWithoutIntersections) {
+  // A simple route has no segments to flip and is returned as is.
+  IsoRouteList isoRouteList;
+  IsoRoute* route = CircleRoute(0, 0, 1, 100);
+  EXPECT_TRUE(Normalize(isoRouteList, route, route, 0, false));
+  ASSERT_EQ(isoRouteList.size(), 1u);
+  EXPECT_EQ(isoRouteList.front()->Count(), 100);
+
+  // Routes with no segments near each other are not merged and left intact.
+  IsoRouteList mergeList;
+  IsoRoute* outer = CircleRoute(0, 0, 2, 100);
+  IsoRoute* inner = CircleRoute(0.5, 0, 0.5, 50);
+  EXPECT_FALSE(Normalize(mergeList, outer, inner, 0, false));
+  EXPECT_TRUE(mergeList.empty());
+  EXPECT_EQ(outer->Count(), 100);
+  EXPECT_EQ(inner->Count(), 50);
+ }
+
+ TEST_F(IsoRouteTest, ReduceClosePointsDecimates) {
+  IsoRoute* route = CircleRoute(0, 0, 1, 1000);
+  int skipCount = route->SkipCount();
+  // Points on a fine circle are nearly in line with their neighbors.
+  route->ReduceClosePoints(0.01);
+  int count = route->Count();
+  EXPECT_LT(count, 1000);
+  EXPECT_GT(count, 8);
+  EXPECT_EQ(route->SkipCount(), skipCount);
+
+  route->ReduceClosePoints(0, 50);
+  EXPECT_LE(route->Count(), 50);
+  EXPECT_EQ(route->SkipCount(), skipCount);
+  // The remaining points still describe the circle.
+  Position center(0, 0), outside(1.1, 0);
+  EXPECT_EQ(route->Contains(center, false), 1);
+  EXPECT_EQ(route->Contains(outside, false), 0);
+  delete route;
+ }
+
+ typedef std::set<std::pair<Position*, int>> SkipEntries;
+
+ // skip positions as (position, quadrant) pairs, wherever the list starts
+ static SkipEntries GetSkipEntries(SkipPosition* skippoints) {
+  SkipEntries entries;
+  SkipPosition* s = skippoints;
+  do {
+    entries.insert(std::make_pair(s->point, s->quadrant));
+    s = s->next;
+  } while (s != skippoints);
+  return entries;
+ }
+
+ // the skip list BuildSkipList() gives for the positions of the route
+ static SkipEntries RebuiltSkipEntries(IsoRoute* route) {
+  SkipPosition* rebuilt = route->skippoints->point->BuildSkipList();
+  SkipEntries entries = GetSkipEntries(rebuilt);
+  SkipPosition* s = rebuilt;
+  do {
+    SkipPosition* next = s->next;
+    delete s;
+    s = next;
+  } while (s != rebuilt);
+  return entries;
+ }
+
+ TEST_F(IsoRouteTest, DecimationSkipListMatchesRebuild) {
+  // a jagged route, with near duplicates at some of its turns
+  const int count = 600;
+  std::mt19937 rng(40);
+  std::uniform_real_distribution<double> noise(-0.01, 0.01);
+  std::vector<Position*> positions;
+  for (int i = 0; i < count; ++i) {
+    double angle = 2 * M_PI * i / count;
+    double radius = 1 + 0.05 * sin(7 * angle) + noise(rng);
+    positions.push_back(new Position(radius * sin(angle), radius * cos(angle)));
+    if (i % 10 == 5)
+      positions.push_back(new Position(positions.back()->lat + 1e-6,
+                                       positions.back()->lon - 1e-6));
+  }
+  int n = positions.size();
+  for (int i = 0; i < n; ++i) {
+    positions[i]->prev = positions[(i + n - 1) % n];
+    positions[i]->next = positions[(i + 1) % n];
+  }
+  IsoRoute* route = new IsoRoute(positions[0]->BuildSkipList(), 1);
+
+  for (double resolution : {0.005, 0.02}) {
+    route->ReduceClosePoints(resolution);
+    EXPECT_EQ(GetSkipEntries(route->skippoints), RebuiltSkipEntries(route));
+  }
+  route->ReduceClosePoints(0, 100);
+  EXPECT_LE(route->Count(), 100);
+  EXPECT_EQ(GetSkipEntries(route->skippoints), RebuiltSkipEntries(route));
+  delete route;
+ }
+
+ // closed route through the given (lat, lon) positions
+ typedef std::vector<std::pair<double, double>> Corners;
+ static IsoRoute* PolygonRoute(const Corners& corners) {
+  std::vector<Position*> positions;
+  for (auto& c : corners) positions.push_back(new Position(c.first, c.second));
+  int n = positions.size();
+  for (int i = 0; i < n; ++i) {
+    positions[i]->prev = positions[(i + n - 1) % n];
+    positions[i]->next = positions[(i + 1) % n];
+  }
+  return new IsoRoute(positions[0]->BuildSkipList(), 1);
+ }
+
+ TEST_F(IsoRouteTest, DecimationWithFewRuns) {
+  // Near duplicates at the corners merge runs, down to fewer than four so the
+  // skip list is built again, and the first position stops starting a run.
+  IsoRoute* route = PolygonRoute({{0.9, 0.4}, {0.900008, 0.400001},
+                                  {0.900014, 0.399994}, {1.3, -0.7},
+                                  {-0.4, -1.0}, {-0.7, 1.0},
+                                  {-0.700006, 1.000013},
+                                  {-0.699996, 0.999998}});
+  EXPECT_EQ(route->SkipCount(), 5);
+  route->ReduceClosePoints(0, 4);
+  EXPECT_EQ(route->Count(), 4);
+  EXPECT_EQ(GetSkipEntries(route->skippoints), RebuiltSkipEntries(route));
+  delete route;
+
+  // The first position no longer starts a run and is decimated.
+  route = PolygonRoute({{0.7, 1.0}, {0.700006, 1.000005}, {0.9, -1.1},
+                        {-1.1, -0.7}, {-0.6, 1.2}});
+  EXPECT_EQ(route->SkipCount(), 5);
+  route->ReduceClosePoints(0, 3);
+  EXPECT_EQ(route->Count(), 3);
+  EXPECT_EQ(GetSkipEntries(route->skippoints), RebuiltSkipEntries(route));
+  delete route;
+ }
+
+ TEST_F(IsoRouteTest, KeepPositionsKeepsOnlyGivenPositions) {
+  IsoRouteList routes;
+  routes.push_back(CircleRoute(0, 0, 1, 100));
+  routes.push_back(CircleRoute(5, 5, 1, 50));
+  std::unordered_set<Position*> keep;
+  keep.insert(routes.front()->skippoints->point->next);
+  keep.insert(routes.back()->skippoints->point);
+
+  Shared_GribRecordSet grib;
+  IsoChron isochron(routes, wxDateTime::Now(), 3600, grib, false);
+  isochron.KeepPositions(keep);
+  EXPECT_TRUE(isochron.IsFrozen());
+  ASSERT_EQ(isochron.routes.size(), 1u);
+  EXPECT_EQ(isochron.routes.front()->Count(), 2);
+  for (Position* p : keep)
+    EXPECT_EQ(isochron.ClosestPosition(p->lat, p->lon), p);
+
+  isochron.ReleaseGrib();
+  EXPECT_EQ(isochron.m_Grib, nullptr);
+ }
+
+ TEST_F(IsoRouteTest, IsoChronMemoryUsage) {
+  IsoRouteList routes;
+  routes.push_back(CircleRoute(0, 0, 1, 100));
+  Shared_GribRecordSet grib;
+  IsoChron isochron(routes, wxDateTime::Now(), 3600, grib, false);
+
+  RouteMapMemory memory;
+  isochron.GetMemoryUsage(memory);
+  EXPECT_EQ(memory.positions, 100 * sizeof(Position));
+  EXPECT_EQ(memory.grib, 0u);
+
+  // freezing releases nothing, nor does it build an index
+  std::atomic<size_t> index_memory(0);
+  isochron.SetIndexMemory(&index_memory);
+  RouteMapMemory frozen;
+  isochron.Freeze();
+  EXPECT_TRUE(isochron.Contains(0, 0));
+  isochron.GetMemoryUsage(frozen);
+  EXPECT_EQ(frozen.Total(), memory.Total());
+  EXPECT_EQ(index_memory, 0u);
+
+  // the index is built once the isochrone is queried often, and counted
+  // wherever it is queried from
+  for (int i = 0; i < IsoChronIndex::MIN_QUERIES; i++)
+    EXPECT_FALSE(isochron.Contains(2, 2));
+  EXPECT_GT(index_memory, 0u);
+
+  // moving the isochrone to another counter moves its index
+  std::atomic<size_t> other(0);
+  size_t bytes = index_memory;
+  isochron.SetIndexMemory(&other);
+  EXPECT_EQ(index_memory, 0u);
+  EXPECT_EQ(other, bytes);
+
+  // and deleting the index takes it out
+  isochron.KeepPositions(std::unordered_set<Position*>());
+  EXPECT_EQ(other, 0u);
+ }
+
  TEST_F(IsoRouteTest, SkipCountBasic) {
   // Check that the skip count is correct for the route.
   EXPECT_EQ(m_isoRoute->SkipCount(), m_positionCount);
@@ -0,0 +1,52 @@
+/***************************************************************************
+ *   Copyright (C) 2024 by OpenCPN development team                        *
+ *                                                                         *
+ *   This program is free software; you can redistribute it and/or modify  *
+ *   it under the terms of the GNU General Public License as published by  *
+ *   the Free Software Foundation; either version 2 of the License, or     *
+ *   (at your option) any later version.                                   *
+ *                                                                         *
+ *   This program is distributed in the hope that it will be useful,       *
+ *   but WITHOUT ANY WARRANTY; without even the implied warranty of        *
+ *   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the         *
+ *   GNU General Public License for more details.                          *
+ *                                                                         *
+ *   You should have received a copy of the GNU General Public License     *
+ *   along with this program; if not, write to the                         *
+ *   Free Software Foundation, Inc.,                                       *
+ *   59 Temple Place - Suite 330, Boston, MA  02111-1307, USA.             *
+ **************************************************************************/
+
+#include <gtest/gtest.h>
+#include "MemoryGovernor.h"
+
+TEST(MemoryGovernorTest, ThrottlesThenSheds) {
+  MemoryGovernor governor;
+  EXPECT_EQ(governor.Update(0.5), MemoryGovernor::NORMAL);
+  EXPECT_TRUE(governor.CanStart());
+  EXPECT_EQ(governor.Update(0.95), MemoryGovernor::THROTTLED);
+  EXPECT_FALSE(governor.CanStart());
+  EXPECT_EQ(governor.Update(1.2), MemoryGovernor::SHEDDING);
+  EXPECT_FALSE(governor.CanStart());
+}
+
+TEST(MemoryGovernorTest, ResumesWithHysteresis) {
+  MemoryGovernor governor;
+  governor.Update(1.5);
+  // keeps shedding until under the throttle load
+  EXPECT_EQ(governor.Update(0.95), MemoryGovernor::SHEDDING);
+  EXPECT_EQ(governor.Update(0.8), MemoryGovernor::THROTTLED);
+  // between the resume and throttle loads the state is kept
+  EXPECT_EQ(governor.Update(0.85), MemoryGovernor::THROTTLED);
+  EXPECT_EQ(governor.Update(0.5), MemoryGovernor::NORMAL);
+  EXPECT_EQ(governor.Update(0.85), MemoryGovernor::NORMAL);
+}
+
+TEST(MemoryGovernorTest, Budget) {
+  MemoryGovernor::SetBudget(100);
+  EXPECT_EQ(MemoryGovernor::GetBudget(), 100);
+  EXPECT_EQ(MemoryGovernor::GetBudgetBytes(), 100u * 1024 * 1024);
+  MemoryGovernor::SetBudget(-1);
+  EXPECT_EQ(MemoryGovernor::GetBudgetBytes(), 0u);
+  MemoryGovernor::SetBudget(MemoryGovernor::DEFAULT_BUDGET);
+}
@@ -0,0 +1,324 @@
+/***************************************************************************
+ *   Copyright (C) 2024 by OpenCPN development team                        *
+ *                                                                         *
+ *   This program is free software; you can redistribute it and/or modify  *
+ *   it under the terms of the GNU General Public License as published by  *
+ *   the Free Software Foundation; either version 2 of the License, or     *
+ *   (at your option) any later version.                                   *
+ *                                                                         *
+ *   This program is distributed in the hope that it will be useful,       *
+ *   but WITHOUT ANY WARRANTY; without even the implied warranty of        *
+ *   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the         *
+ *   GNU General Public License for more details.                          *
+ *                                                                         *
+ *   You should have received a copy of the GNU General Public License     *
+ *   along with this program; if not, write to the                         *
+ *   59 Temple Place - Suite 330, Boston, MA  02111-1307, USA.             *
+ **************************************************************************/
+
+#include <gtest/gtest.h>
+#include <wx/file.h>
+#include <wx/filename.h>
+
+#include <cmath>
+#include <list>
+#include <vector>
+
+#include "GribRecord.h"
+#include "Position.h"
+#include "RouteMap.h"
+#include "RouteMapSnapshot.h"
+
+namespace {
+
+// Builds a closed route of count positions on a circle, all coming from
+// parent.
+IsoRoute* CircleRoute(double radius, int count, Position* parent, int dir) {
+  std::vector<Position*> positions;
+  for (int i = 0; i < count; ++i) {
+    double angle = 2 * M_PI * i / count;
+    positions.push_back(new Position(radius * sin(angle),
+                                     radius * cos(angle), parent, 45, 90, 1,
+                                     i, 0, 0, DataMask::GRIB_WIND));
+  }
+  for (int i = 0; i < count; ++i) {
+    positions[i]->prev = positions[(i + count - 1) % count];
+    positions[i]->next = positions[(i + 1) % count];
+  }
+  return new IsoRoute(positions[0]->BuildSkipList(), dir);
+}
+
+// 4 x 4 grid with a step of 1 degree and value i + 10 * j + offset.
+class SmallRecord : public GribRecord {
+public:
+  SmallRecord(double offset) {
+    ok = true;
+    knownData = true;
+    Ni = Nj = 4;
+    La1 = Lo1 = latMin = lonMin = 0;
+    Di = Dj = 1;
+    La2 = Lo2 = latMax = lonMax = 3;
+    refDate = curDate = 1710050400;
+    data = new double[Ni * Nj];
+    for (zuint j = 0; j < Nj; j++)
+      for (zuint i = 0; i < Ni; i++) data[j * Ni + i] = i + 10. * j + offset;
+  }
+};
+
+class RouteMapSnapshotTest : public ::testing::Test {
+protected:
+  void SetUp() override {
+    m_path = wxFileName::CreateTempFileName("wrsnapshot");
+
+    Shared_GribRecordSet grib;
+    m_start = new Position(0, 0);
+    m_start->prev = m_start->next = m_start;
+    IsoRouteList routes;
+    routes.push_back(new IsoRoute(m_start->BuildSkipList()));
+    m_origin.push_back(new IsoChron(routes, m_time, 3600, grib, false));
+
+    IsoRoute* outer = CircleRoute(2, 16, m_start, 1);
+    IsoRoute* inner = CircleRoute(1, 8, m_start, -1);
+    inner->parent = outer;
+    outer->children.push_back(inner);
+    routes.clear();
+    routes.push_back(outer);
+    m_origin.push_back(new IsoChron(routes, m_time + wxTimeSpan::Hour(),
+                                    1800, grib, true));
+
+    m_destination = new Position(3, 3, outer->skippoints->point);
+
+    PlotData data;
+    data.lat = 1, data.lon = 2;
+    data.time = m_time;
+    data.sog = 6.5;
+    data.twsOverGround = 15;
+    data.polar = 1;
+    data.tacks = 2;
+    data.data_mask = DataMask::GRIB_WIND | DataMask::NIGHT_TIME;
+    m_plotdata.push_back(data);
+    data.lat = 3;
+    m_plotdata.push_back(data);
+  }
+
+  void TearDown() override {
+    for (IsoChron* isochron : m_origin) delete isochron;
+    delete m_destination;
+    wxRemoveFile(m_path);
+  }
+
+  wxString m_path;
+  wxDateTime m_time = wxDateTime(10, wxDateTime::Mar, 2024, 6);
+  Position* m_start;
+  Position* m_destination;
+  IsoChronList m_origin;
+  std::list<PlotData> m_plotdata;
+};
+
+void DeleteContents(RouteMapSnapshot::Contents& contents) {
+  for (IsoChron* isochron : contents.origin) delete isochron;
+  delete contents.destination;
+}
+
+}  // namespace
+
+TEST_F(RouteMapSnapshotTest, RoundTrip) {
+  wxDateTime end = m_time + wxTimeSpan::Hours(2);
+  ASSERT_TRUE(RouteMapSnapshot::Write(m_path, 42, m_origin, m_destination,
+                                      true, end, m_plotdata));
+
+  RouteMapSnapshot::Contents contents;
+  ASSERT_TRUE(RouteMapSnapshot::Read(m_path, 42, contents));
+  ASSERT_EQ(contents.origin.size(), 2u);
+  EXPECT_TRUE(contents.reached_destination);
+  EXPECT_EQ(contents.end_time, end);
+
+  IsoChron* first = contents.origin.front();
+  IsoChron* second = contents.origin.back();
+  EXPECT_EQ(first->time, m_time);
+  EXPECT_EQ(second->time, m_time + wxTimeSpan::Hour());
+  EXPECT_DOUBLE_EQ(second->delta, 1800);
+  EXPECT_TRUE(second->m_Grib_is_data_deficient);
+  EXPECT_TRUE(second->IsFrozen());
+  EXPECT_EQ(second->m_Grib, nullptr);
+
+  // no grib record set was used
+  ASSERT_EQ(contents.gribs.size(), 2u);
+  EXPECT_EQ(contents.gribs.front().reference_time, -1);
+
+  ASSERT_EQ(second->routes.size(), 1u);
+  IsoRoute* outer = second->routes.front();
+  EXPECT_EQ(outer->Count(), 16);
+  ASSERT_EQ(outer->children.size(), 1u);
+  EXPECT_EQ(outer->children.front()->Count(), 8);
+  EXPECT_EQ(outer->children.front()->direction, -1);
+  EXPECT_EQ(outer->children.front()->parent, outer);
+
+  // the parents are restored across isochrones
+  Position* start = first->routes.front()->skippoints->point;
+  Position* p = outer->skippoints->point;
+  do {
+    EXPECT_EQ(p->parent, start);
+    EXPECT_DOUBLE_EQ(p->parent_heading, 45);
+    EXPECT_EQ(p->polar, 1);
+    EXPECT_EQ(p->data_mask, DataMask::GRIB_WIND);
+    p = p->next;
+  } while (p != outer->skippoints->point);
+
+  ASSERT_NE(contents.destination, nullptr);
+  EXPECT_DOUBLE_EQ(contents.destination->lat, 3);
+  ASSERT_NE(contents.destination->parent, nullptr);
+  EXPECT_EQ(contents.destination->parent->parent, start);
+
+  ASSERT_EQ(contents.plotdata.size(), 2u);
+  EXPECT_DOUBLE_EQ(contents.plotdata.front().lat, 1);
+  EXPECT_DOUBLE_EQ(contents.plotdata.back().lat, 3);
+  EXPECT_DOUBLE_EQ(contents.plotdata.front().sog, 6.5);
+  EXPECT_DOUBLE_EQ(contents.plotdata.front().twsOverGround, 15);
+  EXPECT_EQ(contents.plotdata.front().tacks, 2);
+  EXPECT_EQ(contents.plotdata.front().time, m_time);
+  EXPECT_TRUE(contents.plotdata.front().data_mask & DataMask::NIGHT_TIME);
+
+  DeleteContents(contents);
+}
+
+TEST_F(RouteMapSnapshotTest, RejectsOtherConfigurationsAndCorruptFiles) {
+  ASSERT_TRUE(RouteMapSnapshot::Write(m_path, 42, m_origin, nullptr, false,
+                                      wxDateTime(), m_plotdata));
+
+  RouteMapSnapshot::Contents contents;
+  EXPECT_FALSE(RouteMapSnapshot::Read(m_path, 43, contents));
+  EXPECT_FALSE(RouteMapSnapshot::Read(m_path + "missing", 42, contents));
+
+  ASSERT_TRUE(RouteMapSnapshot::Read(m_path, 42, contents));
+  EXPECT_EQ(contents.destination, nullptr);
+  EXPECT_FALSE(contents.reached_destination);
+  EXPECT_FALSE(contents.end_time.IsValid());
+  DeleteContents(contents);
+
+  // truncated in the middle of the positions
+  wxFile file(m_path, wxFile::read_write);
+  ASSERT_TRUE(file.IsOpened());
+  std::vector<char> data(file.Length());
+  file.Read(&data[0], data.size());
+  file.Close();
+  file.Create(m_path, true);
+  file.Write(&data[0], data.size() / 2);
+  file.Close();
+  EXPECT_FALSE(RouteMapSnapshot::Read(m_path, 42, contents));
+  EXPECT_TRUE(contents.origin.empty());
+}
+
+TEST_F(RouteMapSnapshotTest, WriteInBackground) {
+  std::vector<char> data;
+  RouteMapSnapshot::Serialize(42, m_origin, m_destination, true, wxDateTime(),
+                              m_plotdata, data);
+  ASSERT_FALSE(data.empty());
+  RouteMapSnapshot::WriteInBackground(m_path, data);
+  EXPECT_TRUE(data.empty());
+
+  // queued or written, the snapshot reads back
+  RouteMapSnapshot::Contents contents;
+  ASSERT_TRUE(RouteMapSnapshot::Read(m_path, 42, contents));
+  EXPECT_EQ(contents.origin.size(), 2u);
+  DeleteContents(contents);
+
+  RouteMapSnapshot::Flush();
+  ASSERT_TRUE(RouteMapSnapshot::Read(m_path, 42, contents));
+  EXPECT_NE(contents.destination, nullptr);
+  DeleteContents(contents);
+}
+
+TEST(RouteMapSnapshotHashTest, ConfigurationHash) {
+  RouteMapConfiguration c1;
+  RouteMapConfiguration c2 = c1;
+  EXPECT_EQ(RouteMapSnapshot::ConfigurationHash(c1),
+            RouteMapSnapshot::ConfigurationHash(c2));
+
+  // retention is applied after the snapshot is written
+  c2.Retention = RouteMapConfiguration::RETAIN_BEST_ROUTE;
+  EXPECT_EQ(RouteMapSnapshot::ConfigurationHash(c1),
+            RouteMapSnapshot::ConfigurationHash(c2));
+
+  c2.DeltaTime = c1.DeltaTime + 60;
+  EXPECT_NE(RouteMapSnapshot::ConfigurationHash(c1),
+            RouteMapSnapshot::ConfigurationHash(c2));
+
+  c2 = c1;
+  c2.boatFileName = "other.xml";
+  EXPECT_NE(RouteMapSnapshot::ConfigurationHash(c1),
+            RouteMapSnapshot::ConfigurationHash(c2));
+}
+
+TEST(RouteMapSnapshotHashTest, ResultKey) {
+  wxString boat = wxFileName::CreateTempFileName("wrboat");
+  wxFile file(boat, wxFile::write);
+  file.Write("<Boat/>");
+  file.Close();
+
+  RouteMapConfiguration c;
+  c.UseGrib = false;
+  c.boatFileName = boat;
+  wxUint64 boat_hash = RouteMapSnapshot::FileHash(boat);
+  EXPECT_NE(boat_hash, 0u);
+  EXPECT_EQ(RouteMapSnapshot::FileHash(boat), boat_hash);
+  EXPECT_EQ(RouteMapSnapshot::FileHash(boat + "missing"), 0u);
+
+  RouteMapSnapshot::GribProvenance forecast = {1710050400, 7};
+  RouteMapSnapshot::GribProvenance other = {1710050400, 8};
+  RouteMapSnapshot::Environment environment;
+  wxUint64 key = RouteMapSnapshot::ResultKey(c, forecast, environment);
+  // the forecast is ignored without GRIB data
+  EXPECT_EQ(RouteMapSnapshot::ResultKey(c, other, environment), key);
+
+  c.UseGrib = true;
+  wxUint64 grib_key = RouteMapSnapshot::ResultKey(c, forecast, environment);
+  EXPECT_NE(grib_key, key);
+  EXPECT_NE(RouteMapSnapshot::ResultKey(c, other, environment), grib_key);
+
+  // coastline data and climatology are part of the key
+  RouteMapSnapshot::Environment land = environment;
+  land.coastline = "/gshhs/poly-f-1.dat 2024-03-10 06:00:00";
+  EXPECT_NE(RouteMapSnapshot::ResultKey(c, forecast, land), grib_key);
+  RouteMapSnapshot::Environment climatology = environment;
+  climatology.climatology.push_back(1);
+  EXPECT_NE(RouteMapSnapshot::ResultKey(c, forecast, climatology), grib_key);
+  climatology.climatology[0] = 0.5;
+  EXPECT_NE(RouteMapSnapshot::ResultKey(c, forecast, climatology), grib_key);
+
+  // the boat was edited under the same name
+  file.Create(boat, true);
+  file.Write("<Boat Name=\"edited\"/>");
+  file.Close();
+  EXPECT_NE(RouteMapSnapshot::FileHash(boat), boat_hash);
+  EXPECT_NE(RouteMapSnapshot::ResultKey(c, forecast, environment), grib_key);
+
+  wxRemoveFile(boat);
+}
+
+TEST(RouteMapSnapshotHashTest, GribFingerprint) {
+  GribRecord* records[Idx_COUNT] = {};
+  SmallRecord wind(0), changed(0.5);
+  wxUint64 empty = RouteMapSnapshot::GribFingerprint(1710050400, records);
+
+  records[Idx_WIND_VX] = &wind;
+  wxUint64 fingerprint =
+      RouteMapSnapshot::GribFingerprint(1710050400, records);
+  EXPECT_NE(fingerprint, empty);
+  EXPECT_EQ(RouteMapSnapshot::GribFingerprint(1710050400, records),
+            fingerprint);
+  // another reference time
+  EXPECT_NE(RouteMapSnapshot::GribFingerprint(1710072000, records),
+            fingerprint);
+
+  // same header, other values: a GRIB file replaced under the same name
+  records[Idx_WIND_VX] = &changed;
+  EXPECT_NE(RouteMapSnapshot::GribFingerprint(1710050400, records),
+            fingerprint);
+
+  // same record for another parameter
+  records[Idx_WIND_VX] = NULL;
+  records[Idx_WIND_VY] = &wind;
+  EXPECT_NE(RouteMapSnapshot::GribFingerprint(1710050400, records),
+            fingerprint);
+}
@@ -18,6 +18,8 @@
  **************************************************************************/
 
  #include <gtest/gtest.h>
+ #include <wx/ffile.h>
+ #include <wx/filename.h>
  #include <Utilities.h>
 
   TEST(UtilitiesTests, deg2radBasic) {
@@ -196,4 +198,22 @@ TEST(UtilitiesTests, CalculateTimeDeltaBasic) {
      EXPECT_EQ(calculateTimeDelta(dt1, dt2).ToStdString(), "01 01");
      dt2.Add(wxTimeSpan(1, 0, 0, 0));
      EXPECT_EQ(calculateTimeDelta(dt1, dt2).ToStdString(), "01:01");
-}
\ No newline at end of file
+}
+
+TEST(UtilitiesTests, ReplaceFileBasic) {
+    wxString path = wxFileName::CreateTempFileName("wrreplace");
+    wxString temp = path + ".tmp";
+    wxFFile(path, "w").Write("old");
+    wxFFile(temp, "w").Write("new");
+
+    EXPECT_TRUE(replace_file(temp, path));
+    EXPECT_FALSE(wxFileExists(temp));
+    wxString contents;
+    wxFFile(path).ReadAll(&contents);
+    EXPECT_EQ(contents, "new");
+
+    // nothing to move
+    EXPECT_FALSE(replace_file(temp, path));
+    EXPECT_TRUE(wxFileExists(path));
+    wxRemoveFile(path);
+}
@@ -0,0 +1,146 @@
+/***************************************************************************
+ *   Copyright (C) 2024 by OpenCPN development team                        *
+ *                                                                         *
+ *   This program is free software; you can redistribute it and/or modify  *
+ *   it under the terms of the GNU General Public License as published by  *
+ *   the Free Software Foundation; either version 2 of the License, or     *
+ *   (at your option) any later version.                                   *
+ *                                                                         *
+ *   This program is distributed in the hope that it will be useful,       *
+ *   but WITHOUT ANY WARRANTY; without even the implied warranty of        *
+ *   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the         *
+ *   GNU General Public License for more details.                          *
+ *                                                                         *
+ *   You should have received a copy of the GNU General Public License     *
+ *   along with this program; if not, write to the                         *
+ *   Free Software Foundation, Inc.,                                       *
+ *   59 Temple Place - Suite 330, Boston, MA  02111-1307, USA.             *
+ **************************************************************************/
+
+#include <gtest/gtest.h>
+#include <json/json.h>
+
+#include <cmath>
+
+#include "mock_plugin_api.h"
+#include "RouteMap.h"
+#include "WeatherDataProvider.h"
+
+extern Json::Value g_ReceivedJSONMsg;
+extern wxString g_ReceivedMessage;
+
+namespace {
+
+// Value the fake GRIB plugin replies for a field at a position.
+double FakeValue(const std::string& key, double lat, double lon) {
+  if (key == "PRESSURE") return 1000 + lat * 10 + lon;
+  if (key == "CLOUD") return lat + 2 * lon;
+  return 15 + lat;  // AIR TEMP
+}
+
+class WeatherDataProviderTest : public ::testing::Test {
+protected:
+  void SetUp() override {
+    m_requests = 0;
+    m_reply = true;
+    SetPluginMessageHandler([this](const wxString& id, const wxString& body) {
+      if (id != "GRIB_VALUES_REQUEST") return;
+      m_requests++;
+      if (!m_reply) return;
+      Json::Value request, reply;
+      Json::Reader().parse(body.ToStdString(), request);
+      reply["Type"] = "Reply";
+      double lat = request["lat"].asDouble(), lon = request["lon"].asDouble();
+      for (const char* key : {"PRESSURE", "CLOUD", "AIR TEMP"})
+        if (request.isMember(key)) reply[key] = FakeValue(key, lat, lon);
+      g_ReceivedJSONMsg = reply;
+      g_ReceivedMessage = Json::FastWriter().write(reply);
+    });
+
+    m_configuration.time = wxDateTime(1, wxDateTime::Jan, 2024, 12);
+    m_configuration.RouteGUID = "route";
+    m_configuration.UseGrib = true;
+    m_configuration.grib = nullptr;
+    WeatherDataProvider::ClearGribValues();
+  }
+
+  void TearDown() override {
+    SetPluginMessageHandler(nullptr);
+    WeatherDataProvider::ClearGribValues();
+  }
+
+  double Get(const wxString& key, int idx, double lat, double lon) {
+    return WeatherDataProvider::GetWeatherParameter(m_configuration, lat, lon,
+                                                    key, idx);
+  }
+
+  GribValuePoint Point(double lat, double lon) {
+    GribValuePoint point;
+    point.time = m_configuration.time;
+    point.lat = lat, point.lon = lon;
+    return point;
+  }
+
+  int m_requests;
+  bool m_reply;
+  RouteMapConfiguration m_configuration;
+};
+
+}  // namespace
+
+TEST_F(WeatherDataProviderTest, PrefetchedValuesMatchSingleRequests) {
+  double pressure = Get("PRESSURE", Idx_PRESSURE, 12.5, -30.25);
+  double cloud = Get("CLOUD", Idx_CLOUD_TOT, 12.5, -30.25);
+  double temp = Get("AIR TEMP", Idx_AIR_TEMP, 12.5, -30.25);
+  EXPECT_EQ(m_requests, 3);
+  EXPECT_DOUBLE_EQ(pressure, FakeValue("PRESSURE", 12.5, -30.25));
+
+  WeatherDataProvider::ClearGribValues();
+  m_requests = 0;
+  EXPECT_TRUE(WeatherDataProvider::RequestGribValues(
+      Point(12.5, -30.25), WeatherDataProvider::GRIB_VALUE_ALL));
+  EXPECT_EQ(m_requests, 1);
+
+  EXPECT_DOUBLE_EQ(Get("PRESSURE", Idx_PRESSURE, 12.5, -30.25), pressure);
+  EXPECT_DOUBLE_EQ(Get("CLOUD", Idx_CLOUD_TOT, 12.5, -30.25), cloud);
+  EXPECT_DOUBLE_EQ(Get("AIR TEMP", Idx_AIR_TEMP, 12.5, -30.25), temp);
+  EXPECT_EQ(m_requests, 1);
+}
+
+TEST_F(WeatherDataProviderTest, OnlyFetchedPointsAndFieldsAreReused) {
+  EXPECT_TRUE(WeatherDataProvider::RequestGribValues(
+      Point(10, 20), WeatherDataProvider::GRIB_VALUE_PRESSURE));
+  EXPECT_EQ(m_requests, 1);
+
+  // another field of the same point
+  EXPECT_DOUBLE_EQ(Get("CLOUD", Idx_CLOUD_TOT, 10, 20),
+                   FakeValue("CLOUD", 10, 20));
+  EXPECT_EQ(m_requests, 2);
+
+  // the same field at another position and at another time
+  EXPECT_DOUBLE_EQ(Get("PRESSURE", Idx_PRESSURE, 10, 21),
+                   FakeValue("PRESSURE", 10, 21));
+  EXPECT_EQ(m_requests, 3);
+  m_configuration.time += wxTimeSpan::Hour();
+  Get("PRESSURE", Idx_PRESSURE, 10, 20);
+  EXPECT_EQ(m_requests, 4);
+
+  WeatherDataProvider::ClearGribValues();
+  m_configuration.time -= wxTimeSpan::Hour();
+  Get("PRESSURE", Idx_PRESSURE, 10, 20);
+  EXPECT_EQ(m_requests, 5);
+}
+
+TEST_F(WeatherDataProviderTest, MissingReply) {
+  m_reply = false;
+  EXPECT_FALSE(WeatherDataProvider::RequestGribValues(
+      Point(10, 20), WeatherDataProvider::GRIB_VALUE_ALL));
+  EXPECT_TRUE(std::isnan(Get("PRESSURE", Idx_PRESSURE, 10, 20)));
+  EXPECT_EQ(m_requests, 2);
+
+  GribValuePoint invalid = Point(10, 20);
+  invalid.time = wxInvalidDateTime;
+  EXPECT_FALSE(WeatherDataProvider::RequestGribValues(
+      invalid, WeatherDataProvider::GRIB_VALUE_ALL));
+  EXPECT_EQ(m_requests, 2);
+}
@@ -45,11 +45,20 @@ void ClearNMEASentences() { g_nmea_sentences.clear(); }
 
 const std::vector<wxString> &GetNMEASentences() { return g_nmea_sentences; }
 
+static PluginMessageHandler g_plugin_message_handler;
+
+void SetPluginMessageHandler(PluginMessageHandler handler) {
+  g_plugin_message_handler = handler;
+}
+
 // Plugin API mock implementations
 extern "C" {
 
 DECL_EXP int GetChartbarHeight(void) { return 1; }
-void SendPluginMessage(wxString message_id, wxString message_body) {}
+void SendPluginMessage(wxString message_id, wxString message_body) {
+  if (g_plugin_message_handler)
+    g_plugin_message_handler(message_id, message_body);
+}
 bool AddLocaleCatalog(wxString catalog) { return true; }
 bool GetGlobalColor(wxString colorName, wxColour *pcolour) { return true; }
 wxFileConfig *GetOCPNConfigObject(void) { return 0; }
@@ -108,6 +117,7 @@ DECL_EXP wxFont *FindOrCreateFont_PlugIn(int point_size, wxFontFamily family,
 // Plugin API mock implementations
 
 wxString *GetpPrivateApplicationDataLocation(void) { return nullptr; }
+wxString *GetpSharedDataLocation(void) { return nullptr; }
 
 class ObservableListener {
 public:
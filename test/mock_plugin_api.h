@@ -21,6 +21,7 @@
 #define _WEATHER_ROUTING_MOCK_PLUGIN_API_H_
 
 #include "ocpn_plugin.h"
+#include <functional>
 #include <vector>
 #include <wx/string.h>
 
@@ -30,6 +31,13 @@
 void ClearNMEASentences();
 const std::vector<wxString>& GetNMEASentences();
 
+// Called by SendPluginMessage(), to reply as another plugin would. An empty
+// handler drops the messages.
+typedef std::function<void(const wxString& message_id,
+                           const wxString& message_body)>
+    PluginMessageHandler;
+void SetPluginMessageHandler(PluginMessageHandler handler);
+
 // Base mock plugin class implementing all virtual functions with empty
 // implementations
 class mock_plugin_base : public opencpn_plugin_118 {